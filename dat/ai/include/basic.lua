@@ -167,7 +167,6 @@ function follow ()
 end
 function follow_accurate ()
    local target = ai.target()
-   local p = ai.pilot()
  
    -- Will just float without a target to escort.
    if not target:exists() then
@@ -178,7 +177,7 @@ function follow_accurate ()
    local goal = ai.follow_accurate(target, mem.radius, 
          mem.angle, mem.Kp, mem.Kd)
 
-   local mod = vec2.mod(goal - p:pos())
+   local mod = ai.dist(goal)
 
    --  Always face the goal
    local dir   = ai.face(goal)
@@ -202,6 +201,8 @@ function follow_fleet ()
    if mem.form_pos ~= nil then
       local angle, radius, method = unpack(mem.form_pos)
       goal = ai.follow_accurate(leader, radius, angle, mem.Kp, mem.Kd, method)
+   else
+      goal = ai.formationpos(mem.Kp, mem.Kd) or leader
    end
 
    
@@ -734,8 +735,10 @@ function mine ()
       ai.accel()
    end
    
-   local relpos = vec2.add( p:pos(), vec2.mul(target,-1) ):mod()
-   local relvel = vec2.add( p:vel(), vec2.mul(vel,-1) ):mod()
+   local relpos = ai.dist(target)
+   local vx, vy = p:velxy()
+   local ux, uy = vel:get()
+   local relvel = math.sqrt( (vx-ux)^2 + (vy-uy)^2 )
 
    if relpos < wrange and relvel < 10 then
       ai.pushsubtask("__killasteroid")
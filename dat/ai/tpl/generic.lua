@@ -1,6 +1,5 @@
 include("dat/ai/include/basic.lua")
 include("dat/ai/include/attack.lua")
-local formation = include("dat/scripts/formation.lua")
 
 --[[
 -- Variables to adjust AI
@@ -49,16 +48,10 @@ control_rate   = 2
 
 function lead_fleet ()
    if #ai.pilot():followers() ~= 0 then
-      if mem.formation == nil then
-         formation.clear(ai.pilot())
-         return
-      end
-
-      local form = formation[mem.formation]
-      if form == nil then
+      -- Slots are computed every tick in C, followers use ai.formationpos()
+      if not ai.setformation(mem.formation) then
          warn(string.format(_("Formation '%s' not found"), mem.formation))
-      else
-         form(ai.pilot())
+         ai.setformation(nil)
       end
    end
 end
@@ -99,6 +99,11 @@ function scom.spawn( pilots, faction, guerilla )
          end
          spawned[ #spawned+1 ] = { pilot = vv, presence = presence }
       end
+
+      -- Let the scheduler spread big fleets over several frames.
+      if coroutine.running() then
+         coroutine.yield()
+      end
    end
    return spawned
 end
@@ -0,0 +1,12 @@
+#version 130
+
+uniform mat4 projection;
+
+in vec4 vertex;
+in vec2 vertex_tex;
+out vec2 tex_coord;
+
+void main(void) {
+   tex_coord = vertex_tex;
+   gl_Position = projection * vertex;
+}
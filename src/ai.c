@@ -86,6 +86,7 @@
 #include "nlua.h"
 #include "nluadef.h"
 #include "nlua_vec2.h"
+#include "formation.h"
 #include "nlua_rnd.h"
 #include "nlua_pilot.h"
 #include "nlua_planet.h"
@@ -116,11 +117,44 @@
 #define AI_MEM_DEF      "def" /**< Default pilot memory. */
 
 
+/**
+ * @brief Output of a pilot's AI recorded during the think phase.
+ *
+ * Commands are applied in order by ai_applyCommands() once every pilot has
+ * thought, so no AI sees the results of another pilot's think in the same
+ * frame.
+ */
+typedef struct AI_Command_ {
+   unsigned int id; /**< ID of the pilot the command belongs to. */
+   double acc; /**< Acceleration to set. */
+   double turn; /**< Turn to set. */
+   int flags; /**< AI flags (AI_PRIMARY, AI_SECONDARY, AI_DISTRESS). */
+   char *distress; /**< Distress message to send or NULL. */
+} AI_Command;
+
+
+/**
+ * @brief Attack reported during the frame.
+ *
+ * Attacks are gathered by ai_attacked() and handled once per pair of pilots
+ * by ai_attackedFlush(), so a salvo or a beam only runs the hooks and the AI
+ * once. The attacks on a pilot are chained from its attacked_last.
+ */
+typedef struct AI_Attacked_ {
+   unsigned int attacked; /**< ID of the pilot attacked. */
+   unsigned int attacker; /**< ID of the attacker. */
+   double dmg; /**< Total damage done this frame. */
+   int next; /**< Previous attack on the same pilot or -1. */
+} AI_Attacked;
+
+
 /*
  * all the AI profiles
  */
 static AI_Profile* profiles = NULL; /**< Array of AI_Profiles loaded. */
 static nlua_env equip_env = LUA_NOREF; /**< Equipment enviornment. */
+static AI_Command *ai_commands = NULL; /**< Commands pending application (array.h). */
+static AI_Attacked *ai_attacks = NULL; /**< Attacks pending handling (array.h). */
 
 
 /*
@@ -134,12 +168,18 @@ extern int pilot_nstack;
  * prototypes
  */
 /* Internal C routines */
-static void ai_run( nlua_env env, const char *funcname );
+static void ai_run( nlua_env env, int func, const char *funcname );
 static int ai_loadProfile( const char* filename );
+static int ai_loadFunc( nlua_env env, const char *funcname );
+static int ai_taskID( const char *funcname );
+static int ai_taskFunc( AI_Profile *prof, int id );
 static void ai_setMemory (void);
 static void ai_create( Pilot* pilot );
+static void ai_attackedRun( Pilot* attacked, const unsigned int attacker, double dmg );
+static void ai_applyCommand( Pilot *p, const AI_Command *cmd );
 static int ai_loadEquip (void);
 /* Task management. */
+static Task* ai_taskAlloc( Pilot *p, const char *func );
 static void ai_taskGC( Pilot* pilot );
 static Task* ai_curTask( Pilot* pilot );
 static Task* ai_createTask( lua_State *L, int subtask );
@@ -206,6 +246,8 @@ static int aiL_hyperspace( lua_State *L ); /* [number] hyperspace() */
 
 /* escorts */
 static int aiL_dock( lua_State *L ); /* dock( number ) */
+static int aiL_setformation( lua_State *L ); /* boolean setformation( [string] ) */
+static int aiL_formationpos( lua_State *L ); /* vec2 formationpos( [number, number] ) */
 
 /* combat */
 static int aiL_combat( lua_State *L ); /* combat( number ) */
@@ -295,6 +337,8 @@ static const luaL_Reg aiL_methods[] = {
    { "rndhyptarget", aiL_rndhyptarget },
    { "hyperspace", aiL_hyperspace },
    { "dock", aiL_dock },
+   { "setformation", aiL_setformation },
+   { "formationpos", aiL_formationpos },
    /* combat */
    { "aim", aiL_aim },
    { "combat", aiL_combat },
@@ -341,6 +385,15 @@ static double pilot_acc    = 0.; /**< Current pilot's acceleration. */
 static double pilot_turn   = 0.; /**< Current pilot's turning. */
 static int pilot_flags     = 0; /**< Handle stuff like weapon firing. */
 static char aiL_distressmsg[PATH_MAX]; /**< Buffer to store distress message. */
+static unsigned long ai_ncalls = 0; /**< Number of calls into AI Lua functions. */
+
+/*
+ * Task pool, tasks are recycled so pushing and popping doesn't allocate.
+ */
+static Task *ai_taskPool   = NULL; /**< Free tasks linked by next. */
+static unsigned long ai_ntaskallocs = 0; /**< Number of tasks allocated from the heap. */
+static char **ai_taskNames = NULL; /**< Interned task names indexed by task ID (array.h). */
+static int ai_taskNameRef  = LUA_NOREF; /**< Table mapping task names to task IDs. */
 
 /*
  * ai status, used so that create functions can't be used elsewhere
@@ -401,12 +454,18 @@ static Task* ai_curTask( Pilot* pilot )
  */
 static void ai_setMemory (void)
 {
-   nlua_env env;
-   env = cur_pilot->ai->env;
+   AI_Profile *prof;
+   prof = cur_pilot->ai;
 
-   nlua_getenv(env, AI_MEM); /* pm */
-   lua_rawgeti(naevL, -1, cur_pilot->id); /* pm, t */
-   nlua_setenv(env, "mem"); /* pm */
+   nlua_pushenv(prof->env); /* env */
+   if (cur_pilot->lua_mem != LUA_NOREF)
+      lua_rawgeti(naevL, LUA_REGISTRYINDEX, cur_pilot->lua_mem); /* env, t */
+   else {
+      lua_rawgeti(naevL, LUA_REGISTRYINDEX, prof->lua_mem); /* env, pm */
+      lua_rawgeti(naevL, -1, cur_pilot->id); /* env, pm, t */
+      lua_remove(naevL, -2); /* env, t */
+   }
+   lua_setfield(naevL, -2, "mem"); /* env */
    lua_pop(naevL, 1); /* */
 }
 
@@ -423,15 +482,43 @@ void ai_setPilot( Pilot *p )
 }
 
 
+/**
+ * @brief Gets the number of calls made into AI Lua functions.
+ *
+ *    @return Number of calls since the AI was loaded.
+ */
+unsigned long ai_callCount (void)
+{
+   return ai_ncalls;
+}
+
+
+/**
+ * @brief Gets the number of tasks allocated from the heap.
+ *
+ * Tasks are recycled, so this should stay constant once the pool is warm.
+ *
+ *    @return Number of task allocations since the AI was loaded.
+ */
+unsigned long ai_taskAllocCount (void)
+{
+   return ai_ntaskallocs;
+}
+
+
 /**
  * @brief Attempts to run a function.
  *
- *    @param[in] L Lua state to run function on.
+ *    @param[in] env Environment to run function in.
+ *    @param[in] func Reference to the function or LUA_NOREF to look it up by name.
  *    @param[in] funcname Function to run.
  */
-static void ai_run( nlua_env env, const char *funcname )
+static void ai_run( nlua_env env, int func, const char *funcname )
 {
-   nlua_getenv(env, funcname);
+   if (func != LUA_NOREF)
+      lua_rawgeti(naevL, LUA_REGISTRYINDEX, func);
+   else
+      nlua_getenv(env, funcname);
 
 #ifdef DEBUGGING
    if (lua_isnil(naevL, -1)) {
@@ -442,6 +529,7 @@ static void ai_run( nlua_env env, const char *funcname )
    }
 #endif /* DEBUGGING */
 
+   ai_ncalls++;
    if (nlua_pcall(env, 0, 0)) { /* error has occurred */
       WARN( _("Pilot '%s' ai -> '%s': %s"), cur_pilot->name, funcname, lua_tostring(naevL,-1));
       lua_pop(naevL,1);
@@ -475,11 +563,16 @@ int ai_pinit( Pilot *p, const char *ai )
    p->ai = prof;
 
    /* Adds a new pilot memory in the memory table. */
-   nlua_getenv(p->ai->env, AI_MEM);  /* pm */
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, prof->lua_mem); /* pm */
    lua_newtable(naevL);              /* pm, nt */
    lua_pushvalue(naevL, -1);         /* pm, nt, nt */
    lua_rawseti(naevL, -3, p->id);    /* pm, nt */
 
+   /* Keep a direct reference so setting the pilot needs no lookup. */
+   luaL_unref(naevL, LUA_REGISTRYINDEX, p->lua_mem);
+   lua_pushvalue(naevL, -1);         /* pm, nt, nt */
+   p->lua_mem = luaL_ref(naevL, LUA_REGISTRYINDEX); /* pm, nt */
+
    /* Copy defaults over. */
    lua_pushstring(naevL, AI_MEM_DEF);/* pm, nt, s */
    lua_gettable(naevL, -3);          /* pm, nt, dt */
@@ -542,6 +635,8 @@ void ai_destroy( Pilot* p )
       lua_rawseti(naevL,-2, p->id);/* t */
       lua_pop(naevL, 1);         /* */
    }
+   luaL_unref(naevL, LUA_REGISTRYINDEX, p->lua_mem);
+   p->lua_mem = LUA_NOREF;
 
    /* Clear the tasks. */
    ai_cleartasks( p );
@@ -596,8 +691,6 @@ int ai_load (void)
  */
 static int ai_loadEquip (void)
 {
-   char *buf;
-   size_t bufsize;
    const char *filename = "dat/factions/equip/generic.lua";
 
    /* Make sure doesn't already exist. */
@@ -609,15 +702,13 @@ static int ai_loadEquip (void)
    nlua_loadStandard(equip_env);
 
    /* Load the file. */
-   buf = ndata_read( filename, &bufsize );
-   if (nlua_dobufenv(equip_env, buf, bufsize, filename) != 0) {
+   if (nlua_dondataenv(equip_env, filename) != 0) {
       WARN( _("Error loading file: %s\n"
           "%s\n"
           "Most likely Lua file has improper syntax, please check"),
             filename, lua_tostring(naevL, -1));
       return -1;
    }
-   free(buf);
 
    return 0;
 }
@@ -631,8 +722,6 @@ static int ai_loadEquip (void)
  */
 static int ai_loadProfile( const char* filename )
 {
-   char* buf = NULL;
-   size_t bufsize = 0;
    nlua_env env;
    AI_Profile *prof;
    size_t len;
@@ -661,6 +750,8 @@ static int ai_loadProfile( const char* filename )
    /* Add the player memory table. */
    lua_newtable(naevL);              /* pm */
    lua_pushvalue(naevL, -1);         /* pm, pm */
+   prof->lua_mem = luaL_ref(naevL, LUA_REGISTRYINDEX); /* pm */
+   lua_pushvalue(naevL, -1);         /* pm, pm */
    nlua_setenv(env, AI_MEM);         /* pm */
 
    /* Set "mem" to be default template. */
@@ -671,24 +762,122 @@ static int ai_loadProfile( const char* filename )
    lua_pop(naevL, 1);                /*  */
 
    /* Now load the file since all the functions have been previously loaded */
-   buf = ndata_read( filename, &bufsize );
-   if (nlua_dobufenv(env, buf, bufsize, filename) != 0) {
+   if (nlua_dondataenv(env, filename) != 0) {
       WARN( _("Error loading AI file: %s\n"
           "%s\n"
           "Most likely Lua file has improper syntax, please check"),
             filename, lua_tostring(naevL,-1));
-      array_erase( &profiles, prof, &prof[1] );
+      luaL_unref(naevL, LUA_REGISTRYINDEX, prof->lua_mem);
       free(prof->name);
       nlua_freeEnv( env );
-      free(buf);
+      array_erase( &profiles, prof, &prof[1] );
       return -1;
    }
-   free(buf);
+
+   /* Cache the entry points so they don't have to be looked up every call. */
+   prof->ref_control       = ai_loadFunc( env, "control" );
+   prof->ref_control_manual= ai_loadFunc( env, "control_manual" );
+   prof->ref_create        = ai_loadFunc( env, "create" );
+   prof->ref_attacked      = ai_loadFunc( env, "attacked" );
+   prof->ref_distress      = ai_loadFunc( env, "distress" );
+   nlua_getenv( env, "control_rate" );
+   prof->control_rate      = lua_tonumber( naevL, -1 );
+   lua_pop( naevL, 1 );
+   prof->tasks             = array_create( int );
 
    return 0;
 }
 
 
+/**
+ * @brief Gets a reference to a function in an AI environment.
+ *
+ *    @param env Environment to get function from.
+ *    @param funcname Name of the function to get.
+ *    @return Reference to the function or LUA_NOREF if it doesn't exist.
+ */
+static int ai_loadFunc( nlua_env env, const char *funcname )
+{
+   nlua_getenv( env, funcname );
+   if (!lua_isfunction( naevL, -1 )) {
+      lua_pop( naevL, 1 );
+      return LUA_NOREF;
+   }
+   return luaL_ref( naevL, LUA_REGISTRYINDEX );
+}
+
+
+/**
+ * @brief Gets the ID of a task name, interning it if necessary.
+ *
+ * Task IDs are shared by all profiles. The lookup goes through a Lua table
+ *  so it's a hash lookup on the already interned Lua string.
+ *
+ *    @param funcname Name of the task function.
+ *    @return ID of the task name.
+ */
+static int ai_taskID( const char *funcname )
+{
+   int id;
+
+   if (ai_taskNameRef == LUA_NOREF) {
+      lua_newtable(naevL);
+      ai_taskNameRef = luaL_ref(naevL, LUA_REGISTRYINDEX);
+      ai_taskNames   = array_create( char* );
+   }
+
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, ai_taskNameRef); /* t */
+   lua_pushstring(naevL, funcname);    /* t, s */
+   lua_rawget(naevL, -2);              /* t, id */
+   if (!lua_isnil(naevL, -1)) {
+      id = lua_tointeger(naevL, -1);
+      lua_pop(naevL, 2);               /* */
+      return id;
+   }
+   lua_pop(naevL, 1);                  /* t */
+
+   /* New name. */
+   id = array_size(ai_taskNames);
+   array_push_back( &ai_taskNames, strdup(funcname) );
+   lua_pushstring(naevL, funcname);    /* t, s */
+   lua_pushinteger(naevL, id);         /* t, s, id */
+   lua_rawset(naevL, -3);              /* t */
+   lua_pop(naevL, 1);                  /* */
+   return id;
+}
+
+
+/**
+ * @brief Gets the cached reference to a task function of a profile.
+ *
+ * The reference is owned by the profile and only freed in ai_exit().
+ *
+ *    @param prof Profile to get task function of.
+ *    @param id ID of the task as returned by ai_taskID().
+ *    @return Reference to the function or LUA_NOREF if it can't be resolved.
+ */
+static int ai_taskFunc( AI_Profile *prof, int id )
+{
+   int i, n;
+
+   if (prof == NULL)
+      return LUA_NOREF;
+
+   /* Grow the cache to cover the ID. */
+   n = array_size(prof->tasks);
+   if (id >= n) {
+      array_resize( &prof->tasks, id+1 );
+      for (i=n; i<=id; i++)
+         prof->tasks[i] = LUA_NOREF;
+   }
+
+   /* Functions that don't exist yet are looked up again next time. */
+   if (prof->tasks[id] == LUA_NOREF)
+      prof->tasks[id] = ai_loadFunc( prof->env, ai_taskNames[id] );
+   return prof->tasks[id];
+}
+
+
 /**
  * @brief Gets the AI_Profile by name.
  *
@@ -716,15 +905,50 @@ AI_Profile* ai_getProfile( char* name )
  */
 void ai_exit (void)
 {
-   int i;
+   int i, j;
+   AI_Profile *prof;
+   Task *t;
 
    /* Free AI profiles. */
    for (i=0; i<array_size(profiles); i++) {
-      free(profiles[i].name);
-      nlua_freeEnv(profiles[i].env);
+      prof = &profiles[i];
+      for (j=0; j<array_size(prof->tasks); j++)
+         luaL_unref(naevL, LUA_REGISTRYINDEX, prof->tasks[j]);
+      array_free(prof->tasks);
+      luaL_unref(naevL, LUA_REGISTRYINDEX, prof->ref_control);
+      luaL_unref(naevL, LUA_REGISTRYINDEX, prof->ref_control_manual);
+      luaL_unref(naevL, LUA_REGISTRYINDEX, prof->ref_create);
+      luaL_unref(naevL, LUA_REGISTRYINDEX, prof->ref_attacked);
+      luaL_unref(naevL, LUA_REGISTRYINDEX, prof->ref_distress);
+      luaL_unref(naevL, LUA_REGISTRYINDEX, prof->lua_mem);
+      free(prof->name);
+      nlua_freeEnv(prof->env);
    }
    array_free( profiles );
 
+   /* Free task pool and names. */
+   while (ai_taskPool != NULL) {
+      t           = ai_taskPool;
+      ai_taskPool = t->next;
+      free(t);
+   }
+   if (ai_taskNames != NULL) {
+      for (i=0; i<array_size(ai_taskNames); i++)
+         free(ai_taskNames[i]);
+      array_free( ai_taskNames );
+   }
+   ai_taskNames = NULL;
+   luaL_unref(naevL, LUA_REGISTRYINDEX, ai_taskNameRef);
+   ai_taskNameRef = LUA_NOREF;
+
+   /* Free command buffer. */
+   if (ai_commands != NULL)
+      array_free( ai_commands );
+   ai_commands = NULL;
+   if (ai_attacks != NULL)
+      array_free( ai_attacks );
+   ai_attacks = NULL;
+
    /* Free equipment Lua. */
    if (equip_env != LUA_NOREF)
       nlua_freeEnv(equip_env);
@@ -740,6 +964,8 @@ void ai_exit (void)
 void ai_think( Pilot* pilot, const double dt )
 {
    nlua_env env;
+   AI_Profile *prof;
+   AI_Command *cmd, cmd_player;
    (void) dt;
 
    Task *t;
@@ -749,7 +975,8 @@ void ai_think( Pilot* pilot, const double dt )
       return;
 
    ai_setPilot(pilot);
-   env = cur_pilot->ai->env; /* set the AI profile to the current pilot's */
+   prof = cur_pilot->ai;
+   env = prof->env; /* set the AI profile to the current pilot's */
 
    /* Clean up some variables */
    pilot_acc         = 0;
@@ -765,17 +992,13 @@ void ai_think( Pilot* pilot, const double dt )
    if ((cur_pilot->tcontrol < 0.) || (t == NULL)) {
       if (pilot_isFlag(pilot,PILOT_PLAYER) ||
           pilot_isFlag(cur_pilot, PILOT_MANUAL_CONTROL)) {
-         nlua_getenv(env, "control_manual");
-         if (!lua_isnil(naevL, -1))
-            ai_run(env, "control_manual");
-         lua_pop(naevL, 1);
+         if (prof->ref_control_manual != LUA_NOREF)
+            ai_run(env, prof->ref_control_manual, "control_manual");
       } else {
-         ai_run(env, "control"); /* run control */
+         ai_run(env, prof->ref_control, "control"); /* run control */
       }
 
-      nlua_getenv(env, "control_rate");
-      cur_pilot->tcontrol = lua_tonumber(naevL,-1);
-      lua_pop(naevL,1);
+      cur_pilot->tcontrol = prof->control_rate;
 
       /* Task may have changed due to control tick. */
       t = ai_curTask( cur_pilot );
@@ -789,9 +1012,9 @@ void ai_think( Pilot* pilot, const double dt )
    if (t != NULL) {
       /* Run subtask if available, otherwise run main task. */
       if (t->subtask != NULL)
-         ai_run(env, t->subtask->name);
+         ai_run(env, t->subtask->func, t->subtask->name);
       else
-         ai_run(env, t->name);
+         ai_run(env, t->func, t->name);
 
       /* Manual control must check if IDLE hook has to be run. */
       if (pilot_isFlag(cur_pilot, PILOT_MANUAL_CONTROL)) {
@@ -801,37 +1024,161 @@ void ai_think( Pilot* pilot, const double dt )
       }
    }
 
-   /* make sure pilot_acc and pilot_turn are legal */
-   pilot_acc   = CLAMP( -1., 1., pilot_acc );
-   pilot_turn  = CLAMP( -1., 1., pilot_turn );
+   /* The player thinks outside of the pilot think loop, so its output is
+    * applied right away where player_think() expects it. */
+   if (pilot_isFlag(cur_pilot, PILOT_PLAYER)) {
+      cmd_player.id     = cur_pilot->id;
+      cmd_player.acc    = CLAMP( -1., 1., pilot_acc );
+      cmd_player.turn   = CLAMP( -1., 1., pilot_turn );
+      cmd_player.flags  = pilot_flags;
+      cmd_player.distress = ai_isFlag(AI_DISTRESS) ? aiL_distressmsg : NULL;
+      ai_applyCommand( cur_pilot, &cmd_player );
+   }
+   /* Record the output, it gets applied by ai_applyCommands(). */
+   else {
+      if (ai_commands == NULL)
+         ai_commands = array_create( AI_Command );
+      cmd         = &array_grow( &ai_commands );
+      cmd->id     = cur_pilot->id;
+      cmd->acc    = CLAMP( -1., 1., pilot_acc ); /* make sure they are legal */
+      cmd->turn   = CLAMP( -1., 1., pilot_turn );
+      cmd->flags  = pilot_flags;
+      cmd->distress = ai_isFlag(AI_DISTRESS) ? strdup(aiL_distressmsg) : NULL;
+   }
 
+   /* Clean up if necessary. */
+   ai_taskGC( cur_pilot );
+}
+
+
+/**
+ * @brief Applies the output of a pilot's think.
+ *
+ *    @param p Pilot to apply output to.
+ *    @param cmd Output of the think.
+ */
+static void ai_applyCommand( Pilot *p, const AI_Command *cmd )
+{
    /* Set turn and thrust. */
-   pilot_setTurn( cur_pilot, pilot_turn );
-   pilot_setThrust( cur_pilot, pilot_acc );
+   pilot_setTurn( p, cmd->turn );
+   pilot_setThrust( p, cmd->acc );
 
    /* fire weapons if needed */
-   if (ai_isFlag(AI_PRIMARY))
-      pilot_shoot(cur_pilot, 0); /* primary */
-   if (ai_isFlag(AI_SECONDARY))
-      pilot_shoot(cur_pilot, 1 ); /* secondary */
+   if (cmd->flags & AI_PRIMARY)
+      pilot_shoot(p, 0); /* primary */
+   if (cmd->flags & AI_SECONDARY)
+      pilot_shoot(p, 1); /* secondary */
 
    /* other behaviours. */
-   if (ai_isFlag(AI_DISTRESS))
-      pilot_distress(cur_pilot, NULL, aiL_distressmsg, 0);
+   if (cmd->distress != NULL)
+      pilot_distress(p, NULL, cmd->distress, 0);
+}
 
-   /* Clean up if necessary. */
-   ai_taskGC( cur_pilot );
+
+/**
+ * @brief Applies the output of all the pilots that have thought.
+ *
+ * Commands are applied in the order the pilots thought in, skipping pilots
+ * that were removed in the meantime.
+ */
+void ai_applyCommands (void)
+{
+   int i;
+   AI_Command *cmd;
+   Pilot *p;
+
+   if (ai_commands == NULL)
+      return;
+
+   for (i=0; i<array_size(ai_commands); i++) {
+      cmd = &ai_commands[i];
+      p   = pilot_get( cmd->id );
+      if ((p != NULL) && !pilot_isFlag(p, PILOT_DELETE) &&
+            !pilot_isFlag(p, PILOT_DEAD))
+         ai_applyCommand( p, cmd );
+      free( cmd->distress );
+   }
+   array_resize( &ai_commands, 0 );
 }
 
 
 /**
- * @brief Triggers the attacked() function in the pilot's AI.
+ * @brief Reports that a pilot was attacked.
+ *
+ * The attacked hooks and the attacked() function in the pilot's AI are run
+ *  by ai_attackedFlush() at the end of the frame with the damage of the whole
+ *  frame.
  *
  *    @param attacked Pilot that is attacked.
  *    @param[in] attacker ID of the attacker.
  *    @param[i] dmg Damage done by the attacker.
  */
 void ai_attacked( Pilot* attacked, const unsigned int attacker, double dmg )
+{
+   int i, last;
+   AI_Attacked *a;
+
+   if (ai_attacks == NULL)
+      ai_attacks = array_create( AI_Attacked );
+
+   /* The chain is left over from a previous flush if it points elsewhere. */
+   last = attacked->attacked_last;
+   if ((last < 0) || (last >= array_size(ai_attacks)) ||
+         (ai_attacks[last].attacked != attacked->id))
+      last = -1;
+
+   /* Add to a previous attack by the same pilot. */
+   for (i=last; i>=0; i=ai_attacks[i].next) {
+      a = &ai_attacks[i];
+      if (a->attacker == attacker) {
+         a->dmg += dmg;
+         return;
+      }
+   }
+
+   a           = &array_grow( &ai_attacks );
+   a->attacked = attacked->id;
+   a->attacker = attacker;
+   a->dmg      = dmg;
+   a->next     = last;
+   attacked->attacked_last = array_size(ai_attacks)-1;
+}
+
+
+/**
+ * @brief Handles all the attacks reported since the last flush.
+ */
+void ai_attackedFlush (void)
+{
+   int i;
+   Pilot *p;
+   AI_Attacked a;
+
+   if (ai_attacks == NULL)
+      return;
+
+   /* Attacks may be reported while running the hooks, they are handled by this
+    * same loop. */
+   for (i=0; i<array_size(ai_attacks); i++) {
+      a = ai_attacks[i];
+      p = pilot_get( a.attacked );
+      if ((p == NULL) || pilot_isFlag( p, PILOT_DELETE ) ||
+            pilot_isFlag( p, PILOT_DEAD ))
+         continue;
+      ai_attackedRun( p, a.attacker, a.dmg );
+   }
+   array_resize( &ai_attacks, 0 );
+}
+
+
+/**
+ * @brief Triggers the attacked() function in the pilot's AI.
+ *
+ *    @param attacked Pilot that is attacked.
+ *    @param[in] attacker ID of the attacker.
+ *    @param[i] dmg Damage done by the attacker.
+ */
+static void ai_attackedRun( Pilot* attacked, const unsigned int attacker, double dmg )
 {
    HookParam hparam[2];
 
@@ -850,11 +1197,16 @@ void ai_attacked( Pilot* attacked, const unsigned int attacker, double dmg )
    if (attacked->ai == NULL)
       return;
 
+   /* Must have an attacked function. */
+   if (attacked->ai->ref_attacked == LUA_NOREF)
+      return;
+
    ai_setPilot( attacked ); /* Sets cur_pilot. */
 
-   nlua_getenv(cur_pilot->ai->env, "attacked");
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, cur_pilot->ai->ref_attacked);
 
    lua_pushpilot(naevL, attacker);
+   ai_ncalls++;
    if (nlua_pcall(cur_pilot->ai->env, 1, 0)) {
       WARN( _("Pilot '%s' ai -> 'attacked': %s"), cur_pilot->name, lua_tostring(naevL, -1));
       lua_pop(naevL, 1);
@@ -873,8 +1225,7 @@ void ai_refuel( Pilot* refueler, unsigned int target )
    Task *t;
 
    /* Create the task. */
-   t           = calloc( 1, sizeof(Task) );
-   t->name     = strdup("refuel");
+   t           = ai_taskAlloc( refueler, "refuel" );
    lua_pushpilot(naevL, target);
    t->dat      = luaL_ref(naevL, LUA_REGISTRYINDEX);
 
@@ -899,18 +1250,16 @@ void ai_getDistress( Pilot *p, const Pilot *distressed, const Pilot *attacker )
       return;
 
    /* Must have AI. */
-   if (cur_pilot->ai == NULL)
+   if (p->ai == NULL)
       return;
 
-   /* Set up the environment. */
-   ai_setPilot(p);
-
    /* See if function exists. */
-   nlua_getenv(cur_pilot->ai->env, "distress");
-   if (lua_isnil(naevL,-1)) {
-      lua_pop(naevL,1);
+   if (p->ai->ref_distress == LUA_NOREF)
       return;
-   }
+
+   /* Set up the environment. */
+   ai_setPilot(p);
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, cur_pilot->ai->ref_distress);
 
    /* Run the function. */
    lua_pushpilot(naevL, distressed->id);
@@ -918,7 +1267,8 @@ void ai_getDistress( Pilot *p, const Pilot *distressed, const Pilot *attacker )
       lua_pushpilot(naevL, attacker->id);
    else /* Default to the victim's current target. */
       lua_pushpilot(naevL, distressed->target);
-   
+
+   ai_ncalls++;
    if (nlua_pcall(cur_pilot->ai->env, 2, 0)) {
       WARN( _("Pilot '%s' ai -> 'distress': %s"), cur_pilot->name, lua_tostring(naevL,-1));
       lua_pop(naevL,1);
@@ -972,14 +1322,8 @@ static void ai_create( Pilot* pilot )
    /* Prepare AI (this sets cur_pilot among others). */
    ai_setPilot( pilot );
 
-   /* Prepare stack. */
-   nlua_getenv(cur_pilot->ai->env, "create");
-
    /* Run function. */
-   if (nlua_pcall(cur_pilot->ai->env, 0, 0)) { /* error has occurred */
-      WARN( _("Pilot '%s' ai -> '%s': %s"), cur_pilot->name, "create", lua_tostring(naevL,-1));
-      lua_pop(naevL,1);
-   }
+   ai_run( cur_pilot->ai->env, cur_pilot->ai->ref_create, "create" );
 
    /* Recover normal mode. */
    if (!pilot_isFlag(pilot, PILOT_CREATED_AI))
@@ -987,6 +1331,36 @@ static void ai_create( Pilot* pilot )
 }
 
 
+/**
+ * @brief Gets a cleared task from the pool, allocating only if it's empty.
+ *
+ *    @param p Pilot the task is for.
+ *    @param func Name of the task function.
+ *    @return Unlinked task with no data.
+ */
+static Task* ai_taskAlloc( Pilot *p, const char *func )
+{
+   Task *t;
+   int id;
+
+   if (ai_taskPool != NULL) {
+      t           = ai_taskPool;
+      ai_taskPool = t->next;
+      t->next     = NULL;
+   }
+   else {
+      t           = calloc( 1, sizeof(Task) );
+      ai_ntaskallocs++;
+   }
+
+   id          = ai_taskID( func );
+   t->name     = ai_taskNames[id];
+   t->func     = ai_taskFunc( p->ai, id );
+   t->dat      = LUA_NOREF;
+   return t;
+}
+
+
 /**
  * @brief Creates a new AI task.
  */
@@ -995,10 +1369,7 @@ Task *ai_newtask( Pilot *p, const char *func, int subtask, int pos )
    Task *t, *curtask, *pointer;
 
    /* Create the new task. */
-   t           = calloc( 1, sizeof(Task) );
-   t->name     = strdup(func);
-   lua_pushnil(naevL);
-   t->dat      = luaL_ref(naevL, LUA_REGISTRYINDEX);
+   t           = ai_taskAlloc( p, func );
 
    /* Handle subtask and general task. */
    if (!subtask) {
@@ -1036,7 +1407,7 @@ Task *ai_newtask( Pilot *p, const char *func, int subtask, int pos )
 
 
 /**
- * @brief Frees an AI task.
+ * @brief Frees an AI task, returning it to the task pool.
  *
  *    @param t Task to free.
  */
@@ -1056,9 +1427,10 @@ void ai_freetask( Task* t )
       t->next = NULL;
    }
 
-   if (t->name)
-      free(t->name);
-   free(t);
+   /* Recycle. */
+   memset( t, 0, sizeof(Task) );
+   t->next     = ai_taskPool;
+   ai_taskPool = t;
 }
 
 
@@ -1075,6 +1447,8 @@ static Task* ai_createTask( lua_State *L, int subtask )
 
    /* Creates a new AI task. */
    t     = ai_newtask( cur_pilot, func, subtask, 0 );
+   if (t == NULL)
+      return NULL;
 
    /* Set the data. */
    if (lua_gettop(L) > 1) {
@@ -2603,6 +2977,69 @@ static int aiL_face_accurate( lua_State *L )
 }
 
 
+/**
+ * @brief Sets the formation the pilot's escorts keep.
+ *
+ * Slots are computed for all the escorts once per tick, escorts get theirs
+ *  with ai.formationpos().
+ *
+ *    @luatparam[opt] string formation Name of the formation or nil for none.
+ *    @luatreturn boolean true if the formation was set, false if it is unknown.
+ * @luafunc setformation( formation )
+ */
+static int aiL_setformation( lua_State *L )
+{
+   int f;
+
+   if (lua_isnoneornil(L,1))
+      f = FORMATION_NONE;
+   else
+      f = formation_get( luaL_checkstring(L,1) );
+   if (f < 0) {
+      lua_pushboolean(L,0);
+      return 1;
+   }
+
+   cur_pilot->formation = f;
+   lua_pushboolean(L,1);
+   return 1;
+}
+
+
+/**
+ * @brief Gets the point to go to in order to keep the pilot's formation slot.
+ *
+ * Uses the same controller as ai.follow_accurate().
+ *
+ *    @luatparam[opt=10] number Kp The first controller parameter.
+ *    @luatparam[opt=20] number Kd The second controller parameter.
+ *    @luatreturn Vec2|nil The point to go to or nil if the pilot has no slot.
+ * @luafunc formationpos( Kp, Kd )
+ */
+static int aiL_formationpos( lua_State *L )
+{
+   Vector2d goal;
+   double Kp, Kd;
+   Pilot *p;
+
+   p  = cur_pilot;
+   Kp = luaL_optnumber(L,1,10.);
+   Kd = luaL_optnumber(L,2,20.);
+
+   if (!p->form_valid)
+      return 0;
+
+   /* Compute the direction using a pd controller */
+   vect_cset( &goal,
+         p->solid->pos.x + (p->form_point.x - p->solid->pos.x) * Kp +
+               (p->form_vel.x - p->solid->vel.x) * Kd,
+         p->solid->pos.y + (p->form_point.y - p->solid->pos.y) * Kp +
+               (p->form_vel.y - p->solid->vel.y) * Kd );
+   lua_pushvector( L, goal );
+   return 1;
+}
+
+
 /**
  * @brief Completely stops the pilot if it is below minimum vel error (no insta-stops).
  *
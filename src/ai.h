@@ -38,11 +38,12 @@ typedef struct Pilot_ Pilot;
  */
 typedef struct Task_ {
    struct Task_* next; /**< Next task */
-   char *name; /**< Task name. */
+   const char *name; /**< Task name (interned, see ai_taskID()). */
    int done; /**< Task is done and ready for deletion. */
 
    struct Task_* subtask; /**< Subtasks of the current task. */
 
+   int func; /**< Lua reference to the task function (owned by the profile). */
    int dat; /**< Lua reference to the data (index in registry). */
 } Task;
 
@@ -55,6 +56,14 @@ typedef struct Task_ {
 typedef struct AI_Profile_ {
    char* name; /**< Name of the profile. */
    nlua_env env; /**< Assosciated Lua Environment. */
+   int lua_mem; /**< Reference to the pilot memory table. */
+   int ref_control; /**< Reference to the control function. */
+   int ref_control_manual; /**< Reference to the control_manual function. */
+   int ref_create; /**< Reference to the create function. */
+   int ref_attacked; /**< Reference to the attacked function. */
+   int ref_distress; /**< Reference to the distress function. */
+   double control_rate; /**< Time between control ticks. */
+   int *tasks; /**< Cached task function references indexed by task ID (array.h). */
 } AI_Profile;
 
 
@@ -88,10 +97,14 @@ void ai_cleartasks( Pilot* p );
  * Misc functions.
  */
 void ai_attacked( Pilot* attacked, const unsigned int attacker, double dmg );
+void ai_attackedFlush (void);
 void ai_refuel( Pilot* refueler, unsigned int target );
 void ai_getDistress( Pilot *p, const Pilot *distressed, const Pilot *attacker );
 void ai_think( Pilot* pilot, const double dt );
+void ai_applyCommands (void);
 void ai_setPilot( Pilot *p );
+unsigned long ai_callCount (void);
+unsigned long ai_taskAllocCount (void);
 
 
 #endif /* AI_H */
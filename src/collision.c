@@ -21,6 +21,9 @@
  */
 static int pointInPolygon( const CollPoly* at, const Vector2d* ap,
       float x, float y );
+static int lineInCircle( const Vector2d* ap, double dx, double dy,
+      const Vector2d* cp, double r );
+static uint64_t maskBits( const uint64_t* row, int x );
 
 
 /**
@@ -77,6 +80,12 @@ void LoadPolygon( CollPoly* polygon, xmlNodePtr node )
       }
    } while (xml_nextNode(cur));
 
+   /* Bounding circle to quickly reject far away polygons. */
+   polygon->r = 0.;
+   for (i=0; i<polygon->npt; i++)
+      polygon->r = MAX( polygon->r,
+            sqrt( pow2(polygon->x[i]) + pow2(polygon->y[i]) ) );
+
    free(list);
    free(ch);
 
@@ -105,36 +114,59 @@ int CollideSprite( const glTexture* at, const int asx, const int asy, const Vect
       const glTexture* bt, const int bsx, const int bsy, const Vector2d* bp,
       Vector2d* crash )
 {
-   int x,y;
+   int x,y, i, n;
    int ax1,ax2, ay1,ay2;
    int bx1,bx2, by1,by2;
    int inter_x0, inter_x1, inter_y0, inter_y1;
    int rasy, rbsy;
    int abx,aby, bbx, bby;
+   const int *abox, *bbox;
+   const uint64_t *arow, *brow;
+   uint64_t m;
 
 #if DEBUGGING
    /* Make sure the surfaces have transparency maps. */
-   if (at->trans == NULL) {
+   if (at->mask == NULL) {
       WARN(_("Texture '%s' has no transparency map"), at->name);
       return 0;
    }
-   if (bt->trans == NULL) {
+   if (bt->mask == NULL) {
       WARN(_("Texture '%s' has no transparency map"), bt->name);
       return 0;
    }
 #endif /* DEBUGGING */
 
+   /* real vertical sprite value (flipped) */
+   rasy = at->sy - asy - 1;
+   rbsy = bt->sy - bsy - 1;
+
+   /* Boxes around the opaque pixels of each sprite. */
+   abox = &at->sbox[ 4*(rasy*(int)at->sx + asx) ];
+   bbox = &bt->sbox[ 4*(rbsy*(int)bt->sx + bsx) ];
+
    /* a - cube coordinates */
    ax1 = (int)VX(*ap) - (int)(at->sw)/2;
    ay1 = (int)VY(*ap) - (int)(at->sh)/2;
-   ax2 = ax1 + (int)(at->sw) - 1;
-   ay2 = ay1 + (int)(at->sh) - 1;
 
    /* b - cube coordinates */
    bx1 = (int)VX(*bp) - (int)(bt->sw)/2;
    by1 = (int)VY(*bp) - (int)(bt->sh)/2;
-   bx2 = bx1 + bt->sw - 1;
-   by2 = by1 + bt->sh - 1;
+
+   /* set up the base points */
+   abx =  asx*(int)(at->sw) - ax1;
+   aby = rasy*(int)(at->sh) - ay1;
+   bbx =  bsx*(int)(bt->sw) - bx1;
+   bby = rbsy*(int)(bt->sh) - by1;
+
+   /* Shrink to the opaque boxes, empty sprites get inverted boxes. */
+   ax2 = ax1 + abox[2];
+   ay2 = ay1 + abox[3];
+   ax1 += abox[0];
+   ay1 += abox[1];
+   bx2 = bx1 + bbox[2];
+   by2 = by1 + bbox[3];
+   bx1 += bbox[0];
+   by1 += bbox[1];
 
    /* check if bounding boxes intersect */
    if((bx2 < ax1) || (ax2 < bx1)) return 0;
@@ -146,29 +178,48 @@ int CollideSprite( const glTexture* at, const int asx, const int asy, const Vect
    inter_y0 = MAX( ay1, by1 );
    inter_y1 = MIN( ay2, by2 );
 
-   /* real vertical sprite value (flipped) */
-   rasy = at->sy - asy - 1;
-   rbsy = bt->sy - bsy - 1;
+   /* Test 64 pixels of both masks at a time. */
+   for (y=inter_y0; y<=inter_y1; y++) {
+      arow = &at->mask[ (aby + y) * at->mask_stride ];
+      brow = &bt->mask[ (bby + y) * bt->mask_stride ];
+      for (x=inter_x0; x<=inter_x1; x+=64) {
+         m = maskBits( arow, abx + x ) & maskBits( brow, bbx + x );
+         n = inter_x1 - x + 1;
+         if (n < 64)
+            m &= (((uint64_t)1) << n) - 1;
+         if (m == 0)
+            continue;
+
+         /* Set the crash position to the first overlapping pixel. */
+         for (i=0; !(m & 1); i++)
+            m >>= 1;
+         crash->x = x + i;
+         crash->y = y;
+         return 1;
+      }
+   }
 
-   /* set up the base points */
-   abx =  asx*(int)(at->sw) - ax1;
-   aby = rasy*(int)(at->sh) - ay1;
-   bbx =  bsx*(int)(bt->sw) - bx1;
-   bby = rbsy*(int)(bt->sh) - by1;
+   return 0;
+}
 
-   for (y=inter_y0; y<=inter_y1; y++)
-      for (x=inter_x0; x<=inter_x1; x++)
-         /* compute offsets for surface before pass to TransparentPixel test */
-         if ((!gl_isTrans(at, abx + x, aby + y)) &&
-               (!gl_isTrans(bt, bbx + x, bby + y))) {
 
-            /* Set the crash position. */
-            crash->x = x;
-            crash->y = y;
-            return 1;
-         }
-
-   return 0;
+/**
+ * @brief Gets 64 pixels of a row of a collision mask.
+ *
+ *    @param row Row of the mask.
+ *    @param x Position of the first pixel.
+ *    @return The pixels with x in the lowest bit.
+ */
+static uint64_t maskBits( const uint64_t* row, int x )
+{
+   int w, s;
+
+   w = x / 64;
+   s = x % 64;
+   if (s == 0)
+      return row[w];
+   /* Masks have a padding word at the end of each row. */
+   return (row[w] >> s) | (row[w+1] << (64-s));
 }
 
 
@@ -203,6 +254,11 @@ int CollideSpritePolygon( const CollPoly* at, const Vector2d* ap,
    }
 #endif /* DEBUGGING */
 
+   /* check if the bounding circle of a reaches the sprite b */
+   if (pow2(VX(*ap)-VX(*bp)) + pow2(VY(*ap)-VY(*bp)) >
+         pow2(at->r + (bt->sw+bt->sh)/2.))
+      return 0;
+
    /* a - cube coordinates */
    ax1 = (int)VX(*ap) + (int)(at->xmin);
    ay1 = (int)VY(*ap) + (int)(at->ymin);
@@ -272,6 +328,10 @@ int CollidePolygon( const CollPoly* at, const Vector2d* ap,
    int bbx, bby;
    float xabs, yabs;
 
+   /* check if bounding circles intersect */
+   if (pow2(VX(*ap)-VX(*bp)) + pow2(VY(*ap)-VY(*bp)) > pow2(at->r + bt->r))
+      return 0;
+
    /* a - cube coordinates */
    ax1 = (int)VX(*ap) + (int)(at->xmin);
    ay1 = (int)VY(*ap) + (int)(at->ymin);
@@ -329,6 +389,11 @@ int pointInPolygon( const CollPoly* at, const Vector2d* ap,
    float vprod, sprod, angle;
    float dxi, dxip, dyi, dyip;
 
+   /* Points outside the bounding box can't be inside. */
+   if ((x < VX(*ap)+at->xmin) || (x > VX(*ap)+at->xmax) ||
+         (y < VY(*ap)+at->ymin) || (y > VY(*ap)+at->ymax))
+      return 0;
+
    /* See if the pixel is inside the polygon:
       We increment the angle when doing a loop along all the points
       If the final angle is 0, we are outside the polygon
@@ -358,6 +423,32 @@ int pointInPolygon( const CollPoly* at, const Vector2d* ap,
 }
 
 
+/**
+ * @brief Checks whether a segment gets within a circle.
+ *
+ *    @param[in] ap Start of the segment.
+ *    @param[in] dx X length of the segment.
+ *    @param[in] dy Y length of the segment.
+ *    @param[in] cp Center of the circle.
+ *    @param[in] r Radius of the circle.
+ *    @return 1 if the segment gets within r of cp, 0 else.
+ */
+static int lineInCircle( const Vector2d* ap, double dx, double dy,
+      const Vector2d* cp, double r )
+{
+   double l2, t;
+
+   /* Closest point of the segment to the center. */
+   l2 = pow2(dx) + pow2(dy);
+   if (l2 > 0.)
+      t = CLAMP( 0., 1., ((cp->x-ap->x)*dx + (cp->y-ap->y)*dy) / l2 );
+   else
+      t = 0.;
+
+   return (pow2(ap->x + t*dx - cp->x) + pow2(ap->y + t*dy - cp->y) <= pow2(r));
+}
+
+
 /**
  * @brief Checks to see if two lines collide.
  *
@@ -432,26 +523,37 @@ int CollideLineSprite( const Vector2d* ap, double ad, double al,
       Vector2d crash[2] )
 {
    int x,y, rbsy, bbx,bby;
-   double ep[2], bl[2], tr[2], v[2], mod;
+   double ep[2], bl[2], obl[2], tr[2], v[2], mod;
    int hits, real_hits;
+   const int *bbox;
    Vector2d tmp_crash, border[2];
 
    /* Make sure texture has transparency map. */
-   if (bt->trans == NULL) {
+   if (bt->sbox == NULL) {
       WARN(_("Texture '%s' has no transparency map"), bt->name);
       return 0;
    }
 
+   /* real vertical sprite value (flipped) */
+   rbsy = bt->sy - bsy - 1;
+
+   /* Nothing to hit in an empty sprite. */
+   bbox = &bt->sbox[ 4*(rbsy*(int)bt->sx + bsx) ];
+   if (bbox[2] < bbox[0])
+      return 0;
+
    /* Set up end point of line. */
    ep[0] = ap->x + al*cos(ad);
    ep[1] = ap->y + al*sin(ad);
 
-   /* Set up top right corner of the rectangle. */
-   tr[0] = bp->x + bt->sw/2.;
-   tr[1] = bp->y + bt->sh/2.;
-   /* Set up bottom left corner of the rectangle. */
+   /* Set up bottom left corner of the sprite. */
    bl[0] = bp->x - bt->sw/2.;
    bl[1] = bp->y - bt->sh/2.;
+   /* Set up the rectangle around the opaque pixels. */
+   obl[0] = bl[0] + (double)bbox[0];
+   obl[1] = bl[1] + (double)bbox[1];
+   tr[0]  = bl[0] + (double)(bbox[2]+1);
+   tr[1]  = bl[1] + (double)(bbox[3]+1);
 
    /*
     * Start check for rectangular collisions.
@@ -459,14 +561,14 @@ int CollideLineSprite( const Vector2d* ap, double ad, double al,
    hits = 0;
    /* Left border. */
    if (CollideLineLine(ap->x, ap->y, ep[0], ep[1],
-         bl[0], bl[1], bl[0], tr[1], &tmp_crash) == 1) {
+         obl[0], obl[1], obl[0], tr[1], &tmp_crash) == 1) {
       border[hits].x = tmp_crash.x;
       border[hits].y = tmp_crash.y;
       hits++;
    }
    /* Top border. */
    if (CollideLineLine(ap->x, ap->y, ep[0], ep[1],
-         bl[0], tr[1], tr[0], tr[1], &tmp_crash) == 1) {
+         obl[0], tr[1], tr[0], tr[1], &tmp_crash) == 1) {
       border[hits].x = tmp_crash.x;
       border[hits].y = tmp_crash.y;
       hits++;
@@ -474,14 +576,14 @@ int CollideLineSprite( const Vector2d* ap, double ad, double al,
    /* Now we have to make sure hits isn't 2. */
    /* Right border. */
    if ((hits < 2) && CollideLineLine(ap->x, ap->y, ep[0], ep[1],
-         tr[0], tr[1], tr[0], bl[1], &tmp_crash) == 1) {
+         tr[0], tr[1], tr[0], obl[1], &tmp_crash) == 1) {
       border[hits].x = tmp_crash.x;
       border[hits].y = tmp_crash.y;
       hits++;
    }
    /* Bottom border. */
    if ((hits < 2) && CollideLineLine(ap->x, ap->y, ep[0], ep[1],
-         tr[0], bl[1], bl[0], bl[1], &tmp_crash) == 1) {
+         tr[0], obl[1], obl[0], obl[1], &tmp_crash) == 1) {
       border[hits].x = tmp_crash.x;
       border[hits].y = tmp_crash.y;
       hits++;
@@ -509,8 +611,6 @@ int CollideLineSprite( const Vector2d* ap, double ad, double al,
    v[0] /= mod;
    v[1] /= mod;
 
-   /* real vertical sprite value (flipped) */
-   rbsy = bt->sy - bsy - 1;
    /* set up the base points */
    bbx =  bsx*(int)(bt->sw);
    bby = rbsy*(int)(bt->sh);
@@ -590,6 +690,10 @@ int CollideLinePolygon( const Vector2d* ap, double ad, double al,
    ep[0] = ap->x + al*cos(ad);
    ep[1] = ap->y + al*sin(ad);
 
+   /* Line must reach the bounding circle. */
+   if (!lineInCircle( ap, ep[0]-ap->x, ep[1]-ap->y, bp, bt->r ))
+      return 0;
+
    real_hits = 0;
 
    /* Check if the beginning point is inside polygon */
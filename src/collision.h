@@ -24,6 +24,7 @@ typedef struct CollPoly_ {
    float xmax; /**< Max of x. */
    float ymin; /**< Min of y. */
    float ymax; /**< Max of y. */
+   float r; /**< Radius of the bounding circle around the origin. */
    int npt; /**< Nb of points in the polygon. */
 } CollPoly;
 
@@ -104,6 +104,7 @@ static void print_usage( char **argv )
 #ifdef DEBUGGING
    LOG(_("   --devmode             enables dev mode perks like the editors"));
    LOG(_("   --devcsv              generates csv output from the ndata for development purposes"));
+   LOG(_("   --devbench            runs the development benchmarks and logs the results"));
 #endif /* DEBUGGING */
    LOG(_("   -h, --help            display this message and exit"));
    LOG(_("   -v, --version         print the version and exit"));
@@ -156,6 +157,7 @@ void conf_setDefaults (void)
    conf.devmode      = 0;
    conf.devautosave  = 0;
    conf.devcsv       = 0;
+   conf.devbench     = 0;
 
    /* Gameplay. */
    conf_setGameplayDefaults();
@@ -615,6 +617,7 @@ void conf_parseCLI( int argc, char** argv )
 #ifdef DEBUGGING
       { "devmode", no_argument, 0, 'D' },
       { "devcsv", no_argument, 0, 'C' },
+      { "devbench", no_argument, 0, 'B' },
 #endif /* DEBUGGING */
       { "help", no_argument, 0, 'h' },
       { "version", no_argument, 0, 'v' },
@@ -690,6 +693,11 @@ void conf_parseCLI( int argc, char** argv )
             conf.devcsv = 1;
             LOG(_("Will generate CSV output."));
             break;
+
+         case 'B':
+            conf.devbench = 1;
+            LOG(_("Will run benchmarks."));
+            break;
 #endif /* DEBUGGING */
 
          case 'v':
@@ -144,6 +144,7 @@ typedef struct PlayerConf_s {
    int devmode; /**< Developer mode. */
    int devautosave; /**< Developer mode autosave. */
    int devcsv; /**< Output CSV data. */
+   int devbench; /**< Run benchmarks. */
 
    /* Debugging. */
    int fpu_except; /**< Enable FPU exceptions? */
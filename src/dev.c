@@ -10,17 +10,49 @@
 
 #include "dev.h"
 
+#include <math.h>
+#include <stdlib.h>
+
 #include "naev.h"
 
 #include "SDL.h"
+#include <lauxlib.h>
 
+#include "array.h"
 #include "log.h"
 #include "nfile.h"
+#include "nstring.h"
+#include "nlua.h"
+#include "nlua_var.h"
+#include "collision.h"
+#include "pilot.h"
+#include "pilot_heat.h"
+#include "pilot_outfit.h"
+#include "faction.h"
+#include "perlin.h"
 #include "dev_outfit.h"
 #include "dev_ship.h"
 
 
 #define CSV_DIR      "naev_csv" /**< Name of the directory to create all the csv data into. */
+#define BENCH_NEBU_Z 16 /**< Layers to generate when benchmarking the nebula. */
+#define BENCH_VAR_N  5000 /**< Mission variables to create when benchmarking the var store. */
+#define BENCH_VAR_R  20 /**< Times to peek at every mission variable. */
+#define BENCH_STATS_R 200 /**< Times to recalculate the stats of every ship. */
+#define BENCH_COLL_N 16 /**< Offsets per axis to collide ship sprites at. */
+#define BENCH_HEAT_N 2000 /**< Ticks to run the heat regression for. */
+#define BENCH_HEAT_F 10 /**< Ticks between shots in the heat regression. */
+#define BENCH_HEAT_DT (1./60.) /**< Tick length of the heat regression. */
+
+
+/*
+ * Prototypes.
+ */
+static void dev_benchVar (void);
+static void dev_benchStats (void);
+static void dev_benchHeat (void);
+static Pilot* dev_benchHeatPilot( Ship *s, Outfit *outfits, int noutfits );
+static void dev_benchCollide (void);
 
 
 /**
@@ -61,3 +93,343 @@ void dev_csv (void)
 }
 
 
+/**
+ * @brief Runs the development benchmarks and logs the results.
+ */
+void dev_bench (void)
+{
+   const int res[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+   unsigned int t;
+   float *nebu;
+   double dt;
+   int i;
+
+   DEBUG(_("Running benchmarks..."));
+
+   /* Nebula generation. */
+   for (i=0; i<(int)(sizeof(res)/sizeof(res[0])); i++) {
+      t     = SDL_GetTicks();
+      nebu  = noise_genNebulaMap( res[i][0], res[i][1], BENCH_NEBU_Z, 5. );
+      dt    = (double)(SDL_GetTicks() - t) / 1000.;
+      free(nebu);
+      DEBUG(_("   nebula %dx%dx%d: %.3f s (%.1f Mpixels/s)"),
+            res[i][0], res[i][1], BENCH_NEBU_Z, dt,
+            (double)res[i][0] * res[i][1] * BENCH_NEBU_Z / MAX(dt,1e-3) / 1e6 );
+   }
+
+   /* Mission variables. */
+   dev_benchVar();
+
+   /* Pilot stats. */
+   dev_benchStats();
+
+   /* Outfit heat. */
+   dev_benchHeat();
+
+   /* Pixel collisions. */
+   dev_benchCollide();
+}
+
+
+/**
+ * @brief Benchmarks the mission variable store from Lua.
+ *
+ * Mission variables are global so this should only be run before a player
+ *  is loaded.
+ */
+static void dev_benchVar (void)
+{
+   const char *buf =
+      "local n, r = ...\n"
+      "local names = {}\n"
+      "for i=1,n do names[i] = \"bench_\"..i end\n"
+      "local t = naev.ticks()\n"
+      "for i=1,n do var.push( names[i], i ) end\n"
+      "local tpush = naev.ticks() - t\n"
+      "t = naev.ticks()\n"
+      "for j=1,r do for i=1,n do var.peek( names[i] ) end end\n"
+      "local tpeek = naev.ticks() - t\n"
+      "t = naev.ticks()\n"
+      "for j=1,r do var.export( \"bench_\" ) end\n"
+      "local texport = naev.ticks() - t\n"
+      "t = naev.ticks()\n"
+      "for i=n,1,-1 do var.pop( names[i] ) end\n"
+      "return tpush, tpeek, texport, naev.ticks() - t\n";
+   nlua_env env;
+   lua_State *L;
+   double tpush, tpeek, texport, tpop;
+
+   env = nlua_newEnv(1);
+   nlua_loadStandard(env);
+   L = naevL;
+
+   if (luaL_loadbuffer(L, buf, strlen(buf), "dev_benchVar") != 0) {
+      WARN(_("Failed to load var benchmark: %s"), lua_tostring(L,-1));
+      lua_pop(L,1);
+      nlua_freeEnv(env);
+      return;
+   }
+   nlua_pushenv(env);
+   lua_setfenv(L, -2);
+   lua_pushnumber(L, BENCH_VAR_N);
+   lua_pushnumber(L, BENCH_VAR_R);
+   if (nlua_pcall(env, 2, 4) != 0) {
+      WARN(_("Failed to run var benchmark: %s"), lua_tostring(L,-1));
+      lua_pop(L,1);
+      nlua_freeEnv(env);
+      return;
+   }
+   tpush    = lua_tonumber(L,-4) / 1000.;
+   tpeek    = lua_tonumber(L,-3) / 1000.;
+   texport  = lua_tonumber(L,-2) / 1000.;
+   tpop     = lua_tonumber(L,-1) / 1000.;
+   lua_pop(L,4);
+   nlua_freeEnv(env);
+
+   DEBUG(_("   var %d vars: push %.3f s, peek x%d %.3f s (%.1f Mpeeks/s), export x%d %.3f s, pop %.3f s"),
+         BENCH_VAR_N, tpush, BENCH_VAR_R, tpeek,
+         (double)BENCH_VAR_N * BENCH_VAR_R / MAX(tpeek,1e-3) / 1e6,
+         BENCH_VAR_R, texport, tpop );
+}
+
+
+/**
+ * @brief Benchmarks pilot stat calculation, which dominates spawning.
+ *
+ * Runs once with the stat template cache flushed before every calculation
+ *  and once with it warm.
+ */
+static void dev_benchStats (void)
+{
+   Ship *ships;
+   Pilot **pilots;
+   PilotFlags flags;
+   unsigned long hits, misses, h0, m0;
+   unsigned int t;
+   double tcold, twarm;
+   int i, j, n;
+
+   ships = ship_getAll( &n );
+   if (n <= 0)
+      return;
+   pilot_clearFlagsRaw( flags );
+   pilots = malloc( sizeof(Pilot*) * n );
+   for (i=0; i<n; i++)
+      pilots[i] = pilot_createEmpty( &ships[i], "Bench", FACTION_PLAYER, NULL, flags );
+
+   /* Cold, every loadout gets recomputed. */
+   t = SDL_GetTicks();
+   for (j=0; j<BENCH_STATS_R; j++) {
+      for (i=0; i<n; i++) {
+         pilot_statsCacheFree();
+         pilot_calcStats( pilots[i] );
+      }
+   }
+   tcold = (double)(SDL_GetTicks() - t) / 1000.;
+
+   /* Warm, loadouts come from the cache. */
+   pilot_statsCacheCount( &h0, &m0 );
+   t = SDL_GetTicks();
+   for (j=0; j<BENCH_STATS_R; j++)
+      for (i=0; i<n; i++)
+         pilot_calcStats( pilots[i] );
+   twarm = (double)(SDL_GetTicks() - t) / 1000.;
+   pilot_statsCacheCount( &hits, &misses );
+
+   for (i=0; i<n; i++)
+      pilot_free( pilots[i] );
+   free( pilots );
+   pilot_statsCacheFree();
+
+   DEBUG(_("   stats %d ships x%d: cold %.3f s (%.1f k/s), warm %.3f s (%.1f k/s), %lu hits %lu misses"),
+         n, BENCH_STATS_R,
+         tcold, (double)n * BENCH_STATS_R / MAX(tcold,1e-3) / 1e3,
+         twarm, (double)n * BENCH_STATS_R / MAX(twarm,1e-3) / 1e3,
+         hits-h0, misses-m0 );
+}
+
+
+/**
+ * @brief Creates a pilot with every slot filled by the first bolt that fits.
+ *
+ *    @param s Ship to create the pilot with.
+ *    @param outfits All the outfits.
+ *    @param noutfits Number of outfits.
+ *    @return The new pilot.
+ */
+static Pilot* dev_benchHeatPilot( Ship *s, Outfit *outfits, int noutfits )
+{
+   Pilot *p;
+   PilotFlags flags;
+   int i, j;
+
+   pilot_clearFlagsRaw( flags );
+   p = pilot_createEmpty( s, "Bench", FACTION_PLAYER, NULL, flags );
+   for (i=0; i<p->noutfits; i++) {
+      for (j=0; j<noutfits; j++) {
+         if (!outfit_isBolt(&outfits[j]) ||
+               !outfit_fitsSlot( &outfits[j], &p->outfits[i]->sslot->slot ))
+            continue;
+         pilot_addOutfitRaw( p, &outfits[j], p->outfits[i] );
+         break;
+      }
+   }
+   pilot_calcStats( p );
+   pilot_heatReset( p );
+   return p;
+}
+
+
+/**
+ * @brief Checks the grouped outfit heat update against the per-slot one.
+ *
+ * Two pilots with the same loadout fire all their weapons every few ticks,
+ *  one is cooled slot by slot like pilot_update used to do and the other
+ *  over the active outfit group. Their temperatures should never diverge.
+ */
+static void dev_benchHeat (void)
+{
+   Ship *ships;
+   Outfit *outfits;
+   Pilot *pa, *pb;
+   PilotOutfitSlot *o;
+   double Q, dt, diff;
+   int i, j, n, noutfits, nslots;
+
+   ships    = ship_getAll( &n );
+   outfits  = outfit_getAll( &noutfits );
+   if ((n <= 0) || (noutfits <= 0))
+      return;
+
+   /* Use the first ship that can mount weapons. */
+   for (i=0; i<n; i++)
+      if (ships[i].outfit_nweapon > 0)
+         break;
+   if (i >= n)
+      return;
+   pa = dev_benchHeatPilot( &ships[i], outfits, noutfits );
+   pb = dev_benchHeatPilot( &ships[i], outfits, noutfits );
+   pilot_outfitGroup( pb );
+   nslots = array_size( pb->outfit_active );
+
+   dt    = BENCH_HEAT_DT;
+   diff  = 0.;
+   for (j=0; j<BENCH_HEAT_N; j++) {
+      /* Fire everything. */
+      if (j % BENCH_HEAT_F == 0) {
+         for (i=0; i<pa->noutfits; i++) {
+            if ((pa->outfits[i]->outfit == NULL) || !pa->outfits[i]->active)
+               continue;
+            pilot_heatAddSlot( pa, pa->outfits[i] );
+            pa->outfits[i]->timer = outfit_delay( pa->outfits[i]->outfit );
+         }
+         for (i=0; i<nslots; i++) {
+            pilot_heatAddSlot( pb, pb->outfit_active[i] );
+            pb->outfit_active[i]->timer = outfit_delay( pb->outfit_active[i]->outfit );
+         }
+      }
+
+      /* Old per-slot loop. */
+      Q = 0.;
+      for (i=0; i<pa->noutfits; i++) {
+         o = pa->outfits[i];
+         if ((o->outfit == NULL) || !o->active)
+            continue;
+         if (o->timer > 0.)
+            o->timer -= dt * pilot_heatFireRateMod( o->heat_T );
+         Q += pilot_heatUpdateSlot( pa, o, dt );
+      }
+      pilot_heatUpdateShip( pa, Q, dt );
+
+      /* Grouped loop as in pilot_update. */
+      for (i=0; i<nslots; i++)
+         if (pb->outfit_active[i]->timer > 0.)
+            pb->outfit_active[i]->timer -= dt *
+                  pilot_heatFireRateMod( pb->outfit_active[i]->heat_T );
+      Q = pilot_heatUpdateSlots( pb, dt );
+      pilot_heatUpdateShip( pb, Q, dt );
+
+      /* Compare. */
+      diff = MAX( diff, fabs( pa->heat_T - pb->heat_T ) );
+      for (i=0; i<pa->noutfits; i++) {
+         diff = MAX( diff, fabs( pa->outfits[i]->heat_T - pb->outfits[i]->heat_T ) );
+         diff = MAX( diff, fabs( pa->outfits[i]->timer - pb->outfits[i]->timer ) );
+      }
+   }
+
+   if (diff > 0.)
+      WARN(_("   heat %s: grouped update diverges from per-slot update by %g after %d ticks"),
+            pa->ship->name, diff, BENCH_HEAT_N );
+   else
+      DEBUG(_("   heat %s: %d slots, %d ticks, grouped update matches per-slot update"),
+            pa->ship->name, nslots, BENCH_HEAT_N );
+
+   pilot_free( pa );
+   pilot_free( pb );
+}
+
+
+/**
+ * @brief Benchmarks pixel perfect collisions between ship sprites.
+ *
+ * Every ship sprite is collided with the next ship's at a grid of offsets
+ *  covering both sprites, and swept by a beam at the same offsets.
+ */
+static void dev_benchCollide (void)
+{
+   Ship *ships;
+   glTexture *a, *b;
+   Vector2d ap, bp, crash[2];
+   unsigned int t;
+   unsigned long nspr, hspr, nline, hline;
+   double tspr, tline, r;
+   int i, j, k, n, s;
+
+   ships = ship_getAll( &n );
+   if (n <= 1)
+      return;
+
+   /* Sprite against sprite. */
+   nspr = hspr = 0;
+   vectnull( &ap );
+   t = SDL_GetTicks();
+   for (i=0; i<n; i++) {
+      a = ships[i].gfx_space;
+      b = ships[(i+1)%n].gfx_space;
+      r = (a->sw + b->sw) / 2.;
+      for (s=0; s<(int)(a->sx*a->sy); s++) {
+         for (j=0; j<BENCH_COLL_N; j++) {
+            for (k=0; k<BENCH_COLL_N; k++) {
+               vect_cset( &bp, r * (2.*j/(BENCH_COLL_N-1) - 1.),
+                     r * (2.*k/(BENCH_COLL_N-1) - 1.) );
+               hspr += CollideSprite( a, s % (int)a->sx, s / (int)a->sx, &ap,
+                     b, j % (int)b->sx, k % (int)b->sy, &bp, &crash[0] );
+               nspr++;
+            }
+         }
+      }
+   }
+   tspr = (double)(SDL_GetTicks() - t) / 1000.;
+
+   /* Beam against sprite. */
+   nline = hline = 0;
+   vectnull( &bp );
+   t = SDL_GetTicks();
+   for (i=0; i<n; i++) {
+      b = ships[i].gfx_space;
+      r = b->sw;
+      for (s=0; s<(int)(b->sx*b->sy); s++) {
+         for (j=0; j<BENCH_COLL_N; j++) {
+            vect_cset( &ap, -r, r * (2.*j/(BENCH_COLL_N-1) - 1.) / 2. );
+            hline += CollideLineSprite( &ap, 0., 2.*r,
+                  b, s % (int)b->sx, s / (int)b->sx, &bp, crash );
+            nline++;
+         }
+      }
+   }
+   tline = (double)(SDL_GetTicks() - t) / 1000.;
+
+   DEBUG(_("   collide %lu sprites: %.3f s (%.1f k/s, %lu hits), %lu beams: %.3f s (%.1f k/s, %lu hits)"),
+         nspr, tspr, (double)nspr / MAX(tspr,1e-3) / 1e3, hspr,
+         nline, tline, (double)nline / MAX(tline,1e-3) / 1e3, hline );
+}
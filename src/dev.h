@@ -9,6 +9,7 @@
 
 
 void dev_csv (void);
+void dev_bench (void);
 
 
 #endif /* DEV_H */
@@ -27,6 +27,7 @@
 #include <cs.h>
 #endif
 
+#include "array.h"
 #include "nxml.h"
 #include "ndata.h"
 #include "log.h"
@@ -53,6 +54,8 @@
 
 /* Gatherables */
 #define GATHER_DIST 30. /**< Maximum distance a gatherable can be gathered. */
+#define GATHER_CELL 500. /**< Minimum size of a gatherable grid cell. */
+#define GATHER_GRID_MAX 64 /**< Maximum amount of gatherable grid cells per side. */
 
 
 /* commodity stack */
@@ -66,8 +69,19 @@ extern int systems_nstack; /**< Number of star systems. */
 
 
 /* gatherables stack */
-static Gatherable* gatherable_stack = NULL; /**< Contains the gatherable stuff floating around. */
+static Gatherable* gatherable_stack = NULL; /**< Contains the gatherable stuff floating around (array.h). */
 static int gatherable_nstack        = 0; /**< Number of gatherables in the stack. */
+/* gatherables grid, binned like the pilot grid */
+static int gatherable_dirty         = 1; /**< Whether the grid has to be rebuilt. */
+static double gatherable_gx         = 0.; /**< X position of the grid origin. */
+static double gatherable_gy         = 0.; /**< Y position of the grid origin. */
+static double gatherable_cell       = GATHER_CELL; /**< Size of a grid cell. */
+static int gatherable_gw            = 0; /**< Width of the grid in cells. */
+static int gatherable_gh            = 0; /**< Height of the grid in cells. */
+static int *gatherable_start        = NULL; /**< Offset of each cell in gatherable_idx (array.h). */
+static int *gatherable_cellof       = NULL; /**< Cell of each gatherable (array.h). */
+static int *gatherable_idx          = NULL; /**< Gatherables sorted by cell (array.h). */
+static int *gatherable_found        = NULL; /**< Results of the last query (array.h). */
 float noscoop_timer                 = 1.; /**< Timer for the "full cargo" message . */
 
 
@@ -90,6 +104,10 @@ static int commodity_parse( Commodity *temp, xmlNodePtr parent );
 /* Economy. */
 static double econ_calcJumpR( StarSystem *A, StarSystem *B );
 static int econ_createGMatrix (void);
+/* Gatherables. */
+static void gatherable_gridBuild (void);
+static int gatherable_query( const Vector2d *pos, double rad );
+static void gatherable_remove( int i );
 credits_t economy_getPrice( const Commodity *com,
       const StarSystem *sys, const Planet *p ); /* externed in land.c */
 credits_t economy_getPriceAtTime( const Commodity *com,
@@ -372,14 +390,35 @@ void commodity_Jettison( int pilot, Commodity* com, int quantity )
  */
 void gatherable_init( Commodity* com, Vector2d pos, Vector2d vel )
 {
-   gatherable_stack = realloc(gatherable_stack,
-                              sizeof(Gatherable)*(++gatherable_nstack));
-
-   gatherable_stack[gatherable_nstack-1].type = com;
-   gatherable_stack[gatherable_nstack-1].pos = pos;
-   gatherable_stack[gatherable_nstack-1].vel = vel;
-   gatherable_stack[gatherable_nstack-1].timer = 0.;
-   gatherable_stack[gatherable_nstack-1].lifeleng = RNGF()*100. + 50.;
+   Gatherable *gat;
+
+   /* The pool keeps its memory until the system is left. */
+   if (gatherable_stack == NULL)
+      gatherable_stack = array_create( Gatherable );
+
+   gat = &array_grow( &gatherable_stack );
+   gat->type     = com;
+   gat->pos      = pos;
+   gat->vel      = vel;
+   gat->timer    = 0.;
+   gat->lifeleng = RNGF()*100. + 50.;
+   gatherable_nstack = array_size( gatherable_stack );
+   gatherable_dirty  = 1;
+}
+
+
+/**
+ * @brief Removes a gatherable by moving the last one into its place.
+ *
+ *    @param i Index of the gatherable to remove.
+ */
+static void gatherable_remove( int i )
+{
+   gatherable_nstack--;
+   if (i != gatherable_nstack)
+      gatherable_stack[i] = gatherable_stack[gatherable_nstack];
+   array_resize( &gatherable_stack, gatherable_nstack );
+   gatherable_dirty = 1;
 }
 
 
@@ -391,25 +430,27 @@ void gatherable_init( Commodity* com, Vector2d pos, Vector2d vel )
 void gatherable_update( double dt )
 {
    int i;
+   Gatherable *gat;
 
    /* Update the timer for "full cargo" message. */
    noscoop_timer += dt;
 
-   for (i=0; i < gatherable_nstack; i++) {
-      gatherable_stack[i].timer += dt;
-      gatherable_stack[i].pos.x += dt*gatherable_stack[i].vel.x;
-      gatherable_stack[i].pos.y += dt*gatherable_stack[i].vel.y;
+   if (gatherable_nstack <= 0)
+      return;
+
+   for (i=gatherable_nstack-1; i>=0; i--) {
+      gat = &gatherable_stack[i];
+      gat->timer += dt;
+      gat->pos.x += dt*gat->vel.x;
+      gat->pos.y += dt*gat->vel.y;
 
       /* Remove the gatherable */
-      if (gatherable_stack[i].timer > gatherable_stack[i].lifeleng) {
-         gatherable_nstack--;
-         memmove( &gatherable_stack[i], &gatherable_stack[i+1],
-                 sizeof(Gatherable)*(gatherable_nstack-i) );
-         gatherable_stack = realloc(gatherable_stack,
-                                    sizeof(Gatherable) * gatherable_nstack);
-         i--;
-      }
+      if (gat->timer > gat->lifeleng)
+         gatherable_remove( i );
    }
+
+   /* Everything moved. */
+   gatherable_dirty = 1;
 }
 
 
@@ -418,9 +459,21 @@ void gatherable_update( double dt )
  */
 void gatherable_free( void )
 {
-   free(gatherable_stack);
+   if (gatherable_stack != NULL)
+      array_free( gatherable_stack );
    gatherable_stack = NULL;
    gatherable_nstack = 0;
+   if (gatherable_start != NULL) {
+      array_free( gatherable_start );
+      array_free( gatherable_cellof );
+      array_free( gatherable_idx );
+      array_free( gatherable_found );
+   }
+   gatherable_start  = NULL;
+   gatherable_cellof = NULL;
+   gatherable_idx    = NULL;
+   gatherable_found  = NULL;
+   gatherable_dirty  = 1;
 }
 
 
@@ -439,6 +492,119 @@ void gatherable_render( void )
 }
 
 
+/**
+ * @brief Bins the gatherables into a uniform grid covering all of them.
+ */
+static void gatherable_gridBuild (void)
+{
+   int i, c, cx, cy;
+   double xmin, xmax, ymin, ymax;
+   Gatherable *gat;
+
+   if (gatherable_start == NULL) {
+      gatherable_start  = array_create( int );
+      gatherable_cellof = array_create( int );
+      gatherable_idx    = array_create( int );
+      gatherable_found  = array_create( int );
+   }
+
+   /* Get the bounds. */
+   xmin = ymin = HUGE_VAL;
+   xmax = ymax = -HUGE_VAL;
+   for (i=0; i<gatherable_nstack; i++) {
+      gat  = &gatherable_stack[i];
+      xmin = MIN( xmin, gat->pos.x );
+      xmax = MAX( xmax, gat->pos.x );
+      ymin = MIN( ymin, gat->pos.y );
+      ymax = MAX( ymax, gat->pos.y );
+   }
+   if (xmin > xmax) {
+      xmin = xmax = 0.;
+      ymin = ymax = 0.;
+   }
+
+   /* Set up the grid so it has at most GATHER_GRID_MAX cells per side. */
+   gatherable_gx   = xmin;
+   gatherable_gy   = ymin;
+   gatherable_cell = MAX( GATHER_CELL, MAX( xmax-xmin, ymax-ymin ) / GATHER_GRID_MAX );
+   gatherable_gw   = (int)((xmax-xmin) / gatherable_cell) + 1;
+   gatherable_gh   = (int)((ymax-ymin) / gatherable_cell) + 1;
+
+   /* Count the gatherables in each cell. */
+   array_resize( &gatherable_start, gatherable_gw*gatherable_gh+1 );
+   memset( gatherable_start, 0, sizeof(int)*(gatherable_gw*gatherable_gh+1) );
+   array_resize( &gatherable_cellof, gatherable_nstack );
+   for (i=0; i<gatherable_nstack; i++) {
+      gat = &gatherable_stack[i];
+      cx  = CLAMP( 0, gatherable_gw-1, (int)((gat->pos.x-gatherable_gx) / gatherable_cell) );
+      cy  = CLAMP( 0, gatherable_gh-1, (int)((gat->pos.y-gatherable_gy) / gatherable_cell) );
+      c   = cy*gatherable_gw + cx;
+      gatherable_cellof[i] = c;
+      gatherable_start[c+1]++;
+   }
+   for (c=0; c<gatherable_gw*gatherable_gh; c++)
+      gatherable_start[c+1] += gatherable_start[c];
+
+   /* Sort into the cells, this shifts the offsets one cell down. */
+   array_resize( &gatherable_idx, gatherable_nstack );
+   for (i=0; i<gatherable_nstack; i++)
+      gatherable_idx[ gatherable_start[ gatherable_cellof[i] ]++ ] = i;
+   for (c=gatherable_gw*gatherable_gh; c>0; c--)
+      gatherable_start[c] = gatherable_start[c-1];
+   gatherable_start[0] = 0;
+
+   gatherable_dirty = 0;
+}
+
+
+/**
+ * @brief Finds all the gatherables within a radius of a position.
+ *
+ * The indices are left in gatherable_found.
+ *
+ *    @param pos Position to search around.
+ *    @param rad Radius to search in (can be INFINITY).
+ *    @return Number of gatherables found.
+ */
+static int gatherable_query( const Vector2d *pos, double rad )
+{
+   int i, j, k, x0, x1, y0, y1;
+   Gatherable *gat;
+
+   if (gatherable_nstack <= 0)
+      return 0;
+
+   if (gatherable_dirty)
+      gatherable_gridBuild();
+   array_resize( &gatherable_found, 0 );
+
+   /* Get the cells overlapping the search, everything lies within the grid. */
+   if (rad*2. >= gatherable_cell * MAX( gatherable_gw, gatherable_gh )) {
+      x0 = y0 = 0;
+      x1 = gatherable_gw-1;
+      y1 = gatherable_gh-1;
+   }
+   else {
+      x0 = CLAMP( 0, gatherable_gw-1, (int)floor((pos->x-rad-gatherable_gx) / gatherable_cell) );
+      x1 = CLAMP( 0, gatherable_gw-1, (int)floor((pos->x+rad-gatherable_gx) / gatherable_cell) );
+      y0 = CLAMP( 0, gatherable_gh-1, (int)floor((pos->y-rad-gatherable_gy) / gatherable_cell) );
+      y1 = CLAMP( 0, gatherable_gh-1, (int)floor((pos->y+rad-gatherable_gy) / gatherable_cell) );
+   }
+
+   for (j=y0; j<=y1; j++) {
+      for (i=x0; i<=x1; i++) {
+         for (k=gatherable_start[j*gatherable_gw+i]; k<gatherable_start[j*gatherable_gw+i+1]; k++) {
+            gat = &gatherable_stack[ gatherable_idx[k] ];
+            if (vect_dist( pos, &gat->pos ) < rad)
+               array_push_back( &gatherable_found, gatherable_idx[k] );
+         }
+      }
+   }
+
+   return array_size( gatherable_found );
+}
+
+
 /**
  * @brief Gets the closest gatherable from a given position, within a given radius
  *
@@ -448,18 +614,19 @@ void gatherable_render( void )
  */
 int gatherable_getClosest( Vector2d pos, double rad )
 {
-   int i, curg;
-   Gatherable *gat;
+   int i, n, curg;
    double mindist, curdist;
 
    curg = -1;
    mindist = INFINITY;
 
-   for (i=0; i < gatherable_nstack; i++) {
-      gat = &gatherable_stack[i];
-      curdist = vect_dist(&pos, &gat->pos);
-      if ( (curdist<mindist) && (curdist<rad) ) {
-         curg = i;
+   n = gatherable_query( &pos, rad );
+   for (i=0; i<n; i++) {
+      curdist = vect_dist( &pos, &gatherable_stack[ gatherable_found[i] ].pos );
+      /* Ties go to the lowest index like a linear scan would. */
+      if ((curdist < mindist) ||
+            ((curdist == mindist) && (gatherable_found[i] < curg))) {
+         curg = gatherable_found[i];
          mindist = curdist;
       }
    }
@@ -500,38 +667,44 @@ int gatherable_getPos( Vector2d* pos, Vector2d* vel, int id )
  */
 void gatherable_gather( int pilot )
 {
-   int i, q;
+   int i, j, k, n, q;
    Gatherable *gat;
    Pilot* p;
 
+   /* Most systems have nothing floating around. */
+   if (gatherable_nstack <= 0)
+      return;
+
    p = pilot_get( pilot );
 
-   for (i=0; i < gatherable_nstack; i++) {
-      gat = &gatherable_stack[i];
+   /* Sort in decreasing order so removing one doesn't move the rest. */
+   n = gatherable_query( &p->solid->pos, GATHER_DIST );
+   for (i=1; i<n; i++) {
+      k = gatherable_found[i];
+      for (j=i; (j>0) && (gatherable_found[j-1] < k); j--)
+         gatherable_found[j] = gatherable_found[j-1];
+      gatherable_found[j] = k;
+   }
+   for (i=0; i<n; i++) {
+      gat = &gatherable_stack[ gatherable_found[i] ];
 
-      if (vect_dist( &p->solid->pos, &gat->pos ) < GATHER_DIST ) {
-         /* Add cargo to pilot. */
-         q = pilot_cargoAdd( p, gat->type, RNG(1,5), 0 );
+      /* Add cargo to pilot. */
+      q = pilot_cargoAdd( p, gat->type, RNG(1,5), 0 );
 
-         if (q>0) {
-            if (pilot_isPlayer(p))
-               player_message( ngettext("%d ton of %s gathered", "%d tons of %s gathered", q), q, gat->type->name );
+      if (q>0) {
+         if (pilot_isPlayer(p))
+            player_message( ngettext("%d ton of %s gathered", "%d tons of %s gathered", q), q, gat->type->name );
 
-            /* Remove the object from space. */
-            gatherable_nstack--;
-            memmove( &gatherable_stack[i], &gatherable_stack[i+1],
-                    sizeof(Gatherable)*(gatherable_nstack-i) );
-            gatherable_stack = realloc(gatherable_stack,
-                                       sizeof(Gatherable) * gatherable_nstack);
+         /* Remove the object from space. */
+         gatherable_remove( gatherable_found[i] );
 
-            /* Test if there is still cargo space */
-            if ((pilot_cargoFree(p) < 1) && (pilot_isPlayer(p)))
-               player_message( _("No more cargo space available") );
-         }
-         else if ((pilot_isPlayer(p)) && (noscoop_timer > 2.)) {
-            noscoop_timer = 0.;
-            player_message( _("Cannot gather material: no more cargo space available") );
-         }
+         /* Test if there is still cargo space */
+         if ((pilot_cargoFree(p) < 1) && (pilot_isPlayer(p)))
+            player_message( _("No more cargo space available") );
+      }
+      else if ((pilot_isPlayer(p)) && (noscoop_timer > 2.)) {
+         noscoop_timer = 0.;
+         player_message( _("Cannot gather material: no more cargo space available") );
       }
    }
 }
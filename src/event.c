@@ -39,6 +39,7 @@
 #include "hook.h"
 #include "player.h"
 #include "npc.h"
+#include "array.h"
 
 
 #define XML_EVENT_ID          "Events" /**< XML document identifier */
@@ -69,6 +70,7 @@ typedef struct EventData_s {
  */
 static EventData_t *event_data   = NULL; /**< Allocated event data. */
 static int event_ndata           = 0; /**< Number of actual event data. */
+static int *event_triggers[EVENT_TRIGGER_LOAD+1]; /**< Event data IDs by trigger (array.h). */
 
 
 /*
@@ -87,6 +89,8 @@ static unsigned int event_genID (void);
 static int event_parse( EventData_t *temp, const xmlNodePtr parent );
 static void event_freeData( EventData_t *event );
 static int event_create( int dataid, unsigned int *id );
+static void events_indexBuild (void);
+static void events_indexFree (void);
 int events_saveActive( xmlTextWriterPtr writer );
 int events_loadActive( xmlNodePtr parent );;
 static int events_parseActive( xmlNodePtr parent );
@@ -243,8 +247,6 @@ static unsigned int event_genID (void)
  */
 static int event_create( int dataid, unsigned int *id )
 {
-   size_t bufsize;
-   char *buf;
    Event_t *ev;
    EventData_t *data;
 
@@ -276,21 +278,14 @@ static int event_create( int dataid, unsigned int *id )
    nlua_loadMusic(ev->env);
    nlua_loadTk(ev->env);
 
-   /* Load file. */
-   buf = ndata_read( data->lua, &bufsize );
-   if (buf == NULL) {
-      WARN(_("Event '%s' Lua script not found."), data->lua );
-      return -1;
-   }
-   if (nlua_dobufenv(ev->env, buf, bufsize, data->lua) != 0) {
+   /* Load file, compiled chunks are cached so it is only parsed once. */
+   if (nlua_dondataenv(ev->env, data->lua) != 0) {
       WARN(_("Error loading event file: %s\n"
             "%s\n"
             "Most likely Lua file has improper syntax, please check"),
             data->lua, lua_tostring(naevL,-1));
-      free(buf);
       return -1;
    }
-   free(buf);
 
    /* Run Lua. */
    if ((id==NULL) || (*id==0))
@@ -394,14 +389,19 @@ int event_alreadyRunning( int data )
  */
 void events_trigger( EventTrigger_t trigger )
 {
-   int i, c;
+   int i, j, c, *list;
    int created;
 
+   if (((int)trigger < 0) || (trigger > EVENT_TRIGGER_LOAD))
+      return;
+   list = event_triggers[ trigger ];
+   if (list == NULL)
+      return;
+
    created = 0;
-   for (i=0; i<event_ndata; i++) {
-      /* Make sure trigger matches. */
-      if (event_data[i].trigger != trigger)
-         continue;
+   for (j=0; j<array_size(list); j++) {
+      /* Only events with a matching trigger are indexed. */
+      i = list[j];
 
       /* Make sure chance is succeeded. */
       if (RNGF() > event_data[i].chance)
@@ -434,6 +434,36 @@ void events_trigger( EventTrigger_t trigger )
 }
 
 
+/**
+ * @brief Builds the index of events by trigger.
+ */
+static void events_indexBuild (void)
+{
+   int i;
+
+   for (i=0; i<=EVENT_TRIGGER_LOAD; i++)
+      event_triggers[i] = array_create( int );
+   for (i=0; i<event_ndata; i++)
+      if (((int)event_data[i].trigger >= 0) && (event_data[i].trigger <= EVENT_TRIGGER_LOAD))
+         array_push_back( &event_triggers[ event_data[i].trigger ], i );
+}
+
+
+/**
+ * @brief Frees the index of events by trigger.
+ */
+static void events_indexFree (void)
+{
+   int i;
+
+   for (i=0; i<=EVENT_TRIGGER_LOAD; i++) {
+      if (event_triggers[i] != NULL)
+         array_free( event_triggers[i] );
+      event_triggers[i] = NULL;
+   }
+}
+
+
 /**
  * @brief Loads up an event from an XML node.
  *
@@ -604,6 +634,9 @@ int events_load (void)
    /* Shrink to minimum. */
    event_data = realloc(event_data, sizeof(EventData_t)*event_ndata);
 
+   /* Index by trigger. */
+   events_indexBuild();
+
    /* Clean up. */
    xmlFreeDoc(doc);
    free(buf);
@@ -657,6 +690,7 @@ void events_exit (void)
    int i;
 
    events_cleanup();
+   events_indexFree();
 
    /* Free data. */
    if (event_data != NULL) {
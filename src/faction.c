@@ -14,6 +14,7 @@
 #include "naev.h"
 
 #include <stdlib.h>
+#include <stdint.h>
 #include "nstring.h"
 
 #include "nxml.h"
@@ -88,6 +89,15 @@ typedef struct Faction_ {
 static Faction* faction_stack = NULL; /**< Faction stack. */
 int faction_nstack = 0; /**< Number of factions in the faction stack. */
 
+/*
+ * Relation matrices, one bit per pair of factions, kept symmetric.
+ */
+static uint32_t *faction_grid_enemies = NULL; /**< Which factions are enemies. */
+static uint32_t *faction_grid_allies = NULL; /**< Which factions are allies. */
+static int faction_grid_stride = 0; /**< Words per row of the matrices. */
+#define faction_gridGet(g,a,b) \
+   (((g)[(a)*faction_grid_stride + ((b)>>5)] >> ((b)&31)) & 1) /**< Gets relation between a and b. */
+
 
 /*
  * Prototypes
@@ -97,6 +107,10 @@ static void faction_sanitizePlayer( Faction* faction );
 static void faction_modPlayerLua( int f, double mod, const char *source, int secondary );
 static int faction_parse( Faction* temp, xmlNodePtr parent );
 static void faction_parseSocial( xmlNodePtr parent );
+static void faction_gridSet( uint32_t *grid, int a, int b, int value );
+static void faction_gridUpdatePair( int a, int b );
+static void faction_gridUpdatePlayer( int f );
+static void faction_gridBuild (void);
 /* externed */
 int pfaction_save( xmlTextWriterPtr writer );
 int pfaction_load( xmlNodePtr parent );
@@ -368,7 +382,7 @@ int* faction_getEnemies( int f, int *n )
       enemies = malloc(sizeof(int)*faction_nstack);
 
       for (i=0; i<faction_nstack; i++)
-         if (faction_isPlayerEnemy(i))
+         if ((i != f) && faction_gridGet( faction_grid_enemies, f, i ))
             enemies[nenemies++] = i;
 
       enemies = realloc(enemies, sizeof(int)*nenemies);
@@ -406,7 +420,7 @@ int* faction_getAllies( int f, int *n )
       allies = malloc(sizeof(int)*faction_nstack);
 
       for (i=0; i<faction_nstack; i++)
-         if (faction_isPlayerFriend(i))
+         if ((i != f) && faction_gridGet( faction_grid_allies, f, i ))
             allies[nallies++] = i;
 
       allies = realloc(allies, sizeof(int)*nallies);
@@ -464,6 +478,7 @@ void faction_addEnemy( int f, int o)
    ff->nenemies++;
    ff->enemies = realloc(ff->enemies, sizeof(int)*ff->nenemies);
    ff->enemies[ff->nenemies-1] = o;
+   faction_gridUpdatePair( f, o );
 }
 
 
@@ -492,6 +507,7 @@ void faction_rmEnemy( int f, int o)
          ff->enemies[i] = ff->enemies[ff->nenemies-1];
          ff->nenemies--;
          ff->enemies = realloc(ff->enemies, sizeof(int)*ff->nenemies);
+         faction_gridUpdatePair( f, o );
          return;
       }
    }
@@ -541,6 +557,7 @@ void faction_addAlly( int f, int o)
    ff->nallies++;
    ff->allies = realloc(ff->allies, sizeof(int)*ff->nallies);
    ff->allies[ff->nallies-1] = o;
+   faction_gridUpdatePair( f, o );
 }
 
 
@@ -569,6 +586,7 @@ void faction_rmAlly( int f, int o)
          ff->allies[i] = ff->allies[ff->nallies-1];
          ff->nallies--;
          ff->allies = realloc(ff->allies, sizeof(int)*ff->nallies);
+         faction_gridUpdatePair( f, o );
          return;
       }
    }
@@ -667,6 +685,8 @@ static void faction_modPlayerLua( int f, double mod, const char *source, int sec
    /* Run hook if necessary. */
    delta = faction->player - old;
    if (FABS(delta) > 1e-10) {
+      faction_gridUpdatePlayer( f );
+
       hparam[0].type    = HOOK_PARAM_FACTION;
       hparam[0].u.lf    = f;
       hparam[1].type    = HOOK_PARAM_NUMBER;
@@ -756,6 +776,9 @@ void faction_modPlayerRaw( int f, double mod )
 
    faction = &faction_stack[f];
    faction->player += mod;
+   faction_sanitizePlayer( faction );
+   faction_gridUpdatePlayer( f );
+
    /* Run hook if necessary. */
    hparam[0].type    = HOOK_PARAM_FACTION;
    hparam[0].u.lf    = f;
@@ -764,9 +787,6 @@ void faction_modPlayerRaw( int f, double mod )
    hparam[2].type    = HOOK_PARAM_SENTINEL;
    hooks_runParam( "standing", hparam );
 
-   /* Sanitize just in case. */
-   faction_sanitizePlayer( faction );
-
    /* Tell space the faction changed. */
    space_factionChange();
 }
@@ -792,6 +812,9 @@ void faction_setPlayer( int f, double value )
    faction = &faction_stack[f];
    mod = value - faction->player;
    faction->player = value;
+   faction_sanitizePlayer( faction );
+   faction_gridUpdatePlayer( f );
+
    /* Run hook if necessary. */
    hparam[0].type    = HOOK_PARAM_FACTION;
    hparam[0].u.lf    = f;
@@ -800,9 +823,6 @@ void faction_setPlayer( int f, double value )
    hparam[2].type    = HOOK_PARAM_SENTINEL;
    hooks_runParam( "standing", hparam );
 
-   /* Sanitize just in case. */
-   faction_sanitizePlayer( faction );
-
    /* Tell space the faction changed. */
    space_factionChange();
 }
@@ -1077,43 +1097,21 @@ const char *faction_getStandingBroad( int f, int bribed, int override )
  */
 int areEnemies( int a, int b)
 {
-   Faction *fa, *fb;
-   int i;
-
    if (a==b) return 0; /* luckily our factions aren't masochistic */
 
    /* handle a */
-   if (faction_isFaction(a))
-      fa = &faction_stack[a];
-   else { /* a is invalid */
+   if (!faction_isFaction(a)) { /* a is invalid */
       WARN(_("areEnemies: %d is an invalid faction"), a);
       return 0;
    }
 
    /* handle b */
-   if (faction_isFaction(b))
-      fb = &faction_stack[b];
-   else { /* b is invalid */
+   if (!faction_isFaction(b)) { /* b is invalid */
       WARN(_("areEnemies: %d is an invalid faction"), b);
       return 0;
    }
 
-   /* player handled separately */
-   if (a==FACTION_PLAYER) {
-      return faction_isPlayerEnemy(b);
-   }
-   else if (b==FACTION_PLAYER) {
-      return faction_isPlayerEnemy(a);
-   }
-
-   for (i=0;i<fa->nenemies;i++)
-      if (fa->enemies[i] == b)
-         return 1;
-   for (i=0;i<fb->nenemies;i++)
-      if(fb->enemies[i] == a)
-         return 1;
-
-   return 0;
+   return faction_gridGet( faction_grid_enemies, a, b );
 }
 
 
@@ -1126,44 +1124,127 @@ int areEnemies( int a, int b)
  */
 int areAllies( int a, int b )
 {
-   Faction *fa, *fb;
-   int i;
-
    /* If they are the same they must be allies. */
    if (a==b) return 1;
 
    /* handle a */
-   if (faction_isFaction(a))
-      fa = &faction_stack[a];
-   else { /* a is invalid */
+   if (!faction_isFaction(a)) { /* a is invalid */
       WARN(_("%d is an invalid faction"), a);
       return 0;
    }
 
    /* handle b */
-   if (faction_isFaction(b))
-      fb = &faction_stack[b];
-   else { /* b is invalid */
+   if (!faction_isFaction(b)) { /* b is invalid */
       WARN(_("%d is an invalid faction"), b);
       return 0;
    }
 
-   /* we assume player becomes allies with high rating */
-   if (a==FACTION_PLAYER) {
-      return faction_isPlayerFriend(b);
+   /* The player's relations follow the standing, see faction_gridUpdatePlayer(). */
+   return faction_gridGet( faction_grid_allies, a, b );
+}
+
+
+/**
+ * @brief Sets the relation between two factions in a matrix.
+ *
+ *    @param grid Matrix to set relation in.
+ *    @param a Faction A.
+ *    @param b Faction B.
+ *    @param value Whether or not they are related.
+ */
+static void faction_gridSet( uint32_t *grid, int a, int b, int value )
+{
+   if (value) {
+      grid[ a*faction_grid_stride + (b>>5) ] |=  (1u << (b&31));
+      grid[ b*faction_grid_stride + (a>>5) ] |=  (1u << (a&31));
    }
-   else if (b==FACTION_PLAYER) {
-      return faction_isPlayerFriend(a);
+   else {
+      grid[ a*faction_grid_stride + (b>>5) ] &= ~(1u << (b&31));
+      grid[ b*faction_grid_stride + (a>>5) ] &= ~(1u << (a&31));
    }
+}
 
-   for (i=0;i<fa->nallies;i++)
+
+/**
+ * @brief Updates the relations between two factions from their lists.
+ *
+ * Factions are related if either of them lists the other.
+ *
+ *    @param a Faction A.
+ *    @param b Faction B.
+ */
+static void faction_gridUpdatePair( int a, int b )
+{
+   Faction *fa, *fb;
+   int i, enemies, allies;
+
+   if (faction_grid_enemies == NULL)
+      return;
+
+   fa = &faction_stack[a];
+   fb = &faction_stack[b];
+
+   enemies = 0;
+   for (i=0; i<fa->nenemies; i++)
+      if (fa->enemies[i] == b)
+         enemies = 1;
+   for (i=0; i<fb->nenemies; i++)
+      if (fb->enemies[i] == a)
+         enemies = 1;
+
+   allies = 0;
+   for (i=0; i<fa->nallies; i++)
       if (fa->allies[i] == b)
-         return 1;
-   for (i=0;i<fb->nallies;i++)
-      if(fb->allies[i] == a)
-         return 1;
+         allies = 1;
+   for (i=0; i<fb->nallies; i++)
+      if (fb->allies[i] == a)
+         allies = 1;
 
-   return 0;
+   faction_gridSet( faction_grid_enemies, a, b, enemies );
+   faction_gridSet( faction_grid_allies, a, b, allies );
+}
+
+
+/**
+ * @brief Updates the relations between the player and a faction.
+ *
+ * Must be called whenever the player's standing with the faction changes.
+ *
+ *    @param f Faction to update.
+ */
+static void faction_gridUpdatePlayer( int f )
+{
+   if ((faction_grid_enemies == NULL) || (f == FACTION_PLAYER))
+      return;
+
+   faction_gridSet( faction_grid_enemies, FACTION_PLAYER, f, faction_isPlayerEnemy(f) );
+   faction_gridSet( faction_grid_allies, FACTION_PLAYER, f, faction_isPlayerFriend(f) );
+}
+
+
+/**
+ * @brief Builds the relation matrices from scratch.
+ */
+static void faction_gridBuild (void)
+{
+   int i, j;
+
+   free( faction_grid_enemies );
+   free( faction_grid_allies );
+   faction_grid_stride  = (faction_nstack+31) / 32;
+   faction_grid_enemies = calloc( faction_nstack*faction_grid_stride, sizeof(uint32_t) );
+   faction_grid_allies  = calloc( faction_nstack*faction_grid_stride, sizeof(uint32_t) );
+
+   for (i=0; i<faction_nstack; i++) {
+      /* Factions are always allied to themselves. */
+      faction_gridSet( faction_grid_allies, i, i, 1 );
+
+      if (i == FACTION_PLAYER)
+         continue;
+      for (j=i+1; j<faction_nstack; j++)
+         faction_gridUpdatePair( i, j );
+      faction_gridUpdatePlayer( i );
+   }
 }
 
 
@@ -1192,9 +1273,8 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
 {
    xmlNodePtr node;
    int player;
-   char buf[PATH_MAX], *dat, *ctmp;
+   char buf[PATH_MAX], *ctmp;
    glColour *col;
-   size_t ndat;
 
    /* Clear memory. */
    memset( temp, 0, sizeof(Faction) );
@@ -1257,8 +1337,7 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
          nsnprintf( buf, sizeof(buf), "dat/factions/spawn/%s.lua", xml_raw(node) );
          temp->sched_env = nlua_newEnv(1);
          nlua_loadStandard( temp->sched_env);
-         dat = ndata_read( buf, &ndat );
-         if (nlua_dobufenv(temp->sched_env, dat, ndat, buf) != 0) {
+         if (nlua_dondataenv(temp->sched_env, buf) != 0) {
             WARN(_("Failed to run spawn script: %s\n"
                   "%s\n"
                   "Most likely Lua file has improper syntax, please check"),
@@ -1266,7 +1345,6 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
             nlua_freeEnv( temp->sched_env );
             temp->sched_env = LUA_NOREF;
          }
-         free(dat);
          continue;
       }
 
@@ -1276,8 +1354,7 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
          nsnprintf( buf, sizeof(buf), "dat/factions/standing/%s.lua", xml_raw(node) );
          temp->env = nlua_newEnv(1);
          nlua_loadStandard( temp->env );
-         dat = ndata_read( buf, &ndat );
-         if (nlua_dobufenv(temp->env, dat, ndat, buf) != 0) {
+         if (nlua_dondataenv(temp->env, buf) != 0) {
             WARN(_("Failed to run standing script: %s\n"
                   "%s\n"
                   "Most likely Lua file has improper syntax, please check"),
@@ -1285,7 +1362,6 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
             nlua_freeEnv( temp->env );
             temp->env = LUA_NOREF;
          }
-         free(dat);
          continue;
       }
 
@@ -1300,8 +1376,7 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
          nsnprintf( buf, sizeof(buf), "dat/factions/equip/%s.lua", xml_raw(node) );
          temp->equip_env = nlua_newEnv(1);
          nlua_loadStandard( temp->equip_env );
-         dat = ndata_read( buf, &ndat );
-         if (nlua_dobufenv(temp->equip_env, dat, ndat, buf) != 0) {
+         if (nlua_dondataenv(temp->equip_env, buf) != 0) {
             WARN(_("Failed to run equip script: %s\n"
                   "%s\n"
                   "Most likely Lua file has improper syntax, please check"),
@@ -1309,7 +1384,6 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
             nlua_freeEnv( temp->equip_env );
             temp->equip_env = LUA_NOREF;
          }
-         free(dat);
          continue;
       }
 
@@ -1431,6 +1505,7 @@ void factions_reset (void)
    for (i=0; i<faction_nstack; i++) {
       faction_stack[i].player = faction_stack[i].player_def;
       faction_stack[i].flags = faction_stack[i].oflags;
+      faction_gridUpdatePlayer( i );
    }
 }
 
@@ -1498,6 +1573,9 @@ int factions_load (void)
          faction_parseSocial(node);
    } while (xml_nextNode(node));
 
+   /* Build the relation matrices. */
+   faction_gridBuild();
+
 #ifdef DEBUGGING
    int i, j, k, r;
    Faction *f, *sf;
@@ -1577,6 +1655,13 @@ void factions_free (void)
    free(faction_stack);
    faction_stack = NULL;
    faction_nstack = 0;
+
+   /* Free relation matrices. */
+   free(faction_grid_enemies);
+   free(faction_grid_allies);
+   faction_grid_enemies = NULL;
+   faction_grid_allies  = NULL;
+   faction_grid_stride  = 0;
 }
 
 
@@ -1643,8 +1728,10 @@ int pfaction_load( xmlNodePtr parent )
                      if (xml_isNode(sub,"standing")) {
 
                         /* Must not be static. */
-                        if (!faction_isFlag( &faction_stack[faction], FACTION_STATIC ))
+                        if (!faction_isFlag( &faction_stack[faction], FACTION_STATIC )) {
                            faction_stack[faction].player = xml_getFloat(sub);
+                           faction_gridUpdatePlayer( faction );
+                        }
                         continue;
                      }
                      if (xml_isNode(sub,"known")) {
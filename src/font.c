@@ -7,10 +7,13 @@
  *
  * @brief OpenGL font rendering routines.
  *
- * Use a displaylist to store ASCII chars rendered with freefont
- * There are several drawing methods depending on whether you want
- * print it all, print to a max width, print centered or print a
- * block of text.
+ * Glyphs are rendered with freetype on demand and packed into the texture
+ * atlas of their font.  Text is laid out into a single vertex buffer of
+ * quads that is drawn with one call per texture/colour change, and the
+ * layouts (and measurements) are cached so static text is not laid out
+ * again every frame.  There are several drawing methods depending on
+ * whether you want print it all, print to a max width, print centered or
+ * print a block of text.
  *
  * There are hard-coded size limits.  256 characters for all routines
  * except gl_printText which has a 1024 limit.
@@ -41,9 +44,9 @@
 #define HASH_LUT_SIZE 512 /**< Size of glyph look up table. */
 #define MAX_ROWS 128 /**< Max number of rows per texture cache. */
 #define DEFAULT_TEXTURE_SIZE 1024 /**< Default size of texture caches for glyphs. */
-
-static gl_Matrix4 font_projection_mat;
-
+#define FONT_CACHE_SIZE 512 /**< Number of laid-out strings to cache, must be power of two. */
+#define FONT_VERTEX_FLOATS 4 /**< Floats per vertex (x, y, s, t). */
+#define FONT_GLYPH_FLOATS (6*FONT_VERTEX_FLOATS) /**< Floats per glyph (two triangles). */
 
 /**
  * @brief Stores the row information for a font.
@@ -71,9 +74,15 @@ typedef struct glFontGlyph_s {
    uint32_t codepoint; /**< Real character. */
    GLfloat adv_x; /**< X advancement. */
    GLfloat adv_y; /**< Y advancement. */
-   /* Offsets are stored in the VBO and thus not an issue. */
-   glFontTex *tex; /**< Might be on different texture. */
-   GLushort vbo_id; /**< VBO index to use. */
+   int tex; /**< Index of the texture in the font stash holding the glyph. */
+   GLfloat tx; /**< Left texture coordinate. */
+   GLfloat ty; /**< Top texture coordinate. */
+   GLfloat txw; /**< Right texture coordinate. */
+   GLfloat tyh; /**< Bottom texture coordinate. */
+   GLshort vx; /**< X offset of the quad from the pen position. */
+   GLshort vy; /**< Y offset of the quad from the pen position. */
+   GLshort vw; /**< Width of the quad. */
+   GLshort vh; /**< Height of the quad. */
    int next; /**< Stored as a linked list. */
 } glFontGlyph;
 
@@ -103,13 +112,7 @@ typedef struct glFontStash_s {
    int h; /**< Font height. */
    int tw; /**< Width of textures. */
    int th; /**< Height of textures. */
-   glFontTex *tex; /**< Textures. */
-   gl_vbo *vbo_tex; /**< VBO associated to texture coordinates. */
-   gl_vbo *vbo_vert; /**< VBO associated to vertex coordinates. */
-   GLfloat *vbo_tex_data; /**< Copy of texture coordinate data. */
-   GLshort *vbo_vert_data; /**< Copy of vertex coordinate data. */
-   int nvbo; /**< Amount of vbo data. */
-   int mvbo; /**< Amount of vbo memory. */
+   glFontTex *tex; /**< Textures, glyphs of all strings are packed in them. */
    glFontGlyph *glyphs; /**< Unicode glyphs. */
    int lut[HASH_LUT_SIZE]; /**< Look up table. */
 
@@ -120,10 +123,65 @@ typedef struct glFontStash_s {
    FT_Byte *fontdata; /**< Font data buffer. */
 } glFontStash;
 
+
+/**
+ * @brief A single draw call of laid-out text.
+ *
+ * Glyphs are only split into different calls when they change texture or colour.
+ */
+typedef struct glFontBatch_s {
+   int tex; /**< Index of the texture in the font stash. */
+   const glColour *col; /**< Colour to use, NULL is the colour passed when rendering. */
+   GLint first; /**< First vertex. */
+   GLsizei count; /**< Number of vertices. */
+} glFontBatch;
+
+
+/**
+ * @brief Types of cached text.
+ */
+typedef enum glFontCacheType_e {
+   FONT_CACHE_NONE, /**< Unused entry. */
+   FONT_CACHE_RAW, /**< gl_printRaw. */
+   FONT_CACHE_MAX, /**< gl_printMaxRaw. */
+   FONT_CACHE_MID, /**< gl_printMidRaw. */
+   FONT_CACHE_TEXT, /**< gl_printTextRaw. */
+   FONT_CACHE_WIDTH, /**< gl_printWidthRaw. */
+   FONT_CACHE_HEIGHT /**< gl_printHeightRaw. */
+} glFontCacheType;
+
+
+/**
+ * @brief Text that has already been laid out (or measured).
+ *
+ * Vertices are relative to the position the text is rendered at, so the
+ * same entry can be drawn anywhere on the screen.
+ */
+typedef struct glFontCache_s {
+   /* Key. */
+   glFontCacheType type; /**< Type of the entry. */
+   uint32_t hash; /**< Hash of the whole key. */
+   int font; /**< Font stash id. */
+   int width; /**< Width limit used. */
+   int height; /**< Height limit used. */
+   const glColour *col; /**< Colour the text starts with (restored colour), NULL is the base colour. */
+   char *str; /**< The text itself (array.h), reused between keys. */
+
+   /* Value. */
+   int ret; /**< Return value of the function that generated the entry. */
+   GLfloat ox; /**< X offset to render at. */
+   GLfloat oy; /**< Y offset to render at. */
+   GLfloat *vbo_data; /**< Interleaved vertex and texture coordinates (array.h). */
+   glFontBatch *batches; /**< Draw calls (array.h). */
+   int setcol; /**< Whether or not the text changes the colour with escape sequences. */
+   const glColour *lastcol; /**< Colour active at the end of the text if setcol is set. */
+} glFontCache;
+
 /**
  * Available fonts stashes.
  */
 static glFontStash *avail_fonts = NULL;  /**< These are pointed to by the font struct exposed in font.h. */
+static int font_nstash = 0; /**< Number of fonts currently loaded. */
 
 /* default font */
 glFont gl_defFont; /**< Default font. */
@@ -136,6 +194,14 @@ static const glColour *font_lastCol    = NULL; /**< Stores last colour used (act
 static int font_restoreLast      = 0; /**< Restore last colour. */
 
 
+/* Text layout. */
+static glFontCache font_cache[ FONT_CACHE_SIZE ]; /**< Laid-out text cache, direct mapped. */
+static GLfloat font_penX = 0.; /**< Current X position of the layout being generated. */
+static GLfloat font_penY = 0.; /**< Current Y position of the layout being generated. */
+static const glColour *font_penCol = NULL; /**< Current colour of the layout being generated. */
+static gl_vbo *font_vbo = NULL; /**< Stream VBO all the text is drawn from. */
+
+
 /*
  * prototypes
  */
@@ -144,14 +210,17 @@ static size_t font_limitSize( glFontStash *ft_font, int *width,
 static const glColour* gl_fontGetColour( uint32_t ch );
 /* Get unicode glyphs from cache. */
 static glFontGlyph* gl_fontGetGlyph( glFontStash *stsh, uint32_t ch );
-/* Render.
- * TODO this should be changed to be more like font-stash (https://github.com/akrinke/Font-Stash)
- * In particular, instead of writing char by char, they should be batched up by textures and rendered
- * when gl_fontRenderEnd() is called, saving lots of opengl calls.
- */
-static void gl_fontRenderStart( const glFontStash *stsh, double x, double y, const glColour *c );
-static int gl_fontRenderGlyph( glFontStash *stsh, uint32_t ch, const glColour *c, int state );
-static void gl_fontRenderEnd (void);
+/* Layout cache. */
+static glFontCache* gl_fontCacheGet( const glFont *font, glFontCacheType type,
+      const char *text, int width, int height, const glColour *col, int *hit );
+static void gl_fontCacheFlush( int font );
+static const glColour* gl_fontRestoreColour (void);
+/* Render. */
+static void gl_fontLayoutStart( glFontCache *cache, const glColour *col );
+static void gl_fontLayoutMove( GLfloat x, GLfloat y );
+static int gl_fontLayoutGlyph( glFontStash *stsh, glFontCache *cache, uint32_t ch, int state );
+static void gl_fontLayoutRender( const glFontStash *stsh, const glFontCache *cache,
+      double x, double y, const glColour *c );
 
 
 /**
@@ -168,21 +237,17 @@ static glFontStash *gl_fontGetStash( const glFont *font )
  */
 static int gl_fontAddGlyphTex( glFontStash *stsh, font_char_t *ch, glFontGlyph *glyph )
 {
-   int i, j, n;
-   GLubyte *data;
-   glFontRow *r, *gr;
+   int i, j;
+   glFontRow *r, *lr, *gr;
    glFontTex *tex;
-   GLfloat *vbo_tex;
-   GLshort *vbo_vert;
-   GLfloat tx, ty, txw, tyh;
    GLfloat fw, fh;
-   GLshort vx, vy, vw, vh;
 
    /* Find free row. */
-   gr = NULL;
-   for (i=0; i<array_size( stsh->tex ); i++) {
+   tex = NULL;
+   gr  = NULL;
+   for (i=0; (i<array_size( stsh->tex )) && (gr==NULL); i++) {
       for (j=0; j<MAX_ROWS; j++) {
-         r = &stsh->tex->rows[j];
+         r = &stsh->tex[i].rows[j];
          /* Fits in current row, so use that. */
          if ((r->h == ch->h) && (r->x+ch->w < stsh->tw)) {
             tex = &stsh->tex[i];
@@ -192,22 +257,23 @@ static int gl_fontAddGlyphTex( glFontStash *stsh, font_char_t *ch, glFontGlyph *
          /* If not empty row, skip. */
          if (r->h != 0)
             continue;
-         /* See if height fits. */
-         if ((j==0) || (stsh->tex->rows[j-1].y+stsh->tex->rows[j-1].h+ch->h < stsh->th)) {
-            r->h = ch->h;
-            if (j>0)
-               r->y = stsh->tex->rows[j-1].y + stsh->tex->rows[j-1].h;
-            tex = &stsh->tex[i];
-            gr = r;
+         /* See if height fits, if not the texture is full. */
+         lr = (j>0) ? &stsh->tex[i].rows[j-1] : NULL;
+         if ((lr != NULL) && (lr->y+lr->h+ch->h >= stsh->th))
             break;
-         }
+         r->h = ch->h;
+         if (lr != NULL)
+            r->y = lr->y + lr->h;
+         tex = &stsh->tex[i];
+         gr = r;
+         break;
       }
    }
 
    /* Allocate new texture. */
    if (gr == NULL) {
       tex = &array_grow( &stsh->tex );
-      memset( stsh->tex, 0, sizeof(glFontTex) );
+      memset( tex, 0, sizeof(glFontTex) );
 
       glGenTextures( 1, &tex->id );
       glBindTexture( GL_TEXTURE_2D, tex->id );
@@ -240,16 +306,6 @@ static int gl_fontAddGlyphTex( glFontStash *stsh, font_char_t *ch, glFontGlyph *
    /* Check for error. */
    gl_checkErr();
 
-   /* Update VBOs. */
-   stsh->nvbo++;
-   if (stsh->nvbo > stsh->mvbo) {
-      stsh->mvbo *= 2;
-      stsh->vbo_tex_data  = realloc( stsh->vbo_tex_data,  8*stsh->mvbo*sizeof(GLfloat) );
-      stsh->vbo_vert_data = realloc( stsh->vbo_vert_data, 8*stsh->mvbo*sizeof(GLshort) );
-   }
-   n = 8*stsh->nvbo;
-   vbo_tex  = &stsh->vbo_tex_data[n-8];
-   vbo_vert = &stsh->vbo_vert_data[n-8];
    /* We do something like the following for vertex coordinates.
       *
       *
@@ -273,51 +329,22 @@ static int gl_fontAddGlyphTex( glFontStash *stsh, font_char_t *ch, glFontGlyph *
       *  \----/
       *   off_x
       */
-   /* Temporary variables. */
    fw  = (GLfloat) stsh->tw;
    fh  = (GLfloat) stsh->th;
-   tx  = (GLfloat) gr->x / fw;
-   ty  = (GLfloat) gr->y / fh;
-   txw = (GLfloat) (gr->x + ch->w) / fw;
-   tyh = (GLfloat) (gr->y + ch->h) / fh;
-   vx  = ch->off_x;
-   vy  = ch->off_y - ch->h;
-   vw  = ch->w;
-   vh  = ch->h;
-   /* Texture coords. */
-   vbo_tex[ 0 ] = tx;  /* Top left. */
-   vbo_tex[ 1 ] = ty;
-   vbo_tex[ 2 ] = txw; /* Top right. */
-   vbo_tex[ 3 ] = ty;
-   vbo_tex[ 4 ] = tx;  /* Bottom left. */
-   vbo_tex[ 5 ] = tyh;
-   vbo_tex[ 6 ] = txw; /* Bottom right. */
-   vbo_tex[ 7 ] = tyh;
-   /* Vertex coords. */
-   vbo_vert[ 0 ] = vx;    /* Top left. */
-   vbo_vert[ 1 ] = vy+vh;
-   vbo_vert[ 2 ] = vx+vw; /* Top right. */
-   vbo_vert[ 3 ] = vy+vh;
-   vbo_vert[ 4 ] = vx;    /* Bottom left. */
-   vbo_vert[ 5 ] = vy;
-   vbo_vert[ 6 ] = vx+vw; /* Bottom right. */
-   vbo_vert[ 7 ] = vy;
-   /* Update vbos. */
-   gl_vboData( stsh->vbo_tex,  sizeof(GLfloat)*n,  stsh->vbo_tex_data );
-   gl_vboData( stsh->vbo_vert, sizeof(GLshort)*n, stsh->vbo_vert_data );
+   glyph->tx  = (GLfloat) gr->x / fw;
+   glyph->ty  = (GLfloat) gr->y / fh;
+   glyph->txw = (GLfloat) (gr->x + ch->w) / fw;
+   glyph->tyh = (GLfloat) (gr->y + ch->h) / fh;
+   glyph->vx  = ch->off_x;
+   glyph->vy  = ch->off_y - ch->h;
+   glyph->vw  = ch->w;
+   glyph->vh  = ch->h;
 
    /* Add space for the new character. */
    gr->x += ch->w;
 
    /* Save glyph data. */
-   glyph->vbo_id = (n-8)/2;
-   glyph->tex = tex;
-
-   /* Since the VBOs have possibly changed, we have to reset the data. */
-   gl_vboActivateAttribOffset( stsh->vbo_vert, shaders.font.vertex,
-         0, 2, GL_SHORT, 0 );
-   gl_vboActivateAttribOffset( stsh->vbo_tex, shaders.font.tex_coord,
-         0, 2, GL_FLOAT, 0 );
+   glyph->tex = tex - stsh->tex;
 
    return 0;
 }
@@ -535,21 +562,27 @@ void gl_printRaw( const glFont *ft_font,
       const double x, const double y,
       const glColour* c, const char *text )
 {
-   int s;
+   int s, hit;
    size_t i;
    uint32_t ch;
+   glFontCache *cache;
 
    if (ft_font == NULL)
       ft_font = &gl_defFont;
    glFontStash *stsh = gl_fontGetStash( ft_font );
 
+   /* Lay it out if not cached. */
+   cache = gl_fontCacheGet( ft_font, FONT_CACHE_RAW, text, -1, -1, gl_fontRestoreColour(), &hit );
+   if (!hit) {
+      s = 0;
+      i = 0;
+      gl_fontLayoutStart( cache, cache->col );
+      while ((ch = u8_nextchar( text, &i )))
+         s = gl_fontLayoutGlyph( stsh, cache, ch, s );
+   }
+
    /* Render it. */
-   s = 0;
-   i = 0;
-   gl_fontRenderStart(stsh, x, y, c);
-   while ((ch = u8_nextchar( text, &i )))
-      s = gl_fontRenderGlyph( stsh, ch, c, s );
-   gl_fontRenderEnd();
+   gl_fontLayoutRender( stsh, cache, x, y, c );
 }
 
 
@@ -598,26 +631,33 @@ int gl_printMaxRaw( const glFont *ft_font, const int max,
       const double x, const double y,
       const glColour* c, const char *text )
 {
-   int s;
+   int s, hit;
    size_t ret, i;
    uint32_t ch;
+   glFontCache *cache;
 
    if (ft_font == NULL)
       ft_font = &gl_defFont;
    glFontStash *stsh = gl_fontGetStash( ft_font );
 
-   /* Limit size. */
-   ret = font_limitSize( stsh, NULL, text, max );
+   cache = gl_fontCacheGet( ft_font, FONT_CACHE_MAX, text, max, -1, gl_fontRestoreColour(), &hit );
+   if (!hit) {
+      /* Limit size. */
+      ret = font_limitSize( stsh, NULL, text, max );
+      cache->ret = ret;
+
+      /* Lay it out. */
+      s = 0;
+      gl_fontLayoutStart( cache, cache->col );
+      i = 0;
+      while ((ch = u8_nextchar( text, &i )) && (i <= ret))
+         s = gl_fontLayoutGlyph( stsh, cache, ch, s );
+   }
 
    /* Render it. */
-   s = 0;
-   gl_fontRenderStart(stsh, x, y, c);
-   i = 0;
-   while ((ch = u8_nextchar( text, &i )) && (i <= ret))
-      s = gl_fontRenderGlyph( stsh, ch, c, s );
-   gl_fontRenderEnd();
+   gl_fontLayoutRender( stsh, cache, x, y, c );
 
-   return ret;
+   return cache->ret;
 }
 /**
  * @brief Behaves like gl_print but stops displaying text after reaching a certain length.
@@ -667,27 +707,34 @@ int gl_printMidRaw( const glFont *ft_font, const int width,
       const glColour* c, const char *text )
 {
    /*float h = ft_font->h / .63;*/ /* slightly increase fontsize */
-   int n, s;
+   int n, s, hit;
    size_t ret, i;
    uint32_t ch;
+   glFontCache *cache;
 
    if (ft_font == NULL)
       ft_font = &gl_defFont;
    glFontStash *stsh = gl_fontGetStash( ft_font );
 
-   /* limit size */
-   ret = font_limitSize( stsh, &n, text, width );
-   x += (double)(width - n)/2.;
+   cache = gl_fontCacheGet( ft_font, FONT_CACHE_MID, text, width, -1, gl_fontRestoreColour(), &hit );
+   if (!hit) {
+      /* limit size */
+      ret = font_limitSize( stsh, &n, text, width );
+      cache->ret = ret;
+      cache->ox  = (GLfloat)(width - n)/2.;
+
+      /* Lay it out. */
+      s = 0;
+      gl_fontLayoutStart( cache, cache->col );
+      i = 0;
+      while ((ch = u8_nextchar( text, &i )) && (i <= ret))
+         s = gl_fontLayoutGlyph( stsh, cache, ch, s );
+   }
 
    /* Render it. */
-   s = 0;
-   gl_fontRenderStart(stsh, x, y, c);
-   i = 0;
-   while ((ch = u8_nextchar( text, &i )) && (i <= ret))
-      s = gl_fontRenderGlyph( stsh, ch, c, s );
-   gl_fontRenderEnd();
+   gl_fontLayoutRender( stsh, cache, x, y, c );
 
-   return ret;
+   return cache->ret;
 }
 /**
  * @brief Displays text centered in position and width.
@@ -741,46 +788,49 @@ int gl_printTextRaw( const glFont *ft_font,
       double bx, double by,
       const glColour* c, const char *text )
 {
-   int p, s;
-   double x,y;
+   int p, s, hit;
+   double y;
    size_t i, ret;
    uint32_t ch;
+   glFontCache *cache;
 
    if (ft_font == NULL)
       ft_font = &gl_defFont;
    glFontStash *stsh = gl_fontGetStash( ft_font );
 
-   x = bx;
-   y = by + height - (double)stsh->h; /* y is top left corner */
-
-   /* Clears restoration. */
+   /* Clears restoration, colours carry over from line to line on their own. */
    gl_printRestoreClear();
+   font_restoreLast = 0;
 
-   i = 0;
-   s = 0;
-   p = 0; /* where we last drew up to */
-   while (y - by > -1e-5) {
-      ret = p + gl_printWidthForText( ft_font, &text[p], width );
-
-      /* Must restore stuff. */
-      gl_printRestoreLast();
-
-      /* Render it. */
-      gl_fontRenderStart(stsh, x, y, c);
-      for (i=p; i<ret; ) {
-         ch = u8_nextchar( text, &i);
-         s = gl_fontRenderGlyph( stsh, ch, c, s );
-      }
-      gl_fontRenderEnd();
+   cache = gl_fontCacheGet( ft_font, FONT_CACHE_TEXT, text, width, height, NULL, &hit );
+   if (!hit) {
+      /* Lay it out relative to the top left corner. */
+      cache->oy = height - stsh->h;
+      gl_fontLayoutStart( cache, NULL );
+
+      y = 0.;
+      s = 0;
+      p = 0; /* where we last drew up to */
+      while (cache->oy + y > -1e-5) {
+         ret = p + gl_printWidthForText( ft_font, &text[p], width );
+
+         gl_fontLayoutMove( 0., round(y) );
+         for (i=p; i<ret; ) {
+            ch = u8_nextchar( text, &i);
+            s = gl_fontLayoutGlyph( stsh, cache, ch, s );
+         }
 
-      if (ch == '\0')
-         break;
-      p = i;
-      if ((text[p] == '\n') || (text[p] == ' '))
-         p++; /* Skip "empty char". */
-      y -= 1.5*(double)stsh->h; /* move position down */
+         if (text[ret] == '\0')
+            break;
+         p = ret;
+         if ((text[p] == '\n') || (text[p] == ' '))
+            p++; /* Skip "empty char". */
+         y -= 1.5*(double)stsh->h; /* move position down */
+      }
    }
 
+   /* Render it. */
+   gl_fontLayoutRender( stsh, cache, bx, by, c );
 
    return 0;
 }
@@ -835,11 +885,18 @@ int gl_printWidthRaw( const glFont *ft_font, const char *text )
    GLfloat n;
    size_t i;
    uint32_t ch;
+   int hit;
+   glFontCache *cache;
 
    if (ft_font == NULL)
       ft_font = &gl_defFont;
    glFontStash *stsh = gl_fontGetStash( ft_font );
 
+   /* Already measured. */
+   cache = gl_fontCacheGet( ft_font, FONT_CACHE_WIDTH, text, -1, -1, NULL, &hit );
+   if (hit)
+      return cache->ret;
+
    n = 0.;
    i = 0;
    while ((ch = u8_nextchar( text, &i ))) {
@@ -856,7 +913,8 @@ int gl_printWidthRaw( const glFont *ft_font, const char *text )
       n += glyph->adv_x;
    }
 
-   return (int)n;
+   cache->ret = (int)n;
+   return cache->ret;
 }
 
 
@@ -898,8 +956,9 @@ int gl_printWidth( const glFont *ft_font, const char *fmt, ... )
 int gl_printHeightRaw( const glFont *ft_font,
       const int width, const char *text )
 {
-   int i, p;
+   int i, p, hit;
    double y;
+   glFontCache *cache;
 
    if (ft_font == NULL)
       ft_font = &gl_defFont;
@@ -908,6 +967,11 @@ int gl_printHeightRaw( const glFont *ft_font,
    if (text[0] == '\0')
       return 0;
 
+   /* Already measured. */
+   cache = gl_fontCacheGet( ft_font, FONT_CACHE_HEIGHT, text, width, -1, NULL, &hit );
+   if (hit)
+      return cache->ret;
+
    y = 0.;
    p = 0;
    do {
@@ -916,7 +980,8 @@ int gl_printHeightRaw( const glFont *ft_font,
       y += 1.5*(double)ft_font->h; /* move position down */
    } while (text[p-1] != '\0');
 
-   return (int) (y - 0.5*(double)ft_font->h);
+   cache->ret = (int) (y - 0.5*(double)ft_font->h);
+   return cache->ret;
 }
 
 /**
@@ -997,36 +1062,158 @@ static int font_makeChar( glFontStash *stsh, font_char_t *c, uint32_t ch )
 
 
 /**
- * @brief Starts the rendering engine.
+ * @brief Gets the colour text should start with taking into account restoration.
+ *
+ *    @return Colour to start with or NULL if the base colour should be used.
  */
-static void gl_fontRenderStart( const glFontStash* font, double x, double y, const glColour *c )
+static const glColour* gl_fontRestoreColour (void)
 {
-   double a;
+   return font_restoreLast ? font_lastCol : NULL;
+}
 
-   glUseProgram(shaders.font.program);
 
-   font_projection_mat = gl_Matrix4_Translate(gl_view_matrix, round(x), round(y), 0);
+/**
+ * @brief Hashes a string with the rest of the cache key (FNV-1a).
+ */
+static uint32_t gl_fontCacheHash( int font, glFontCacheType type,
+      const char *text, int width, int height, const glColour *col )
+{
+   uint32_t h;
+   size_t i;
 
-   /* Handle colour. */
-   if (font_restoreLast) {
-      a   = (c==NULL) ? 1. : c->a;
-      gl_uniformAColor(shaders.font.color, font_lastCol, a);
+   h = 2166136261u;
+   for (i=0; text[i]!='\0'; i++) {
+      h ^= (unsigned char)text[i];
+      h *= 16777619u;
    }
-   else {
-      if (c==NULL)
-         gl_uniformColor(shaders.font.color, &cWhite);
-      else
-         gl_uniformColor(shaders.font.color, c);
+   h ^= (uint32_t)font;
+   h *= 16777619u;
+   h ^= (uint32_t)type;
+   h *= 16777619u;
+   h ^= (uint32_t)width;
+   h *= 16777619u;
+   h ^= (uint32_t)height;
+   h *= 16777619u;
+   h ^= (uint32_t)((uintptr_t)col >> 4);
+   h *= 16777619u;
+   return h;
+}
+
+
+/**
+ * @brief Gets the cache entry for a piece of text.
+ *
+ * On a miss the entry is taken over for the new key and must be filled in
+ * by the caller.
+ *
+ *    @param font Font being used.
+ *    @param type Type of entry.
+ *    @param text Text being rendered or measured.
+ *    @param width Width limit or -1.
+ *    @param height Height limit or -1.
+ *    @param col Colour the text starts with, NULL for the base colour.
+ *    @param[out] hit Set to 1 if the entry was already laid out, 0 otherwise.
+ *    @return The cache entry for the text.
+ */
+static glFontCache* gl_fontCacheGet( const glFont *font, glFontCacheType type,
+      const char *text, int width, int height, const glColour *col, int *hit )
+{
+   uint32_t h;
+   size_t len;
+   glFontCache *cache;
+
+   h     = gl_fontCacheHash( font->id, type, text, width, height, col );
+   cache = &font_cache[ h & (FONT_CACHE_SIZE-1) ];
+
+   /* See if it's what we are looking for. */
+   if ((cache->type == type) && (cache->hash == h) && (cache->font == font->id) &&
+         (cache->width == width) && (cache->height == height) &&
+         (cache->col == col) && (strcmp( cache->str, text )==0)) {
+      *hit = 1;
+      return cache;
    }
-   font_restoreLast = 0;
 
-   /* Activate the appropriate VBOs. */
-   glEnableVertexAttribArray( shaders.font.vertex );
-   gl_vboActivateAttribOffset( font->vbo_vert, shaders.font.vertex,
-         0, 2, GL_SHORT, 0 );
-   glEnableVertexAttribArray( shaders.font.tex_coord );
-   gl_vboActivateAttribOffset( font->vbo_tex, shaders.font.tex_coord,
-         0, 2, GL_FLOAT, 0 );
+   /* Take over the entry, reusing its key storage. */
+   len = strlen( text ) + 1;
+   if (cache->str == NULL)
+      cache->str = array_create( char );
+   array_resize( &cache->str, len );
+   memcpy( cache->str, text, len );
+   cache->type    = type;
+   cache->hash    = h;
+   cache->font    = font->id;
+   cache->width   = width;
+   cache->height  = height;
+   cache->col     = col;
+   cache->ret     = 0;
+   cache->ox      = 0.;
+   cache->oy      = 0.;
+   cache->setcol  = 0;
+   cache->lastcol = NULL;
+   if (cache->vbo_data != NULL)
+      array_resize( &cache->vbo_data, 0 );
+   if (cache->batches != NULL)
+      array_resize( &cache->batches, 0 );
+   *hit = 0;
+   return cache;
+}
+
+
+/**
+ * @brief Flushes entries from the layout cache.
+ *
+ *    @param font Font to flush entries of or -1 to flush all and free memory.
+ */
+static void gl_fontCacheFlush( int font )
+{
+   int i;
+   glFontCache *cache;
+
+   for (i=0; i<FONT_CACHE_SIZE; i++) {
+      cache = &font_cache[i];
+      if ((font >= 0) && ((cache->type == FONT_CACHE_NONE) || (cache->font != font)))
+         continue;
+      cache->type = FONT_CACHE_NONE;
+      if (font >= 0)
+         continue;
+      if (cache->str != NULL)
+         array_free( cache->str );
+      cache->str = NULL;
+      if (cache->vbo_data != NULL)
+         array_free( cache->vbo_data );
+      cache->vbo_data = NULL;
+      if (cache->batches != NULL)
+         array_free( cache->batches );
+      cache->batches = NULL;
+   }
+}
+
+
+/**
+ * @brief Starts laying out text into a cache entry.
+ *
+ *    @param cache Cache entry to lay out into.
+ *    @param col Colour to start with (NULL is the base colour).
+ */
+static void gl_fontLayoutStart( glFontCache *cache, const glColour *col )
+{
+   if (cache->vbo_data == NULL)
+      cache->vbo_data = array_create( GLfloat );
+   if (cache->batches == NULL)
+      cache->batches  = array_create( glFontBatch );
+   font_penX   = 0.;
+   font_penY   = 0.;
+   font_penCol = col;
+}
+
+
+/**
+ * @brief Moves the layout pen to a new position relative to the text origin.
+ */
+static void gl_fontLayoutMove( GLfloat x, GLfloat y )
+{
+   font_penX = x;
+   font_penY = y;
 }
 
 
@@ -1113,7 +1300,7 @@ static glFontGlyph* gl_fontGetGlyph( glFontStash *stsh, uint32_t ch )
    /* Create new character. */
    glyph = &array_grow( &stsh->glyphs );
    glyph->codepoint = ch;
-   glyph->tex   = NULL;
+   glyph->tex   = -1;
    glyph->adv_x = ft_char.adv_x;
    glyph->adv_y = ft_char.adv_y;
    glyph->next  = -1;
@@ -1144,29 +1331,23 @@ static glFontGlyph* gl_fontGetGlyph( glFontStash *stsh, uint32_t ch )
 
 
 /**
- * @brief Renders a character.
+ * @brief Lays out a character, appending its quad to the cache entry.
  */
-static int gl_fontRenderGlyph( glFontStash* stsh, uint32_t ch, const glColour *c, int state )
+static int gl_fontLayoutGlyph( glFontStash* stsh, glFontCache *cache, uint32_t ch, int state )
 {
-   double a;
-   const glColour *col;
+   int n;
+   GLfloat *v;
+   GLfloat x, y, w, h;
+   glFontBatch *batch;
 
    /* Handle escape sequences. */
    if (ch == '\a') {/* Start sequence. */
       return 1;
    }
    if (state == 1) {
-      col = gl_fontGetColour( ch );
-      a   = (c==NULL) ? 1. : c->a;
-      if (col == NULL) {
-         if (c==NULL)
-            gl_uniformColor(shaders.font.color, &cWhite);
-         else
-            gl_uniformColor(shaders.font.color, c);
-      }
-      else
-         gl_uniformAColor(shaders.font.color, col, a);
-      font_lastCol = col;
+      font_penCol    = gl_fontGetColour( ch );
+      cache->setcol  = 1;
+      cache->lastcol = font_penCol;
       return 0;
    }
 
@@ -1179,27 +1360,114 @@ static int gl_fontRenderGlyph( glFontStash* stsh, uint32_t ch, const glColour *c
       return -1;
    }
 
-   /* Activate texture. */
-   glBindTexture(GL_TEXTURE_2D, glyph->tex->id);
-
-   gl_Matrix4_Uniform(shaders.font.projection, font_projection_mat);
-
-   /* Draw the element. */
-   glDrawArrays( GL_TRIANGLE_STRIP, glyph->vbo_id, 4 );
+   /* Start a new draw call if the state changed. */
+   n = array_size( cache->batches );
+   batch = (n > 0) ? &cache->batches[n-1] : NULL;
+   if ((batch == NULL) || (batch->tex != glyph->tex) || (batch->col != font_penCol)) {
+      batch = &array_grow( &cache->batches );
+      batch->tex   = glyph->tex;
+      batch->col   = font_penCol;
+      batch->first = array_size( cache->vbo_data ) / FONT_VERTEX_FLOATS;
+      batch->count = 0;
+   }
 
-   /* Translate matrix. */
-   font_projection_mat = gl_Matrix4_Translate( font_projection_mat,
-         glyph->adv_x, glyph->adv_y, 0 );
+   /* Two triangles per glyph so the whole text is a single GL_TRIANGLES call. */
+   n = array_size( cache->vbo_data );
+   array_resize( &cache->vbo_data, n + FONT_GLYPH_FLOATS );
+   v = &cache->vbo_data[n];
+   x = font_penX + glyph->vx;
+   y = font_penY + glyph->vy;
+   w = glyph->vw;
+   h = glyph->vh;
+   /* Top left. */
+   v[ 0] = x;   v[ 1] = y+h; v[ 2] = glyph->tx;  v[ 3] = glyph->ty;
+   /* Top right. */
+   v[ 4] = x+w; v[ 5] = y+h; v[ 6] = glyph->txw; v[ 7] = glyph->ty;
+   /* Bottom left. */
+   v[ 8] = x;   v[ 9] = y;   v[10] = glyph->tx;  v[11] = glyph->tyh;
+   /* Top right. */
+   v[12] = x+w; v[13] = y+h; v[14] = glyph->txw; v[15] = glyph->ty;
+   /* Bottom left. */
+   v[16] = x;   v[17] = y;   v[18] = glyph->tx;  v[19] = glyph->tyh;
+   /* Bottom right. */
+   v[20] = x+w; v[21] = y;   v[22] = glyph->txw; v[23] = glyph->tyh;
+   batch->count += 6;
+
+   /* Advance pen. */
+   font_penX += glyph->adv_x;
+   font_penY += glyph->adv_y;
 
    return 0;
 }
 
 
 /**
- * @brief Ends the rendering engine.
+ * @brief Renders laid-out text.
+ *
+ * All the vertices are uploaded at once and there is one draw call per batch,
+ * which is usually one for the entire text.
+ *
+ *    @param stsh Font stash the text was laid out with.
+ *    @param cache Laid-out text.
+ *    @param x X position to render at.
+ *    @param y Y position to render at.
+ *    @param c Base colour (NULL is white).
  */
-static void gl_fontRenderEnd (void)
+static void gl_fontLayoutRender( const glFontStash *stsh, const glFontCache *cache,
+      double x, double y, const glColour *c )
 {
+   int i, tex;
+   GLsizei size;
+   double a;
+   const glFontBatch *batch;
+   gl_Matrix4 projection;
+
+   /* Colour escapes affect whatever gets printed next. */
+   font_restoreLast = 0;
+   if (cache->setcol)
+      font_lastCol = cache->lastcol;
+
+   /* Nothing to draw. */
+   if (array_size( cache->batches ) == 0)
+      return;
+
+   /* Upload all the vertices at once. */
+   size = sizeof(GLfloat) * array_size( cache->vbo_data );
+   gl_vboData( font_vbo, size, cache->vbo_data );
+
+   glUseProgram(shaders.font.program);
+
+   projection = gl_Matrix4_Translate(gl_view_matrix,
+         round(x + cache->ox), round(y + cache->oy), 0);
+   gl_Matrix4_Uniform(shaders.font.projection, projection);
+
+   glEnableVertexAttribArray( shaders.font.vertex );
+   gl_vboActivateAttribOffset( font_vbo, shaders.font.vertex,
+         0, 2, GL_FLOAT, FONT_VERTEX_FLOATS*sizeof(GLfloat) );
+   glEnableVertexAttribArray( shaders.font.tex_coord );
+   gl_vboActivateAttribOffset( font_vbo, shaders.font.tex_coord,
+         2*sizeof(GLfloat), 2, GL_FLOAT, FONT_VERTEX_FLOATS*sizeof(GLfloat) );
+
+   /* Draw the batches. */
+   a   = (c==NULL) ? 1. : c->a;
+   tex = -1;
+   for (i=0; i<array_size( cache->batches ); i++) {
+      batch = &cache->batches[i];
+      if (batch->col == NULL) {
+         if (c==NULL)
+            gl_uniformColor(shaders.font.color, &cWhite);
+         else
+            gl_uniformColor(shaders.font.color, c);
+      }
+      else
+         gl_uniformAColor(shaders.font.color, batch->col, a);
+      if (batch->tex != tex) {
+         tex = batch->tex;
+         glBindTexture( GL_TEXTURE_2D, stsh->tex[tex].id );
+      }
+      glDrawArrays( GL_TRIANGLES, batch->first, batch->count );
+   }
+
    glDisableVertexAttribArray( shaders.font.vertex );
    glDisableVertexAttribArray( shaders.font.tex_coord );
    glUseProgram(0);
@@ -1208,6 +1476,7 @@ static void gl_fontRenderEnd (void)
    gl_checkErr();
 }
 
+
 /**
  * @brief Tries to find a system font.
  */
@@ -1361,12 +1630,10 @@ int gl_fontInit( glFont* font, const char *fname, const char *fallback, const un
    stsh->library  = library;
    stsh->fontdata = buf;
 
-   /* Set up VBOs. */
-   stsh->mvbo = 256;
-   stsh->vbo_tex_data  = calloc( 8*stsh->mvbo, sizeof(GLfloat) );
-   stsh->vbo_vert_data = calloc( 8*stsh->mvbo, sizeof(GLshort) );
-   stsh->vbo_tex  = gl_vboCreateStatic( sizeof(GLfloat)*8*stsh->mvbo,  stsh->vbo_tex_data );
-   stsh->vbo_vert = gl_vboCreateStatic( sizeof(GLshort)*8*stsh->mvbo, stsh->vbo_vert_data );
+   /* Set up the VBO shared by all the fonts. */
+   if (font_vbo == NULL)
+      font_vbo = gl_vboCreateStream( sizeof(GLfloat)*FONT_GLYPH_FLOATS*256, NULL );
+   font_nstash++;
 
    /* Initializes ASCII. */
    for (i=0; i<128; i++)
@@ -1405,19 +1672,26 @@ void gl_freeFont( glFont* font )
    free(stsh->fontdata);
 
    for (i=0; i<array_size(stsh->tex); i++)
-      glDeleteTextures( 1, &stsh->tex->id );
+      glDeleteTextures( 1, &stsh->tex[i].id );
    array_free( stsh->tex );
    stsh->tex = NULL;
 
    if (stsh->glyphs != NULL)
       array_free( stsh->glyphs );
    stsh->glyphs = NULL;
-   if (stsh->vbo_tex != NULL)
-      gl_vboDestroy(stsh->vbo_tex);
-   stsh->vbo_tex = NULL;
-   if (stsh->vbo_vert != NULL)
-      gl_vboDestroy(stsh->vbo_vert);
-   stsh->vbo_vert = NULL;
+
+   /* Laid-out text refers to the textures. */
+   gl_fontCacheFlush( font->id );
+
+   /* Last font cleans up shared data. */
+   font_nstash--;
+   if (font_nstash <= 0) {
+      gl_fontCacheFlush( -1 );
+      if (font_vbo != NULL)
+         gl_vboDestroy( font_vbo );
+      font_vbo = NULL;
+      font_nstash = 0;
+   }
 }
 
 
@@ -0,0 +1,299 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file formation.c
+ *
+ * @brief Computes the formation slots of the escorts of every leader.
+ *
+ * Slots are worked out once per tick for all the followers of a leader and
+ *  the AI just looks up its own with ai.formationpos().  The layouts match
+ *  the ones in dat/scripts/formation.lua.
+ */
+
+#include "formation.h"
+
+#include "naev.h"
+
+#include <math.h>
+
+#include "nstring.h"
+
+
+#define FORMATION_BASE_RADIUS 100. /**< Distance between ships in most formations. */
+#define FORMATION_BONE_RADIUS 500. /**< Distance between rows in fishbone and chevron. */
+
+
+/**
+ * @brief Formation names, as used by the AI.
+ */
+static const char *formation_names[FORMATION_MAX] = {
+   "none",
+   "cross",
+   "buffer",
+   "vee",
+   "wedge",
+   "echelon_left",
+   "echelon_right",
+   "column",
+   "wall",
+   "fishbone",
+   "chevron",
+   "circle"
+};
+
+
+/*
+ * extern pilot hacks
+ */
+extern Pilot** pilot_stack;
+extern int pilot_nstack;
+
+
+/*
+ * Prototypes.
+ */
+static double formation_bufferRadius( ShipClass class );
+static void formation_setSlot( Pilot *leader, unsigned int id,
+      double angle, double radius, int absolute );
+static void formation_compute( Pilot *leader );
+
+
+/**
+ * @brief Gets a formation by name.
+ *
+ *    @param name Name of the formation.
+ *    @return The formation or -1 if not found.
+ */
+int formation_get( const char *name )
+{
+   int i;
+   for (i=0; i<FORMATION_MAX; i++)
+      if (strcmp( formation_names[i], name )==0)
+         return i;
+   return -1;
+}
+
+
+/**
+ * @brief Gets the name of a formation.
+ *
+ *    @param formation Formation to get name of.
+ *    @return Name of the formation.
+ */
+const char* formation_name( int formation )
+{
+   if ((formation < 0) || (formation >= FORMATION_MAX))
+      return formation_names[FORMATION_NONE];
+   return formation_names[formation];
+}
+
+
+/**
+ * @brief Gets the radius of a ship class in the buffer formation.
+ */
+static double formation_bufferRadius( ShipClass class )
+{
+   switch (class) {
+      case SHIP_CLASS_SCOUT:     return 1200.;
+      case SHIP_CLASS_DRONE:     return 1500.;
+      case SHIP_CLASS_FIGHTER:   return 900.;
+      case SHIP_CLASS_BOMBER:    return 850.;
+      case SHIP_CLASS_CORVETTE:  return 700.;
+      case SHIP_CLASS_DESTROYER: return 500.;
+      case SHIP_CLASS_CRUISER:   return 350.;
+      case SHIP_CLASS_CARRIER:   return 250.;
+      default:                   return 500.;
+   }
+}
+
+
+/**
+ * @brief Sets the formation slot of a follower.
+ *
+ *    @param leader Leader of the formation.
+ *    @param id ID of the follower.
+ *    @param angle Angle of the slot in degrees.
+ *    @param radius Distance of the slot to the leader.
+ *    @param absolute Whether the angle is absolute or relative to the
+ *           leader's velocity.
+ */
+static void formation_setSlot( Pilot *leader, unsigned int id,
+      double angle, double radius, int absolute )
+{
+   Pilot *p;
+   double a;
+
+   p = pilot_get( id );
+   if (p == NULL)
+      return;
+
+   a = angle * M_PI / 180.;
+   if (!absolute)
+      a += VANGLE( leader->solid->vel );
+   vect_cset( &p->form_point, leader->solid->pos.x + radius * cos(a),
+         leader->solid->pos.y + radius * sin(a) );
+   p->form_vel    = leader->solid->vel;
+   p->form_valid  = 1;
+}
+
+
+/**
+ * @brief Computes the slots of all the escorts of a leader.
+ *
+ *    @param leader Leader to compute slots of.
+ */
+static void formation_compute( Pilot *leader )
+{
+   int i, j, n, flip, count[SHIP_CLASS_MOTHERSHIP+1], total[SHIP_CLASS_MOTHERSHIP+1];
+   double angle, radius, base;
+   ShipClass class;
+   Pilot *p;
+
+   n = leader->nescorts;
+   switch (leader->formation) {
+      case FORMATION_CROSS:
+         angle  = 45.;
+         radius = FORMATION_BASE_RADIUS;
+         for (i=1; i<=n; i++) {
+            formation_setSlot( leader, leader->escorts[i-1].id, angle, radius, 0 );
+            angle  = fmod( angle + 90., 360. );
+            radius = FORMATION_BASE_RADIUS * (floor(i / 4.) + 1.);
+         }
+         break;
+
+      case FORMATION_BUFFER:
+         for (j=0; j<=SHIP_CLASS_MOTHERSHIP; j++) {
+            count[j] = 1;
+            total[j] = 0;
+         }
+         for (i=0; i<n; i++) {
+            p = pilot_get( leader->escorts[i].id );
+            if (p != NULL)
+               total[ p->ship->class ]++;
+         }
+         for (i=0; i<n; i++) {
+            p = pilot_get( leader->escorts[i].id );
+            if (p == NULL)
+               continue;
+            class = p->ship->class;
+            if (total[class] == 1)
+               angle = 0.;
+            else {
+               angle = (count[class]-1) * (90. / (total[class]-1)) - 45.;
+               count[class]++;
+            }
+            formation_setSlot( leader, p->id, angle, formation_bufferRadius(class), 0 );
+         }
+         break;
+
+      case FORMATION_VEE:
+         angle  = 45.;
+         radius = FORMATION_BASE_RADIUS;
+         for (i=1; i<=n; i++) {
+            formation_setSlot( leader, leader->escorts[i-1].id, angle, radius, 0 );
+            angle  = -angle;
+            radius = FORMATION_BASE_RADIUS * (floor(i / 2.) + 1.);
+         }
+         break;
+
+      case FORMATION_WEDGE:
+         flip   = -1;
+         radius = FORMATION_BASE_RADIUS;
+         for (i=1; i<=n; i++) {
+            formation_setSlot( leader, leader->escorts[i-1].id, flip*45. + 180., radius, 0 );
+            flip   = -flip;
+            radius = FORMATION_BASE_RADIUS * (floor(i / 2.) + 1.);
+         }
+         break;
+
+      /* Lines through the leader, alternating sides. */
+      case FORMATION_ECHELON_LEFT:
+      case FORMATION_ECHELON_RIGHT:
+      case FORMATION_COLUMN:
+      case FORMATION_WALL:
+         if (leader->formation == FORMATION_ECHELON_LEFT) {
+            base = 135.;
+            flip = -1;
+         }
+         else if (leader->formation == FORMATION_ECHELON_RIGHT) {
+            base = 225.;
+            flip = 1;
+         }
+         else if (leader->formation == FORMATION_COLUMN) {
+            base = 90.;
+            flip = -1;
+         }
+         else {
+            base = 180.;
+            flip = -1;
+         }
+         radius = FORMATION_BASE_RADIUS;
+         for (i=1; i<=n; i++) {
+            formation_setSlot( leader, leader->escorts[i-1].id, base + 90.*flip, radius, 0 );
+            flip   = -flip;
+            radius = FORMATION_BASE_RADIUS * ceil(i / 2.);
+         }
+         break;
+
+      /* Rows of three, fishbone rows spread out and chevron rows close in. */
+      case FORMATION_FISHBONE:
+      case FORMATION_CHEVRON:
+         flip   = -1;
+         radius = FORMATION_BONE_RADIUS;
+         for (i=1; i<=n; i++) {
+            angle = (22.5 * flip) / (radius / FORMATION_BONE_RADIUS);
+            formation_setSlot( leader, leader->escorts[i-1].id, angle, radius, 0 );
+            if (flip == 0) {
+               flip   = -1;
+               radius = FORMATION_BONE_RADIUS * ceil(i / 3.);
+               if (leader->formation == FORMATION_FISHBONE)
+                  radius += radius / 30.;
+               else
+                  radius -= radius / 20.;
+            }
+            else if (flip == -1)
+               flip   = 1;
+            else {
+               flip   = 0;
+               radius = FORMATION_BONE_RADIUS * ceil(i / 3.);
+            }
+         }
+         break;
+
+      case FORMATION_CIRCLE:
+         angle  = 360. / n;
+         radius = 80. + n * 25.;
+         for (i=1; i<=n; i++)
+            formation_setSlot( leader, leader->escorts[i-1].id, angle * i, radius, 1 );
+         break;
+
+      default:
+         break;
+   }
+}
+
+
+/**
+ * @brief Updates the formation slots of all the pilots.
+ *
+ * Should be run once per tick before the AI thinks.
+ */
+void formation_update (void)
+{
+   int i;
+   Pilot *p;
+
+   for (i=0; i<pilot_nstack; i++)
+      pilot_stack[i]->form_valid = 0;
+
+   for (i=0; i<pilot_nstack; i++) {
+      p = pilot_stack[i];
+      if ((p->formation == FORMATION_NONE) || (p->nescorts <= 0))
+         continue;
+      if (pilot_isFlag( p, PILOT_DELETE ) || pilot_isFlag( p, PILOT_DEAD ))
+         continue;
+      formation_compute( p );
+   }
+}
@@ -0,0 +1,38 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef FORMATION_H
+#  define FORMATION_H
+
+
+#include "pilot.h"
+
+
+/**
+ * @brief Formations a leader's escorts can fly in.
+ */
+typedef enum Formation_ {
+   FORMATION_NONE,         /**< Escorts don't keep a formation. */
+   FORMATION_CROSS,        /**< X with the leader in the center. */
+   FORMATION_BUFFER,       /**< Arcs in front of the leader by ship class. */
+   FORMATION_VEE,          /**< V with the arms extending in front. */
+   FORMATION_WEDGE,        /**< V with the arms extending out back. */
+   FORMATION_ECHELON_LEFT, /**< "/" with the leader in the middle. */
+   FORMATION_ECHELON_RIGHT, /**< "\" with the leader in the middle. */
+   FORMATION_COLUMN,       /**< "|" with the leader in the middle. */
+   FORMATION_WALL,         /**< "-" with the leader in the middle. */
+   FORMATION_FISHBONE,     /**< Rows of three widening out back. */
+   FORMATION_CHEVRON,      /**< Rows of three narrowing out back. */
+   FORMATION_CIRCLE,       /**< Circle around the leader. */
+   FORMATION_MAX           /**< Number of formations. */
+} Formation;
+
+
+int formation_get( const char *name );
+const char* formation_name( int formation );
+void formation_update (void);
+
+
+#endif /* FORMATION_H */
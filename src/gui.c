@@ -58,6 +58,7 @@
 #include "nlua_tk.h"
 #include "gui_omsg.h"
 #include "nstring.h"
+#include "array.h"
 
 
 #define XML_GUI_ID   "GUIs" /**< XML section identifier for GUI document. */
@@ -81,10 +82,25 @@ static double blink_planet    = 0.; /**< Timer on planet blinking on radar. */
 
 /* for VBO. */
 static gl_vbo *gui_triangle_vbo = NULL;
-static gl_vbo *gui_planet_vbo = NULL;
-static gl_vbo *gui_radar_select_vbo = NULL;
 static gl_vbo *gui_out_of_range_vbo = NULL;
-static gl_vbo *gui_planet_blink_vbo = NULL;
+
+/* Radar shapes, drawn through the radar buffer. */
+static const GLfloat gui_triangle_shape[] = {
+   -5., -5., 5., -5., 0., 5., -5., -5. }; /**< Jump point triangle, line strip. */
+static const GLfloat gui_planet_shape[] = {
+   0., 1., 1., 0., 0., -1., -1., 0., 0., 1. }; /**< Planet diamond, line strip. */
+static const GLfloat gui_radar_select_shape[] = {
+   -1.5, 1.5, -3.3, 3.3, 1.5, 1.5, 3.3, 3.3,
+   1.5, -1.5, 3.3, -3.3, -1.5, -1.5, -3.3, -3.3 }; /**< Pilot target marks, lines. */
+static const GLfloat gui_planet_blink_shape[] = {
+   -1., 1., -1.2, 1.2, 1., 1., 1.2, 1.2,
+   1., -1., 1.2, -1.2, -1., -1., -1.2, -1.2 }; /**< Planet target marks, lines. */
+
+/* Radar buffer, vertices are x, y, r, g, b, a. */
+static gl_vbo *gui_radar_vbo       = NULL; /**< Streamed VBO with all the radar objects. */
+static GLsizei gui_radar_vboSize   = 0; /**< Size of the radar VBO in bytes. */
+static GLfloat *gui_radar_lines    = NULL; /**< Outlines to draw as lines (array.h). */
+static GLfloat *gui_radar_tris     = NULL; /**< Filled blips to draw as triangles (array.h). */
 
 static int gui_getMessage     = 1; /**< Whether or not the player should receive messages. */
 
@@ -196,6 +212,9 @@ static void gui_renderMessages( double dt );
 static const glColour *gui_getPlanetColour( int i );
 static void gui_renderRadarOutOfRange( RadarShape sh, int w, int h, int cx, int cy, const glColour *col );
 static void gui_planetBlink( int w, int h, int rc, int cx, int cy, GLfloat vr, RadarShape shape );
+static void gui_radarVertex( GLfloat **buf, double x, double y, const glColour *c );
+static void gui_radarShape( const GLfloat *shape, int n, int strip,
+      double x, double y, double s, double a, const glColour *c );
 static const glColour* gui_getPilotColour( const Pilot* p );
 static void gui_renderInterference (void);
 static void gui_calcBorders (void);
@@ -979,6 +998,9 @@ void gui_radarRender( double x, double y )
          gui_renderAsteroid( &ast->asteroids[j], radar->w, radar->h, radar->res, 0 );
    }
 
+   /* Draw everything gathered in one pass. */
+   gui_radarFlush();
+
    /* Interference. */
    gui_renderInterference();
 
@@ -1185,6 +1207,136 @@ static const glColour* gui_getPilotColour( const Pilot* p )
 }
 
 
+/**
+ * @brief Adds a vertex to a radar buffer.
+ */
+static void gui_radarVertex( GLfloat **buf, double x, double y, const glColour *c )
+{
+   GLfloat *v;
+
+   if (*buf == NULL) {
+      gui_radar_lines = array_create( GLfloat );
+      gui_radar_tris  = array_create( GLfloat );
+   }
+
+   array_resize( buf, array_size(*buf)+6 );
+   v = &array_back( *buf ) - 5;
+   v[0] = x;
+   v[1] = y;
+   v[2] = c->r;
+   v[3] = c->g;
+   v[4] = c->b;
+   v[5] = c->a;
+}
+
+
+/**
+ * @brief Adds a filled rectangle to the radar.
+ *
+ * Nothing is drawn until gui_radarFlush() is called.
+ *
+ *    @param x X position of the bottom left corner.
+ *    @param y Y position of the bottom left corner.
+ *    @param w Width of the rectangle.
+ *    @param h Height of the rectangle.
+ *    @param c Colour of the rectangle.
+ */
+void gui_radarRect( double x, double y, double w, double h, const glColour *c )
+{
+   gui_radarVertex( &gui_radar_tris, x,   y,   c );
+   gui_radarVertex( &gui_radar_tris, x+w, y,   c );
+   gui_radarVertex( &gui_radar_tris, x,   y+h, c );
+   gui_radarVertex( &gui_radar_tris, x+w, y,   c );
+   gui_radarVertex( &gui_radar_tris, x+w, y+h, c );
+   gui_radarVertex( &gui_radar_tris, x,   y+h, c );
+}
+
+
+/**
+ * @brief Adds an outline shape to the radar.
+ *
+ *    @param shape Vertices of the shape.
+ *    @param n Number of vertices in the shape.
+ *    @param strip Whether the shape is a line strip instead of line pairs.
+ *    @param x X position of the shape.
+ *    @param y Y position of the shape.
+ *    @param s Scale of the shape.
+ *    @param a Rotation of the shape.
+ *    @param c Colour of the shape.
+ */
+static void gui_radarShape( const GLfloat *shape, int n, int strip,
+      double x, double y, double s, double a, const glColour *c )
+{
+   int i, step;
+   double ca, sa;
+
+   ca   = s * cos(a);
+   sa   = s * sin(a);
+   step = (strip) ? 1 : 2;
+   for (i=0; i+1<n; i+=step) {
+      gui_radarVertex( &gui_radar_lines,
+            x + ca*shape[2*i]   - sa*shape[2*i+1],
+            y + sa*shape[2*i]   + ca*shape[2*i+1], c );
+      gui_radarVertex( &gui_radar_lines,
+            x + ca*shape[2*i+2] - sa*shape[2*i+3],
+            y + sa*shape[2*i+2] + ca*shape[2*i+3], c );
+   }
+}
+
+
+/**
+ * @brief Draws all the objects added to the radar since the last flush.
+ *
+ * Everything goes into a single streamed buffer and gets drawn with one call
+ *  for the outlines and one for the blips.
+ */
+void gui_radarFlush (void)
+{
+   GLsizei nl, nt, size;
+
+   if (gui_radar_lines == NULL)
+      return;
+
+   nl = array_size( gui_radar_lines ) / 6;
+   nt = array_size( gui_radar_tris ) / 6;
+   if (nl+nt == 0)
+      return;
+
+   /* Grow the buffer if needed, it keeps its size afterwards. */
+   size = sizeof(GLfloat) * 6 * (nl+nt);
+   if (gui_radar_vbo == NULL) {
+      gui_radar_vboSize = MAX( size, (GLsizei)(sizeof(GLfloat) * 6 * 1024) );
+      gui_radar_vbo     = gl_vboCreateStream( gui_radar_vboSize, NULL );
+   }
+   else if (size > gui_radar_vboSize) {
+      gui_radar_vboSize = MAX( size, 2*gui_radar_vboSize );
+      gl_vboData( gui_radar_vbo, gui_radar_vboSize, NULL );
+   }
+
+   /* Upload. */
+   if (nl > 0)
+      gl_vboSubData( gui_radar_vbo, 0, sizeof(GLfloat) * 6 * nl, gui_radar_lines );
+   if (nt > 0)
+      gl_vboSubData( gui_radar_vbo, sizeof(GLfloat) * 6 * nl,
+            sizeof(GLfloat) * 6 * nt, gui_radar_tris );
+
+   /* Draw. */
+   gl_beginSmoothProgram(gl_view_matrix);
+   gl_vboActivateAttribOffset( gui_radar_vbo, shaders.smooth.vertex,
+         0, 2, GL_FLOAT, sizeof(GLfloat) * 6 );
+   gl_vboActivateAttribOffset( gui_radar_vbo, shaders.smooth.vertex_color,
+         sizeof(GLfloat) * 2, 4, GL_FLOAT, sizeof(GLfloat) * 6 );
+   if (nl > 0)
+      glDrawArrays( GL_LINES, 0, nl );
+   if (nt > 0)
+      glDrawArrays( GL_TRIANGLES, nl, nt );
+   gl_endSmoothProgram();
+
+   array_resize( &gui_radar_lines, 0 );
+   array_resize( &gui_radar_tris, 0 );
+}
+
+
 /**
  * @brief Renders a pilot in the GUI radar.
  *
@@ -1253,10 +1405,7 @@ void gui_renderPilot( const Pilot* p, RadarShape shape, double w, double h, doub
          col = cRadar_tPilot;
          col.a = 1.-interference_alpha;
 
-         gl_beginSolidProgram(gl_Matrix4_Translate(gl_view_matrix, x, y, 0), &cRadar_tPilot);
-         gl_vboActivateAttribOffset( gui_radar_select_vbo, shaders.solid.vertex, 0, 2, GL_FLOAT, 0 );
-         glDrawArrays( GL_LINES, 0, 8 );
-         gl_endSolidProgram();
+         gui_radarShape( gui_radar_select_shape, 8, 0, x, y, 1., 0., &cRadar_tPilot );
       }
    }
 
@@ -1268,7 +1417,7 @@ void gui_renderPilot( const Pilot* p, RadarShape shape, double w, double h, doub
    else
       col = *gui_getPilotColour(p);
    col.a = 1.-interference_alpha;
-   gl_renderRect( px, py, MIN( 2*sx, w-px ), MIN( 2*sy, h-py ), &col );
+   gui_radarRect( px, py, MIN( 2*sx, w-px ), MIN( 2*sy, h-py ), &col );
 
    /* Draw name. */
    if (overlay && pilot_isFlag(p, PILOT_HILIGHT))
@@ -1327,7 +1476,7 @@ void gui_renderAsteroid( const Asteroid* a, double w, double h, double res, int
    ccol.g = col->g;
    ccol.b = col->b;
    ccol.a = 1.-interference_alpha;
-   gl_renderRect( px, py, MIN( 2*sx, w-px ), MIN( 2*sy, h-py ), &ccol );
+   gui_radarRect( px, py, MIN( 2*sx, w-px ), MIN( 2*sy, h-py ), &ccol );
 }
 
 
@@ -1395,18 +1544,11 @@ void gui_forceBlink (void)
 static void gui_planetBlink( int w, int h, int rc, int cx, int cy, GLfloat vr, RadarShape shape )
 {
    glColour col;
-   gl_Matrix4 projection;
 
    if (blink_planet < RADAR_BLINK_PLANET/2.) {
       col = cRadar_tPlanet;
       col.a = 1.-interference_alpha;
-
-      projection = gl_Matrix4_Translate(gl_view_matrix, cx, cy, 0);
-      projection = gl_Matrix4_Scale(projection, vr, vr, 1);
-      gl_beginSolidProgram(projection, &col);
-      gl_vboActivateAttribOffset( gui_planet_blink_vbo, shaders.solid.vertex, 0, 2, GL_FLOAT, 0 );
-      glDrawArrays( GL_LINES, 0, 8 );
-      gl_endSolidProgram();
+      gui_radarShape( gui_planet_blink_shape, 8, 0, cx, cy, vr, 0., &col );
    }
 }
 
@@ -1537,10 +1679,7 @@ void gui_renderPlanet( int ind, RadarShape shape, double w, double h, double res
    if (!overlay)
       col.a = 1.-interference_alpha;
 
-   gl_beginSolidProgram(gl_Matrix4_Scale(gl_Matrix4_Translate(gl_view_matrix, cx, cy, 0), vr, vr, 1), &col);
-   gl_vboActivateAttribOffset( gui_planet_vbo, shaders.solid.vertex, 0, 2, GL_FLOAT, 0 );
-   glDrawArrays( GL_LINE_STRIP, 0, 5 );
-   gl_endSolidProgram();
+   gui_radarShape( gui_planet_shape, 5, 1, cx, cy, vr, 0., &col );
 
    /* Render name. */
    if (overlay)
@@ -1562,7 +1701,6 @@ void gui_renderJumpPoint( int ind, RadarShape shape, double w, double h, double
    GLfloat vx, vy, vr;
    glColour col;
    JumpPoint *jp;
-   gl_Matrix4 projection;
 
    /* Default values. */
    jp    = &cur_system->jumps[ind];
@@ -1626,12 +1764,7 @@ void gui_renderJumpPoint( int ind, RadarShape shape, double w, double h, double
    if (!overlay)
       col.a = 1.-interference_alpha;
 
-   projection = gl_Matrix4_Translate(gl_view_matrix, cx, cy, 0);
-   projection = gl_Matrix4_Rotate2d(projection, -M_PI/2-jp->angle);
-   gl_beginSolidProgram(projection, &col);
-   gl_vboActivateAttribOffset( gui_triangle_vbo, shaders.solid.vertex, 0, 2, GL_FLOAT, 0 );
-   glDrawArrays( GL_LINE_STRIP, 0, 4 );
-   gl_endSolidProgram();
+   gui_radarShape( gui_triangle_shape, 4, 1, cx, cy, 1., -M_PI/2-jp->angle, &col );
 
    /* Render name. */
    if (overlay)
@@ -1744,40 +1877,6 @@ int gui_init (void)
       gui_triangle_vbo = gl_vboCreateStatic( sizeof(GLfloat) * 8, vertex );
    }
 
-   if (gui_planet_vbo == NULL) {
-      vertex[0] = 0;
-      vertex[1] = 1;
-      vertex[2] = 1;
-      vertex[3] = 0;
-      vertex[4] = 0;
-      vertex[5] = -1;
-      vertex[6] = -1;
-      vertex[7] = 0;
-      vertex[8] = 0;
-      vertex[9] = 1;
-      gui_planet_vbo = gl_vboCreateStatic( sizeof(GLfloat) * 10, vertex );
-   }
-
-   if (gui_radar_select_vbo == NULL) {
-      vertex[0] = -1.5;
-      vertex[1] = 1.5;
-      vertex[2] = -3.3;
-      vertex[3] = 3.3;
-      vertex[4] = 1.5;
-      vertex[5] = 1.5;
-      vertex[6] = 3.3;
-      vertex[7] = 3.3;
-      vertex[8] = 1.5;
-      vertex[9] = -1.5;
-      vertex[10] = 3.3;
-      vertex[11] = -3.3;
-      vertex[12] = -1.5;
-      vertex[13] = -1.5;
-      vertex[14] = -3.3;
-      vertex[15] = -3.3;
-      gui_radar_select_vbo = gl_vboCreateStatic( sizeof(GLfloat) * 16, vertex );
-   }
-
    if (gui_out_of_range_vbo == NULL) {
       vertex[0] = 0;
       vertex[1] = 0;
@@ -1786,26 +1885,6 @@ int gui_init (void)
       gui_out_of_range_vbo = gl_vboCreateStatic( sizeof(GLfloat) * 4, vertex );
    }
 
-   if (gui_planet_blink_vbo == NULL) {
-      vertex[0] = -1;
-      vertex[1] = 1;
-      vertex[2] = -1.2;
-      vertex[3] = 1.2;
-      vertex[4] = 1;
-      vertex[5] = 1;
-      vertex[6] = 1.2;
-      vertex[7] = 1.2;
-      vertex[8] = 1;
-      vertex[9] = -1;
-      vertex[10] = 1.2;
-      vertex[11] = -1.2;
-      vertex[12] = -1;
-      vertex[13] = -1;
-      vertex[14] = -1.2;
-      vertex[15] = -1.2;
-      gui_planet_blink_vbo = gl_vboCreateStatic( sizeof(GLfloat) * 16, vertex );
-   }
-
    /*
     * OSD
     */
@@ -2197,21 +2276,20 @@ void gui_free (void)
       gl_vboDestroy( gui_triangle_vbo );
       gui_triangle_vbo = NULL;
    }
-   if (gui_planet_vbo != NULL) {
-      gl_vboDestroy( gui_planet_vbo );
-      gui_planet_vbo = NULL;
-   }
-   if (gui_radar_select_vbo != NULL) {
-      gl_vboDestroy( gui_radar_select_vbo );
-      gui_radar_select_vbo = NULL;
-   }
    if (gui_out_of_range_vbo != NULL) {
       gl_vboDestroy( gui_out_of_range_vbo );
       gui_out_of_range_vbo = NULL;
    }
-   if (gui_planet_blink_vbo != NULL) {
-      gl_vboDestroy( gui_planet_blink_vbo );
-      gui_planet_blink_vbo = NULL;
+   if (gui_radar_vbo != NULL) {
+      gl_vboDestroy( gui_radar_vbo );
+      gui_radar_vbo = NULL;
+      gui_radar_vboSize = 0;
+   }
+   if (gui_radar_lines != NULL) {
+      array_free( gui_radar_lines );
+      array_free( gui_radar_tris );
+      gui_radar_lines = NULL;
+      gui_radar_tris  = NULL;
    }
 
    /* Clean up the osd. */
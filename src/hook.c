@@ -1030,6 +1030,42 @@ nlua_env hook_env( unsigned int hook )
 }
 
 
+/**
+ * @brief Gets a hook to run directly with hook_runRefParam.
+ *
+ * The hook stays valid until it is freed, which removes it from all the
+ *  pilots first, including the ships the player has stored.
+ *
+ *    @param id Identifier of the hook.
+ *    @return The hook or NULL if not found.
+ */
+Hook* hook_getRef( unsigned int id )
+{
+   return hook_get( id );
+}
+
+
+/**
+ * @brief Runs a single hook gotten with hook_getRef.
+ *
+ *    @param h Hook to run.
+ *    @param param Parameters to pass.
+ *    @return 0 on success.
+ */
+int hook_runRefParam( Hook *h, HookParam *param )
+{
+   /* Don't update if player is dead. */
+   if ((player.p == NULL) || player_isFlag(PLAYER_DESTROYED))
+      return 0;
+
+   if (h == NULL)
+      return -1;
+   hook_run( h, param, -1 );
+
+   return 0;
+}
+
+
 /**
  * @brief Runs a single hook by id.
  *
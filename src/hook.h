@@ -67,6 +67,8 @@ int hook_hasEventParent( unsigned int parent );
 
 /* pilot hook. */
 int pilot_runHookParam( Pilot* p, int hook_type, HookParam *param, int nparam );
+struct Hook_* hook_getRef( unsigned int id );
+int hook_runRefParam( struct Hook_ *h, HookParam *param );
 
 nlua_env hook_env( unsigned int hook );
 
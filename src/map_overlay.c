@@ -253,6 +253,9 @@ void ovr_render( double dt )
          gui_renderAsteroid( &ast->asteroids[j], w, h, res, 1 );
    }
 
+   /* Draw the gathered radar objects. */
+   gui_radarFlush();
+
    /* Render the player. */
    gui_renderPlayer( res, 1 );
 
@@ -42,6 +42,30 @@
 #define XML_MISSION_TAG       "mission" /**< XML mission tag. */
 
 #define MISSION_CHUNK         32 /**< Chunk allocation. */
+#define MISSION_NLOC          (MIS_AVAIL_SPACE+1) /**< Number of mission locations. */
+
+
+/**
+ * @brief Key used to look up missions in the index.
+ */
+typedef struct MissionKey_ {
+   const char *name; /**< Planet or system name, NULL when keyed by faction. */
+   int faction; /**< Faction when keyed by faction. */
+   int id; /**< ID of the mission. */
+} MissionKey;
+
+
+/**
+ * @brief Missions available at a location, bucketed so that only missions
+ *        that can apply have their requirements checked.
+ */
+typedef struct MissionIndex_ {
+   int *generic; /**< Missions not tied to a planet nor a system (array.h). */
+   int *anyfaction; /**< Generic missions not restricted by faction (array.h). */
+   MissionKey *factions; /**< Generic missions sorted by faction (array.h). */
+   MissionKey *planets; /**< Missions tied to a planet, sorted by name (array.h). */
+   MissionKey *systems; /**< Missions tied to a system, sorted by name (array.h). */
+} MissionIndex;
 
 
 /*
@@ -56,6 +80,7 @@ Mission *player_missions[MISSION_MAX]; /**< Player's active missions. */
  */
 static MissionData *mission_stack = NULL; /**< Unmutable after creation */
 static int mission_nstack = 0; /**< Missions in stack. */
+static MissionIndex mission_index[MISSION_NLOC]; /**< Missions by location. */
 
 
 /*
@@ -72,6 +97,15 @@ static int mission_meetReq( int mission, int faction,
       const char* planet, const char* sysname );
 static int mission_matchFaction( MissionData* misn, int faction );
 static int mission_location( const char* loc );
+/* index */
+static int mission_keyCompare( const void* arg1, const void* arg2 );
+static int mission_idCompare( const void* arg1, const void* arg2 );
+static int mission_keyFind( MissionKey *keys, const char *name, int faction );
+static void mission_keyAppend( int **list, MissionKey *keys, const char *name, int faction );
+static void missions_indexBuild (void);
+static void missions_indexFree (void);
+static int* missions_candidates( int loc, int faction,
+      const char* planet, const char* sysname );
 /* Loading. */
 static int mission_parse( MissionData* temp, const xmlNodePtr parent );
 static int missions_parseActive( xmlNodePtr parent );
@@ -157,8 +191,6 @@ MissionData* mission_getFromName( const char* name )
  */
 static int mission_init( Mission* mission, MissionData* misn, int genid, int create, unsigned int *id )
 {
-   char *buf;
-   size_t bufsize;
    int ret;
 
    /* clear the mission */
@@ -179,21 +211,14 @@ static int mission_init( Mission* mission, MissionData* misn, int genid, int cre
 
    misn_loadLibs( mission->env ); /* load our custom libraries */
 
-   /* load the file */
-   buf = ndata_read( misn->lua, &bufsize );
-   if (buf == NULL) {
-      WARN(_("Mission '%s' Lua script not found."), misn->lua );
-      return -1;
-   }
-   if (nlua_dobufenv(mission->env, buf, bufsize, misn->lua) != 0) {
+   /* load the file, compiled chunks are cached so it is only parsed once */
+   if (nlua_dondataenv(mission->env, misn->lua) != 0) {
       WARN(_("Error loading mission file: %s\n"
           "%s\n"
           "Most likely Lua file has improper syntax, please check"),
             misn->lua, lua_tostring(naevL, -1));
-      free(buf);
       return -1;
    }
-   free(buf);
 
    /* run create function */
    if (create) {
@@ -290,7 +315,7 @@ static int mission_meetReq( int mission, int faction,
 
    /* Must meet previous mission requirements. */
    if ((misn->avail.done != NULL) &&
-         (player_missionAlreadyDone( mission_getID(misn->avail.done) ) == 0))
+         (player_missionAlreadyDone( misn->avail.done_id ) == 0))
       return 0;
 
   return 1;
@@ -309,15 +334,14 @@ void missions_run( int loc, int faction, const char* planet, const char* sysname
 {
    MissionData* misn;
    Mission mission;
-   int i;
+   int i, *cand;
    double chance;
 
-   for (i=0; i<mission_nstack; i++) {
-      misn = &mission_stack[i];
-      if (misn->avail.loc != loc)
-         continue;
+   cand = missions_candidates( loc, faction, planet, sysname );
+   for (i=0; i<array_size(cand); i++) {
+      misn = &mission_stack[ cand[i] ];
 
-      if (!mission_meetReq(i, faction, planet, sysname))
+      if (!mission_meetReq(cand[i], faction, planet, sysname))
          continue;
 
       chance = (double)(misn->avail.chance % 100)/100.;
@@ -329,6 +353,7 @@ void missions_run( int loc, int faction, const char* planet, const char* sysname
          mission_cleanup(&mission); /* it better clean up for itself or we do it */
       }
    }
+   array_free( cand );
 }
 
 
@@ -696,7 +721,7 @@ Mission* missions_genList( int *n, int faction,
 {
    int i,j, m, alloced;
    double chance;
-   int rep;
+   int rep, *cand;
    Mission* tmp;
    MissionData* misn;
 
@@ -704,37 +729,37 @@ Mission* missions_genList( int *n, int faction,
    tmp      = NULL;
    m        = 0;
    alloced  = 0;
-   for (i=0; i<mission_nstack; i++) {
-      misn = &mission_stack[i];
-      if (misn->avail.loc == loc) {
+   cand     = missions_candidates( loc, faction, planet, sysname );
+   for (i=0; i<array_size(cand); i++) {
+      misn = &mission_stack[ cand[i] ];
 
-         /* Must meet requirements. */
-         if (!mission_meetReq(i, faction, planet, sysname))
-            continue;
+      /* Must meet requirements. */
+      if (!mission_meetReq(cand[i], faction, planet, sysname))
+         continue;
 
-         /* Must hit chance. */
-         chance = (double)(misn->avail.chance % 100)/100.;
-         if (chance == 0.) /* We want to consider 100 -> 100% not 0% */
-            chance = 1.;
-         rep = MAX(1, misn->avail.chance / 100);
-
-         for (j=0; j<rep; j++) /* random chance of rep appearances */
-            if (RNGF() < chance) {
-               m++;
-               /* Extra allocation. */
-               if (m > alloced) {
-                  if (alloced == 0)
-                     alloced = 32;
-                  else
-                     alloced *= 2;
-                  tmp      = realloc( tmp, sizeof(Mission) * alloced );
-               }
-               /* Initialize the mission. */
-               if (mission_init( &tmp[m-1], misn, 1, 1, NULL ))
-                  m--;
+      /* Must hit chance. */
+      chance = (double)(misn->avail.chance % 100)/100.;
+      if (chance == 0.) /* We want to consider 100 -> 100% not 0% */
+         chance = 1.;
+      rep = MAX(1, misn->avail.chance / 100);
+
+      for (j=0; j<rep; j++) /* random chance of rep appearances */
+         if (RNGF() < chance) {
+            m++;
+            /* Extra allocation. */
+            if (m > alloced) {
+               if (alloced == 0)
+                  alloced = 32;
+               else
+                  alloced *= 2;
+               tmp      = realloc( tmp, sizeof(Mission) * alloced );
             }
-      }
+            /* Initialize the mission. */
+            if (mission_init( &tmp[m-1], misn, 1, 1, NULL ))
+               m--;
+         }
    }
+   array_free( cand );
 
    /* Sort. */
    if (tmp != NULL) {
@@ -748,6 +773,232 @@ Mission* missions_genList( int *n, int faction,
 }
 
 
+/**
+ * @brief Compares mission keys by name or faction, then by mission ID.
+ */
+static int mission_keyCompare( const void* arg1, const void* arg2 )
+{
+   const MissionKey *k1, *k2;
+   int ret;
+
+   k1 = (const MissionKey*) arg1;
+   k2 = (const MissionKey*) arg2;
+
+   if (k1->name != NULL) {
+      ret = strcmp( k1->name, k2->name );
+      if (ret != 0)
+         return ret;
+   }
+   else if (k1->faction != k2->faction)
+      return (k1->faction < k2->faction) ? -1 : +1;
+
+   return k1->id - k2->id;
+}
+
+
+/**
+ * @brief Compares mission IDs.
+ */
+static int mission_idCompare( const void* arg1, const void* arg2 )
+{
+   return *(const int*)arg1 - *(const int*)arg2;
+}
+
+
+/**
+ * @brief Finds the first key matching a name or faction.
+ *
+ *    @param keys Sorted keys to search (array.h).
+ *    @param name Name to match or NULL to match by faction.
+ *    @param faction Faction to match if name is NULL.
+ *    @return Position of the first matching key or -1 if none match.
+ */
+static int mission_keyFind( MissionKey *keys, const char *name, int faction )
+{
+   int lo, hi, mid, c;
+
+   lo = 0;
+   hi = array_size(keys);
+   while (lo < hi) {
+      mid = (lo+hi) / 2;
+      if (name != NULL)
+         c = strcmp( keys[mid].name, name );
+      else
+         c = keys[mid].faction - faction;
+      if (c < 0)
+         lo = mid+1;
+      else
+         hi = mid;
+   }
+
+   if (lo >= array_size(keys))
+      return -1;
+   if ((name != NULL) ? (strcmp(keys[lo].name,name)!=0) : (keys[lo].faction!=faction))
+      return -1;
+   return lo;
+}
+
+
+/**
+ * @brief Appends the missions matching a key to a list.
+ *
+ *    @param list List to append to (array.h).
+ *    @param keys Sorted keys to search (array.h).
+ *    @param name Name to match or NULL to match by faction.
+ *    @param faction Faction to match if name is NULL.
+ */
+static void mission_keyAppend( int **list, MissionKey *keys, const char *name, int faction )
+{
+   int i;
+
+   i = mission_keyFind( keys, name, faction );
+   if (i < 0)
+      return;
+
+   for ( ; i<array_size(keys); i++) {
+      if ((name != NULL) ? (strcmp(keys[i].name,name)!=0) : (keys[i].faction!=faction))
+         break;
+      array_push_back( list, keys[i].id );
+   }
+}
+
+
+/**
+ * @brief Builds the mission index by location, planet, system and faction.
+ */
+static void missions_indexBuild (void)
+{
+   int i, j;
+   MissionData *misn;
+   MissionIndex *idx;
+   MissionKey *key;
+
+   for (i=0; i<MISSION_NLOC; i++) {
+      idx = &mission_index[i];
+      idx->generic      = array_create( int );
+      idx->anyfaction   = array_create( int );
+      idx->factions     = array_create( MissionKey );
+      idx->planets      = array_create( MissionKey );
+      idx->systems      = array_create( MissionKey );
+   }
+
+   for (i=0; i<mission_nstack; i++) {
+      misn = &mission_stack[i];
+
+      /* Resolve the previous mission requirement once. */
+      misn->avail.done_id = (misn->avail.done != NULL) ?
+            mission_getID( misn->avail.done ) : -1;
+
+      if ((misn->avail.loc < 0) || (misn->avail.loc >= MISSION_NLOC))
+         continue;
+      idx = &mission_index[ misn->avail.loc ];
+
+      /* Specific missions only get checked at their planet or system. */
+      if (misn->avail.planet != NULL) {
+         key         = &array_grow( &idx->planets );
+         key->name   = misn->avail.planet;
+         key->faction = -1;
+         key->id     = i;
+         continue;
+      }
+      if (misn->avail.system != NULL) {
+         key         = &array_grow( &idx->systems );
+         key->name   = misn->avail.system;
+         key->faction = -1;
+         key->id     = i;
+         continue;
+      }
+
+      /* Generic missions are bucketed by faction. */
+      array_push_back( &idx->generic, i );
+      if (misn->avail.nfactions <= 0) {
+         array_push_back( &idx->anyfaction, i );
+         continue;
+      }
+      for (j=0; j<misn->avail.nfactions; j++) {
+         key         = &array_grow( &idx->factions );
+         key->name   = NULL;
+         key->faction = misn->avail.factions[j];
+         key->id     = i;
+      }
+   }
+
+   for (i=0; i<MISSION_NLOC; i++) {
+      idx = &mission_index[i];
+      qsort( idx->factions, array_size(idx->factions), sizeof(MissionKey), mission_keyCompare );
+      qsort( idx->planets, array_size(idx->planets), sizeof(MissionKey), mission_keyCompare );
+      qsort( idx->systems, array_size(idx->systems), sizeof(MissionKey), mission_keyCompare );
+   }
+}
+
+
+/**
+ * @brief Frees the mission index.
+ */
+static void missions_indexFree (void)
+{
+   int i;
+   MissionIndex *idx;
+
+   for (i=0; i<MISSION_NLOC; i++) {
+      idx = &mission_index[i];
+      if (idx->generic == NULL)
+         continue;
+      array_free( idx->generic );
+      array_free( idx->anyfaction );
+      array_free( idx->factions );
+      array_free( idx->planets );
+      array_free( idx->systems );
+   }
+   memset( mission_index, 0, sizeof(mission_index) );
+}
+
+
+/**
+ * @brief Gets the missions that can possibly be available at a location.
+ *
+ * Only location, planet, system and faction are used to narrow down the
+ *  candidates, the rest of the requirements must still be checked.
+ *
+ *    @param loc Location to match.
+ *    @param faction Faction of the planet or -1 to not filter.
+ *    @param planet Name of the current planet or NULL.
+ *    @param sysname Name of the current system or NULL.
+ *    @return Candidate mission IDs in stack order (array.h), must be freed.
+ */
+static int* missions_candidates( int loc, int faction,
+      const char* planet, const char* sysname )
+{
+   int *cand;
+   MissionIndex *idx;
+
+   cand = array_create( int );
+   if ((loc < 0) || (loc >= MISSION_NLOC) || (mission_index[loc].generic == NULL))
+      return cand;
+   idx = &mission_index[loc];
+
+   if (planet != NULL)
+      mission_keyAppend( &cand, idx->planets, planet, -1 );
+   if (sysname != NULL)
+      mission_keyAppend( &cand, idx->systems, sysname, -1 );
+   if (faction >= 0) {
+      array_resize( &cand, array_size(cand) + array_size(idx->anyfaction) );
+      memcpy( &cand[ array_size(cand) - array_size(idx->anyfaction) ],
+            idx->anyfaction, sizeof(int) * array_size(idx->anyfaction) );
+      mission_keyAppend( &cand, idx->factions, NULL, faction );
+   }
+   else {
+      array_resize( &cand, array_size(cand) + array_size(idx->generic) );
+      memcpy( &cand[ array_size(cand) - array_size(idx->generic) ],
+            idx->generic, sizeof(int) * array_size(idx->generic) );
+   }
+
+   /* Keep the stack order so missions are run as they were defined. */
+   qsort( cand, array_size(cand), sizeof(int), mission_idCompare );
+   return cand;
+}
+
+
 /**
  * @brief Gets location based on a human readable string.
  *
@@ -932,6 +1183,9 @@ int missions_load (void)
    xmlFreeDoc(doc);
    free(buf);
 
+   /* Build the index. */
+   missions_indexBuild();
+
    DEBUG( ngettext("Loaded %d Mission", "Loaded %d Missions", mission_nstack ), mission_nstack );
 
    return 0;
@@ -949,6 +1203,7 @@ void missions_free (void)
    missions_cleanup();
 
    /* Free the mission data. */
+   missions_indexFree();
    for (i=0; i<mission_nstack; i++)
       mission_freeData( &mission_stack[i] );
    free( mission_stack );
@@ -61,6 +61,7 @@ typedef struct MissionAvail_s {
 
    char* cond; /**< Condition that must be met (Lua). */
    char* done; /**< Previous mission that must have been done. */
+   int done_id; /**< ID of the previous mission, resolved after loading. */
 
    int priority; /**< Mission priority: 0 = main plot, 5 = default, 10 = insignificant. */
 } MissionAvail_t;
@@ -78,6 +78,7 @@
 #include "gui.h"
 #include "news.h"
 #include "nlua_var.h"
+#include "nlua_vec2.h"
 #include "map.h"
 #include "event.h"
 #include "cond.h"
@@ -384,6 +385,10 @@ int main( int argc, char** argv )
    if (conf.devcsv)
       dev_csv();
 
+   /* Run the benchmarks. */
+   if (conf.devbench)
+      dev_bench();
+
    /* Unload load screen. */
    loadscreen_unload();
 
@@ -1070,6 +1075,14 @@ static void render_all (void)
 
 static double fps     = 0.; /**< FPS to finally display. */
 static double fps_cur = 0.; /**< FPS accumulator to trigger change. */
+#ifdef DEBUGGING
+static double ai_cps  = 0.; /**< AI Lua calls per second to display. */
+static unsigned long ai_calls = 0; /**< AI Lua calls at last recalculation. */
+static double task_aps = 0.; /**< AI task heap allocations per second to display. */
+static unsigned long task_allocs = 0; /**< AI task heap allocations at last recalculation. */
+static double vec_aps = 0.; /**< Lua vector allocations per second to display. */
+static unsigned long vec_allocs = 0; /**< Lua vector allocations at last recalculation. */
+#endif /* DEBUGGING */
 /**
  * @brief Displays FPS on the screen.
  *
@@ -1079,11 +1092,22 @@ static void display_fps( const double dt )
 {
    double x,y;
    double dt_mod_base = 1.;
+#ifdef DEBUGGING
+   int nactive, nvirtual, nculled;
+#endif /* DEBUGGING */
 
    fps_dt  += dt;
    fps_cur += 1.;
    if (fps_dt > 1.) { /* recalculate every second */
       fps = fps_cur / fps_dt;
+#ifdef DEBUGGING
+      ai_cps   = (double)(ai_callCount() - ai_calls) / fps_dt;
+      ai_calls = ai_callCount();
+      task_aps = (double)(ai_taskAllocCount() - task_allocs) / fps_dt;
+      task_allocs = ai_taskAllocCount();
+      vec_aps  = (double)(nlua_vectorAllocs() - vec_allocs) / fps_dt;
+      vec_allocs = nlua_vectorAllocs();
+#endif /* DEBUGGING */
       fps_dt = fps_cur = 0.;
    }
 
@@ -1092,6 +1116,20 @@ static void display_fps( const double dt )
    if (conf.fps_show) {
       gl_print( NULL, x, y, NULL, "%3.2f", fps );
       y -= gl_defFont.h + 5.;
+#ifdef DEBUGGING
+      /* Active, virtual and culled voices. */
+      if (conf.devmode) {
+         sound_voiceStats( &nactive, &nvirtual, &nculled );
+         gl_print( NULL, x, y, NULL, "%d/%d/%d", nactive, nvirtual, nculled );
+         y -= gl_defFont.h + 5.;
+         /* AI Lua calls and task heap allocations per second. */
+         gl_print( NULL, x, y, NULL, "%.0f %.0f", ai_cps, task_aps );
+         y -= gl_defFont.h + 5.;
+         /* Lua memory use and vector allocations per second. */
+         gl_print( NULL, x, y, NULL, "%d KiB %.0f", lua_gc( naevL, LUA_GCCOUNT, 0 ), vec_aps );
+         y -= gl_defFont.h + 5.;
+      }
+#endif /* DEBUGGING */
    }
 
    if ((player.p != NULL) && !player_isFlag(PLAYER_DESTROYED) &&
@@ -29,11 +29,14 @@
 #include "camera.h"
 #include "nstring.h"
 #include "ndata.h"
+#include "md5.h"
 
 
 #define NEBULA_Z             16 /**< Z plane */
 #define NEBULA_PUFFS         32 /**< Amount of puffs to generate */
-#define NEBULA_PATH_BG       "nebu_bg_%dx%d_%02d.png" /**< Nebula path format. */
+#define NEBULA_RUGOSITY      5. /**< Rugosity of the background nebula. */
+#define NEBULA_PATH_BG       "nebu_bg_%dx%d_%s_%02d.png" /**< Nebula path format (resolution, key and layer). */
+#define NEBULA_PATH_SUM      "nebu_bg_%dx%d_%s.md5" /**< Nebula checksum path format (resolution and key). */
 
 #define NEBULA_PUFF_BUFFER   300 /**< Nebula buffer */
 
@@ -62,6 +65,8 @@ static glTexture *nebu_pufftexs[NEBULA_PUFFS]; /**< Nebula puffs. */
 
 /* Misc. */
 static int nebu_loaded = 0; /**< Whether the nebula has been loaded. */
+static char nebu_key[9]; /**< Hash of the generation parameters, part of the cache file names. */
+static char nebu_sums[NEBULA_Z][33]; /**< Checksums of the cached nebula layers. */
 
 /* VBOs */
 static gl_vbo *nebu_vboOverlay   = NULL; /**< Overlay VBO. */
@@ -88,11 +93,13 @@ static double puff_y          = 0.;
  * prototypes
  */
 static int nebu_init_recursive( int iter );
-static int nebu_checkCompat( const char* file );
+static void nebu_genKey (void);
+static void nebu_md5( char digest[33], const char *data, size_t len );
+static int nebu_checkCompat (void);
 static int nebu_loadTexture( SDL_Surface *sur, int w, int h, glTexture **tex );
 static int nebu_generate (void);
 static int saveNebula( float *map, const uint32_t w, const uint32_t h, const char* file );
-static SDL_Surface* loadNebula( const char* file );
+static SDL_Surface* loadNebula( const char* file, const char *sum );
 static SDL_Surface* nebu_surfaceFromNebulaMap( float* map, const int w, const int h );
 /* Puffs. */
 static void nebu_generatePuffs (void);
@@ -147,16 +154,17 @@ static int nebu_init_recursive( int iter )
       nebu_ph = nebu_h;
    }
 
-   /* Load each, checking for compatibility and padding */
-   for (i=0; i<NEBULA_Z; i++) {
-      nsnprintf( nebu_file, PATH_MAX, NEBULA_PATH_BG, nebu_w, nebu_h, i );
+   /* Check compatibility. */
+   nebu_genKey();
+   if (nebu_checkCompat())
+      goto no_nebula;
 
-      /* Check compatibility. */
-      if (nebu_checkCompat( nebu_file ))
-         goto no_nebula;
+   /* Load each, checking for integrity and padding */
+   for (i=0; i<NEBULA_Z; i++) {
+      nsnprintf( nebu_file, PATH_MAX, NEBULA_PATH_BG, nebu_w, nebu_h, nebu_key, i );
 
       /* Try to load. */
-      nebu_sur = loadNebula( nebu_file );
+      nebu_sur = loadNebula( nebu_file, nebu_sums[i] );
       if (nebu_sur == NULL)
          goto no_nebula;
       if ((nebu_sur->w != nebu_w) || (nebu_sur->h != nebu_h))
@@ -509,10 +517,13 @@ void nebu_forceGenerate (void)
  */
 static int nebu_generate (void)
 {
-   int i;
+   int i, l;
    float *nebu;
    const char *cache;
    char nebu_file[PATH_MAX];
+   char sums[NEBULA_Z*33];
+   char *buf;
+   size_t bufsize;
    int w,h;
    int ret;
 
@@ -529,19 +540,39 @@ static int nebu_generate (void)
    nfile_dirMakeExist( "%s"NEBULA_PATH, cache );
 
    /* Generate all the nebula backgrounds */
-   nebu = noise_genNebulaMap( w, h, NEBULA_Z, 5. );
+   nebu = noise_genNebulaMap( w, h, NEBULA_Z, NEBULA_RUGOSITY );
+   if (nebu == NULL)
+      return -1;
 
    /* Start saving - compression can take a bit. */
    loadscreen_render( 0.05, _("Compressing Nebula layers...") );
 
-   /* Save each nebula as an image */
+   /* Save each nebula as an image and checksum it. */
+   nebu_genKey();
+   ret = 0;
+   l   = 0;
    for (i=0; i<NEBULA_Z; i++) {
-      nsnprintf( nebu_file, PATH_MAX, NEBULA_PATH_BG, w, h, i );
+      nsnprintf( nebu_file, PATH_MAX, NEBULA_PATH_BG, w, h, nebu_key, i );
       ret = saveNebula( &nebu[ i*w*h ], w, h, nebu_file );
       if (ret != 0)
          break; /* An error has happened */
+
+      buf = nfile_readFile( &bufsize, "%s"NEBULA_PATH"%s", cache, nebu_file );
+      if (buf == NULL) {
+         ret = -1;
+         break;
+      }
+      nebu_md5( &sums[l], buf, bufsize );
+      free(buf);
+      sums[l+32] = '\n';
+      l += 33;
    }
 
+   /* Checksums are written last so interrupted generation is detected. */
+   if (ret == 0)
+      ret = nfile_writeFile( sums, l, "%s"NEBULA_PATH NEBULA_PATH_SUM,
+            cache, w, h, nebu_key );
+
    /* Cleanup */
    free(nebu);
    return ret;
@@ -577,16 +608,72 @@ static void nebu_generatePuffs (void)
 
 
 /**
- * @brief Checks the validity of a nebula.
+ * @brief Generates the key of the nebula generation parameters.
+ *
+ * Cached nebulae generated with other parameters or another version of
+ * the noise generator won't be picked up.
+ */
+static void nebu_genKey (void)
+{
+   char buf[128], digest[33];
+   int l;
+
+   l = nsnprintf( buf, sizeof(buf), "%d %d %f", NOISE_NEBULA_VERSION,
+         NEBULA_Z, NEBULA_RUGOSITY );
+   nebu_md5( digest, buf, l );
+   strncpy( nebu_key, digest, sizeof(nebu_key)-1 );
+   nebu_key[ sizeof(nebu_key)-1 ] = '\0';
+}
+
+
+/**
+ * @brief Gets the md5 of some data as a hexadecimal string.
+ *
+ *    @param[out] digest String to write to (32 characters and terminator).
+ *    @param data Data to hash.
+ *    @param len Length of the data.
+ */
+static void nebu_md5( char digest[33], const char *data, size_t len )
+{
+   md5_state_t md5;
+   md5_byte_t md5val[16];
+   int i;
+
+   md5_init( &md5 );
+   md5_append( &md5, (const md5_byte_t*)data, len );
+   md5_finish( &md5, md5val );
+   for (i=0; i<16; i++)
+      nsnprintf( &digest[i * 2], 3, "%02x", md5val[i] );
+}
+
+
+/**
+ * @brief Checks the validity of the cached nebula for the current resolution.
+ *
+ * Loads the checksums of the layers into nebu_sums.
  *
- *    @param file Path of the nebula to check (relative to base directory).
  *    @return 0 on success.
  */
-static int nebu_checkCompat( const char* file )
+static int nebu_checkCompat (void)
 {
-   /* first check to see if file exists */
-   if (nfile_fileExists("%s"NEBULA_PATH"%s", nfile_cachePath(), file) == 0)
+   char *buf;
+   size_t bufsize;
+   int i;
+
+   /* Checksums are only written once all the layers are. */
+   buf = nfile_readFile( &bufsize, "%s"NEBULA_PATH NEBULA_PATH_SUM,
+         nfile_cachePath(), nebu_w, nebu_h, nebu_key );
+   if (buf == NULL)
+      return -1;
+   if (bufsize != NEBULA_Z*33) {
+      free(buf);
       return -1;
+   }
+   for (i=0; i<NEBULA_Z; i++) {
+      memcpy( nebu_sums[i], &buf[i*33], 32 );
+      nebu_sums[i][32] = '\0';
+   }
+   free(buf);
    return 0;
 }
 
@@ -624,31 +711,50 @@ static int saveNebula( float *map, const uint32_t w, const uint32_t h, const cha
  * @brief Loads the nebulae from file.
  *
  *    @param file Path of the nebula to load.  Relative to base directory.
+ *    @param sum Expected md5 of the file.
  *    @return A SDL surface with the nebula.
  */
-static SDL_Surface* loadNebula( const char* file )
+static SDL_Surface* loadNebula( const char* file, const char *sum )
 {
-   char file_path[PATH_MAX];
+   char digest[33];
+   char *buf;
+   size_t bufsize;
    SDL_Surface* sur;
    SDL_RWops *rw;
    npng_t *npng;
 
    /* loads the file */
-   nsnprintf(file_path, PATH_MAX, "%s"NEBULA_PATH"%s", nfile_cachePath(), file );
-   rw    = SDL_RWFromFile( file_path, "rb" );;
+   buf = nfile_readFile( &bufsize, "%s"NEBULA_PATH"%s", nfile_cachePath(), file );
+   if (buf == NULL) {
+      WARN(_("Unable to read Nebula image: %s"), file);
+      return NULL;
+   }
+
+   /* Make sure it's what was generated. */
+   nebu_md5( digest, buf, bufsize );
+   if (strcmp( digest, sum ) != 0) {
+      WARN(_("Nebula image '%s' doesn't match its checksum!"), file);
+      free(buf);
+      return NULL;
+   }
+
+   rw    = SDL_RWFromConstMem( buf, bufsize );
    if (rw == NULL) {
       WARN(_("Unable to create rwops from Nebula image: %s"), file);
+      free(buf);
       return NULL;
    }
    npng  = npng_open( rw );
    if (npng == NULL) {
       WARN(_("Unable to open Nebula image: %s"), file);
       SDL_RWclose( rw );
+      free(buf);
       return NULL;
    }
    sur   = npng_readSurface( npng, 0, 1 );
    npng_close( npng );
    SDL_RWclose( rw );
+   free(buf);
    if (sur == NULL) {
       WARN(_("Unable to load Nebula image: %s"), file);
       return NULL;
@@ -32,10 +32,32 @@
 #include "nlua_commodity.h"
 #include "nlua_cli.h"
 #include "nstring.h"
+#include "nfile.h"
+#include "md5.h"
+#include "array.h"
+
+#ifdef HAVE_LUAJIT
+#include <luajit.h>
+#define NLUA_CACHE_VERSION    LUAJIT_VERSION /**< Bytecode is only valid for this version. */
+#else /* HAVE_LUAJIT */
+#define NLUA_CACHE_VERSION    LUA_RELEASE /**< Bytecode is only valid for this version. */
+#endif /* HAVE_LUAJIT */
+#define NLUA_CACHE_PATH       "luac/" /**< Subdirectory of the cache path for bytecode. */
+
+
+/**
+ * @brief Compiled Lua chunk.
+ */
+typedef struct LuaChunk_s {
+   char *name; /**< Path of the script in ndata. */
+   char *code; /**< Compiled bytecode. */
+   size_t len; /**< Length of the bytecode. */
+} LuaChunk_t;
 
 
 lua_State *naevL = NULL;
 nlua_env __NLUA_CURENV = LUA_NOREF;
+static LuaChunk_t *nlua_chunks = NULL; /**< Compiled chunks sorted by name (array.h). */
 
 
 /*
@@ -45,6 +67,10 @@ static int nlua_packfileLoader( lua_State* L );
 static lua_State *nlua_newState (void); /* creates a new state */
 static int nlua_loadBasic( lua_State* L );
 static int nlua_errTrace( lua_State *L );
+/* bytecode cache */
+static int nlua_chunkFind( const char *name, int *pos );
+static int nlua_chunkWriter( lua_State *L, const void *p, size_t sz, void *ud );
+static void nlua_chunkFree (void);
 /* gettext */
 static int nlua_gettext( lua_State *L );
 static int nlua_ngettext( lua_State *L );
@@ -107,6 +133,7 @@ void lua_init(void) {
 void lua_exit(void) {
    lua_close(naevL);
    naevL = NULL;
+   nlua_chunkFree();
 }
 
 
@@ -132,6 +159,182 @@ int nlua_dobufenv(nlua_env env,
 }
 
 
+/**
+ * @brief Finds a compiled chunk by name.
+ *
+ *    @param name Name of the chunk to find.
+ *    @param[out] pos Position the chunk is or should be inserted at.
+ *    @return 1 if found, 0 otherwise.
+ */
+static int nlua_chunkFind( const char *name, int *pos )
+{
+   int lo, hi, mid, c;
+
+   lo = 0;
+   hi = (nlua_chunks==NULL) ? 0 : array_size(nlua_chunks);
+   while (lo < hi) {
+      mid = (lo+hi) / 2;
+      c = strcmp( nlua_chunks[mid].name, name );
+      if (c == 0) {
+         *pos = mid;
+         return 1;
+      }
+      else if (c < 0)
+         lo = mid+1;
+      else
+         hi = mid;
+   }
+   *pos = lo;
+   return 0;
+}
+
+
+/**
+ * @brief lua_dump writer that appends to a chunk.
+ */
+static int nlua_chunkWriter( lua_State *L, const void *p, size_t sz, void *ud )
+{
+   (void) L;
+   LuaChunk_t *chunk;
+
+   chunk = (LuaChunk_t*) ud;
+   chunk->code = realloc( chunk->code, chunk->len + sz );
+   memcpy( &chunk->code[ chunk->len ], p, sz );
+   chunk->len += sz;
+   return 0;
+}
+
+
+/**
+ * @brief Frees all the compiled chunks.
+ */
+static void nlua_chunkFree (void)
+{
+   int i;
+
+   if (nlua_chunks == NULL)
+      return;
+   for (i=0; i<array_size(nlua_chunks); i++) {
+      free( nlua_chunks[i].name );
+      free( nlua_chunks[i].code );
+   }
+   array_free( nlua_chunks );
+   nlua_chunks = NULL;
+}
+
+
+/**
+ * @brief Loads a Lua script from ndata as a function, without running it.
+ *
+ * Compiled chunks are kept in memory so a script is only parsed once, and
+ *  written to the cache directory keyed by the hash of the source and the
+ *  Lua version so they don't have to be parsed again on the next run.
+ *
+ *    @param L Lua state to push the function onto.
+ *    @param filename Path of the script in ndata.
+ *    @return 0 on success, otherwise an error message is pushed instead.
+ */
+int nlua_loadndata( lua_State *L, const char *filename )
+{
+   int i, pos, ret;
+   char *buf, *cachefile;
+   size_t bufsize, cachesize;
+   md5_state_t md5;
+   md5_byte_t md5val[16];
+   char digest[33];
+   LuaChunk_t chunk;
+
+   /* Already compiled. */
+   if (nlua_chunkFind( filename, &pos ))
+      return luaL_loadbuffer( L, nlua_chunks[pos].code,
+            nlua_chunks[pos].len, filename );
+
+   buf = ndata_read( filename, &bufsize );
+   if (buf == NULL) {
+      lua_pushfstring( L, _("%s not found in ndata."), filename );
+      return -1;
+   }
+
+   /* Look for bytecode compiled in a previous run. */
+   md5_init( &md5 );
+   md5_append( &md5, (md5_byte_t*)buf, bufsize );
+   md5_append( &md5, (md5_byte_t*)NLUA_CACHE_VERSION, strlen(NLUA_CACHE_VERSION) );
+   md5_finish( &md5, md5val );
+   for (i=0; i<16; i++)
+      nsnprintf( &digest[i * 2], 3, "%02x", md5val[i] );
+
+   cachefile = malloc( PATH_MAX );
+   nsnprintf( cachefile, PATH_MAX, "%s"NLUA_CACHE_PATH"%s", nfile_cachePath(), digest );
+
+   memset( &chunk, 0, sizeof(chunk) );
+   ret = -1;
+   if (nfile_fileExists( cachefile )) {
+      chunk.code = nfile_readFile( &cachesize, cachefile );
+      chunk.len  = cachesize;
+      if (chunk.code != NULL) {
+         ret = luaL_loadbuffer( L, chunk.code, chunk.len, filename );
+         /* Stale or corrupt, compile from source instead. */
+         if (ret != 0) {
+            lua_pop( L, 1 );
+            free( chunk.code );
+            chunk.code = NULL;
+            chunk.len  = 0;
+         }
+      }
+   }
+
+   /* Compile from source. */
+   if (ret != 0) {
+      ret = luaL_loadbuffer( L, buf, bufsize, filename );
+      if (ret != 0) {
+         free( cachefile );
+         free( buf );
+         return ret;
+      }
+      lua_dump( L, nlua_chunkWriter, &chunk );
+      if (chunk.code != NULL) {
+         nfile_dirMakeExist( "%s"NLUA_CACHE_PATH, nfile_cachePath() );
+         nfile_writeFile( chunk.code, chunk.len, cachefile );
+      }
+   }
+   free( cachefile );
+   free( buf );
+
+   /* Keep in memory for the next time. */
+   if (chunk.code != NULL) {
+      if (nlua_chunks == NULL)
+         nlua_chunks = array_create( LuaChunk_t );
+      chunk.name = strdup( filename );
+      array_resize( &nlua_chunks, array_size(nlua_chunks)+1 );
+      memmove( &nlua_chunks[pos+1], &nlua_chunks[pos],
+            sizeof(LuaChunk_t) * (array_size(nlua_chunks)-pos-1) );
+      nlua_chunks[pos] = chunk;
+   }
+
+   return 0;
+}
+
+
+/*
+ * @brief Run a Lua script from ndata in Lua environment.
+ *
+ * Uses the compiled chunk cache, see nlua_loadndata().
+ *
+ *    @param env Lua environment.
+ *    @param filename Path of the script in ndata.
+ *    @return 0 on success, otherwise an error message is left on the stack.
+ */
+int nlua_dondataenv(nlua_env env, const char *filename) {
+   if (nlua_loadndata(naevL, filename) != 0)
+      return -1;
+   nlua_pushenv(env);
+   lua_setfenv(naevL, -2);
+   if (nlua_pcall(env, 0, LUA_MULTRET) != 0)
+      return -1;
+   return 0;
+}
+
+
 /*
  * @brief Run code a file in Lua environment.
  *
@@ -337,11 +540,9 @@ static int nlua_loadBasic( lua_State* L )
  */
 static int nlua_packfileLoader( lua_State* L )
 {
-   const char *filename;
+   const char *filename, *path;
    char *path_filename;
-   char *buf;
-   int len;
-   size_t bufsize;
+   int len, pos;
    int envtab;
 
    /* Environment table to load module into */
@@ -368,31 +569,35 @@ static int nlua_packfileLoader( lua_State* L )
    }
 
    /* Try to locate the data directly */
-   buf = NULL;
-   if (ndata_exists( filename ))
-      buf = ndata_read( filename, &bufsize );
-   /* If failed to load or doesn't exist try again with INCLUDE_PATH prefix. */
-   if (buf == NULL) {
+   path           = NULL;
+   path_filename  = NULL;
+   if (nlua_chunkFind( filename, &pos ) || ndata_exists( filename ))
+      path = filename;
+   /* If doesn't exist try again with INCLUDE_PATH prefix. */
+   else {
       /* Try to locate the data in the data path */
       len           = strlen(LUA_INCLUDE_PATH)+strlen(filename)+2;
       path_filename = malloc( len );
       nsnprintf( path_filename, len, "%s%s", LUA_INCLUDE_PATH, filename );
-      if (ndata_exists( path_filename ))
-         buf = ndata_read( path_filename, &bufsize );
-      free( path_filename );
+      if (nlua_chunkFind( path_filename, &pos ) || ndata_exists( path_filename ))
+         path = path_filename;
    }
 
-   /* Must have buf by now. */
-   if (buf == NULL) {
+   /* Must have path by now. */
+   if (path == NULL) {
+      free( path_filename );
       DEBUG(_("include(): %s not found in ndata."), filename);
       luaL_error(L, _("include(): %s not found in ndata."), filename);
       return 1;
    }
 
-   if (luaL_loadbuffer(L, buf, bufsize, filename) != 0) {
+   /* Compiled chunks are cached so includes are only parsed once. */
+   if (nlua_loadndata(L, path) != 0) {
+      free( path_filename );
       lua_error(L);
       return 1;
    }
+   free( path_filename );
 
    lua_pushvalue(L, envtab);
    lua_setfenv(L, -2);
@@ -415,8 +620,7 @@ static int nlua_packfileLoader( lua_State* L )
    lua_setfield(L, -2, filename);   /* val, t */
    lua_pop(L, 1); /* val */
 
-   /* cleanup, success */
-   free(buf);
+   /* success */
    return 1;
 }
 
@@ -34,6 +34,8 @@ int nlua_dobufenv(nlua_env env,
                   size_t sz,
                   const char *name);
 int nlua_dofileenv(nlua_env env, const char *filename);
+int nlua_loadndata( lua_State *L, const char *filename );
+int nlua_dondataenv(nlua_env env, const char *filename);
 int nlua_loadStandard( nlua_env env );
 int nlua_pcall( nlua_env env, int nargs, int nresults );
 
@@ -28,6 +28,7 @@ static int factionL_get( lua_State *L );
 static int factionL_eq( lua_State *L );
 static int factionL_name( lua_State *L );
 static int factionL_longname( lua_State *L );
+static int factionL_relation( lua_State *L, int (*rel)( int a, int b ) );
 static int factionL_areenemies( lua_State *L );
 static int factionL_areallies( lua_State *L );
 static int factionL_modplayer( lua_State *L );
@@ -250,44 +251,66 @@ static int factionL_longname( lua_State *L )
    return 1;
 }
 
+/**
+ * @brief Checks a relation between a faction and a faction or table of factions.
+ */
+static int factionL_relation( lua_State *L, int (*rel)( int a, int b ) )
+{
+   int f, i, n;
+   f  = luaL_validfaction(L,1);
+
+   /* Single faction. */
+   if (!lua_istable(L,2)) {
+      lua_pushboolean(L, rel( f, luaL_validfaction(L,2) ));
+      return 1;
+   }
+
+   /* Table of factions, results are in the same order. */
+   n = (int) lua_objlen(L,2);
+   lua_createtable(L,n,0);
+   for (i=1; i<=n; i++) {
+      lua_rawgeti(L,2,i);
+      lua_pushboolean(L, rel( f, luaL_validfaction(L,-1) ));
+      lua_remove(L,-2);
+      lua_rawseti(L,-2,i);
+   }
+   return 1;
+}
+
 /**
  * @brief Checks to see if f is an enemy of e.
  *
+ * If e is a table of factions, checks all of them at once.
+ *
  * @usage if f:areEnemies( faction.get( "Dvaered" ) ) then
+ * @usage r = f:areEnemies( { fa, fb } ) -- r[1] and r[2] are booleans
  *
  *    @luatparam Faction f Faction to check against.
- *    @luatparam Faction e Faction to check if is an enemy.
- *    @luatreturn string true if they are enemies, false if they aren't.
+ *    @luatparam Faction|{Faction,...} e Faction or factions to check if are enemies.
+ *    @luatreturn boolean|{boolean,...} true if they are enemies, false if they aren't.
  * @luafunc areEnemies( f, e )
  */
 static int factionL_areenemies( lua_State *L )
 {
-   int f, ff;
-   f  = luaL_validfaction(L,1);
-   ff = luaL_validfaction(L,2);
-
-   lua_pushboolean(L, areEnemies( f, ff ));
-   return 1;
+   return factionL_relation( L, areEnemies );
 }
 
 /**
  * @brief Checks to see if f is an ally of a.
  *
+ * If a is a table of factions, checks all of them at once.
+ *
  * @usage if f:areAllies( faction.get( "Pirate" ) ) then
+ * @usage r = f:areAllies( { fa, fb } ) -- r[1] and r[2] are booleans
  *
  *    @luatparam Faction f Faction to check against.
- *    @luatparam faction a Faction to check if is an enemy.
- *    @luatreturn boolean true if they are enemies, false if they aren't.
+ *    @luatparam Faction|{Faction,...} a Faction or factions to check if are allies.
+ *    @luatreturn boolean|{boolean,...} true if they are allies, false if they aren't.
  * @luafunc areAllies( f, a )
  */
 static int factionL_areallies( lua_State *L )
 {
-   int f, ff;
-   f  = luaL_validfaction(L,1);
-   ff = luaL_validfaction(L,2);
-
-   lua_pushboolean(L, areAllies( f, ff ));
-   return 1;
+   return factionL_relation( L, areAllies );
 }
 
 /**
@@ -54,10 +54,16 @@ extern int pilot_nstack;
 extern Pilot *cur_pilot;
 
 
+static Pilot **pilotL_query = NULL; /**< Reused buffer for spatial queries (array.h). */
+
+
 /*
  * Prototypes.
  */
 static Task *pilotL_newtask( lua_State *L, Pilot* p, const char *task );
+static void pilotL_pushvector( lua_State *L, int ind, const Vector2d *vec );
+static int pilotL_pushQuery( lua_State *L, int ind, int n );
+static int pilotL_getFiltered( lua_State *L, PilotFilter filter );
 static int pilotL_addFleetFrom( lua_State *L, int from_ship );
 static int outfit_compareActive( const void *slot1, const void *slot2 );
 
@@ -69,6 +75,11 @@ static int pilotL_remove( lua_State *L );
 static int pilotL_clear( lua_State *L );
 static int pilotL_toggleSpawn( lua_State *L );
 static int pilotL_getPilots( lua_State *L );
+static int pilotL_getInRange( lua_State *L );
+static int pilotL_getNearest( lua_State *L );
+static int pilotL_getEnemies( lua_State *L );
+static int pilotL_getAllies( lua_State *L );
+static int pilotL_getVisible( lua_State *L );
 static int pilotL_eq( lua_State *L );
 static int pilotL_name( lua_State *L );
 static int pilotL_id( lua_State *L );
@@ -83,7 +94,9 @@ static int pilotL_actives( lua_State *L );
 static int pilotL_outfits( lua_State *L );
 static int pilotL_rename( lua_State *L );
 static int pilotL_position( lua_State *L );
+static int pilotL_positionXY( lua_State *L );
 static int pilotL_velocity( lua_State *L );
+static int pilotL_velocityXY( lua_State *L );
 static int pilotL_dir( lua_State *L );
 static int pilotL_ew( lua_State *L );
 static int pilotL_temp( lua_State *L );
@@ -158,6 +171,11 @@ static const luaL_Reg pilotL_methods[] = {
    { "add", pilotL_addFleet },
    { "rm", pilotL_remove },
    { "get", pilotL_getPilots },
+   { "getInRange", pilotL_getInRange },
+   { "getNearest", pilotL_getNearest },
+   { "getEnemies", pilotL_getEnemies },
+   { "getAllies", pilotL_getAllies },
+   { "getVisible", pilotL_getVisible },
    { "__eq", pilotL_eq },
    /* Info. */
    { "name", pilotL_name },
@@ -173,7 +191,9 @@ static const luaL_Reg pilotL_methods[] = {
    { "outfits", pilotL_outfits },
    { "rename", pilotL_rename },
    { "pos", pilotL_position },
+   { "posxy", pilotL_positionXY },
    { "vel", pilotL_velocity },
+   { "velxy", pilotL_velocityXY },
    { "dir", pilotL_dir },
    { "ew", pilotL_ew },
    { "temp", pilotL_temp },
@@ -815,6 +835,176 @@ static int pilotL_getPilots( lua_State *L )
    return 1;
 }
 
+/**
+ * @brief Pushes the results of a spatial query as a table.
+ *
+ * If there is a table at ind it is reused, otherwise a new one is created.
+ *
+ *    @param L Lua state.
+ *    @param ind Index of the table to reuse.
+ *    @param n Number of pilots in pilotL_query.
+ *    @return Number of values pushed.
+ */
+static int pilotL_pushQuery( lua_State *L, int ind, int n )
+{
+   int i;
+
+   if (lua_istable(L,ind))
+      lua_pushvalue(L,ind);
+   else
+      lua_createtable(L,n,0);
+
+   for (i=0; i<n; i++) {
+      lua_pushpilot(L, pilotL_query[i]->id);
+      lua_rawseti(L,-2,i+1);
+   }
+
+   /* Clear left over elements of a reused table. */
+   for (i=n+1; ; i++) {
+      lua_rawgeti(L,-1,i);
+      if (lua_isnil(L,-1)) {
+         lua_pop(L,1);
+         break;
+      }
+      lua_pop(L,1);
+      lua_pushnil(L);
+      lua_rawseti(L,-2,i);
+   }
+   return 1;
+}
+
+/**
+ * @brief Gets the pilots within a radius of a position sorted by distance.
+ *
+ * Disabled pilots are included.
+ *
+ * @usage pl = pilot.getInRange( vec2.new( 0, 0 ), 3000 ) -- Pilots near the origin
+ * @usage pilot.getInRange( pos, 3000, pl ) -- Reuses the table pl
+ *
+ *    @luatparam Vec2 pos Position to get pilots around.
+ *    @luatparam number radius Maximum distance from the position.
+ *    @luatparam[opt] table t Table to store the pilots in.
+ *    @luatreturn {Pilot,...} The pilots found, nearest first.
+ * @luafunc getInRange( pos, radius, t )
+ */
+static int pilotL_getInRange( lua_State *L )
+{
+   Vector2d *v;
+   double r;
+   int n;
+
+   v = luaL_checkvector(L,1);
+   r = luaL_checknumber(L,2);
+
+   n = pilot_gridQuery( &pilotL_query, NULL, v->x, v->y, r, 0,
+         pilot_filterExists, NULL );
+   return pilotL_pushQuery( L, 3, n );
+}
+
+/**
+ * @brief Gets the pilots nearest to a position.
+ *
+ * Disabled pilots are included.
+ *
+ * @usage pl = pilot.getNearest( pos, 3 ) -- Three nearest pilots
+ * @usage pl = pilot.getNearest( pos, 3, 5000 ) -- Three nearest pilots within 5000
+ *
+ *    @luatparam Vec2 pos Position to get pilots around.
+ *    @luatparam number k Maximum number of pilots to get.
+ *    @luatparam[opt] number radius Maximum distance from the position.
+ *    @luatparam[opt] table t Table to store the pilots in.
+ *    @luatreturn {Pilot,...} The pilots found, nearest first.
+ * @luafunc getNearest( pos, k, radius, t )
+ */
+static int pilotL_getNearest( lua_State *L )
+{
+   Vector2d *v;
+   double r;
+   int k, n;
+
+   v = luaL_checkvector(L,1);
+   k = luaL_checkint(L,2);
+   r = luaL_optnumber(L,3,-1.);
+
+   if (k <= 0) {
+      NLUA_ERROR(L, _("Number of pilots to get must be positive."));
+      return 0;
+   }
+
+   n = pilot_gridQuery( &pilotL_query, NULL, v->x, v->y, r, k,
+         pilot_filterExists, NULL );
+   return pilotL_pushQuery( L, 4, n );
+}
+
+/**
+ * @brief Gets the pilots around a pilot matching a filter.
+ */
+static int pilotL_getFiltered( lua_State *L, PilotFilter filter )
+{
+   Pilot *p;
+   double r;
+   int n;
+
+   p = luaL_validpilot(L,1);
+   r = luaL_optnumber(L,2,-1.);
+
+   n = pilot_gridQuery( &pilotL_query, p, p->solid->pos.x, p->solid->pos.y,
+         r, 0, filter, NULL );
+   return pilotL_pushQuery( L, 3, n );
+}
+
+/**
+ * @brief Gets the enemies of a pilot it can target sorted by distance.
+ *
+ * Disabled pilots are not included.
+ *
+ * @usage el = p:getEnemies( 5000 ) -- Enemies within 5000
+ *
+ *    @luatparam Pilot p Pilot to get enemies of.
+ *    @luatparam[opt] number radius Maximum distance from the pilot.
+ *    @luatparam[opt] table t Table to store the pilots in.
+ *    @luatreturn {Pilot,...} The enemies found, nearest first.
+ * @luafunc getEnemies( p, radius, t )
+ */
+static int pilotL_getEnemies( lua_State *L )
+{
+   return pilotL_getFiltered( L, pilot_filterEnemy );
+}
+
+/**
+ * @brief Gets the allies of a pilot sorted by distance.
+ *
+ * Pilots of the same faction are included.
+ *
+ * @usage al = p:getAllies( 5000 ) -- Allies within 5000
+ *
+ *    @luatparam Pilot p Pilot to get allies of.
+ *    @luatparam[opt] number radius Maximum distance from the pilot.
+ *    @luatparam[opt] table t Table to store the pilots in.
+ *    @luatreturn {Pilot,...} The allies found, nearest first.
+ * @luafunc getAllies( p, radius, t )
+ */
+static int pilotL_getAllies( lua_State *L )
+{
+   return pilotL_getFiltered( L, pilot_filterAlly );
+}
+
+/**
+ * @brief Gets the pilots a pilot can see sorted by distance.
+ *
+ * @usage vl = p:getVisible() -- All the pilots p can see
+ *
+ *    @luatparam Pilot p Pilot to get visible pilots of.
+ *    @luatparam[opt] number radius Maximum distance from the pilot.
+ *    @luatparam[opt] table t Table to store the pilots in.
+ *    @luatreturn {Pilot,...} The pilots found, nearest first.
+ * @luafunc getVisible( p, radius, t )
+ */
+static int pilotL_getVisible( lua_State *L )
+{
+   return pilotL_getFiltered( L, pilot_filterVisible );
+}
+
 /**
  * @brief Checks to see if pilot and p are the same.
  *
@@ -1634,14 +1824,32 @@ static int pilotL_rename( lua_State *L )
    return 0;
 }
 
+/**
+ * @brief Pushes a pilot vector, reusing the vector at index ind if there is one.
+ */
+static void pilotL_pushvector( lua_State *L, int ind, const Vector2d *vec )
+{
+   if (lua_isvector(L,ind)) {
+      *lua_tovector(L,ind) = *vec;
+      lua_pushvalue(L,ind);
+   }
+   else
+      lua_pushvector(L, *vec);
+}
+
 /**
  * @brief Gets the pilot's position.
  *
+ * If a vector is passed it is set to the position instead of allocating a new
+ *  one.
+ *
  * @usage v = p:pos()
+ * @usage p:pos( v ) -- Sets v to the position
  *
  *    @luatparam Pilot p Pilot to get the position of.
+ *    @luatparam[opt] Vec2 v Vector to store the position in.
  *    @luatreturn Vec2 The pilot's current position.
- * @luafunc pos( p )
+ * @luafunc pos( p, v )
  */
 static int pilotL_position( lua_State *L )
 {
@@ -1651,18 +1859,48 @@ static int pilotL_position( lua_State *L )
    p     = luaL_validpilot(L,1);
 
    /* Push position. */
-   lua_pushvector(L, p->solid->pos);
+   pilotL_pushvector(L, 2, &p->solid->pos);
    return 1;
 }
 
+/**
+ * @brief Gets the pilot's position as coordinates.
+ *
+ * Doesn't allocate a vector so it's cheaper than pos().
+ *
+ * @usage x, y = p:posxy()
+ *
+ *    @luatparam Pilot p Pilot to get the position of.
+ *    @luatreturn number X coordinate of the pilot's position.
+ *    @luatreturn number Y coordinate of the pilot's position.
+ * @luafunc posxy( p )
+ */
+static int pilotL_positionXY( lua_State *L )
+{
+   Pilot *p;
+
+   /* Parse parameters */
+   p     = luaL_validpilot(L,1);
+
+   /* Push position. */
+   lua_pushnumber(L, p->solid->pos.x);
+   lua_pushnumber(L, p->solid->pos.y);
+   return 2;
+}
+
 /**
  * @brief Gets the pilot's velocity.
  *
+ * If a vector is passed it is set to the velocity instead of allocating a new
+ *  one.
+ *
  * @usage vel = p:vel()
+ * @usage p:vel( v ) -- Sets v to the velocity
  *
  *    @luatparam Pilot p Pilot to get the velocity of.
+ *    @luatparam[opt] Vec2 v Vector to store the velocity in.
  *    @luatreturn Vec2 The pilot's current velocity.
- * @luafunc vel( p )
+ * @luafunc vel( p, v )
  */
 static int pilotL_velocity( lua_State *L )
 {
@@ -1672,10 +1910,35 @@ static int pilotL_velocity( lua_State *L )
    p     = luaL_validpilot(L,1);
 
    /* Push velocity. */
-   lua_pushvector(L, p->solid->vel);
+   pilotL_pushvector(L, 2, &p->solid->vel);
    return 1;
 }
 
+/**
+ * @brief Gets the pilot's velocity as coordinates.
+ *
+ * Doesn't allocate a vector so it's cheaper than vel().
+ *
+ * @usage vx, vy = p:velxy()
+ *
+ *    @luatparam Pilot p Pilot to get the velocity of.
+ *    @luatreturn number X coordinate of the pilot's velocity.
+ *    @luatreturn number Y coordinate of the pilot's velocity.
+ * @luafunc velxy( p )
+ */
+static int pilotL_velocityXY( lua_State *L )
+{
+   Pilot *p;
+
+   /* Parse parameters */
+   p     = luaL_validpilot(L,1);
+
+   /* Push velocity. */
+   lua_pushnumber(L, p->solid->vel.x);
+   lua_pushnumber(L, p->solid->vel.y);
+   return 2;
+}
+
 /**
  * @brief Gets the pilot's evasion.
  *
@@ -2582,7 +2845,9 @@ static int pilotL_addOutfit( lua_State *L )
 
       /* Add outfit - already tested. */
       ret = pilot_addOutfitRaw( p, o, p->outfits[i] );
-      pilot_calcStats( p );
+      /* Tests need up to date stats, when bypassing they are only updated once at the end. */
+      if (!bypass)
+         pilot_calcStats( p );
 
       /* Add ammo if needed. */
       if ((ret==0) && (outfit_ammo(o) != NULL))
@@ -2593,6 +2858,9 @@ static int pilotL_addOutfit( lua_State *L )
       added++;
    }
 
+   if (bypass && (added > 0))
+      pilot_calcStats( p );
+
    /* Update the weapon sets. */
    if ((added > 0) && p->autoweap)
       pilot_weaponAuto(p);
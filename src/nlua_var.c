@@ -15,6 +15,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include "nstring.h"
 #include <math.h>
 
@@ -32,6 +33,9 @@
 #define MISN_VAR_NUM    1 /**< Number type. */
 #define MISN_VAR_BOOL   2 /**< Boolean type. */
 #define MISN_VAR_STR    3 /**< String type. */
+
+#define VAR_HASH_MIN    256 /**< Minimum size of the variable hash index. */
+#define VAR_HASH_EMPTY  -1 /**< Empty slot in the variable hash index. */
 /**
  * @struct misn_var
  *
@@ -39,6 +43,7 @@
  */
 typedef struct misn_var_ {
    char* name; /**< Name of the variable. */
+   uint32_t hash; /**< Hash of the name. */
    char type; /**< Type of the variable. */
    union {
       double num; /**< Used if type is number. */
@@ -55,12 +60,24 @@ static misn_var* var_stack = NULL; /**< Stack of mission variables. */
 static int var_nstack      = 0; /**< Number of mission variables. */
 static int var_mstack      = 0; /**< Memory size of the mission variable stack. */
 
+/*
+ * Open addressing index into the variable stack, the stack itself keeps
+ * insertion order so saving is stable.
+ */
+static int *var_hash       = NULL; /**< Hash slots containing stack indices. */
+static int var_mhash       = 0; /**< Number of hash slots (power of two). */
+
 
 /*
  * prototypes
  */
 /* static */
+static uint32_t var_hashStr( const char *str );
+static int var_find( const char *str, uint32_t hash );
+static void var_hashInsert( int idx );
+static void var_hashRebuild (void);
 static int var_add( misn_var *var );
+static void var_pushValue( lua_State *L, const misn_var *var );
 static void var_free( misn_var* var );
 /* externed */
 int var_save( xmlTextWriterPtr writer );
@@ -71,10 +88,12 @@ int var_load( xmlNodePtr parent );
 static int var_peek( lua_State *L );
 static int var_pop( lua_State *L );
 static int var_push( lua_State *L );
+static int var_export( lua_State *L );
 static const luaL_Reg var_methods[] = {
    { "peek", var_peek },
    { "pop", var_pop },
    { "push", var_push },
+   { "export", var_export },
    {0,0}
 }; /**< Mission variable Lua methods. */
 
@@ -189,6 +208,87 @@ int var_load( xmlNodePtr parent )
 }
 
 
+/**
+ * @brief Hashes a variable name (FNV-1a).
+ *
+ *    @param str Name to hash.
+ *    @return Hash of the name.
+ */
+static uint32_t var_hashStr( const char *str )
+{
+   uint32_t h;
+   const unsigned char *c;
+
+   h = 2166136261u;
+   for (c=(const unsigned char*)str; *c!='\0'; c++) {
+      h ^= *c;
+      h *= 16777619u;
+   }
+   return h;
+}
+
+
+/**
+ * @brief Finds a variable in the stack.
+ *
+ *    @param str Name of the variable.
+ *    @param hash Hash of the name as returned by var_hashStr.
+ *    @return Index of the variable in the stack or -1 if not found.
+ */
+static int var_find( const char *str, uint32_t hash )
+{
+   int i, idx;
+
+   if (var_mhash == 0)
+      return -1;
+
+   for (i=hash & (var_mhash-1); ; i=(i+1) & (var_mhash-1)) {
+      idx = var_hash[i];
+      if (idx == VAR_HASH_EMPTY)
+         return -1;
+      if ((var_stack[idx].hash == hash) && (strcmp(var_stack[idx].name,str)==0))
+         return idx;
+   }
+}
+
+
+/**
+ * @brief Inserts a stack index into the hash index.
+ *
+ *    @param idx Index of the variable in the stack.
+ */
+static void var_hashInsert( int idx )
+{
+   int i;
+
+   for (i=var_stack[idx].hash & (var_mhash-1);
+         var_hash[i]!=VAR_HASH_EMPTY;
+         i=(i+1) & (var_mhash-1));
+   var_hash[i] = idx;
+}
+
+
+/**
+ * @brief Rebuilds the hash index, growing it to keep the load factor under half.
+ */
+static void var_hashRebuild (void)
+{
+   int i, n;
+
+   n = VAR_HASH_MIN;
+   while (n < 2*var_nstack)
+      n *= 2;
+   if (n != var_mhash) {
+      var_mhash = n;
+      var_hash  = realloc( var_hash, var_mhash * sizeof(int) );
+   }
+   for (i=0; i<var_mhash; i++)
+      var_hash[i] = VAR_HASH_EMPTY;
+   for (i=0; i<var_nstack; i++)
+      var_hashInsert( i );
+}
+
+
 /**
  * @brief Adds a var to the stack, strings will be SHARED, don't free.
  *
@@ -199,26 +299,59 @@ static int var_add( misn_var *new_var )
 {
    int i;
 
+   new_var->hash = var_hashStr( new_var->name );
+
+   /* check if already exists */
+   i = var_find( new_var->name, new_var->hash );
+   if (i >= 0) { /* overwrite */
+      var_free( &var_stack[i] );
+      var_stack[i] = *new_var;
+      return 0;
+   }
+
    if (var_nstack+1 > var_mstack) { /* more memory */
       var_mstack += 64; /* overkill ftw */
       var_stack = realloc( var_stack, var_mstack * sizeof(misn_var) );
    }
 
-   /* check if already exists */
-   for (i=0; i<var_nstack; i++)
-      if (strcmp(new_var->name,var_stack[i].name)==0) { /* overwrite */
-         var_free( &var_stack[i] );
-         var_stack[i] = *new_var;
-         return 0;
-      }
-
    var_stack[var_nstack] = *new_var;
    var_nstack++;
 
+   /* Update the index. */
+   if (2*var_nstack > var_mhash)
+      var_hashRebuild();
+   else
+      var_hashInsert( var_nstack-1 );
+
    return 0;
 }
 
 
+/**
+ * @brief Pushes the value of a mission variable onto the Lua stack.
+ *
+ *    @param L Lua state to push to.
+ *    @param var Variable to push.
+ */
+static void var_pushValue( lua_State *L, const misn_var *var )
+{
+   switch (var->type) {
+      case MISN_VAR_NIL:
+         lua_pushnil(L);
+         break;
+      case MISN_VAR_NUM:
+         lua_pushnumber(L,var->d.num);
+         break;
+      case MISN_VAR_BOOL:
+         lua_pushboolean(L,var->d.b);
+         break;
+      case MISN_VAR_STR:
+         lua_pushstring(L,var->d.str);
+         break;
+   }
+}
+
+
 /**
  * @brief Mission variable Lua bindings.
  *
@@ -246,12 +379,7 @@ static int var_add( misn_var *new_var )
  */
 int var_checkflag( char* str )
 {
-   int i;
-
-   for (i=0; i<var_nstack; i++)
-      if (strcmp(var_stack[i].name,str)==0)
-         return 1;
-   return 0;
+   return (var_find( str, var_hashStr(str) ) >= 0);
 }
 /**
  * @brief Gets the mission variable value of a certain name.
@@ -269,26 +397,12 @@ static int var_peek( lua_State *L )
    /* Get the parameter. */
    str = luaL_checkstring(L,1);
 
-   for (i=0; i<var_nstack; i++)
-      if (strcmp(str,var_stack[i].name)==0) {
-         switch (var_stack[i].type) {
-            case MISN_VAR_NIL:
-               lua_pushnil(L);
-               break;
-            case MISN_VAR_NUM:
-               lua_pushnumber(L,var_stack[i].d.num);
-               break;
-            case MISN_VAR_BOOL:
-               lua_pushboolean(L,var_stack[i].d.b);
-               break;
-            case MISN_VAR_STR:
-               lua_pushstring(L,var_stack[i].d.str);
-               break;
-         }
-         return 1;
-      }
+   i = var_find( str, var_hashStr(str) );
+   if (i < 0)
+      return 0;
 
-   return 0;
+   var_pushValue( L, &var_stack[i] );
+   return 1;
 }
 /**
  * @brief Pops a mission variable off the stack, destroying it.
@@ -307,15 +421,17 @@ static int var_pop( lua_State *L )
 
    str = luaL_checkstring(L,1);
 
-   for (i=0; i<var_nstack; i++)
-      if (strcmp(str,var_stack[i].name)==0) {
-         var_free( &var_stack[i] );
-         memmove( &var_stack[i], &var_stack[i+1], sizeof(misn_var)*(var_nstack-i-1) );
-         var_nstack--;
-         return 0;
-      }
+   i = var_find( str, var_hashStr(str) );
+   if (i < 0) {
+      /*NLUA_DEBUG("Var '%s' not found in stack", str);*/
+      return 0;
+   }
 
-   /*NLUA_DEBUG("Var '%s' not found in stack", str);*/
+   /* Keep insertion order, indices shift so the index has to be rebuilt. */
+   var_free( &var_stack[i] );
+   memmove( &var_stack[i], &var_stack[i+1], sizeof(misn_var)*(var_nstack-i-1) );
+   var_nstack--;
+   var_hashRebuild();
    return 0;
 }
 /**
@@ -363,6 +479,40 @@ static int var_push( lua_State *L )
 
    return 0;
 }
+/**
+ * @brief Exports mission variables into a table in a single call.
+ *
+ * Useful when many variables have to be checked at once, as it avoids a call
+ *  per variable.
+ *
+ * @usage t = var.export() -- Gets all the mission variables
+ * @usage t = var.export( "es_" ) -- Gets only variables starting with "es_"
+ *
+ *    @luatparam[opt] string prefix Only export variables whose name starts with prefix.
+ *    @luatreturn table Table mapping variable names to their values.
+ * @luafunc export( prefix )
+ */
+static int var_export( lua_State *L )
+{
+   int i;
+   const char *prefix;
+   size_t len;
+
+   prefix = luaL_optlstring(L,1,NULL,&len);
+
+   lua_createtable(L, 0, (prefix==NULL) ? var_nstack : 0);
+   for (i=0; i<var_nstack; i++) {
+      if ((prefix!=NULL) && (strncmp(var_stack[i].name,prefix,len)!=0))
+         continue;
+      /* Nil variables can't be stored in a table. */
+      if (var_stack[i].type == MISN_VAR_NIL)
+         continue;
+      lua_pushstring(L,var_stack[i].name);
+      var_pushValue( L, &var_stack[i] );
+      lua_rawset(L,-3);
+   }
+   return 1;
+}
 /**
  * @brief Frees a mission variable.
  *
@@ -402,5 +552,9 @@ void var_cleanup (void)
    var_stack   = NULL;
    var_nstack  = 0;
    var_mstack  = 0;
+
+   free( var_hash );
+   var_hash    = NULL;
+   var_mhash   = 0;
 }
 
@@ -20,6 +20,9 @@
 #include "log.h"
 
 
+static unsigned long vector_nalloc = 0; /**< Number of vectors allocated in Lua. */
+
+
 /* Vector metatable methods */
 static int vectorL_new( lua_State *L );
 static int vectorL_newP( lua_State *L );
@@ -131,11 +134,25 @@ Vector2d* lua_pushvector( lua_State *L, Vector2d vec )
    Vector2d *v;
    v = (Vector2d*) lua_newuserdata(L, sizeof(Vector2d));
    *v = vec;
+   vector_nalloc++;
    luaL_getmetatable(L, VECTOR_METATABLE);
    lua_setmetatable(L, -2);
    return v;
 }
 
+/**
+ * @brief Gets the number of vectors that have been allocated in Lua.
+ *
+ * Every allocation ends up as garbage to collect, so this gives an idea of
+ * the GC pressure caused by vectors.
+ *
+ *    @return Number of vectors allocated since start up.
+ */
+unsigned long nlua_vectorAllocs (void)
+{
+   return vector_nalloc;
+}
+
 /**
  * @brief Checks to see if ind is a vector.
  *
@@ -500,24 +517,35 @@ static int vectorL_polar( lua_State *L )
 }
 
 /**
- * @brief Sets the vector by cartesian coordinates.
+ * @brief Sets the vector by cartesian coordinates or copies another vector.
+ *
+ * Unlike creating a new vector this doesn't allocate, so it should be
+ *  preferred when reusing a vector in code that runs often.
  *
  * @usage my_vec:set(5, 3) -- my_vec is now (5,3)
+ * @usage my_vec:set(your_vec) -- my_vec is now a copy of your_vec
  *
  *    @luatparam Vec2 v Vector to set coordinates of.
- *    @luatparam number x X coordinate to set.
- *    @luatparam number y Y coordinate to set.
+ *    @luatparam number|Vec2 x X coordinate or vector to set.
+ *    @luatparam number|nil y Y coordinate to set or nil.
  * @luafunc set( v, x, y )
  */
 static int vectorL_set( lua_State *L )
 {
-   Vector2d *v1;
+   Vector2d *v1, *v2;
    double x, y;
 
    /* Get parameters. */
    v1 = luaL_checkvector(L,1);
-   x  = luaL_checknumber(L,2);
-   y  = luaL_checknumber(L,3);
+   if (lua_isvector(L,2)) {
+      v2 = lua_tovector(L,2);
+      x  = v2->x;
+      y  = v2->y;
+   }
+   else {
+      x  = luaL_checknumber(L,2);
+      y  = luaL_checknumber(L,3);
+   }
 
    vect_cset( v1, x, y );
    return 0;
@@ -27,6 +27,7 @@ Vector2d* lua_tovector( lua_State *L, int ind );
 Vector2d* luaL_checkvector( lua_State *L, int ind );
 Vector2d* lua_pushvector( lua_State *L, Vector2d vec );
 int lua_isvector( lua_State *L, int ind );
+unsigned long nlua_vectorAllocs (void);
 
 
 #endif /* NLUA_VEC2_H */
@@ -55,6 +55,7 @@ static int gl_tex_ext_npot = 0; /**< Support for GL_ARB_texture_non_power_of_two
 static int SDL_IsTrans( SDL_Surface* s, int x, int y );
 static uint8_t* SDL_MapTrans( SDL_Surface* s, int w, int h );
 static size_t gl_transSize( const int w, const int h );
+static void gl_transMask( glTexture* texture );
 /* glTexture */
 static GLuint gl_loadSurface( SDL_Surface* surface, int *rw, int *rh, unsigned int flags, int freesur );
 static glTexture* gl_loadNewImage( const char* path, unsigned int flags );
@@ -214,6 +215,65 @@ static size_t gl_transSize( const int w, const int h )
 }
 
 
+/**
+ * @brief Builds the collision masks of a texture from its transparency map.
+ *
+ * The mask has every row start on a 64 bit word so that collisions can test
+ *  64 pixels at a time, and each sprite gets the box bounding its opaque
+ *  pixels so most collisions can be rejected without looking at the mask.
+ *
+ *    @param texture Texture to build masks of, must have a transparency map.
+ */
+static void gl_transMask( glTexture* texture )
+{
+   int i, j, k, w, h, sw, sh, cx, cy, nx, ny;
+   int *box;
+   uint64_t *row;
+
+   w  = (int)texture->w;
+   h  = (int)texture->h;
+   sw = (int)texture->sw;
+   sh = (int)texture->sh;
+   nx = (int)texture->sx;
+   ny = (int)texture->sy;
+
+   /* Mask, the extra word lets unaligned reads run off the end of a row. */
+   free( texture->mask );
+   texture->mask_stride = (w+63)/64 + 1;
+   texture->mask = calloc( texture->mask_stride * h, sizeof(uint64_t) );
+
+   /* Sprite boxes start out empty. */
+   free( texture->sbox );
+   texture->sbox = malloc( 4 * nx * ny * sizeof(int) );
+   for (k=0; k<nx*ny; k++) {
+      box    = &texture->sbox[4*k];
+      box[0] = sw;
+      box[1] = sh;
+      box[2] = -1;
+      box[3] = -1;
+   }
+
+   for (i=0; i<h; i++) {
+      row = &texture->mask[ i*texture->mask_stride ];
+      cy  = MIN( i / MAX(sh,1), ny-1 );
+      for (j=0; j<w; j++) {
+         k = i*w + j;
+         if (!(texture->trans[ k/8 ] & (1 << (k%8))))
+            continue;
+         row[ j/64 ] |= ((uint64_t)1) << (j%64);
+
+         /* Grow the box of the sprite. */
+         cx     = MIN( j / MAX(sw,1), nx-1 );
+         box    = &texture->sbox[ 4*(cy*nx + cx) ];
+         box[0] = MIN( box[0], j - cx*sw );
+         box[1] = MIN( box[1], i - cy*sh );
+         box[2] = MAX( box[2], j - cx*sw );
+         box[3] = MAX( box[3], i - cy*sh );
+      }
+   }
+}
+
+
 /**
  * @brief Prepares the surface to be loaded as a texture.
  *
@@ -463,6 +523,7 @@ glTexture* gl_loadImagePadTrans( const char *name, SDL_Surface* surface, SDL_RWo
 
    texture = gl_loadImagePad( name, surface, flags, w, h, sx, sy, freesur );
    texture->trans = trans;
+   gl_transMask( texture );
    return texture;
 }
 
@@ -513,6 +574,7 @@ glTexture* gl_loadImagePad( const char *name, SDL_Surface* surface,
    texture->sh    = texture->h / texture->sy;
    texture->srw   = texture->sw / texture->rw;
    texture->srh   = texture->sh / texture->rh;
+   texture->sdir  = texture->sx * texture->sy / (2.*M_PI);
 
    if (name != NULL) {
       texture->name = strdup(name);
@@ -702,6 +764,11 @@ glTexture* gl_newSprite( const char* path, const int sx, const int sy,
    texture->sh    = texture->h / texture->sy;
    texture->srw   = texture->sw / texture->rw;
    texture->srh   = texture->sh / texture->rh;
+   texture->sdir  = texture->sx * texture->sy / (2.*M_PI);
+
+   /* Sprite boxes depend on the sprite layout. */
+   if (texture->trans != NULL)
+      gl_transMask( texture );
    return texture;
 }
 
@@ -731,6 +798,8 @@ void gl_freeTexture( glTexture* texture )
             glDeleteTextures( 1, &texture->texture );
             if (texture->trans != NULL)
                free(texture->trans);
+            free(texture->mask);
+            free(texture->sbox);
             if (texture->name != NULL)
                free(texture->name);
             free(texture);
@@ -759,6 +828,8 @@ void gl_freeTexture( glTexture* texture )
    glDeleteTextures( 1, &texture->texture );
    if (texture->trans != NULL)
       free(texture->trans);
+   free(texture->mask);
+   free(texture->sbox);
    if (texture->name != NULL)
       free(texture->name);
    free(texture);
@@ -819,8 +890,8 @@ int gl_isTrans( const glTexture* t, const int x, const int y )
 /**
  * @brief Sets x and y to be the appropriate sprite for glTexture using dir.
  *
- * Very slow, try to cache if possible like the pilots do instead of using
- *  in O(n^2) or worse functions.
+ * Uses the sprites per radian precomputed when the texture was loaded, so
+ *  it's cheap enough to run for every pilot and weapon every frame.
  *
  *    @param[out] x X sprite to use.
  *    @param[out] y Y sprite to use.
@@ -829,8 +900,7 @@ int gl_isTrans( const glTexture* t, const int x, const int y )
  */
 void gl_getSpriteFromDir( int* x, int* y, const glTexture* t, const double dir )
 {
-   int s, sx, sy;
-   double shard, rdir;
+   int s, sx, n;
 
 #ifdef DEBUGGING
    if ((dir > 2.*M_PI) || (dir < 0.)) {
@@ -839,20 +909,15 @@ void gl_getSpriteFromDir( int* x, int* y, const glTexture* t, const double dir )
    }
 #endif /* DEBUGGING */
 
-   /* what each image represents in angle */
-   shard = 2.*M_PI / (t->sy*t->sx);
-
-   /* real dir is slightly moved downwards */
-   rdir = dir + shard/2.;
+   sx = (int)t->sx;
+   n  = sx * (int)t->sy;
 
-   /* now calculate the sprite we need */
-   s = (int)(rdir / shard);
-   sx = t->sx;
-   sy = t->sy;
+   /* Sprites are centered on their direction, so round to the nearest. */
+   s = (int)(dir * t->sdir + 0.5);
 
    /* makes sure the sprite is "in range" */
-   if (s > (sy*sx-1))
-      s = s % (sy*sx);
+   if (s >= n)
+      s %= n;
 
    (*x) = s % sx;
    (*y) = s / sx;
@@ -59,10 +59,14 @@ typedef struct glTexture_ {
    double sh; /**< Height of a sprite. */
    double srw; /**< Sprite render width - equivalent to sw/rw. */
    double srh; /**< Sprite render height - equivalent to sh/rh. */
+   double sdir; /**< Sprites per radian - equivalent to sx*sy/(2*pi). */
 
    /* data */
    GLuint texture; /**< the opengl texture itself */
    uint8_t* trans; /**< maps the transparency */
+   uint64_t* mask; /**< Row-aligned bitmask of the opaque pixels, built from trans. */
+   int mask_stride; /**< Number of 64 bit words per row of mask, including one of padding. */
+   int* sbox; /**< Opaque box (x0,y0,x1,y1) of each sprite, indexed like trans rows. */
 
    /* properties */
    uint8_t flags; /**< flags used for texture properties */
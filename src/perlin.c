@@ -35,9 +35,12 @@
  *  about 20 seconds to 8 seconds per Nebula image with the manual loop
  *  unrolling.
  *
- * @note Tried to optimize a while back with SSE and the works, but because
- *       of the nature of how it's implemented in non-linear fashion it just
- *       wound up complicating the code without actually making it faster.
+ * The nebula generation doesn't go through noise_turbulence3 pixel by
+ *  pixel.  Along a row only the x coordinate changes, so the lattice
+ *  lookups and the y/z part of the gradient dot products are computed once
+ *  per row and octave, leaving only arithmetic per pixel that is done with
+ *  SSE2 (or AVX2 if the compiler targets it) several pixels at a time.
+ *  The work is split into tiles of rows over the threadpool.
  */
 
 
@@ -49,6 +52,16 @@
 #include <stdlib.h>
 #include "nstring.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NOISE_SIMD_WIDTH   8 /**< Pixels processed at once. */
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define NOISE_SIMD_WIDTH   4 /**< Pixels processed at once. */
+#else
+#define NOISE_SIMD_WIDTH   1 /**< Pixels processed at once. */
+#endif
+
 #include "SDL.h"
 #include "SDL_thread.h"
 #include "threadpool.h"
@@ -59,6 +72,7 @@
 
 
 #define SIMPLEX_SCALE 0.5f
+#define NOISE_TILE_ROWS    32 /**< Rows of a nebula layer generated per job. */
 
 
 /**
@@ -81,11 +95,26 @@ struct perlin_data_s {
 };
 
 
+/**
+ * @brief Lattice data of a row of 3d noise for a single octave.
+ *
+ * Tables are indexed by the lattice x index.  The four corners are in the order (y,z), (y+1,z), (y,z+1), (y+1,z+1).
+ */
+typedef struct noise_row_s {
+   float *a[4]; /**< Gradient x component per lattice x index and corner. */
+   float *c[4]; /**< Gradient dot product of the y/z part per lattice x index and corner. */
+   float wy; /**< Cubic weight along y. */
+   float wz; /**< Cubic weight along z. */
+} noise_row_t;
+
+
 /**
  * @brief Threading stuff.
  */
 typedef struct thread_args_ {
    int z; /**< Z level working on. */
+   int y0; /**< First row of the tile working on. */
+   int y1; /**< Row after the last row of the tile working on. */
    float zoom; /**< Zoom level of detail. */
    int n; /**< Number of layers to generate. */
    int h; /**< Height. */
@@ -108,6 +137,13 @@ static float lattice3( perlin_data_t *pdata, int ix, float fx,
       int iy, float fy, int iz, float fz );
 static float lattice2( perlin_data_t *pdata, int ix, float fx, int iy, float fy );
 static float lattice1( perlin_data_t *pdata, int ix, float fx );
+/* Row kernel. */
+static void noise_rowPrepare( perlin_data_t *pdata, noise_row_t *row,
+      int ix1, float fy, float fz );
+static float noise_rowPixel( perlin_data_t *pdata, const noise_row_t *rows,
+      float fx, int octaves );
+static void noise_turbulence3Row( perlin_data_t *pdata, const noise_row_t *rows,
+      float *out, int w, float zoom, int octaves );
 /*Threading */
 static int noise_genNebulaMap_thread( void *data );
 
@@ -584,6 +620,211 @@ float* noise_genRadarInt( const int w, const int h, float rug )
 }
 
 
+/**
+ * @brief Prepares the lattice data of a row for an octave.
+ *
+ *    @param pdata Perlin data to use.
+ *    @param row Row to prepare, tables must hold ix1+2 entries.
+ *    @param ix1 Largest lattice x index the row will be evaluated at.
+ *    @param fy Y position of the row.
+ *    @param fz Z position of the row.
+ */
+static void noise_rowPrepare( perlin_data_t *pdata, noise_row_t *row,
+      int ix1, float fy, float fz )
+{
+   int k, ix, ny, nz, dy, dz, nIndex;
+   float ry, rz;
+
+   ny = (int)fy;
+   nz = (int)fz;
+   ry = fy - ny;
+   rz = fz - nz;
+   row->wy  = CUBIC(ry);
+   row->wz  = CUBIC(rz);
+
+   for (ix=0; ix<=ix1+1; ix++) {
+      for (k=0; k<4; k++) {
+         dy = k & 1;
+         dz = k >> 1;
+         /* Same as lattice3. */
+         nIndex = pdata->map[ ix & 0xFF ];
+         nIndex = pdata->map[ (nIndex + ny + dy) & 0xFF ];
+         nIndex = pdata->map[ (nIndex + nz + dz) & 0xFF ];
+         row->a[k][ix] = pdata->buffer[nIndex][0];
+         row->c[k][ix] = pdata->buffer[nIndex][1] * (ry - dy) +
+               pdata->buffer[nIndex][2] * (rz - dz);
+      }
+   }
+}
+
+
+/**
+ * @brief Gets the 3d turbulence of a pixel in a prepared row.
+ *
+ * Equivalent to noise_turbulence3.
+ *
+ *    @param pdata Perlin data to use.
+ *    @param rows Prepared rows, one per octave.
+ *    @param fx X position of the pixel.
+ *    @param octaves Octaves to use.
+ *    @return The noise level at the position.
+ */
+static float noise_rowPixel( perlin_data_t *pdata, const noise_row_t *rows,
+      float fx, int octaves )
+{
+   int o, k, ix;
+   float rx, wx, lo, hi, e[4], value, sum;
+   const noise_row_t *r;
+
+   sum = 0.;
+   for (o=0; o<octaves; o++) {
+      r  = &rows[o];
+      ix = (int)fx;
+      rx = fx - ix;
+      wx = CUBIC(rx);
+      for (k=0; k<4; k++) {
+         lo   = r->a[k][ix]   * rx     + r->c[k][ix];
+         hi   = r->a[k][ix+1] * (rx-1) + r->c[k][ix+1];
+         e[k] = LERP( lo, hi, wx );
+      }
+      value = LERP( LERP( e[0], e[1], r->wy ), LERP( e[2], e[3], r->wy ), r->wz );
+      value = CLAMP( -0.99999f, 0.99999f, value );
+      sum  += ABS(value) * pdata->exponent[o];
+      fx   *= pdata->lacunarity;
+   }
+   return CLAMP( -0.99999f, 0.99999f, sum );
+}
+
+
+#if NOISE_SIMD_WIDTH == 8
+/**
+ * @brief Gathers lattice data for the vector of pixels.
+ */
+#define NOISE_GATHER(tbl, idx)   _mm256_i32gather_ps( (tbl), (idx), 4 )
+#elif NOISE_SIMD_WIDTH == 4
+/**
+ * @brief Gathers lattice data for the vector of pixels.
+ */
+#define NOISE_GATHER(tbl, idx)   _mm_set_ps( (tbl)[(idx)[3]], (tbl)[(idx)[2]], (tbl)[(idx)[1]], (tbl)[(idx)[0]] )
+#endif
+
+
+/**
+ * @brief Generates a row of 3d turbulence.
+ *
+ *    @param pdata Perlin data to use.
+ *    @param rows Prepared rows, one per octave.
+ *    @param[out] out Row to write.
+ *    @param w Width of the row.
+ *    @param zoom Zoom of the noise.
+ *    @param octaves Octaves to use.
+ */
+static void noise_turbulence3Row( perlin_data_t *pdata, const noise_row_t *rows,
+      float *out, int w, float zoom, int octaves )
+{
+   int x;
+
+   x = 0;
+#if NOISE_SIMD_WIDTH == 8
+   int o, k;
+   const noise_row_t *r;
+   __m256i ix, idx, idx1;
+   __m256 fx, rx, rx1, wx, lo, hi, e[4], value, sum;
+   const __m256 one   = _mm256_set1_ps( 1. );
+   const __m256 two   = _mm256_set1_ps( 2. );
+   const __m256 three = _mm256_set1_ps( 3. );
+   const __m256 vmin  = _mm256_set1_ps( -0.99999f );
+   const __m256 vmax  = _mm256_set1_ps( 0.99999f );
+   const __m256 sign  = _mm256_set1_ps( -0. );
+   const __m256 vzoom = _mm256_set1_ps( zoom );
+   const __m256 vw    = _mm256_set1_ps( (float)w );
+   const __m256 vlac  = _mm256_set1_ps( pdata->lacunarity );
+   const __m256i lane = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+
+   for (; x+8<=w; x+=8) {
+      fx  = _mm256_div_ps( _mm256_mul_ps( vzoom,
+               _mm256_cvtepi32_ps( _mm256_add_epi32( _mm256_set1_epi32( x ), lane ) ) ), vw );
+      sum = _mm256_setzero_ps();
+      for (o=0; o<octaves; o++) {
+         r    = &rows[o];
+         ix   = _mm256_cvttps_epi32( fx );
+         rx   = _mm256_sub_ps( fx, _mm256_cvtepi32_ps( ix ) );
+         rx1  = _mm256_sub_ps( rx, one );
+         wx   = _mm256_mul_ps( _mm256_mul_ps( rx, rx ), _mm256_sub_ps( three, _mm256_mul_ps( two, rx ) ) );
+         idx  = ix;
+         idx1 = _mm256_add_epi32( ix, _mm256_set1_epi32( 1 ) );
+         for (k=0; k<4; k++) {
+            lo   = _mm256_add_ps( _mm256_mul_ps( NOISE_GATHER( r->a[k], idx ), rx ),
+                     NOISE_GATHER( r->c[k], idx ) );
+            hi   = _mm256_add_ps( _mm256_mul_ps( NOISE_GATHER( r->a[k], idx1 ), rx1 ),
+                     NOISE_GATHER( r->c[k], idx1 ) );
+            e[k] = _mm256_add_ps( lo, _mm256_mul_ps( wx, _mm256_sub_ps( hi, lo ) ) );
+         }
+         lo    = _mm256_add_ps( e[0], _mm256_mul_ps( _mm256_set1_ps( r->wy ), _mm256_sub_ps( e[1], e[0] ) ) );
+         hi    = _mm256_add_ps( e[2], _mm256_mul_ps( _mm256_set1_ps( r->wy ), _mm256_sub_ps( e[3], e[2] ) ) );
+         value = _mm256_add_ps( lo, _mm256_mul_ps( _mm256_set1_ps( r->wz ), _mm256_sub_ps( hi, lo ) ) );
+         value = _mm256_min_ps( _mm256_max_ps( value, vmin ), vmax );
+         sum   = _mm256_add_ps( sum, _mm256_mul_ps( _mm256_andnot_ps( sign, value ),
+                  _mm256_set1_ps( pdata->exponent[o] ) ) );
+         fx    = _mm256_mul_ps( fx, vlac );
+      }
+      _mm256_storeu_ps( &out[x], _mm256_min_ps( _mm256_max_ps( sum, vmin ), vmax ) );
+   }
+#elif NOISE_SIMD_WIDTH == 4
+   int o, k;
+   const noise_row_t *r;
+   int idx[4] __attribute__ ((aligned (16)));
+   int idx1[4] __attribute__ ((aligned (16)));
+   __m128i ix;
+   __m128 fx, rx, rx1, wx, lo, hi, e[4], value, sum;
+   const __m128 one   = _mm_set1_ps( 1. );
+   const __m128 two   = _mm_set1_ps( 2. );
+   const __m128 three = _mm_set1_ps( 3. );
+   const __m128 vmin  = _mm_set1_ps( -0.99999f );
+   const __m128 vmax  = _mm_set1_ps( 0.99999f );
+   const __m128 sign  = _mm_set1_ps( -0. );
+   const __m128 vzoom = _mm_set1_ps( zoom );
+   const __m128 vw    = _mm_set1_ps( (float)w );
+   const __m128 vlac  = _mm_set1_ps( pdata->lacunarity );
+   const __m128i lane = _mm_setr_epi32( 0, 1, 2, 3 );
+
+   for (; x+4<=w; x+=4) {
+      fx  = _mm_div_ps( _mm_mul_ps( vzoom,
+               _mm_cvtepi32_ps( _mm_add_epi32( _mm_set1_epi32( x ), lane ) ) ), vw );
+      sum = _mm_setzero_ps();
+      for (o=0; o<octaves; o++) {
+         r   = &rows[o];
+         ix  = _mm_cvttps_epi32( fx );
+         rx  = _mm_sub_ps( fx, _mm_cvtepi32_ps( ix ) );
+         rx1 = _mm_sub_ps( rx, one );
+         wx  = _mm_mul_ps( _mm_mul_ps( rx, rx ), _mm_sub_ps( three, _mm_mul_ps( two, rx ) ) );
+         _mm_store_si128( (__m128i*)idx, ix );
+         _mm_store_si128( (__m128i*)idx1, _mm_add_epi32( ix, _mm_set1_epi32( 1 ) ) );
+         for (k=0; k<4; k++) {
+            lo   = _mm_add_ps( _mm_mul_ps( NOISE_GATHER( r->a[k], idx ), rx ),
+                     NOISE_GATHER( r->c[k], idx ) );
+            hi   = _mm_add_ps( _mm_mul_ps( NOISE_GATHER( r->a[k], idx1 ), rx1 ),
+                     NOISE_GATHER( r->c[k], idx1 ) );
+            e[k] = _mm_add_ps( lo, _mm_mul_ps( wx, _mm_sub_ps( hi, lo ) ) );
+         }
+         lo    = _mm_add_ps( e[0], _mm_mul_ps( _mm_set1_ps( r->wy ), _mm_sub_ps( e[1], e[0] ) ) );
+         hi    = _mm_add_ps( e[2], _mm_mul_ps( _mm_set1_ps( r->wy ), _mm_sub_ps( e[3], e[2] ) ) );
+         value = _mm_add_ps( lo, _mm_mul_ps( _mm_set1_ps( r->wz ), _mm_sub_ps( hi, lo ) ) );
+         value = _mm_min_ps( _mm_max_ps( value, vmin ), vmax );
+         sum   = _mm_add_ps( sum, _mm_mul_ps( _mm_andnot_ps( sign, value ),
+                  _mm_set1_ps( pdata->exponent[o] ) ) );
+         fx    = _mm_mul_ps( fx, vlac );
+      }
+      _mm_storeu_ps( &out[x], _mm_min_ps( _mm_max_ps( sum, vmin ), vmax ) );
+   }
+#endif /* NOISE_SIMD_WIDTH */
+
+   /* Scalar fallback and remainder. */
+   for (; x<w; x++)
+      out[x] = noise_rowPixel( pdata, rows, zoom * (float)x / (float)w, octaves );
+}
+
+
 /**
  * @brief Thread worker for generating nebula stuff.
  *
@@ -592,33 +833,54 @@ float* noise_genRadarInt( const int w, const int h, float rug )
 static int noise_genNebulaMap_thread( void *data )
 {
    thread_args *args = (thread_args*) data;
-   float f[3];
-   float value;
-   int y, x;
+   noise_row_t rows[NOISE_MAX_OCTAVES];
+   float fx, fy, fz;
+   float *out, *buf;
+   int y, x, o, k, n, ix1[NOISE_MAX_OCTAVES];
    float max;
 
-   /* Generate the layer. */
-   max = 0;
-   f[2] = args->zoom * (float)args->z / (float)args->n;
-
-   for (y=0; y<args->h; y++) {
-      f[1] = args->zoom * (float)y / (float)args->h;
-
-      for (x=0; x<args->w; x++) {
-         f[0] = args->zoom * (float)x / (float)args->w;
+   /* Size the lattice tables with the largest x coordinate of each octave. */
+   n  = 0;
+   fx = args->zoom * (float)(args->w-1) / (float)args->w;
+   for (o=0; o<args->octaves; o++) {
+      ix1[o] = (int)fx;
+      n     += ix1[o] + 2;
+      fx    *= args->noise->lacunarity;
+   }
+   buf = malloc( sizeof(float) * 8 * n );
+   for (o=0; o<args->octaves; o++) {
+      for (k=0; k<4; k++) {
+         rows[o].a[k] = buf;
+         buf += ix1[o] + 2;
+         rows[o].c[k] = buf;
+         buf += ix1[o] + 2;
+      }
+   }
+   buf = rows[0].a[0];
 
-         value = noise_turbulence3( args->noise, f, args->octaves );
-         if (max < value)
-            max = value;
+   /* Generate the tile. */
+   max = 0;
+   for (y=args->y0; y<args->y1; y++) {
+      fy  = args->zoom * (float)y / (float)args->h;
+      fz  = args->zoom * (float)args->z / (float)args->n;
+      for (o=0; o<args->octaves; o++) {
+         noise_rowPrepare( args->noise, &rows[o], ix1[o], fy, fz );
+         fy *= args->noise->lacunarity;
+         fz *= args->noise->lacunarity;
+      }
 
-         args->nebula[args->z * args->w * args->h + y * args->w + x] = value;
-       }
+      out = &args->nebula[ args->z * args->w * args->h + y * args->w ];
+      noise_turbulence3Row( args->noise, rows, out, args->w, args->zoom, args->octaves );
+      for (x=0; x<args->w; x++)
+         if (max < out[x])
+            max = out[x];
    }
 
    /* Set up output. */
    *args->max = max;
 
    /* Clean up. */
+   free( buf );
    free( args );
    return 0;
 }
@@ -637,6 +899,7 @@ float* noise_genNebulaMap( const int w, const int h, const int n, float rug )
 {
    int x, y, z, i;
    int octaves;
+   int ntiles;
    float hurst;
    float lacunarity;
    perlin_data_t* noise;
@@ -669,33 +932,39 @@ float* noise_genNebulaMap( const int w, const int h, const int n, float rug )
    DEBUG(_("Generating Nebula of size %dx%dx%d"), w, h, n);
 
    /* Prepare for generation. */
-   _max        = malloc( sizeof(float) * n );
+   ntiles      = (h + NOISE_TILE_ROWS - 1) / NOISE_TILE_ROWS;
+   _max        = malloc( sizeof(float) * n * ntiles );
 
    /* Initialize vpool */
    vpool = vpool_create();
 
-   /* Start to create the nebula */
+   /* Start to create the nebula, tiles are small so all the threads stay busy. */
+   i = 0;
    for (z=0; z<n; z++) {
-      /* Make ze arguments! */
-      args     = malloc( sizeof(thread_args) );
-      args->z  = z;
-      args->zoom = zoom;
-      args->n  = n;
-      args->h  = h;
-      args->w  = w;
-      args->noise = noise;
-      args->octaves = octaves;
-      args->max = &_max[z];
-      args->nebula = nebula;
-
-      /* Launch ze thread. */
-      vpool_enqueue( vpool, noise_genNebulaMap_thread, args );
+      for (y=0; y<h; y+=NOISE_TILE_ROWS) {
+         /* Make ze arguments! */
+         args     = malloc( sizeof(thread_args) );
+         args->z  = z;
+         args->y0 = y;
+         args->y1 = MIN( y+NOISE_TILE_ROWS, h );
+         args->zoom = zoom;
+         args->n  = n;
+         args->h  = h;
+         args->w  = w;
+         args->noise = noise;
+         args->octaves = octaves;
+         args->max = &_max[i++];
+         args->nebula = nebula;
+
+         /* Launch ze thread. */
+         vpool_enqueue( vpool, noise_genNebulaMap_thread, args );
+      }
    }
 
    /* Wait for threads to signal completion. */
    vpool_wait( vpool );
    max = 0.;
-   for (i=0; i<n; i++) {
+   for (i=0; i<n*ntiles; i++) {
       if (_max[i]>max)
          max = _max[i];
    }
@@ -712,7 +981,9 @@ float* noise_genNebulaMap( const int w, const int h, const int n, float rug )
    free(_max);
 
    /* Results */
-   DEBUG(_("Nebula Generated in %d ms"), SDL_GetTicks() - s );
+   s = SDL_GetTicks() - s;
+   DEBUG(_("Nebula Generated in %d ms (%.1f Mpixels/s)"), s,
+         (double)w*h*n / (1000. * MAX(s,1)) );
    return nebula;
 }
 
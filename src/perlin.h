@@ -5,6 +5,7 @@
 #define NOISE_MAX_OCTAVES            4 /**< Default octaves for noise. */
 #define NOISE_DEFAULT_HURST          0.5 /**< Default hurst for noise. */
 #define NOISE_DEFAULT_LACUNARITY     2. /**< Default lacunarity for noise. */
+#define NOISE_NEBULA_VERSION         2 /**< Version of noise_genNebulaMap output, change when it changes. */
 
 
 struct perlin_data_s;
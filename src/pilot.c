@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <limits.h>
 
+#include "array.h"
 #include "nxml.h"
 #include "nstring.h"
 #include "log.h"
@@ -37,6 +38,8 @@
 #include "debris.h"
 #include "ntime.h"
 #include "ai.h"
+#include "pilot_grid.h"
+#include "formation.h"
 #include "faction.h"
 #include "font.h"
 #include "land.h"
@@ -59,6 +62,7 @@ static unsigned int pilot_id = PLAYER_ID; /**< Stack of pilot ids to assure uniq
 Pilot** pilot_stack = NULL; /**< Not static, used in player.c, weapon.c, pause.c, space.c and ai.c */
 int pilot_nstack = 0; /**< same */
 static int pilot_mstack = 0; /**< Memory allocated for pilot_stack. */
+static Pilot **pilot_aoe = NULL; /**< Pilots found by the last area of effect query (array.h). */
 
 
 /* misc */
@@ -76,7 +80,8 @@ static void pilot_refuel( Pilot *p, double dt );
 /* Clean up. */
 static void pilot_dead( Pilot* p, unsigned int killer );
 /* Targetting. */
-static int pilot_validEnemy( const Pilot* p, const Pilot* target );
+static int pilot_filterEnemySize( const Pilot *p, const Pilot *target, void *data );
+static int pilot_filterNearest( const Pilot *p, const Pilot *target, void *data );
 /* Misc. */
 static void pilot_setCommMsg( Pilot *p, const char *s );
 static int pilot_getStackPos( const unsigned int id );
@@ -255,7 +260,7 @@ int pilot_validTarget( const Pilot* p, const Pilot* target )
  *    @param target Pilot to see if is a valid enemy of the reference.
  *    @return 1 if it is valid, 0 otherwise.
  */
-static int pilot_validEnemy( const Pilot* p, const Pilot* target )
+int pilot_validEnemy( const Pilot* p, const Pilot* target )
 {
    /* Should either be hostile by faction or by player. */
    if ( !( areEnemies( p->faction, target->faction )
@@ -284,25 +289,27 @@ static int pilot_validEnemy( const Pilot* p, const Pilot* target )
  */
 unsigned int pilot_getNearestEnemy( const Pilot* p )
 {
-   unsigned int tp;
-   int i;
-   double d, td;
+   Pilot *t;
+   t = pilot_gridNearest( p, p->solid->pos.x, p->solid->pos.y, -1.,
+         pilot_filterEnemy, NULL, NULL );
+   return (t != NULL) ? t->id : 0;
+}
 
-   tp = 0;
-   d  = 0.;
-   for (i=0; i<pilot_nstack; i++) {
 
-      if (!pilot_validEnemy( p, pilot_stack[i] ))
-         continue;
+/**
+ * @brief Filter for enemies in a mass range.
+ */
+static int pilot_filterEnemySize( const Pilot *p, const Pilot *target, void *data )
+{
+   const double *bounds = (const double*) data;
 
-      /* Check distance. */
-      td = vect_dist2(&pilot_stack[i]->solid->pos, &p->solid->pos);
-      if (!tp || (td < d)) {
-         d  = td;
-         tp = pilot_stack[i]->id;
-      }
-   }
-   return tp;
+   if (!pilot_validEnemy( p, target ))
+      return 0;
+
+   if ((target->solid->mass < bounds[0]) || (target->solid->mass > bounds[1]))
+      return 0;
+
+   return 1;
 }
 
 /**
@@ -315,29 +322,14 @@ unsigned int pilot_getNearestEnemy( const Pilot* p )
  */
 unsigned int pilot_getNearestEnemy_size( const Pilot* p, double target_mass_LB, double target_mass_UB)
 {
-   unsigned int tp;
-   int i;
-   double d, td;
-
-   tp = 0;
-   d  = 0.;
-   for (i=0; i<pilot_nstack; i++) {
-
-      if (!pilot_validEnemy( p, pilot_stack[i] ))
-         continue;
-
-      if (pilot_stack[i]->solid->mass < target_mass_LB || pilot_stack[i]->solid->mass > target_mass_UB)
-         continue;
-
-      /* Check distance. */
-      td = vect_dist2(&pilot_stack[i]->solid->pos, &p->solid->pos);
-      if (!tp || (td < d)) {
-         d = td;
-         tp = pilot_stack[i]->id;
-      }
-   }
+   Pilot *t;
+   double bounds[2];
 
-   return tp;
+   bounds[0] = target_mass_LB;
+   bounds[1] = target_mass_UB;
+   t = pilot_gridNearest( p, p->solid->pos.x, p->solid->pos.y, -1.,
+         pilot_filterEnemySize, bounds, NULL );
+   return (t != NULL) ? t->id : 0;
 }
 
 /**
@@ -478,38 +470,37 @@ unsigned int pilot_getBoss( const Pilot* p )
  */
 double pilot_getNearestPos( const Pilot *p, unsigned int *tp, double x, double y, int disabled )
 {
-   int i;
-   double d, td;
+   Pilot *t;
+   double d;
 
-   *tp = PLAYER_ID;
-   d  = 0;
-   for (i=0; i<pilot_nstack; i++) {
+   t = pilot_gridNearest( p, x, y, -1., pilot_filterNearest, &disabled, &d );
+   if (t == NULL) {
+      *tp = PLAYER_ID;
+      return 0.;
+   }
+   *tp = t->id;
+   return d;
+}
 
-      /* Must not be self. */
-      if (pilot_stack[i] == p)
-         continue;
 
-      /* Player doesn't select escorts (unless disabled is active). */
-      if (!disabled && (p->faction == FACTION_PLAYER) &&
-            (pilot_stack[i]->faction == FACTION_PLAYER))
-         continue;
+/**
+ * @brief Filter for pilot_getNearestPos().
+ */
+static int pilot_filterNearest( const Pilot *p, const Pilot *target, void *data )
+{
+   int disabled = *(const int*) data;
 
-      /* Shouldn't be disabled. */
-      if (!disabled && pilot_isDisabled(pilot_stack[i]))
-         continue;
+   /* Player doesn't select escorts (unless disabled is active). */
+   if (!disabled && (p->faction == FACTION_PLAYER) &&
+         (target->faction == FACTION_PLAYER))
+      return 0;
 
-      /* Must be a valid target. */
-      if (!pilot_validTarget( p, pilot_stack[i] ))
-         continue;
+   /* Shouldn't be disabled. */
+   if (!disabled && pilot_isDisabled(target))
+      return 0;
 
-      /* Minimum distance. */
-      td = pow2(x-pilot_stack[i]->solid->pos.x) + pow2(y-pilot_stack[i]->solid->pos.y);
-      if (((*tp==PLAYER_ID) || (td < d))) {
-         d = td;
-         *tp = pilot_stack[i]->id;
-      }
-   }
-   return d;
+   /* Must be a valid target. */
+   return pilot_validTarget( p, target );
 }
 
 
@@ -1568,7 +1559,7 @@ static void pilot_dead( Pilot* p, unsigned int killer )
  */
 void pilot_explode( double x, double y, double radius, const Damage *dmg, const Pilot *parent )
 {
-   int i;
+   int i, n;
    double rx, ry;
    double dist, rad2;
    Pilot *p;
@@ -1578,8 +1569,11 @@ void pilot_explode( double x, double y, double radius, const Damage *dmg, const
    rad2 = radius*radius;
    ddmg = *dmg;
 
-   for (i=0; i<pilot_nstack; i++) {
-      p = pilot_stack[i];
+   /* Ship size counts, so look further by the largest ship. */
+   n = pilot_gridQuery( &pilot_aoe, NULL, x, y,
+         sqrt( rad2 + pow2( pilot_gridMaxSize() ) ), 0, NULL, NULL );
+   for (i=0; i<n; i++) {
+      p = pilot_aoe[i];
 
       /* Calculate a bit. */
       rx = p->solid->pos.x - x;
@@ -1723,13 +1717,13 @@ void pilot_renderOverlay( Pilot* p, const double dt )
  */
 void pilot_update( Pilot* pilot, const double dt )
 {
-   int i, cooling, nchg;
+   int i, n, cooling, nchg;
    int ammo_threshold;
    unsigned int l;
    Pilot *target;
    double a, px,py, vx,vy;
    char buf[16];
-   PilotOutfitSlot *o;
+   PilotOutfitSlot *o, **slots;
    double Q;
    Damage dmg;
    double stress_falloff;
@@ -1764,55 +1758,30 @@ void pilot_update( Pilot* pilot, const double dt )
    for (i=0; i<MAX_AI_TIMERS; i++)
       if (pilot->timer[i] > 0.)
          pilot->timer[i] -= dt;
-   /* Update heat. */
-   a = -1.;
-   Q = 0.;
+   /*
+    * Update active outfits, each kind of update runs over its own group.
+    * Slots don't depend on each other so this matches updating them one by
+    * one, the fire rate timers just have to see the heat before it changes.
+    */
+   if (!pilot->outfit_grouped)
+      pilot_outfitGroup( pilot );
    nchg = 0; /* Number of outfits that change state, processed at the end. */
-   for (i=0; i<pilot->noutfits; i++) {
-      o = pilot->outfits[i];
 
-      /* Picky about our outfits. */
-      if (o->outfit == NULL)
-         continue;
-      if (!o->active)
-         continue;
+   /* Handle firerate timer. */
+   slots = pilot->outfit_active;
+   n     = array_size( slots );
+   for (i=0; i<n; i++)
+      if (slots[i]->timer > 0.)
+         slots[i]->timer -= dt * pilot_heatFireRateMod( slots[i]->heat_T );
 
-      /* Handle firerate timer. */
-      if (o->timer > 0.)
-         o->timer -= dt * pilot_heatFireRateMod( o->heat_T );
-
-      /* Handle reload timer. (Note: this works backwards compared to
-       * other timers. This helps to simplify code resetting the timer
-       * elsewhere.)
-       */
-      if ( ( o->outfit != NULL ) &&
-            ( outfit_isLauncher( o->outfit ) || outfit_isFighterBay( o->outfit ) ) &&
-            ( outfit_ammo( o->outfit ) != NULL ) ) {
-         if (o->rtimer < o->outfit->u.lau.reload_time)
-            o->rtimer += dt;
-
-         /* Initial (raw) ammo threshold */
-         ammo_threshold = o->outfit->u.lau.amount;
-
-         /* Adjust for deployed fighters if needed */
-         if ( outfit_isFighterBay( o->outfit ) )
-            ammo_threshold -= o->u.ammo.deployed;
-
-         /* Don't allow accumulation of the timer before reload allowed */
-         if ( o->u.ammo.quantity >= ammo_threshold ) {
-            o->rtimer = 0;
-         }
-
-         while ( ( o->rtimer >= o->outfit->u.lau.reload_time ) &&
-               ( o->u.ammo.quantity < ammo_threshold ) ) {
-            o->rtimer -= o->outfit->u.lau.reload_time;
-            pilot_addAmmo( pilot, o, outfit_ammo( o->outfit ), 1 );
-         }
-
-         o->rtimer = MIN( o->rtimer, o->outfit->u.lau.reload_time );
-      }
+   /* Handle heat. */
+   Q = 0.;
+   if (!cooling)
+      Q = pilot_heatUpdateSlots( pilot, dt );
 
-      /* Handle state timer. */
+   /* Handle state timer. */
+   for (i=0; i<n; i++) {
+      o = slots[i];
       if (o->stimer >= 0.) {
          o->stimer -= dt;
          if (o->stimer < 0.) {
@@ -1826,15 +1795,48 @@ void pilot_update( Pilot* pilot, const double dt )
             }
          }
       }
+   }
+
+   /* Handle reload timer. (Note: this works backwards compared to
+    * other timers. This helps to simplify code resetting the timer
+    * elsewhere.)
+    */
+   slots = pilot->outfit_reload;
+   n     = array_size( slots );
+   for (i=0; i<n; i++) {
+      o = slots[i];
+      if (o->rtimer < o->outfit->u.lau.reload_time)
+         o->rtimer += dt;
+
+      /* Initial (raw) ammo threshold */
+      ammo_threshold = o->outfit->u.lau.amount;
+
+      /* Adjust for deployed fighters if needed */
+      if ( outfit_isFighterBay( o->outfit ) )
+         ammo_threshold -= o->u.ammo.deployed;
+
+      /* Don't allow accumulation of the timer before reload allowed */
+      if ( o->u.ammo.quantity >= ammo_threshold ) {
+         o->rtimer = 0;
+      }
 
-      /* Handle heat. */
-      if (!cooling)
-         Q  += pilot_heatUpdateSlot( pilot, o, dt );
+      while ( ( o->rtimer >= o->outfit->u.lau.reload_time ) &&
+            ( o->u.ammo.quantity < ammo_threshold ) ) {
+         o->rtimer -= o->outfit->u.lau.reload_time;
+         pilot_addAmmo( pilot, o, outfit_ammo( o->outfit ), 1 );
+      }
 
-      /* Handle lockons. */
-      pilot_lockUpdateSlot( pilot, o, target, &a, dt );
+      o->rtimer = MIN( o->rtimer, o->outfit->u.lau.reload_time );
    }
 
+   /* Handle lockons. */
+   a = -1.;
+   slots = pilot->outfit_seeker;
+   n     = array_size( slots );
+   if (target != NULL)
+      for (i=0; i<n; i++)
+         pilot_lockUpdateSlot( pilot, slots[i], target, &a, dt );
+
    /* Global heat. */
    if (!cooling)
       pilot_heatUpdateShip( pilot, Q, dt );
@@ -2466,6 +2468,9 @@ void pilot_init( Pilot* pilot, Ship* ship, const char* name, int faction, const
 
    /* Clear memory. */
    memset(pilot, 0, sizeof(Pilot));
+   pilot->lua_mem = LUA_NOREF;
+   pilot->vis_id  = -1;
+   pilot->attacked_last = -1;
 
    if (pilot_isFlagRaw(flags, PILOT_PLAYER)) /* Set player ID, should probably be fixed to something sane someday. */
       pilot->id = PLAYER_ID;
@@ -2644,6 +2649,8 @@ unsigned int pilot_create( Ship* ship, const char* name, int faction, const char
    /* Set the pilot in the stack -- must be there before initializing */
    pilot_stack[pilot_nstack] = dyn;
    pilot_nstack++; /* there's a new pilot */
+   pilot_gridDirty();
+   pilot_visDirty();
 
    /* Initialize the pilot. */
    pilot_init( dyn, ship, name, faction, ai, dir, pos, vel, flags, dockpilot, dockslot );
@@ -2724,10 +2731,15 @@ Pilot* pilot_copy( Pilot* src )
    for (i=0; i<dest->outfit_nweapon; i++)
       dest->outfits[p++] = &dest->outfit_weapon[i];
    dest->afterburner = NULL;
+   dest->outfit_grouped = 0;
+   dest->outfit_active  = NULL;
+   dest->outfit_reload  = NULL;
+   dest->outfit_seeker  = NULL;
 
    /* Hooks get cleared. */
    dest->hooks          = NULL;
    dest->nhooks         = 0;
+   dest->hook_mask      = 0;
 
    /* Copy has no escorts. */
    dest->escorts        = NULL;
@@ -2735,6 +2747,7 @@ Pilot* pilot_copy( Pilot* src )
 
    /* AI is not copied. */
    dest->task           = NULL;
+   dest->lua_mem        = LUA_NOREF;
 
    /* Set pointers and friends to NULL. */
    /* Commodities. */
@@ -2864,6 +2877,7 @@ void pilot_free( Pilot* p )
       free(p->outfit_utility);
    if (p->outfit_weapon != NULL)
       free(p->outfit_weapon);
+   pilot_outfitGroupFree(p);
 
    /* Remove commodities. */
    while (p->commodities != NULL)
@@ -2943,6 +2957,8 @@ void pilot_destroy(Pilot* p)
    /* pilot is eliminated */
    pilot_free(p);
    pilot_nstack--;
+   pilot_gridDirty();
+   pilot_visDirty();
 
    /* copy other pilots down */
    memmove(&pilot_stack[i], &pilot_stack[i+1], (pilot_nstack-i)*sizeof(Pilot*));
@@ -2965,6 +2981,12 @@ void pilots_free (void)
    pilot_stack = NULL;
    player.p = NULL;
    pilot_nstack = 0;
+   pilot_gridFree();
+   pilot_visFree();
+   pilot_statsCacheFree();
+   if (pilot_aoe != NULL)
+      array_free( pilot_aoe );
+   pilot_aoe = NULL;
 }
 
 
@@ -2995,6 +3017,8 @@ void pilots_clean (int persist)
    }
 
    pilot_nstack = persist_count;
+   pilot_gridDirty();
+   pilot_visDirty();
 
    /* Clear global hooks. */
    pilots_clearGlobalHooks();
@@ -3024,6 +3048,8 @@ void pilots_cleanAll (void)
       player.p = NULL;
    }
    pilot_nstack = 0;
+   pilot_gridDirty();
+   pilot_visDirty();
 }
 
 
@@ -3037,6 +3063,14 @@ void pilots_update( double dt )
    int i;
    Pilot *p;
 
+   /* Pilots have moved since last frame. */
+   pilot_gridDirty();
+   pilot_visDirty();
+   pilot_visUpdate();
+
+   /* Escorts look up their slots while thinking. */
+   formation_update();
+
    /* Now update all the pilots. */
    for (i=0; i<pilot_nstack; i++) {
       p = pilot_stack[i];
@@ -3077,6 +3111,9 @@ void pilots_update( double dt )
          p->think(p, dt);
    }
 
+   /* Apply what the AI decided now that every pilot has thought. */
+   ai_applyCommands();
+
    /* Now update all the pilots. */
    for (i=0; i<pilot_nstack; i++) {
       p = pilot_stack[i];
@@ -3093,6 +3130,13 @@ void pilots_update( double dt )
       if (p->update) /* update */
          p->update( p, dt );
    }
+
+   /* Positions changed again. */
+   pilot_gridDirty();
+   pilot_visDirty();
+
+   /* Let pilots know they were attacked this frame. */
+   ai_attackedFlush();
 }
 
 
@@ -58,7 +58,8 @@ enum {
    PILOT_HOOK_ATTACKED,  /**< Pilot is in manual override and is being attacked. */
    PILOT_HOOK_IDLE,      /**< Pilot is in manual override and has just become idle. */
    PILOT_HOOK_EXPLODED,  /**< Pilot died and exploded (about to be removed). */
-   PILOT_HOOK_LOCKON     /**< Pilot had a launcher lockon. */
+   PILOT_HOOK_LOCKON,    /**< Pilot had a launcher lockon. */
+   PILOT_HOOKS           /**< Number of pilot hook types. */
 };
 
 
@@ -236,6 +237,7 @@ typedef struct PilotCommodity_ {
 typedef struct PilotHook_ {
    int type;         /**< Type of hook. */
    unsigned int id;  /**< Hook ID associated with pilot hook. */
+   struct Hook_ *hook; /**< The hook, valid until it is freed which removes it from pilots. */
 } PilotHook;
 
 
@@ -329,6 +331,7 @@ typedef struct Pilot_ {
    double ew_evasion; /**< Dynamic evasion factor. */
    double ew_detect; /**< Static detection factor. */
    double ew_jump_detect; /** Static jump detection factor */
+   int vis_id; /**< Index in the visibility matrix, see pilot_inRangePilot. */
 
    /* Heat. */
    double heat_T;    /**< Ship temperature. [K] */
@@ -370,6 +373,12 @@ typedef struct Pilot_ {
    /* For easier usage. */
    PilotOutfitSlot *afterburner; /**< the afterburner */
 
+   /* Active outfits grouped by what needs updating, see pilot_outfitGroup. */
+   int outfit_grouped; /**< Whether the groups are up to date with the outfits. */
+   PilotOutfitSlot **outfit_active; /**< Active slots with an outfit (array.h). */
+   PilotOutfitSlot **outfit_reload; /**< Active launchers and fighter bays that use ammo (array.h). */
+   PilotOutfitSlot **outfit_seeker; /**< Active seeker launchers (array.h). */
+
    /* Weapon sets. */
    PilotWeaponSet weapon_sets[PILOT_WEAPON_SETS]; /**< All the weapon sets the pilot has. */
    int active_set;   /**< Index of the currently active weapon set. */
@@ -382,8 +391,9 @@ typedef struct Pilot_ {
    int cargo_free;   /**< Free commodity space. */
 
    /* Hook attached to the pilot */
-   PilotHook *hooks; /**< Pilot hooks. */
+   PilotHook *hooks; /**< Pilot hooks, sorted by type. */
    int nhooks;       /**< Number of pilot hooks. */
+   unsigned int hook_mask; /**< Bit set for each hook type the pilot has. */
 
    /* Escort stuff. */
    unsigned int parent; /**< Pilot's parent. */
@@ -395,6 +405,12 @@ typedef struct Pilot_ {
                           is destroyed. */
    int dockslot; /**< Outfit slot pilot originates from, index of dockpilot's outfits. */
 
+   /* Formation. */
+   int formation;    /**< Formation the pilot's escorts keep, see formation.h. */
+   int form_valid;   /**< Whether the pilot has a formation slot this tick. */
+   Vector2d form_point; /**< Position of the pilot's formation slot. */
+   Vector2d form_vel; /**< Velocity of the pilot's formation slot. */
+
    /* Targeting. */
    unsigned int target; /**< AI pilot target. */
    int nav_planet;   /**< Planet land target. */
@@ -404,9 +420,11 @@ typedef struct Pilot_ {
 
    /* AI */
    AI_Profile* ai;   /**< AI personality profile */
+   int lua_mem;      /**< Reference to the pilot's AI memory table. */
    double tcontrol;  /**< timer for control tick */
    double timer[MAX_AI_TIMERS]; /**< timers for AI */
    Task* task;       /**< current action */
+   int attacked_last; /**< Last attack on the pilot pending handling by the AI (ai.c). */
 
    /* Misc */
    double comm_msgTimer; /**< Message timer for the comm. */
@@ -436,6 +454,7 @@ typedef struct Pilot_ {
 #include "pilot_outfit.h"
 #include "pilot_weapon.h"
 #include "pilot_ew.h"
+#include "pilot_grid.h"
 
 
 /*
@@ -456,6 +475,7 @@ double pilot_getNearestAng( const Pilot *p, unsigned int *tp, double ang, int di
 int pilot_getJumps( const Pilot* p );
 const glColour* pilot_getColour( const Pilot* p );
 int pilot_validTarget( const Pilot* p, const Pilot* target );
+int pilot_validEnemy( const Pilot* p, const Pilot* target );
 
 /* non-lua wrappers */
 double pilot_relsize( const Pilot* cur_pilot, const Pilot* p );
@@ -16,13 +16,37 @@
 
 #include <math.h>
 
+#include "array.h"
 #include "log.h"
 #include "space.h"
 #include "player.h"
+#include "pilot_grid.h"
 
 static double sensor_curRange    = 0.; /**< Current base sensor range, used to calculate
                                          what is in range and what isn't. */
 
+/*
+ * Visibility matrix, rows are observers and columns are targets.
+ */
+static int vis_dirty          = 1; /**< Whether the matrix has to be rebuilt. */
+static Pilot **vis_pilots     = NULL; /**< Pilots in the matrix (array.h). */
+static int vis_w              = 0; /**< Words per row. */
+static uint32_t *vis_detect   = NULL; /**< Bit set when the target is fully detected (array.h). */
+static uint32_t *vis_fuzzy    = NULL; /**< Bit set when the target is fuzzily detected (array.h). */
+static Pilot **vis_near       = NULL; /**< Scratch list for grid queries (array.h). */
+
+/*
+ * extern pilot hacks
+ */
+extern Pilot** pilot_stack;
+extern int pilot_nstack;
+
+/*
+ * Prototypes.
+ */
+static int pilot_inRangePilotRaw( const Pilot *p, const Pilot *target );
+static void pilot_visBuild (void);
+
 #define EVASION_SCALE        1.3225 /**< 1.15 squared. Ensures that ships have higher evasion than hide. */
 #define SENSOR_DEFAULT_RANGE 7500   /**< The default sensor range for all ships. */
 
@@ -129,6 +153,9 @@ void pilot_updateSensorRange (void)
    /* Speeds up calculations as we compare it against vectors later on
     * and we want to avoid actually calculating the sqrt(). */
    sensor_curRange = pow2(sensor_curRange);
+
+   /* Ranges changed. */
+   pilot_visDirty();
 }
 
 
@@ -175,7 +202,7 @@ int pilot_inRange( const Pilot *p, double x, double y )
  */
 int pilot_inRangePilot( const Pilot *p, const Pilot *target )
 {
-   double d, sense;
+   int w;
 
    /* Special case player or omni-visible. */
    if ((pilot_isPlayer(p) && pilot_isFlag(target, PILOT_VISPLAYER)) ||
@@ -183,6 +210,37 @@ int pilot_inRangePilot( const Pilot *p, const Pilot *target )
          target->parent == p->id)
       return 1;
 
+   /* Use the visibility matrix if both pilots are in it. */
+   if (vis_dirty)
+      pilot_visBuild();
+   if ((p->vis_id >= 0) && (p->vis_id < array_size(vis_pilots)) &&
+         (vis_pilots[ p->vis_id ] == p) &&
+         (target->vis_id >= 0) && (target->vis_id < array_size(vis_pilots)) &&
+         (vis_pilots[ target->vis_id ] == target)) {
+      w = p->vis_id * vis_w + target->vis_id / 32;
+      if (vis_detect[w] & (1U << (target->vis_id % 32)))
+         return 1;
+      else if (vis_fuzzy[w] & (1U << (target->vis_id % 32)))
+         return -1;
+      return 0;
+   }
+
+   /* Pilots created this frame are checked directly. */
+   return pilot_inRangePilotRaw( p, target );
+}
+
+
+/**
+ * @brief Checks the sensor range of a pilot against another without special cases.
+ *
+ *    @param p Pilot who is trying to check to see if other is in sensor range.
+ *    @param target Target of p to check to see if is in sensor range.
+ *    @return 1 if they are in range, 0 if they aren't and -1 if they are detected fuzzily.
+ */
+static int pilot_inRangePilotRaw( const Pilot *p, const Pilot *target )
+{
+   double d, sense;
+
    /* Get distance. */
    d = vect_dist2( &p->solid->pos, &target->solid->pos );
 
@@ -196,6 +254,120 @@ int pilot_inRangePilot( const Pilot *p, const Pilot *target )
 }
 
 
+/**
+ * @brief Marks the visibility matrix as needing to be rebuilt.
+ *
+ * Called every tick and whenever pilots are added or removed, the matrix is
+ *  then built on the first query.
+ */
+void pilot_visDirty (void)
+{
+   vis_dirty = 1;
+}
+
+
+/**
+ * @brief Rebuilds the visibility matrix if it is dirty.
+ *
+ * Done before the pilots think so that the first visibility check of the tick
+ *  doesn't have to build it from within a grid query.
+ */
+void pilot_visUpdate (void)
+{
+   if (vis_dirty)
+      pilot_visBuild();
+}
+
+
+/**
+ * @brief Frees the visibility matrix.
+ */
+void pilot_visFree (void)
+{
+   if (vis_pilots != NULL) {
+      array_free( vis_pilots );
+      array_free( vis_detect );
+      array_free( vis_fuzzy );
+      array_free( vis_near );
+   }
+   vis_pilots  = NULL;
+   vis_detect  = NULL;
+   vis_fuzzy   = NULL;
+   vis_near    = NULL;
+   vis_w       = 0;
+   vis_dirty   = 1;
+}
+
+
+/**
+ * @brief Builds the visibility matrix of all the pilots in the system.
+ *
+ * Only pairs within the largest fuzzy detection range are checked, using the
+ *  pilot grid, everything else is undetected.
+ */
+static void pilot_visBuild (void)
+{
+   int i, j, n, nnear, w;
+   double hide, sense, r;
+   Pilot *p, *t;
+
+   if (vis_pilots == NULL) {
+      vis_pilots  = array_create( Pilot* );
+      vis_detect  = array_create( uint32_t );
+      vis_fuzzy   = array_create( uint32_t );
+      vis_near    = array_create( Pilot* );
+   }
+
+   /* Number the pilots. */
+   array_resize( &vis_pilots, 0 );
+   hide = HUGE_VAL;
+   for (i=0; i<pilot_nstack; i++) {
+      p = pilot_stack[i];
+      if (pilot_isFlag( p, PILOT_DELETE )) {
+         p->vis_id = -1;
+         continue;
+      }
+      p->vis_id = array_size( vis_pilots );
+      array_push_back( &vis_pilots, p );
+      /* Evasion is always larger than hide, so hide bounds the range. */
+      hide = MIN( hide, p->ew_hide );
+   }
+   n     = array_size( vis_pilots );
+   vis_w = (n+31) / 32;
+   array_resize( &vis_detect, n*vis_w );
+   array_resize( &vis_fuzzy, n*vis_w );
+   memset( vis_detect, 0, sizeof(uint32_t) * n*vis_w );
+   memset( vis_fuzzy, 0, sizeof(uint32_t) * n*vis_w );
+
+   /* Fill the rows. */
+   for (i=0; i<n; i++) {
+      p     = vis_pilots[i];
+      sense = sensor_curRange * p->ew_detect;
+      r     = (hide > 0.) ? sqrt( sense / hide ) : -1.;
+      nnear = pilot_gridQuery( &vis_near, p, p->solid->pos.x, p->solid->pos.y,
+            r, 0, NULL, NULL );
+      for (j=0; j<nnear; j++) {
+         t = vis_near[j];
+         if ((t->vis_id < 0) || (t->vis_id >= n) || (vis_pilots[ t->vis_id ] != t))
+            continue;
+         w = i*vis_w + t->vis_id / 32;
+         switch (pilot_inRangePilotRaw( p, t )) {
+            case 1:
+               vis_detect[w] |= 1U << (t->vis_id % 32);
+               break;
+            case -1:
+               vis_fuzzy[w]  |= 1U << (t->vis_id % 32);
+               break;
+            default:
+               break;
+         }
+      }
+   }
+
+   vis_dirty = 0;
+}
+
+
 /**
  * @brief Check to see if a planet is in sensor range of the pilot.
  *
@@ -21,6 +21,13 @@ int pilot_inRangePilot( const Pilot *p, const Pilot *target );
 int pilot_inRangePlanet( const Pilot *p, int target );
 int pilot_inRangeJump( const Pilot *p, int target );
 
+/*
+ * Visibility matrix.
+ */
+void pilot_visDirty (void);
+void pilot_visUpdate (void);
+void pilot_visFree (void);
+
 /*
  * Weapon tracking.
  */
@@ -0,0 +1,480 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+/**
+ * @file pilot_grid.c
+ *
+ * @brief Spatial index over the pilots in the system.
+ *
+ * Pilots are binned into a uniform grid that covers all the pilots in the
+ *  system.  The grid is rebuilt lazily the first time it is queried after
+ *  being marked dirty, which happens every frame and whenever the pilot stack
+ *  changes.  Queries always check the current pilot positions, so pilots
+ *  that moved a little since the grid was built are still reported
+ *  correctly.  Filters may run queries of their own, every search in
+ *  progress keeps its results in a separate buffer.
+ */
+
+
+#include "pilot_grid.h"
+
+#include "naev.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "array.h"
+#include "log.h"
+#include "nstring.h"
+
+
+#define PILOT_GRID_CELL    1500. /**< Minimum size of a grid cell. */
+#define PILOT_GRID_MAX     64 /**< Maximum amount of cells per side. */
+#define PILOT_GRID_DEPTH   4 /**< Maximum nesting of queries made from filters. */
+
+
+/**
+ * @brief Pilot found by a query.
+ */
+typedef struct PilotDist_ {
+   Pilot *p; /**< Pilot found. */
+   double d2; /**< Squared distance to the query position. */
+} PilotDist;
+
+
+/*
+ * The grid.
+ */
+static int grid_dirty      = 1; /**< Whether the grid has to be rebuilt. */
+static double grid_x       = 0.; /**< X position of the grid origin. */
+static double grid_y       = 0.; /**< Y position of the grid origin. */
+static double grid_cell    = PILOT_GRID_CELL; /**< Size of a cell. */
+static int grid_w          = 0; /**< Width of the grid in cells. */
+static int grid_h          = 0; /**< Height of the grid in cells. */
+static double grid_size    = 0.; /**< Largest ship sprite width in the grid. */
+static int *grid_start     = NULL; /**< Offset of each cell in grid_pilots (array.h). */
+static int *grid_cellof    = NULL; /**< Cell of each pilot in the stack (array.h). */
+static Pilot **grid_pilots = NULL; /**< Pilots sorted by cell (array.h). */
+static PilotDist *grid_results[PILOT_GRID_DEPTH]; /**< Results of the searches in progress (array.h). */
+static int grid_depth      = 0; /**< Number of searches in progress. */
+
+
+/*
+ * extern pilot hacks
+ */
+extern Pilot** pilot_stack;
+extern int pilot_nstack;
+
+
+/*
+ * Prototypes.
+ */
+static void pilot_gridBuild (void);
+static int pilot_gridCoord( double v, double o, int n );
+static void pilot_gridScan( PilotDist **res, int c, const Pilot *p,
+      double x, double y, double r, PilotFilter filter, void *data );
+static PilotDist** pilot_gridPush (void);
+static int pilot_gridSearch( PilotDist **res, const Pilot *p, double x, double y,
+      double r, int k, PilotFilter filter, void *data );
+static int pilot_gridCompare( const void *a, const void *b );
+
+
+/**
+ * @brief Marks the grid as needing to be rebuilt.
+ *
+ * Must be called whenever pilots move or the pilot stack changes.
+ */
+void pilot_gridDirty (void)
+{
+   grid_dirty = 1;
+}
+
+
+/**
+ * @brief Frees the grid.
+ */
+void pilot_gridFree (void)
+{
+   int i;
+
+   if (grid_start != NULL) {
+      array_free( grid_start );
+      array_free( grid_cellof );
+      array_free( grid_pilots );
+   }
+   grid_start  = NULL;
+   grid_cellof = NULL;
+   grid_pilots = NULL;
+   for (i=0; i<PILOT_GRID_DEPTH; i++) {
+      if (grid_results[i] != NULL)
+         array_free( grid_results[i] );
+      grid_results[i] = NULL;
+   }
+   grid_depth = 0;
+   grid_dirty = 1;
+}
+
+
+/**
+ * @brief Gets the cell coordinate of a position along an axis.
+ *
+ * Positions outside of the grid map to -1 or n.
+ */
+static int pilot_gridCoord( double v, double o, int n )
+{
+   double c;
+   c = floor( (v-o) / grid_cell );
+   if (c < -1.)
+      return -1;
+   if (c > (double)n)
+      return n;
+   return (int)c;
+}
+
+
+/**
+ * @brief Rebuilds the grid from the pilot stack.
+ */
+static void pilot_gridBuild (void)
+{
+   int i, c, n;
+   double xmin, xmax, ymin, ymax;
+   Pilot *p;
+
+   /* Create arrays if necessary. */
+   if (grid_start == NULL) {
+      grid_start  = array_create( int );
+      grid_cellof = array_create( int );
+      grid_pilots = array_create( Pilot* );
+   }
+
+   /* Get the bounds of the pilots. */
+   xmin = ymin = HUGE_VAL;
+   xmax = ymax = -HUGE_VAL;
+   grid_size = 0.;
+   for (i=0; i<pilot_nstack; i++) {
+      p = pilot_stack[i];
+      if (pilot_isFlag( p, PILOT_DELETE ))
+         continue;
+      grid_size = MAX( grid_size, p->ship->gfx_space->sw );
+      xmin = MIN( xmin, p->solid->pos.x );
+      xmax = MAX( xmax, p->solid->pos.x );
+      ymin = MIN( ymin, p->solid->pos.y );
+      ymax = MAX( ymax, p->solid->pos.y );
+   }
+   if (xmin > xmax) {
+      xmin = xmax = 0.;
+      ymin = ymax = 0.;
+   }
+
+   /* Set up the grid so it has at most PILOT_GRID_MAX cells per side. */
+   grid_x    = xmin;
+   grid_y    = ymin;
+   grid_cell = MAX( PILOT_GRID_CELL, MAX( xmax-xmin, ymax-ymin ) / PILOT_GRID_MAX );
+   grid_w    = (int)((xmax-xmin) / grid_cell) + 1;
+   grid_h    = (int)((ymax-ymin) / grid_cell) + 1;
+
+   /* Count the pilots in each cell. */
+   array_resize( &grid_start, grid_w*grid_h+1 );
+   memset( grid_start, 0, sizeof(int)*(grid_w*grid_h+1) );
+   array_resize( &grid_cellof, pilot_nstack );
+   n = 0;
+   for (i=0; i<pilot_nstack; i++) {
+      p = pilot_stack[i];
+      if (pilot_isFlag( p, PILOT_DELETE )) {
+         grid_cellof[i] = -1;
+         continue;
+      }
+      c = CLAMP( 0, grid_h-1, pilot_gridCoord( p->solid->pos.y, grid_y, grid_h ) ) * grid_w +
+            CLAMP( 0, grid_w-1, pilot_gridCoord( p->solid->pos.x, grid_x, grid_w ) );
+      grid_cellof[i] = c;
+      grid_start[c+1]++;
+      n++;
+   }
+   for (c=0; c<grid_w*grid_h; c++)
+      grid_start[c+1] += grid_start[c];
+
+   /* Sort the pilots into the cells, this shifts the offsets one cell down. */
+   array_resize( &grid_pilots, n );
+   for (i=0; i<pilot_nstack; i++)
+      if (grid_cellof[i] >= 0)
+         grid_pilots[ grid_start[ grid_cellof[i] ]++ ] = pilot_stack[i];
+   for (c=grid_w*grid_h; c>0; c--)
+      grid_start[c] = grid_start[c-1];
+   grid_start[0] = 0;
+
+   grid_dirty = 0;
+}
+
+
+/**
+ * @brief Adds all the pilots in a cell that match the query to the results.
+ */
+static void pilot_gridScan( PilotDist **res, int c, const Pilot *p,
+      double x, double y, double r, PilotFilter filter, void *data )
+{
+   int i;
+   double d2;
+   Pilot *t;
+   PilotDist *pd;
+
+   for (i=grid_start[c]; i<grid_start[c+1]; i++) {
+      t = grid_pilots[i];
+
+      /* Must not be self. */
+      if (t == p)
+         continue;
+
+      /* Must be in range. */
+      d2 = pow2( x-t->solid->pos.x ) + pow2( y-t->solid->pos.y );
+      if ((r >= 0.) && (d2 > pow2(r)))
+         continue;
+
+      /* Must match filter. */
+      if ((filter != NULL) && !filter( p, t, data ))
+         continue;
+
+      pd    = &array_grow( res );
+      pd->p = t;
+      pd->d2 = d2;
+   }
+}
+
+
+/**
+ * @brief Compares two query results by distance.
+ */
+static int pilot_gridCompare( const void *a, const void *b )
+{
+   const PilotDist *pa, *pb;
+   pa = (const PilotDist*) a;
+   pb = (const PilotDist*) b;
+   if (pa->d2 < pb->d2)
+      return -1;
+   else if (pa->d2 > pb->d2)
+      return +1;
+   /* Keep results deterministic. */
+   if (pa->p->id < pb->p->id)
+      return -1;
+   else if (pa->p->id > pb->p->id)
+      return +1;
+   return 0;
+}
+
+
+/**
+ * @brief Gets the result buffer for a new search.
+ *
+ * Filters can run queries of their own (visibility does), so every search in
+ *  progress gets its own buffer. Must be matched by decrementing grid_depth
+ *  once the results are no longer needed.
+ *
+ *    @return Empty result buffer or NULL if nested too deep.
+ */
+static PilotDist** pilot_gridPush (void)
+{
+   PilotDist **res;
+
+   if (grid_depth >= PILOT_GRID_DEPTH) {
+      WARN(_("Pilot grid queries nested more than %d deep!"), PILOT_GRID_DEPTH);
+      return NULL;
+   }
+   res = &grid_results[ grid_depth++ ];
+   if (*res == NULL)
+      *res = array_create( PilotDist );
+   array_resize( res, 0 );
+   return res;
+}
+
+
+/**
+ * @brief Searches the grid leaving the sorted results in res.
+ *
+ * Cells are searched in rings around the position, so that searches for the
+ *  nearest pilots only look at the cells near the position.
+ *
+ *    @param res Buffer from pilot_gridPush to store the results in.
+ *    @return Number of results.
+ */
+static int pilot_gridSearch( PilotDist **res, const Pilot *p, double x, double y,
+      double r, int k, PilotFilter filter, void *data )
+{
+   int cx, cy, ring, i, j, step, n;
+   double lb;
+
+   /* Make sure grid is up to date. */
+   if (grid_dirty)
+      pilot_gridBuild();
+
+   cx = pilot_gridCoord( x, grid_x, grid_w );
+   cy = pilot_gridCoord( y, grid_y, grid_h );
+   for (ring=0; ; ring++) {
+      /* Scan all the cells in the ring. */
+      for (j=cy-ring; j<=cy+ring; j++) {
+         if ((j < 0) || (j >= grid_h))
+            continue;
+         step = ((ring==0) || (j==cy-ring) || (j==cy+ring)) ? 1 : 2*ring;
+         for (i=cx-ring; i<=cx+ring; i+=step) {
+            if ((i < 0) || (i >= grid_w))
+               continue;
+            pilot_gridScan( res, j*grid_w+i, p, x, y, r, filter, data );
+         }
+      }
+
+      /* Whole grid has been scanned. */
+      if ((cx-ring <= 0) && (cx+ring >= grid_w-1) &&
+            (cy-ring <= 0) && (cy+ring >= grid_h-1))
+         break;
+
+      /* Pilots in cells not yet scanned are at least this far away. */
+      lb = ring * grid_cell;
+      if ((r >= 0.) && (lb > r))
+         break;
+      if ((k > 0) && (array_size(*res) >= k)) {
+         qsort( *res, array_size(*res), sizeof(PilotDist),
+               pilot_gridCompare );
+         if ((*res)[k-1].d2 <= pow2(lb))
+            break;
+      }
+   }
+
+   /* Sort and truncate. */
+   n = array_size(*res);
+   qsort( *res, n, sizeof(PilotDist), pilot_gridCompare );
+   if ((k > 0) && (n > k))
+      n = k;
+   return n;
+}
+
+
+/**
+ * @brief Gets the pilots near a position sorted by distance.
+ *
+ *    @param[in,out] list Array (array.h) to store the results in.  Created if
+ *          it points to NULL, otherwise it is reused.
+ *    @param p Pilot doing the query, it is never included in the results.
+ *    @param x X position to query.
+ *    @param y Y position to query.
+ *    @param r Maximum distance from the position or negative for no limit.
+ *    @param k Maximum number of pilots to get or 0 for no limit.
+ *    @param filter Filter pilots have to pass or NULL.
+ *    @param data Data to pass to the filter.
+ *    @return Number of pilots found.
+ */
+int pilot_gridQuery( Pilot ***list, const Pilot *p, double x, double y,
+      double r, int k, PilotFilter filter, void *data )
+{
+   int i, n;
+   PilotDist **res;
+
+   if (*list == NULL)
+      *list = array_create( Pilot* );
+   res = pilot_gridPush();
+   if (res == NULL) {
+      array_resize( list, 0 );
+      return 0;
+   }
+
+   n = pilot_gridSearch( res, p, x, y, r, k, filter, data );
+
+   array_resize( list, n );
+   for (i=0; i<n; i++)
+      (*list)[i] = (*res)[i].p;
+   grid_depth--;
+   return n;
+}
+
+
+/**
+ * @brief Gets the nearest pilot to a position.
+ *
+ *    @param p Pilot doing the query, it is never returned.
+ *    @param x X position to query.
+ *    @param y Y position to query.
+ *    @param r Maximum distance from the position or negative for no limit.
+ *    @param filter Filter pilots have to pass or NULL.
+ *    @param data Data to pass to the filter.
+ *    @param[out] d2 Squared distance to the pilot found (may be NULL).
+ *    @return The nearest pilot or NULL if none was found.
+ */
+Pilot* pilot_gridNearest( const Pilot *p, double x, double y, double r,
+      PilotFilter filter, void *data, double *d2 )
+{
+   PilotDist **res;
+   Pilot *t;
+
+   res = pilot_gridPush();
+   if (res == NULL)
+      return NULL;
+
+   t = NULL;
+   if (pilot_gridSearch( res, p, x, y, r, 1, filter, data ) > 0) {
+      t = (*res)[0].p;
+      if (d2 != NULL)
+         *d2 = (*res)[0].d2;
+   }
+   grid_depth--;
+   return t;
+}
+
+
+/**
+ * @brief Gets the width of the largest ship in the grid.
+ *
+ * Useful to extend queries that check against the hull instead of the
+ *  center of the ships.
+ *
+ *    @return Largest ship sprite width.
+ */
+double pilot_gridMaxSize (void)
+{
+   if (grid_dirty)
+      pilot_gridBuild();
+   return grid_size;
+}
+
+
+/**
+ * @brief Filter for valid enemies of the querying pilot.
+ */
+int pilot_filterEnemy( const Pilot *p, const Pilot *target, void *data )
+{
+   (void) data;
+   return pilot_validEnemy( p, target );
+}
+
+
+/**
+ * @brief Filter for allies of the querying pilot.
+ */
+int pilot_filterAlly( const Pilot *p, const Pilot *target, void *data )
+{
+   if (!pilot_filterExists( p, target, data ))
+      return 0;
+   return (p->faction == target->faction) || areAllies( p->faction, target->faction );
+}
+
+
+/**
+ * @brief Filter for pilots the querying pilot can see.
+ */
+int pilot_filterVisible( const Pilot *p, const Pilot *target, void *data )
+{
+   (void) data;
+   return pilot_validTarget( p, target );
+}
+
+
+/**
+ * @brief Filter for pilots that are still in the game.
+ */
+int pilot_filterExists( const Pilot *p, const Pilot *target, void *data )
+{
+   (void) p;
+   (void) data;
+   return !pilot_isFlag( target, PILOT_DELETE ) &&
+         !pilot_isFlag( target, PILOT_DEAD ) &&
+         !pilot_isFlag( target, PILOT_INVISIBLE );
+}
@@ -0,0 +1,48 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef PILOT_GRID_H
+#  define PILOT_GRID_H
+
+
+#include "pilot.h"
+
+
+/**
+ * @brief Filter for pilot spatial queries.
+ *
+ *    @param p Pilot doing the query (may be NULL).
+ *    @param target Pilot being checked.
+ *    @param data User data passed to the query.
+ *    @return 1 if the target should be included in the results.
+ */
+typedef int (*PilotFilter)( const Pilot *p, const Pilot *target, void *data );
+
+
+/*
+ * Index maintenance.
+ */
+void pilot_gridDirty (void);
+void pilot_gridFree (void);
+
+/*
+ * Queries.
+ */
+int pilot_gridQuery( Pilot ***list, const Pilot *p, double x, double y,
+      double r, int k, PilotFilter filter, void *data );
+Pilot* pilot_gridNearest( const Pilot *p, double x, double y, double r,
+      PilotFilter filter, void *data, double *d2 );
+double pilot_gridMaxSize (void);
+
+/*
+ * Common filters.
+ */
+int pilot_filterEnemy( const Pilot *p, const Pilot *target, void *data );
+int pilot_filterAlly( const Pilot *p, const Pilot *target, void *data );
+int pilot_filterVisible( const Pilot *p, const Pilot *target, void *data );
+int pilot_filterExists( const Pilot *p, const Pilot *target, void *data );
+
+
+#endif /* PILOT_GRID_H */
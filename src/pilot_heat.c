@@ -16,6 +16,7 @@
 
 #include <math.h>
 
+#include "array.h"
 #include "log.h"
 
 
@@ -186,6 +187,29 @@ double pilot_heatUpdateSlot( Pilot *p, PilotOutfitSlot *o, double dt )
 }
 
 
+/**
+ * @brief Heats up the pilot's active outfit slots.
+ *
+ * Runs pilot_heatUpdateSlot over the active outfit group, so the groups must
+ *  be up to date (see pilot_outfitGroup).
+ *
+ *    @param p Pilot to update.
+ *    @param dt Delta tick.
+ *    @return The energy transferred from all the slots.
+ */
+double pilot_heatUpdateSlots( Pilot *p, double dt )
+{
+   int i, n;
+   double Q;
+
+   Q = 0.;
+   n = array_size( p->outfit_active );
+   for (i=0; i<n; i++)
+      Q += pilot_heatUpdateSlot( p, p->outfit_active[i], dt );
+   return Q;
+}
+
+
 /**
  * @brief Heats the pilot's ship.
  *
@@ -23,10 +23,100 @@
 #include "log.h"
 #include "hook.h"
 #include "array.h"
+#include "player.h"
 
 
-static PilotHook *pilot_globalHooks = NULL; /**< Global hooks that affect all pilots. */
+#define PILOT_HOOK_RUN  32 /**< Hooks of a type that can be run without allocating. */
+
+
+static PilotHook *pilot_globalHooks[PILOT_HOOKS]; /**< Global hooks that affect all pilots by type (array.h). */
+static unsigned int pilot_globalMask = 0; /**< Bit set for each type with global hooks. */
 static int pilot_hookCleanup = 0; /**< Are hooks being removed from a pilot? */
+static unsigned int pilot_hookGen = 0; /**< Bumped every time hooks are removed. */
+
+
+/*
+ * Prototypes.
+ */
+static void pilot_hookMask( Pilot *p );
+static void pilot_rmHookOne( Pilot *p, unsigned int hook );
+static int pilot_hookHas( const Pilot *p, int hook_type, unsigned int id );
+static int pilot_hookRunList( Pilot *p, int hook_type, const PilotHook *hooks,
+      int n, HookParam *param );
+
+
+/**
+ * @brief Checks to see if a hook is still attached.
+ *
+ *    @param p Pilot to check or NULL for the global hooks.
+ *    @param hook_type Type of the hook.
+ *    @param id ID of the hook.
+ *    @return 1 if the hook is still there.
+ */
+static int pilot_hookHas( const Pilot *p, int hook_type, unsigned int id )
+{
+   int i;
+
+   if (p == NULL) {
+      if (pilot_globalHooks[ hook_type ] == NULL)
+         return 0;
+      for (i=0; i<array_size(pilot_globalHooks[ hook_type ]); i++)
+         if (pilot_globalHooks[ hook_type ][i].id == id)
+            return 1;
+      return 0;
+   }
+
+   for (i=0; i<p->nhooks; i++)
+      if ((p->hooks[i].type == hook_type) && (p->hooks[i].id == id))
+         return 1;
+   return 0;
+}
+
+
+/**
+ * @brief Runs a list of hooks of the same type.
+ *
+ * Hooks may add or remove hooks while running, which moves them around, so
+ *  the list is copied first. Hooks left in the copy are only looked up again
+ *  if something was removed since the copy was made.
+ *
+ *    @param p Pilot the hooks belong to or NULL for global hooks.
+ *    @param hook_type Type of the hooks.
+ *    @param hooks Hooks to run.
+ *    @param n Number of hooks to run.
+ *    @param param Parameters to pass.
+ *    @return The number of hooks run.
+ */
+static int pilot_hookRunList( Pilot *p, int hook_type, const PilotHook *hooks,
+      int n, HookParam *param )
+{
+   PilotHook hstarun[PILOT_HOOK_RUN], *hrun;
+   unsigned int gen;
+   int i, run;
+
+   if (n <= 0)
+      return 0;
+   hrun = (n <= PILOT_HOOK_RUN) ? hstarun : malloc( sizeof(PilotHook) * n );
+   memcpy( hrun, hooks, sizeof(PilotHook) * n );
+
+   run = 0;
+   gen = pilot_hookGen;
+   for (i=0; i<n; i++) {
+      /* Skip hooks removed by a previous one. */
+      if ((gen != pilot_hookGen) && !pilot_hookHas( p, hook_type, hrun[i].id ))
+         continue;
+
+      if (hook_runRefParam( hrun[i].hook, param ))
+         WARN(_("Pilot '%s' failed to run hook type %d"),
+               (p != NULL) ? p->name : "global", hook_type);
+      else
+         run++;
+   }
+
+   if (hrun != hstarun)
+      free( hrun );
+   return run;
+}
 
 
 /**
@@ -38,9 +128,13 @@ static int pilot_hookCleanup = 0; /**< Are hooks being removed from a pilot? */
  */
 int pilot_runHookParam( Pilot* p, int hook_type, HookParam* param, int nparam )
 {
-   int n, i, run, ret;
+   int n, i, nrun, run;
    HookParam hstaparam[5], *hdynparam, *hparam;
 
+   /* Nothing to run. */
+   if (!((p->hook_mask | pilot_globalMask) & (1U << hook_type)))
+      return 0;
+
    /* Set up hook parameters. */
    if (nparam <= 3) {
       hstaparam[0].type       = HOOK_PARAM_PILOT;
@@ -62,32 +156,18 @@ int pilot_runHookParam( Pilot* p, int hook_type, HookParam* param, int nparam )
       hparam                  = hdynparam;
    }
 
-   /* Run pilot specific hooks. */
+   /* Run pilot specific hooks, they are sorted by type. */
    run = 0;
-   for (i=0; i<p->nhooks; i++) {
-      if (p->hooks[i].type != hook_type)
-         continue;
-
-      ret = hook_runIDparam( p->hooks[i].id, hparam );
-      if (ret)
-         WARN(_("Pilot '%s' failed to run hook type %d"), p->name, hook_type);
-      else
-         run++;
+   if (p->hook_mask & (1U << hook_type)) {
+      for (i=0; (i<p->nhooks) && (p->hooks[i].type < hook_type); i++);
+      for (nrun=0; (i+nrun<p->nhooks) && (p->hooks[i+nrun].type == hook_type); nrun++);
+      run += pilot_hookRunList( p, hook_type, &p->hooks[i], nrun, hparam );
    }
 
    /* Run global hooks. */
-   if (pilot_globalHooks != NULL) {
-      for (i=0; i<array_size(pilot_globalHooks); i++) {
-         if (pilot_globalHooks[i].type != hook_type)
-            continue;
-
-         ret = hook_runIDparam( pilot_globalHooks[i].id, hparam );
-         if (ret)
-            WARN(_("Pilot '%s' failed to run hook type %d"), p->name, hook_type);
-         else
-            run++;
-      }
-   }
+   if (pilot_globalHooks[ hook_type ] != NULL)
+      run += pilot_hookRunList( NULL, hook_type, pilot_globalHooks[ hook_type ],
+            array_size( pilot_globalHooks[ hook_type ] ), hparam );
 
    /* Clean up. */
    if (hdynparam != NULL)
@@ -122,10 +202,32 @@ int pilot_runHook( Pilot* p, int hook_type )
  */
 void pilot_addHook( Pilot *pilot, int type, unsigned int hook )
 {
+   int i;
+
+   /* Keep sorted by type, after the hooks of the same type. */
+   for (i=pilot->nhooks; (i>0) && (pilot->hooks[i-1].type > type); i--);
+
    pilot->nhooks++;
    pilot->hooks = realloc( pilot->hooks, sizeof(PilotHook) * pilot->nhooks );
-   pilot->hooks[pilot->nhooks-1].type  = type;
-   pilot->hooks[pilot->nhooks-1].id    = hook;
+   memmove( &pilot->hooks[i+1], &pilot->hooks[i], sizeof(PilotHook) * (pilot->nhooks-1-i) );
+   pilot->hooks[i].type  = type;
+   pilot->hooks[i].id    = hook;
+   pilot->hooks[i].hook  = hook_getRef( hook );
+   pilot->hook_mask     |= 1U << type;
+}
+
+
+/**
+ * @brief Recalculates which hook types a pilot has.
+ *
+ *    @param p Pilot to recalculate hook types of.
+ */
+static void pilot_hookMask( Pilot *p )
+{
+   int i;
+   p->hook_mask = 0;
+   for (i=0; i<p->nhooks; i++)
+      p->hook_mask |= 1U << p->hooks[i].type;
 }
 
 
@@ -137,13 +239,15 @@ void pilots_addGlobalHook( int type, unsigned int hook )
    PilotHook *phook;
 
    /* Allocate memory. */
-   if (pilot_globalHooks == NULL)
-      pilot_globalHooks = array_create( PilotHook );
+   if (pilot_globalHooks[type] == NULL)
+      pilot_globalHooks[type] = array_create( PilotHook );
 
    /* Create the new hook. */
-   phook       = &array_grow( &pilot_globalHooks );
+   phook       = &array_grow( &pilot_globalHooks[type] );
    phook->type = type;
    phook->id   = hook;
+   phook->hook = hook_getRef( hook );
+   pilot_globalMask |= 1U << type;
 }
 
 
@@ -152,16 +256,23 @@ void pilots_addGlobalHook( int type, unsigned int hook )
  */
 void pilots_rmGlobalHook( unsigned int hook )
 {
-   int i;
+   int i, t;
 
    /* Must exist pilot hook.s */
-   if (pilot_globalHooks == NULL )
+   if (pilot_globalMask == 0)
       return;
 
-   for (i=0; i<array_size(pilot_globalHooks); i++) {
-      if (pilot_globalHooks[i].id == hook) {
-         array_erase( &pilot_globalHooks, &pilot_globalHooks[i], &pilot_globalHooks[i+1] );
-         return;
+   for (t=0; t<PILOT_HOOKS; t++) {
+      if (pilot_globalHooks[t] == NULL)
+         continue;
+      for (i=0; i<array_size(pilot_globalHooks[t]); i++) {
+         if (pilot_globalHooks[t][i].id == hook) {
+            array_erase( &pilot_globalHooks[t], &pilot_globalHooks[t][i], &pilot_globalHooks[t][i+1] );
+            pilot_hookGen++;
+            if (array_size(pilot_globalHooks[t]) == 0)
+               pilot_globalMask &= ~(1U << t);
+            return;
+         }
       }
    }
 }
@@ -172,11 +283,13 @@ void pilots_rmGlobalHook( unsigned int hook )
  */
 void pilots_clearGlobalHooks (void)
 {
-   /* Must exist pilot hook.s */
-   if (pilot_globalHooks == NULL )
-      return;
+   int t;
 
-   array_erase( &pilot_globalHooks, pilot_globalHooks, &pilot_globalHooks[ array_size(pilot_globalHooks) ] );
+   for (t=0; t<PILOT_HOOKS; t++)
+      if (pilot_globalHooks[t] != NULL)
+         array_resize( &pilot_globalHooks[t], 0 );
+   pilot_globalMask = 0;
+   pilot_hookGen++;
 }
 
 
@@ -187,8 +300,9 @@ void pilots_clearGlobalHooks (void)
  */
 void pilots_rmHook( unsigned int hook )
 {
-   int i, j;
-   Pilot *p, **plist;
+   int i;
+   Pilot **plist;
+   const PlayerShip_t *pships;
    int n;
 
    /* Cleaning up a pilot's hooks. */
@@ -199,24 +313,42 @@ void pilots_rmHook( unsigned int hook )
    pilots_rmGlobalHook( hook );
 
    plist = pilot_getAll( &n );
-   for (i=0; i<n; i++) {
-      p = plist[i];
+   for (i=0; i<n; i++)
+      pilot_rmHookOne( plist[i], hook );
 
-      /* Must have hooks. */
-      if (p->nhooks <= 0)
-         continue;
+   /* Ships the player isn't flying keep their hooks too. */
+   pships = player_getShipStack( &n );
+   for (i=0; i<n; i++)
+      pilot_rmHookOne( pships[i].p, hook );
+}
 
-      for (j=0; j<p->nhooks; j++) {
 
-         /* Hook not found. */
-         if (p->hooks[j].id != hook)
-            continue;
+/**
+ * @brief Removes a hook from a pilot.
+ *
+ *    @param p Pilot to remove hook from.
+ *    @param hook Hook to remove.
+ */
+static void pilot_rmHookOne( Pilot *p, unsigned int hook )
+{
+   int j;
 
-         p->nhooks--;
-         memmove( &p->hooks[j], &p->hooks[j+1], sizeof(PilotHook) * (p->nhooks-j) );
-         j--; /* Dun like it but we have to keep iterator sane. */
-      }
+   /* Must have hooks. */
+   if (p->nhooks <= 0)
+      return;
+
+   for (j=0; j<p->nhooks; j++) {
+
+      /* Hook not found. */
+      if (p->hooks[j].id != hook)
+         continue;
+
+      p->nhooks--;
+      memmove( &p->hooks[j], &p->hooks[j+1], sizeof(PilotHook) * (p->nhooks-j) );
+      pilot_hookGen++;
+      j--; /* Dun like it but we have to keep iterator sane. */
    }
+   pilot_hookMask( p );
 }
 
 
@@ -243,6 +375,8 @@ void pilot_clearHooks( Pilot *p )
    free(p->hooks);
    p->hooks  = NULL;
    p->nhooks = 0;
+   p->hook_mask = 0;
+   pilot_hookGen++;
 }
 
 
@@ -251,12 +385,16 @@ void pilot_clearHooks( Pilot *p )
  */
 void pilot_freeGlobalHooks (void)
 {
+   int t;
+
    /* Clear global hooks. */
-   if (pilot_globalHooks != NULL) {
-      pilots_clearGlobalHooks();
-      array_free( pilot_globalHooks );
-      pilot_globalHooks = NULL;
+   for (t=0; t<PILOT_HOOKS; t++) {
+      if (pilot_globalHooks[t] != NULL)
+         array_free( pilot_globalHooks[t] );
+      pilot_globalHooks[t] = NULL;
    }
+   pilot_globalMask = 0;
+   pilot_hookGen++;
 }
 
 
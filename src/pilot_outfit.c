@@ -23,12 +23,73 @@
 #include "slots.h"
 #include "nstring.h"
 #include "outfit.h"
+#include "array.h"
+
+
+#define STATS_CACHE_MAX       1024 /**< Maximum cached stat templates before flushing. */
+#define STATS_CACHE_ON        ((uintptr_t)1) /**< Key bit set when a slot's outfit contributes to stats. */
+
+
+/**
+ * @brief Stats derived from a ship and its loadout, shared by all pilots
+ *        with the same loadout.
+ *
+ * Everything here only depends on the ship, the outfits and which active
+ *  outfits are on, per pilot values such as ammo and health are applied on
+ *  top.
+ */
+typedef struct PilotStatsTemplate_ {
+   uint32_t hash; /**< Hash of the key. */
+   const Ship *ship; /**< Ship of the loadout. */
+   uintptr_t *key; /**< Outfit pointers per slot, with STATS_CACHE_ON or'd in. */
+   int nkey; /**< Number of slots in the key. */
+
+   ShipStats stats; /**< Resulting ship stats. */
+   double base_mass; /**< Ship mass plus core outfit mass. */
+   double mass_outfit; /**< Outfit mass, without ammo. */
+   int cpu; /**< CPU left. */
+   int cpu_max; /**< Maximum CPU. */
+   double crew; /**< Crew. */
+   double cap_cargo; /**< Cargo capacity. */
+   double thrust_base; /**< Base thrust. */
+   double turn_base; /**< Base turn. */
+   double speed_base; /**< Base speed. */
+   int fuel_consumption; /**< Fuel consumed per jump. */
+   int fuel_max; /**< Maximum fuel. */
+   double armour_max; /**< Maximum armour. */
+   double armour_regen; /**< Armour regeneration. */
+   double shield_max; /**< Maximum shield. */
+   double shield_regen; /**< Shield regeneration. */
+   double dmg_absorb; /**< Damage absorption. */
+   double energy_max; /**< Maximum energy. */
+   double energy_regen; /**< Energy regeneration. */
+   double energy_loss; /**< Energy loss. */
+   double ew_base_hide; /**< Squared base hide. */
+   double ew_detect; /**< Squared detection. */
+   double ew_jump_detect; /**< Squared jump detection. */
+   int afterburner; /**< An afterburner is on. */
+} PilotStatsTemplate;
+
+
+/*
+ * Stat template cache.
+ */
+static PilotStatsTemplate *stats_cache = NULL; /**< Cached stat templates (array.h). */
+static int *stats_hash        = NULL; /**< Open addressing index into stats_cache, -1 is empty. */
+static int stats_mhash        = 0; /**< Size of stats_hash (power of two). */
+static uintptr_t *stats_key   = NULL; /**< Scratch key (array.h). */
+static unsigned long stats_hits = 0; /**< Number of templates reused. */
+static unsigned long stats_misses = 0; /**< Number of templates computed. */
 
 
 /*
  * Prototypes.
  */
 static int pilot_hasOutfitLimit( Pilot *p, const char *limit );
+static uint32_t pilot_statsKey( const Pilot *pilot );
+static const PilotStatsTemplate* pilot_statsTemplate( Pilot *pilot );
+static void pilot_statsCompute( Pilot *pilot, PilotStatsTemplate *t );
+static void pilot_statsCacheFlush (void);
 
 
 /**
@@ -279,6 +340,63 @@ int pilot_hasDeployed( Pilot *p )
 }
 
 
+/**
+ * @brief Groups the pilot's active outfits by what has to be updated every frame.
+ *
+ * This lets pilot_update run each kind of update as its own loop instead of
+ *  checking the outfit type of every slot every frame.
+ *
+ *    @param p Pilot to group outfits of.
+ */
+void pilot_outfitGroup( Pilot *p )
+{
+   int i;
+   PilotOutfitSlot *o;
+
+   if (p->outfit_active == NULL) {
+      p->outfit_active = array_create( PilotOutfitSlot* );
+      p->outfit_reload = array_create( PilotOutfitSlot* );
+      p->outfit_seeker = array_create( PilotOutfitSlot* );
+   }
+   array_resize( &p->outfit_active, 0 );
+   array_resize( &p->outfit_reload, 0 );
+   array_resize( &p->outfit_seeker, 0 );
+
+   for (i=0; i<p->noutfits; i++) {
+      o = p->outfits[i];
+      if ((o->outfit == NULL) || !o->active)
+         continue;
+      array_push_back( &p->outfit_active, o );
+      if ((outfit_isLauncher(o->outfit) || outfit_isFighterBay(o->outfit)) &&
+            (outfit_ammo(o->outfit) != NULL))
+         array_push_back( &p->outfit_reload, o );
+      if (outfit_isSeeker(o->outfit))
+         array_push_back( &p->outfit_seeker, o );
+   }
+
+   p->outfit_grouped = 1;
+}
+
+
+/**
+ * @brief Frees the pilot's outfit update groups.
+ *
+ *    @param p Pilot to free outfit groups of.
+ */
+void pilot_outfitGroupFree( Pilot *p )
+{
+   if (p->outfit_active != NULL) {
+      array_free( p->outfit_active );
+      array_free( p->outfit_reload );
+      array_free( p->outfit_seeker );
+   }
+   p->outfit_active  = NULL;
+   p->outfit_reload  = NULL;
+   p->outfit_seeker  = NULL;
+   p->outfit_grouped = 0;
+}
+
+
 /**
  * @brief Adds an outfit to the pilot, ignoring CPU or other limits.
  *
@@ -295,6 +413,7 @@ int pilot_addOutfitRaw( Pilot* pilot, Outfit* outfit, PilotOutfitSlot *s )
 
    /* Set the outfit. */
    s->outfit   = outfit;
+   pilot->outfit_grouped = 0;
 
    /* Set some default parameters. */
    s->timer    = 0.;
@@ -424,6 +543,7 @@ int pilot_rmOutfitRaw( Pilot* pilot, PilotOutfitSlot *s )
    /* Remove the outfit. */
    ret         = (s->outfit==NULL);
    s->outfit   = NULL;
+   pilot->outfit_grouped = 0;
 
    /* Remove secondary and such if necessary. */
    if (pilot->afterburner == s)
@@ -886,60 +1006,153 @@ char* pilot_getOutfits( const Pilot* pilot )
 
 
 /**
- * @brief Recalculates the pilot's stats based on his outfits.
+ * @brief Builds the loadout key of a pilot into the scratch key.
  *
- *    @param pilot Pilot to recalculate his stats.
+ *    @param pilot Pilot to build key of.
+ *    @return Hash of the key.
  */
-void pilot_calcStats( Pilot* pilot )
+static uint32_t pilot_statsKey( const Pilot *pilot )
+{
+   int i, j;
+   uint32_t h;
+   uintptr_t k;
+   PilotOutfitSlot *slot;
+
+   if (stats_key == NULL)
+      stats_key = array_create( uintptr_t );
+   array_resize( &stats_key, pilot->noutfits );
+
+   h = 2166136261u;
+   k = (uintptr_t)pilot->ship;
+   for (j=0; j<(int)sizeof(uintptr_t); j++) {
+      h ^= (k >> (8*j)) & 0xff;
+      h *= 16777619u;
+   }
+   for (i=0; i<pilot->noutfits; i++) {
+      slot = pilot->outfits[i];
+      k    = (uintptr_t)slot->outfit;
+      /* Active outfits only contribute when on. */
+      if ((slot->outfit != NULL) && !(slot->active && (slot->state!=PILOT_OUTFIT_ON)))
+         k |= STATS_CACHE_ON;
+      stats_key[i] = k;
+      for (j=0; j<(int)sizeof(uintptr_t); j++) {
+         h ^= (k >> (8*j)) & 0xff;
+         h *= 16777619u;
+      }
+   }
+   return h;
+}
+
+
+/**
+ * @brief Gets the stat template matching the pilot's loadout, computing it if needed.
+ *
+ *    @param pilot Pilot to get template of.
+ *    @return The stat template.
+ */
+static const PilotStatsTemplate* pilot_statsTemplate( Pilot *pilot )
+{
+   int i, n, idx;
+   uint32_t h;
+   PilotStatsTemplate *t;
+
+   h = pilot_statsKey( pilot );
+   n = pilot->noutfits;
+
+   /* Look up. */
+   if (stats_mhash > 0) {
+      for (i=h & (stats_mhash-1); stats_hash[i] >= 0; i=(i+1) & (stats_mhash-1)) {
+         t = &stats_cache[ stats_hash[i] ];
+         if ((t->hash == h) && (t->ship == pilot->ship) && (t->nkey == n) &&
+               (memcmp( t->key, stats_key, sizeof(uintptr_t) * n )==0)) {
+            stats_hits++;
+            return t;
+         }
+      }
+   }
+
+   /* Start over when full, loadouts in use get cached again quickly. */
+   if ((stats_cache != NULL) && (array_size(stats_cache) >= STATS_CACHE_MAX))
+      pilot_statsCacheFlush();
+   if (stats_cache == NULL) {
+      stats_cache = array_create( PilotStatsTemplate );
+      stats_mhash = 2*STATS_CACHE_MAX;
+      stats_hash  = malloc( sizeof(int) * stats_mhash );
+      for (i=0; i<stats_mhash; i++)
+         stats_hash[i] = -1;
+   }
+
+   /* Compute a new template. */
+   stats_misses++;
+   idx      = array_size(stats_cache);
+   t        = &array_grow( &stats_cache );
+   t->hash  = h;
+   t->ship  = pilot->ship;
+   t->nkey  = n;
+   t->key   = malloc( sizeof(uintptr_t) * MAX(n,1) );
+   memcpy( t->key, stats_key, sizeof(uintptr_t) * n );
+   pilot_statsCompute( pilot, t );
+
+   for (i=h & (stats_mhash-1); stats_hash[i] >= 0; i=(i+1) & (stats_mhash-1));
+   stats_hash[i] = idx;
+   return t;
+}
+
+
+/**
+ * @brief Computes the stat template of the pilot's loadout.
+ *
+ *    @param pilot Pilot to compute the loadout of.
+ *    @param t Template to fill in.
+ */
+static void pilot_statsCompute( Pilot *pilot, PilotStatsTemplate *t )
 {
    int i;
    Outfit* o;
    PilotOutfitSlot *slot;
-   double ac, sc, ec; /* temporary health coefficients to set */
    ShipStats amount, *s, *default_s;
+   const Ship *ship;
 
    /*
     * set up the basic stuff
     */
+   ship = pilot->ship;
    /* mass */
-   pilot->solid->mass   = pilot->ship->mass;
-   pilot->base_mass     = pilot->solid->mass;
+   t->base_mass      = ship->mass;
    /* cpu */
-   pilot->cpu           = 0.;
+   t->cpu            = 0;
    /* movement */
-   pilot->thrust_base   = pilot->ship->thrust;
-   pilot->turn_base     = pilot->ship->turn;
-   pilot->speed_base    = pilot->ship->speed;
+   t->thrust_base    = ship->thrust;
+   t->turn_base      = ship->turn;
+   t->speed_base     = ship->speed;
    /* crew */
-   pilot->crew          = pilot->ship->crew;
+   t->crew           = ship->crew;
    /* cargo */
-   pilot->cap_cargo     = pilot->ship->cap_cargo;
+   t->cap_cargo      = ship->cap_cargo;
    /* fuel_consumption. */
-   pilot->fuel_consumption = pilot->ship->fuel_consumption;
+   t->fuel_consumption = ship->fuel_consumption;
    /* health */
-   ac = (pilot->armour_max > 0.) ? pilot->armour / pilot->armour_max : 0.;
-   sc = (pilot->shield_max > 0.) ? pilot->shield / pilot->shield_max : 0.;
-   ec = (pilot->energy_max > 0.) ? pilot->energy / pilot->energy_max : 0.;
-   pilot->armour_max    = pilot->ship->armour;
-   pilot->shield_max    = pilot->ship->shield;
-   pilot->fuel_max      = pilot->ship->fuel;
-   pilot->armour_regen  = pilot->ship->armour_regen;
-   pilot->shield_regen  = pilot->ship->shield_regen;
+   t->armour_max     = ship->armour;
+   t->shield_max     = ship->shield;
+   t->fuel_max       = ship->fuel;
+   t->armour_regen   = ship->armour_regen;
+   t->shield_regen   = ship->shield_regen;
    /* Absorption. */
-   pilot->dmg_absorb    = pilot->ship->dmg_absorb;
+   t->dmg_absorb     = ship->dmg_absorb;
    /* Energy. */
-   pilot->energy_max    = pilot->ship->energy;
-   pilot->energy_regen  = pilot->ship->energy_regen;
-   pilot->energy_loss   = 0.; /* Initially no net loss. */
+   t->energy_max     = ship->energy;
+   t->energy_regen   = ship->energy_regen;
+   t->energy_loss    = 0.; /* Initially no net loss. */
+   t->afterburner    = 0;
    /* Stats. */
-   s = &pilot->stats;
-   *s = pilot->ship->stats_array;
+   s = &t->stats;
+   *s = ship->stats_array;
    memset( &amount, 0, sizeof(ShipStats) );
 
    /*
     * Now add outfit changes
     */
-   pilot->mass_outfit   = 0.;
+   t->mass_outfit    = 0.;
    for (i=0; i<pilot->noutfits; i++) {
       slot = pilot->outfits[i];
       o    = slot->outfit;
@@ -949,22 +1162,14 @@ void pilot_calcStats( Pilot* pilot )
          continue;
 
       /* Modify CPU. */
-      pilot->cpu           += outfit_cpu(o);
+      t->cpu           += outfit_cpu(o);
 
       /* Add mass. */
-      pilot->mass_outfit   += o->mass;
+      t->mass_outfit   += o->mass;
 
       /* Keep a separate counter for required (core) outfits. */
       if (sp_required( o->slot.spid ))
-         pilot->base_mass += o->mass;
-
-      /* Add ammo mass. */
-      if (outfit_ammo(o) != NULL)
-         if (slot->u.ammo.outfit != NULL)
-            pilot->mass_outfit += slot->u.ammo.quantity * slot->u.ammo.outfit->mass;
-
-      if (outfit_isAfterburner(o)) /* Afterburner */
-         pilot->afterburner = pilot->outfits[i]; /* Set afterburner */
+         t->base_mass  += o->mass;
 
       /* Active outfits must be on to affect stuff. */
       if (slot->active && !(slot->state==PILOT_OUTFIT_ON))
@@ -972,24 +1177,24 @@ void pilot_calcStats( Pilot* pilot )
 
       if (outfit_isMod(o)) { /* Modification */
          /* Movement. */
-         pilot->thrust_base   += o->u.mod.thrust;
-         pilot->turn_base     += o->u.mod.turn;
-         pilot->speed_base    += o->u.mod.speed;
+         t->thrust_base   += o->u.mod.thrust;
+         t->turn_base     += o->u.mod.turn;
+         t->speed_base    += o->u.mod.speed;
          /* Health. */
-         pilot->dmg_absorb    += o->u.mod.absorb;
-         pilot->armour_max    += o->u.mod.armour;
-         pilot->armour_regen  += o->u.mod.armour_regen;
-         pilot->shield_max    += o->u.mod.shield;
-         pilot->shield_regen  += o->u.mod.shield_regen;
-         pilot->energy_max    += o->u.mod.energy;
-         pilot->energy_regen  += o->u.mod.energy_regen;
-         pilot->energy_loss   += o->u.mod.energy_loss;
+         t->dmg_absorb    += o->u.mod.absorb;
+         t->armour_max    += o->u.mod.armour;
+         t->armour_regen  += o->u.mod.armour_regen;
+         t->shield_max    += o->u.mod.shield;
+         t->shield_regen  += o->u.mod.shield_regen;
+         t->energy_max    += o->u.mod.energy;
+         t->energy_regen  += o->u.mod.energy_regen;
+         t->energy_loss   += o->u.mod.energy_loss;
          /* Fuel. */
-         pilot->fuel_max      += o->u.mod.fuel;
+         t->fuel_max      += o->u.mod.fuel;
          /* Misc. */
-         pilot->cap_cargo     += o->u.mod.cargo;
-         pilot->mass_outfit   += o->u.mod.mass_rel * pilot->ship->mass;
-         pilot->crew          += o->u.mod.crew_rel * pilot->ship->crew;
+         t->cap_cargo     += o->u.mod.cargo;
+         t->mass_outfit   += o->u.mod.mass_rel * ship->mass;
+         t->crew          += o->u.mod.crew_rel * ship->crew;
          /*
           * Stats.
           */
@@ -997,17 +1202,13 @@ void pilot_calcStats( Pilot* pilot )
 
       }
       else if (outfit_isAfterburner(o)) { /* Afterburner */
-         pilot_setFlag( pilot, PILOT_AFTERBURNER ); /* We use old school flags for this still... */
-         pilot->energy_loss += pilot->afterburner->outfit->u.afb.energy; /* energy loss */
+         t->afterburner  = 1;
+         t->energy_loss += o->u.afb.energy; /* energy loss */
       }
    }
 
-   if (!pilot_isFlag( pilot, PILOT_AFTERBURNER ))
-      pilot->solid->speed_max = pilot->speed;
-
    /* Slot voodoo. */
-   s = &pilot->stats;
-   default_s = &pilot->ship->stats_array;
+   default_s = (ShipStats*) &ship->stats_array;
 
    /* Fire rate:
     *  amount = p * exp( -0.15 * (n-1) )
@@ -1031,39 +1232,156 @@ void pilot_calcStats( Pilot* pilot )
    s->ew_jump_detect    = default_s->ew_jump_detect + (s->ew_jump_detect-default_s->ew_jump_detect) * exp( -0.2 * (double)(MAX(amount.ew_jump_detect-1.,0)) );
 
    /* Square the internal values to speed up comparisons. */
-   pilot->ew_base_hide   = pow2( s->ew_hide );
-   pilot->ew_detect      = pow2( s->ew_detect );
-   pilot->ew_jump_detect = pow2( s->ew_jump_detect );
+   t->ew_base_hide   = pow2( s->ew_hide );
+   t->ew_detect      = pow2( s->ew_detect );
+   t->ew_jump_detect = pow2( s->ew_jump_detect );
 
    /*
     * Relative increases.
     */
    /* Movement. */
-   pilot->thrust_base  *= s->thrust_mod;
-   pilot->turn_base    *= s->turn_mod;
-   pilot->speed_base   *= s->speed_mod;
+   t->thrust_base  *= s->thrust_mod;
+   t->turn_base    *= s->turn_mod;
+   t->speed_base   *= s->speed_mod;
    /* Health. */
-   pilot->armour_max   *= s->armour_mod;
-   pilot->armour_regen *= s->armour_regen_mod;
-   pilot->shield_max   *= s->shield_mod;
-   pilot->shield_regen *= s->shield_regen_mod;
-   pilot->energy_max   *= s->energy_mod;
-   pilot->energy_regen *= s->energy_regen_mod;
+   t->armour_max   *= s->armour_mod;
+   t->armour_regen *= s->armour_regen_mod;
+   t->shield_max   *= s->shield_mod;
+   t->shield_regen *= s->shield_regen_mod;
+   t->energy_max   *= s->energy_mod;
+   t->energy_regen *= s->energy_regen_mod;
    /* cpu */
-   pilot->cpu_max       = (int)floor((float)(pilot->ship->cpu + s->cpu_max)*s->cpu_mod);
-   pilot->cpu          += pilot->cpu_max; /* CPU is negative, this just sets it so it's based off of cpu_max. */
+   t->cpu_max       = (int)floor((float)(ship->cpu + s->cpu_max)*s->cpu_mod);
+   t->cpu          += t->cpu_max; /* CPU is negative, this just sets it so it's based off of cpu_max. */
    /* Misc. */
-   pilot->dmg_absorb    = MAX( 0., pilot->dmg_absorb );
-   pilot->crew         *= s->crew_mod;
-   pilot->cap_cargo    *= s->cargo_mod;
-   s->engine_limit     *= s->engine_limit_rel;
+   t->dmg_absorb    = MAX( 0., t->dmg_absorb );
+   t->crew         *= s->crew_mod;
+   t->cap_cargo    *= s->cargo_mod;
+   s->engine_limit *= s->engine_limit_rel;
 
    /*
     * Flat increases.
     */
-   pilot->energy_max   += s->energy_flat;
-   pilot->energy       += s->energy_flat;
-   pilot->energy_regen -= s->energy_usage;
+   t->energy_max   += s->energy_flat;
+   t->energy_regen -= s->energy_usage;
+}
+
+
+/**
+ * @brief Drops the cached stat templates, keeping the scratch key.
+ */
+static void pilot_statsCacheFlush (void)
+{
+   int i;
+
+   if (stats_cache != NULL) {
+      for (i=0; i<array_size(stats_cache); i++)
+         free( stats_cache[i].key );
+      array_free( stats_cache );
+   }
+   stats_cache = NULL;
+   free( stats_hash );
+   stats_hash  = NULL;
+   stats_mhash = 0;
+}
+
+
+/**
+ * @brief Frees the cached stat templates.
+ */
+void pilot_statsCacheFree (void)
+{
+   pilot_statsCacheFlush();
+   if (stats_key != NULL)
+      array_free( stats_key );
+   stats_key   = NULL;
+}
+
+
+/**
+ * @brief Gets how often stat templates were reused.
+ *
+ *    @param[out] hits Number of times a cached template was reused.
+ *    @param[out] misses Number of times a template had to be computed.
+ */
+void pilot_statsCacheCount( unsigned long *hits, unsigned long *misses )
+{
+   *hits    = stats_hits;
+   *misses  = stats_misses;
+}
+
+
+/**
+ * @brief Recalculates the pilot's stats based on his outfits.
+ *
+ * The loadout dependent part comes from a template shared by all pilots
+ *  with the same ship and outfits, only ammo and health are per pilot.
+ *
+ *    @param pilot Pilot to recalculate his stats.
+ */
+void pilot_calcStats( Pilot* pilot )
+{
+   int i;
+   Outfit* o;
+   PilotOutfitSlot *slot;
+   double ac, sc, ec; /* temporary health coefficients to set */
+   const PilotStatsTemplate *t;
+
+   /* health */
+   ac = (pilot->armour_max > 0.) ? pilot->armour / pilot->armour_max : 0.;
+   sc = (pilot->shield_max > 0.) ? pilot->shield / pilot->shield_max : 0.;
+   ec = (pilot->energy_max > 0.) ? pilot->energy / pilot->energy_max : 0.;
+
+   /* Apply the loadout template. */
+   t = pilot_statsTemplate( pilot );
+   pilot->solid->mass   = pilot->ship->mass;
+   pilot->stats         = t->stats;
+   pilot->base_mass     = t->base_mass;
+   pilot->mass_outfit   = t->mass_outfit;
+   pilot->cpu           = t->cpu;
+   pilot->cpu_max       = t->cpu_max;
+   pilot->crew          = t->crew;
+   pilot->cap_cargo     = t->cap_cargo;
+   pilot->thrust_base   = t->thrust_base;
+   pilot->turn_base     = t->turn_base;
+   pilot->speed_base    = t->speed_base;
+   pilot->fuel_consumption = t->fuel_consumption;
+   pilot->fuel_max      = t->fuel_max;
+   pilot->armour_max    = t->armour_max;
+   pilot->armour_regen  = t->armour_regen;
+   pilot->shield_max    = t->shield_max;
+   pilot->shield_regen  = t->shield_regen;
+   pilot->dmg_absorb    = t->dmg_absorb;
+   pilot->energy_max    = t->energy_max;
+   pilot->energy_regen  = t->energy_regen;
+   pilot->energy_loss   = t->energy_loss;
+   pilot->ew_base_hide  = t->ew_base_hide;
+   pilot->ew_detect     = t->ew_detect;
+   pilot->ew_jump_detect = t->ew_jump_detect;
+   if (t->afterburner)
+      pilot_setFlag( pilot, PILOT_AFTERBURNER ); /* We use old school flags for this still... */
+
+   /* Per pilot outfit state. */
+   for (i=0; i<pilot->noutfits; i++) {
+      slot = pilot->outfits[i];
+      o    = slot->outfit;
+      if (o==NULL)
+         continue;
+
+      /* Add ammo mass. */
+      if (outfit_ammo(o) != NULL)
+         if (slot->u.ammo.outfit != NULL)
+            pilot->mass_outfit += slot->u.ammo.quantity * slot->u.ammo.outfit->mass;
+
+      if (outfit_isAfterburner(o)) /* Afterburner */
+         pilot->afterburner = pilot->outfits[i]; /* Set afterburner */
+   }
+
+   if (!pilot_isFlag( pilot, PILOT_AFTERBURNER ))
+      pilot->solid->speed_max = pilot->speed;
+
+   /* Flat energy increase is included in the template. */
+   pilot->energy       += pilot->stats.energy_flat;
 
    /* Give the pilot his health proportion back */
    pilot->armour = ac * pilot->armour_max;
@@ -1080,7 +1398,7 @@ void pilot_calcStats( Pilot* pilot )
    pilot_cargoCalc(pilot);
 
    /* Calculate mass. */
-   pilot->solid->mass = s->mass_mod*pilot->ship->mass + pilot->stats.cargo_inertia*pilot->mass_cargo + pilot->mass_outfit;
+   pilot->solid->mass = pilot->stats.mass_mod*pilot->ship->mass + pilot->stats.cargo_inertia*pilot->mass_cargo + pilot->mass_outfit;
 
    /* Calculate the heat. */
    pilot_heatCalc( pilot );
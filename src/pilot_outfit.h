@@ -35,11 +35,17 @@ const char* pilot_canEquip( Pilot *p, PilotOutfitSlot *s, Outfit *o );
 
 /* Lockons. */
 void pilot_lockUpdateSlot( Pilot *p, PilotOutfitSlot *o, Pilot *t, double *a, double dt );
+
+/* Update groups. */
+void pilot_outfitGroup( Pilot *p );
+void pilot_outfitGroupFree( Pilot *p );
 void pilot_lockClear( Pilot *p );
 
 /* Other. */
 char* pilot_getOutfits( const Pilot *pilot );
 void pilot_calcStats( Pilot *pilot );
+void pilot_statsCacheFree (void);
+void pilot_statsCacheCount( unsigned long *hits, unsigned long *misses );
 void pilot_updateMass( Pilot *pilot );
 void pilot_healLanded( Pilot *pilot );
 
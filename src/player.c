@@ -131,6 +131,8 @@ static double player_timer = 0.; /**< For death and such. */
 static int* missions_done  = NULL; /**< Saves position of completed missions. */
 static int missions_mdone  = 0; /**< Memory size of completed missions. */
 static int missions_ndone  = 0; /**< Number of completed missions. */
+static uint32_t* missions_donebits = NULL; /**< Bitset of completed missions by ID. */
+static int missions_ndonebits = 0; /**< Number of words in the completed missions bitset. */
 
 
 /*
@@ -139,6 +141,8 @@ static int missions_ndone  = 0; /**< Number of completed missions. */
 static int* events_done  = NULL; /**< Saves position of completed events. */
 static int events_mdone  = 0; /**< Memory size of completed events. */
 static int events_ndone  = 0; /**< Number of completed events. */
+static uint32_t* events_donebits = NULL; /**< Bitset of completed events by ID. */
+static int events_ndonebits = 0; /**< Number of words in the completed events bitset. */
 
 
 /*
@@ -167,6 +171,9 @@ static int player_newMake (void);
 static Pilot* player_newShipMake( const char* name );
 /* sound */
 static void player_initSound (void);
+/* unique missions and events */
+static void player_doneSet( uint32_t **bits, int *nbits, int id );
+static int player_doneGet( const uint32_t *bits, int nbits, int id );
 /* save/load */
 static int player_saveEscorts( xmlTextWriterPtr writer );
 static int player_saveShipSlot( xmlTextWriterPtr writer, PilotOutfitSlot *slot, int i );
@@ -695,6 +702,9 @@ void player_cleanup (void)
    missions_done = NULL;
    missions_ndone = 0;
    missions_mdone = 0;
+   free(missions_donebits);
+   missions_donebits = NULL;
+   missions_ndonebits = 0;
 
    /* Clean up events. */
    if (events_done != NULL)
@@ -702,6 +712,9 @@ void player_cleanup (void)
    events_done = NULL;
    events_ndone = 0;
    events_mdone = 0;
+   free(events_donebits);
+   events_donebits = NULL;
+   events_ndonebits = 0;
 
    /* Clean up licenses. */
    if (player_nlicenses > 0) {
@@ -2587,6 +2600,46 @@ int player_rmOutfit( const Outfit *o, int quantity )
 }
 
 
+/**
+ * @brief Sets a bit in a completion bitset, growing it as necessary.
+ *
+ *    @param bits Bitset to modify.
+ *    @param nbits Number of words in the bitset.
+ *    @param id ID to set.
+ */
+static void player_doneSet( uint32_t **bits, int *nbits, int id )
+{
+   int n;
+
+   if (id < 0)
+      return;
+
+   n = id/32 + 1;
+   if (n > *nbits) {
+      *bits = realloc( *bits, sizeof(uint32_t) * n );
+      memset( &(*bits)[ *nbits ], 0, sizeof(uint32_t) * (n - *nbits) );
+      *nbits = n;
+   }
+   (*bits)[ id/32 ] |= (1u << (id%32));
+}
+
+
+/**
+ * @brief Checks a bit in a completion bitset.
+ *
+ *    @param bits Bitset to check.
+ *    @param nbits Number of words in the bitset.
+ *    @param id ID to check.
+ *    @return 1 if the bit is set, 0 otherwise.
+ */
+static int player_doneGet( const uint32_t *bits, int nbits, int id )
+{
+   if ((id < 0) || (id/32 >= nbits))
+      return 0;
+   return !!(bits[ id/32 ] & (1u << (id%32)));
+}
+
+
 /**
  * @brief Marks a mission as completed.
  *
@@ -2605,6 +2658,7 @@ void player_missionFinished( int id )
       missions_done = realloc( missions_done, sizeof(int) * missions_mdone);
    }
    missions_done[ missions_ndone-1 ] = id;
+   player_doneSet( &missions_donebits, &missions_ndonebits, id );
 }
 
 
@@ -2616,11 +2670,7 @@ void player_missionFinished( int id )
  */
 int player_missionAlreadyDone( int id )
 {
-   int i;
-   for (i=0; i<missions_ndone; i++)
-      if (missions_done[i] == id)
-         return 1;
-   return 0;
+   return player_doneGet( missions_donebits, missions_ndonebits, id );
 }
 
 
@@ -2642,6 +2692,7 @@ void player_eventFinished( int id )
       events_done = realloc( events_done, sizeof(int) * events_mdone);
    }
    events_done[ events_ndone-1 ] = id;
+   player_doneSet( &events_donebits, &events_ndonebits, id );
 }
 
 
@@ -2653,11 +2704,7 @@ void player_eventFinished( int id )
  */
 int player_eventAlreadyDone( int id )
 {
-   int i;
-   for (i=0; i<events_ndone; i++)
-      if (events_done[i] == id)
-         return 1;
-   return 0;
+   return player_doneGet( events_donebits, events_ndonebits, id );
 }
 
 
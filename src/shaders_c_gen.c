@@ -46,6 +46,13 @@ const Shader shaders[] = {
       .attributes = {"vertex"},
       .uniforms = {"projection", "color", "tex_mat"}
    },
+   {
+      .name = "texture_batch",
+      .vs_path = "texture_batch.vert",
+      .fs_path = "texture.frag",
+      .attributes = {"vertex", "vertex_tex"},
+      .uniforms = {"projection", "color"}
+   },
    {
       .name = "texture_interpolate",
       .vs_path = "texture.vert",
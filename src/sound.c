@@ -30,6 +30,7 @@
 #include "conf.h"
 #include "player.h"
 #include "camera.h"
+#include "threadpool.h"
 
 
 #define SOUND_SUFFIX_WAV   ".wav" /**< Suffix of sounds. */
@@ -39,6 +40,9 @@
 #define voiceLock()        SDL_LockMutex(voice_mutex)
 #define voiceUnlock()      SDL_UnlockMutex(voice_mutex)
 
+#define loadLock()         SDL_LockMutex(sound_load_mutex)
+#define loadUnlock()       SDL_UnlockMutex(sound_load_mutex)
+
 
 /*
  * Global sound properties.
@@ -54,6 +58,24 @@ static alSound *sound_list    = NULL; /**< List of available sounds. */
 static int sound_nlist        = 0; /**< Number of available sounds. */
 
 
+/*
+ * Background loading.
+ */
+static SDL_mutex *sound_load_mutex = NULL; /**< Lock for the sound states. */
+static SDL_cond *sound_load_cond = NULL; /**< Signalled when a sound finishes loading. */
+static int sound_load_pending = 0; /**< Number of sounds being loaded. */
+
+
+/**
+ * @brief Sound load job for the threadpool.
+ */
+typedef struct soundLoadJob_ {
+   alSound *snd; /**< Sound to load. */
+   char *data; /**< Contents of the sound file. */
+   size_t size; /**< Size of the data. */
+} soundLoadJob;
+
+
 /*
  * Voices.
  */
@@ -61,6 +83,9 @@ static int voice_genid        = 0; /**< Voice identifier generator. */
 alVoice *voice_active         = NULL; /**< Active voices. */
 static alVoice *voice_pool    = NULL; /**< Pool of free voices. */
 static SDL_mutex *voice_mutex = NULL; /**< Lock for voices. */
+static int voice_nactive      = 0; /**< Number of voices being mixed. */
+static int voice_nvirtual     = 0; /**< Number of voices only being tracked. */
+static int voice_nculled      = 0; /**< Number of voices that ended without being heard. */
 
 
 /*
@@ -79,7 +104,7 @@ static double snd_compression_gain = 0.; /**< Current compression gain. */
 int  (*sound_sys_init) (void)          = NULL;
 void (*sound_sys_exit) (void)          = NULL;
  /* Sound creation. */
-int  (*sound_sys_load) ( alSound *snd, const char *filename ) = NULL;
+int  (*sound_sys_load) ( alSound *snd, const char *data, size_t size ) = NULL;
 void (*sound_sys_free) ( alSound *snd ) = NULL;
  /* Sound settings. */
 int  (*sound_sys_volume) ( const double vol ) = NULL;
@@ -91,7 +116,7 @@ int  (*sound_sys_playPos) ( alVoice *v, alSound *s,
       double px, double py, double vx, double vy ) = NULL;
 int  (*sound_sys_updatePos) ( alVoice *v, double px, double py,
       double vx, double vy )           = NULL;
-void (*sound_sys_updateVoice) ( alVoice *v ) = NULL;
+void (*sound_sys_updateVoices) ( double dt ) = NULL;
  /* Sound management. */
 void (*sound_sys_update) (void)        = NULL;
 void (*sound_sys_stop) ( alVoice *v )  = NULL;
@@ -119,7 +144,9 @@ int  (*sound_sys_env) ( SoundEnv_t env, double param ) = NULL;
  */
 /* General. */
 static int sound_makeList (void);
-static int sound_load( alSound *snd, const char *filename );
+static int sound_loadJob( void *data );
+static void sound_request( alSound *snd );
+static int sound_ensureLoaded( alSound *snd );
 static void sound_free( alSound *snd );
 /* Voices. */
 
@@ -164,7 +191,7 @@ int sound_init (void)
       sound_sys_play       = sound_al_play;
       sound_sys_playPos    = sound_al_playPos;
       sound_sys_updatePos  = sound_al_updatePos;
-      sound_sys_updateVoice = sound_al_updateVoice;
+      sound_sys_updateVoices = sound_al_updateVoices;
       /* Sound management. */
       sound_sys_update     = sound_al_update;
       sound_sys_stop       = sound_al_stop;
@@ -208,7 +235,7 @@ int sound_init (void)
       sound_sys_play       = sound_mix_play;
       sound_sys_playPos    = sound_mix_playPos;
       sound_sys_updatePos  = sound_mix_updatePos;
-      sound_sys_updateVoice = sound_mix_updateVoice;
+      sound_sys_updateVoices = sound_mix_updateVoices;
       /* Sound management. */
       sound_sys_update     = sound_mix_update;
       sound_sys_stop       = sound_mix_stop;
@@ -254,6 +281,10 @@ int sound_init (void)
    if (voice_mutex == NULL)
       WARN(_("Unable to create voice mutex."));
 
+   /* Create loading lock. */
+   sound_load_mutex = SDL_CreateMutex();
+   sound_load_cond  = SDL_CreateCond();
+
    /* Load available sounds. */
    ret = sound_makeList();
    if (ret != 0)
@@ -301,6 +332,12 @@ void sound_exit (void)
    /* Exit music subsystem. */
    music_exit();
 
+   /* Wait for the background loads to finish. */
+   loadLock();
+   while (sound_load_pending > 0)
+      SDL_CondWait( sound_load_cond, sound_load_mutex );
+   loadUnlock();
+
    if (voice_mutex != NULL) {
       voiceLock();
       /* free the voices. */
@@ -328,6 +365,12 @@ void sound_exit (void)
    sound_list = NULL;
    sound_nlist = 0;
 
+   /* Destroy loading lock. */
+   SDL_DestroyCond( sound_load_cond );
+   SDL_DestroyMutex( sound_load_mutex );
+   sound_load_cond  = NULL;
+   sound_load_mutex = NULL;
+
    /* Exit sound subsystem. */
    sound_sys_exit();
 
@@ -339,6 +382,8 @@ void sound_exit (void)
 /**
  * @brief Gets the buffer to sound of name.
  *
+ * The sound starts loading in the background if it wasn't already.
+ *
  *    @param name Name of the sound to get the id of.
  *    @return ID of the sound matching name.
  */
@@ -349,9 +394,12 @@ int sound_get( char* name )
    if (sound_disabled)
       return 0;
 
-   for (i=0; i<sound_nlist; i++)
-      if (strcmp(name, sound_list[i].name)==0)
+   for (i=0; i<sound_nlist; i++) {
+      if (strcmp(name, sound_list[i].name)==0) {
+         sound_request( &sound_list[i] );
          return i;
+      }
+   }
 
    WARN(_("Sound '%s' not found in sound list"), name);
    return -1;
@@ -369,6 +417,12 @@ double sound_length( int sound )
    if (sound_disabled)
       return 0.;
 
+   if ((sound < 0) || (sound >= sound_nlist))
+      return 0.;
+
+   if (sound_ensureLoaded( &sound_list[sound] ))
+      return 0.;
+
    return sound_list[sound].length;
 }
 
@@ -390,11 +444,13 @@ int sound_play( int sound )
    if ((sound < 0) || (sound >= sound_nlist))
       return -1;
 
-   /* Gets a new voice. */
-   v = voice_new();
-
    /* Get the sound. */
    s = &sound_list[sound];
+   if (sound_ensureLoaded( s ))
+      return -1;
+
+   /* Gets a new voice. */
+   v = voice_new();
 
    /* Try to play the sound. */
    if (sound_sys_play( v, s ))
@@ -438,22 +494,28 @@ int sound_playPos( int sound, double px, double py, double vx, double vy )
    /* Following a pilot. */
    p = pilot_get(target);
    if (target && (p != NULL)) {
-      if (!pilot_inRange( p, px, py ))
+      if (!pilot_inRange( p, px, py )) {
+         voice_nculled++;
          return 0;
+      }
    }
    /* Set to a position. */
    else {
       cam_getPos(&cx, &cy);
       dist = pow2(px - cx) + pow2(py - cy);
-      if (dist > pilot_sensorRange())
+      if (dist > pilot_sensorRange()) {
+         voice_nculled++;
          return 0;
+      }
    }
 
-   /* Gets a new voice. */
-   v = voice_new();
-
    /* Get the sound. */
    s = &sound_list[sound];
+   if (sound_ensureLoaded( s ))
+      return -1;
+
+   /* Gets a new voice. */
+   v = voice_new();
 
    /* Try to play the sound. */
    if (sound_sys_playPos( v, s, px, py, vx, vy ))
@@ -501,7 +563,7 @@ int sound_updatePos( int voice, double px, double py, double vx, double vy )
  */
 int sound_update( double dt )
 {
-   alVoice *v, *tv;
+   alVoice *v, *tv, *nv;
 
    /* Update music if needed. */
    music_update(dt);
@@ -512,20 +574,33 @@ int sound_update( double dt )
    /* System update. */
    sound_sys_update();
 
-   if (voice_active == NULL)
+   if (voice_active == NULL) {
+      voice_nactive  = 0;
+      voice_nvirtual = 0;
       return 0;
+   }
 
    voiceLock();
 
-   /* The actual control loop. */
-   for (v=voice_active; v!=NULL; v=v->next) {
+   /* Update all the voices at once, run first to clear in same iteration. */
+   sound_sys_updateVoices( dt );
 
-      /* Run first to clear in same iteration. */
-      sound_sys_updateVoice( v );
+   /* The actual control loop. */
+   voice_nactive  = 0;
+   voice_nvirtual = 0;
+   v = voice_active;
+   while (v != NULL) {
+      nv = v->next;
 
       /* Destroy and toss into pool. */
       if ((v->state == VOICE_STOPPED) || (v->state == VOICE_DESTROY)) {
 
+         /* Never got heard. */
+         if (v->flags & VOICE_VIRTUAL) {
+            voice_nculled++;
+            v->flags &= ~VOICE_VIRTUAL;
+         }
+
          /* Remove from active list. */
          tv = v->prev;
          if (tv == NULL) {
@@ -546,11 +621,16 @@ int sound_update( double dt )
          if (v->next != NULL)
             v->next->prev = v;
 
-         /* Avoid loop blockage. */
-         v = (tv != NULL) ? tv->next : voice_active;
-         if (v == NULL)
-            break;
+         v = nv;
+         continue;
       }
+
+      /* Count. */
+      if (v->flags & VOICE_VIRTUAL)
+         voice_nvirtual++;
+      else
+         voice_nactive++;
+      v = nv;
    }
 
    voiceUnlock();
@@ -559,6 +639,21 @@ int sound_update( double dt )
 }
 
 
+/**
+ * @brief Gets the voice counters.
+ *
+ *    @param[out] active Number of voices being mixed.
+ *    @param[out] virt Number of inaudible voices only being tracked.
+ *    @param[out] culled Number of voices that ended without being heard.
+ */
+void sound_voiceStats( int *active, int *virt, int *culled )
+{
+   *active  = voice_nactive;
+   *virt    = voice_nvirtual;
+   *culled  = voice_nculled;
+}
+
+
 /**
  * @brief Pauses all the sounds.
  */
@@ -696,6 +791,10 @@ void sound_setSpeed( double s )
 
 /**
  * @brief Makes the list of available sounds.
+ *
+ * Sounds aren't loaded here, only when they are first requested.
+ *
+ * @sa sound_request
  */
 static int sound_makeList (void)
 {
@@ -743,11 +842,12 @@ static int sound_makeList (void)
       strncpy( tmp, files[i], len );
       tmp[len] = '\0';
 
-      /* Load the sound. */
-      sound_list[sound_nlist-1].name = strdup(tmp);
+      /* Register the sound. */
       nsnprintf( path, PATH_MAX, SOUND_PATH"%s", files[i] );
-      if (sound_load( &sound_list[sound_nlist-1], path ))
-         sound_nlist--; /* Song not actually added. */
+      memset( &sound_list[sound_nlist-1], 0, sizeof(alSound) );
+      sound_list[sound_nlist-1].name     = strdup(tmp);
+      sound_list[sound_nlist-1].filename = strdup(path);
+      sound_list[sound_nlist-1].state    = SOUND_UNLOADED;
 
       /* Clean up. */
       free(files[i]);
@@ -808,20 +908,103 @@ double sound_getVolumeLog(void)
 
 
 /**
- * @brief Loads a sound into the sound_list.
+ * @brief Loads a sound, run in the threadpool.
  *
- *    @param snd Sound to load into.
- *    @param filename Name fo the file to load.
+ *    @param data Sound load job, freed when done.
  *    @return 0 on success.
  *
- * @sa sound_makeList
+ * @sa sound_request
  */
-static int sound_load( alSound *snd, const char *filename )
+static int sound_loadJob( void *data )
 {
-   if (sound_disabled)
-      return -1;
+   soundLoadJob *job;
+   int ret;
+
+   job = (soundLoadJob*) data;
 
-   return sound_sys_load( snd, filename );
+   /* Decode and upload. */
+   ret = sound_sys_load( job->snd, job->data, job->size );
+   if (ret != 0)
+      WARN(_("Failed to load sound file '%s'."), job->snd->filename);
+   free( job->data );
+
+   /* Mark as done. */
+   loadLock();
+   job->snd->state = (ret == 0) ? SOUND_LOADED : SOUND_FAILED;
+   sound_load_pending--;
+   SDL_CondBroadcast( sound_load_cond );
+   loadUnlock();
+
+   free( job );
+   return ret;
+}
+
+
+/**
+ * @brief Starts loading a sound in the background if it isn't loaded.
+ *
+ * The file is read here as ndata is not thread safe, decoding is done in the
+ * threadpool.
+ *
+ *    @param snd Sound to load.
+ */
+static void sound_request( alSound *snd )
+{
+   soundLoadJob *job;
+   char *data;
+   size_t size;
+
+   loadLock();
+   if (snd->state != SOUND_UNLOADED) {
+      loadUnlock();
+      return;
+   }
+   snd->state = SOUND_LOADING;
+   sound_load_pending++;
+   loadUnlock();
+
+   /* Read the file. */
+   data = ndata_read( snd->filename, &size );
+   if (data == NULL) {
+      WARN(_("Failed to load sound file '%s'."), snd->filename);
+      loadLock();
+      snd->state = SOUND_FAILED;
+      sound_load_pending--;
+      SDL_CondBroadcast( sound_load_cond );
+      loadUnlock();
+      return;
+   }
+
+   /* Load in the background, or right away if there is no threadpool. */
+   job         = malloc( sizeof(soundLoadJob) );
+   job->snd    = snd;
+   job->data   = data;
+   job->size   = size;
+   if (threadpool_newJob( sound_loadJob, job ))
+      sound_loadJob( job );
+}
+
+
+/**
+ * @brief Makes sure a sound is loaded, waiting for it if necessary.
+ *
+ *    @param snd Sound to make sure is loaded.
+ *    @return 0 if the sound is ready to play.
+ */
+static int sound_ensureLoaded( alSound *snd )
+{
+   int ret;
+
+   /* In case it wasn't requested through sound_get. */
+   sound_request( snd );
+
+   loadLock();
+   while (snd->state == SOUND_LOADING)
+      SDL_CondWait( sound_load_cond, sound_load_mutex );
+   ret = (snd->state == SOUND_LOADED) ? 0 : -1;
+   loadUnlock();
+
+   return ret;
 }
 
 
@@ -837,9 +1020,15 @@ static void sound_free( alSound *snd )
       free(snd->name);
       snd->name = NULL;
    }
+   if (snd->filename) {
+      free(snd->filename);
+      snd->filename = NULL;
+   }
 
    /* Free internals. */
-   sound_sys_free(snd);
+   if (snd->state == SOUND_LOADED)
+      sound_sys_free(snd);
+   snd->state = SOUND_UNLOADED;
 }
 
 
@@ -875,6 +1064,9 @@ int sound_playGroup( int group, int sound, int once )
    if ((sound < 0) || (sound >= sound_nlist))
       return -1;
 
+   if (sound_ensureLoaded( &sound_list[sound] ))
+      return -1;
+
    return sound_sys_playGroup( group, &sound_list[sound], once );
 }
 
@@ -49,6 +49,7 @@ int sound_updatePos( int voice, double px, double py, double vx, double vy );
 int sound_updateListener( double dir, double px, double py,
       double vx, double vy );
 void sound_setSpeed( double s );
+void sound_voiceStats( int *active, int *virt, int *culled );
 
 
 /*
@@ -19,6 +19,9 @@
 #include "music_openal.h"
 #include "sound.h"
 #include "ndata.h"
+#include "nfile.h"
+#include "nstring.h"
+#include "md5.h"
 #include "log.h"
 #include "conf.h"
 
@@ -42,8 +45,11 @@
  * 3) Now we allow the user to dynamically create voices, these voices will
  * always try to grab a source from the source pool.  If they can't they
  * will pretend to play the buffer.
- * 4) Every so often we'll check to see if the important voices are being
- * played and take away the sources from the lesser ones.
+ * 4) Every frame we estimate how loud each voice is at the listener. Voices
+ * that are inaudible or can't get a source are made virtual: they keep
+ * track of their playback position without any OpenAL calls. The most
+ * audible virtual voices are given free sources, or take them away from
+ * much quieter voices, and resume where they would be.
  *
  *
  * EFX
@@ -52,11 +58,30 @@
  *
  * - Air absorption factor
  * - Reverb
+ *
+ *
+ * PCM CACHE
+ *
+ * Buffers are loaded from the threadpool when first requested. Decoding
+ * Ogg files is slow, so the decoded samples are stored in the cache
+ * directory under the md5 of the Ogg file and read from there on later
+ * runs.
  */
 
 
 #define SOUND_FADEOUT         100
 
+#define SOUND_REFERENCE_DISTANCE 500. /**< Distance under which sounds don't get louder. */
+#define SOUND_MAX_DISTANCE    25000. /**< Distance over which sounds don't get quieter. */
+#define SOUND_ROLLOFF_FACTOR  1. /**< How fast sounds get quieter with distance. */
+#define SOUND_VIRTUAL_GAIN    0.03 /**< Estimated gain under which voices are made virtual. */
+#define SOUND_PROMOTE_MAX     4 /**< Maximum virtual voices to give sources to per frame. */
+
+#define SOUND_CACHE_PATH      "sounds/" /**< Path of the PCM cache, relative to the cache directory. */
+#define SOUND_CACHE_MAGIC     "NPCM" /**< Magic of the PCM cache files. */
+#define SOUND_CACHE_VERSION   1 /**< Version of the PCM cache files. */
+#define SOUND_DECODE_CHUNK    (64*1024) /**< Bytes decoded at a time. */
+
 
 #define soundLock()     SDL_mutexP(sound_lock)
 #define soundUnlock()   SDL_mutexV(sound_lock)
@@ -106,6 +131,26 @@ static ALuint efx_echo        = 0; /**< Echo effect. */
 static double sound_speed     = 1.; /**< Sound speed. */
 
 
+/*
+ * Voice priority.
+ */
+static ALfloat al_listener[2] = { 0., 0. }; /**< Listener position. */
+static int al_paused          = 0; /**< Whether the sounds are paused. */
+
+
+/**
+ * @brief Header of the decoded PCM cache files.
+ */
+typedef struct alPCMHeader_s {
+   char magic[4]; /**< Should be SOUND_CACHE_MAGIC. */
+   uint32_t version; /**< Should be SOUND_CACHE_VERSION. */
+   uint32_t endian; /**< Endianness of the samples. */
+   uint32_t channels; /**< Number of channels. */
+   uint32_t freq; /**< Sample rate. */
+} alPCMHeader_t;
+static char sound_cachePath[PATH_MAX]; /**< Directory of the PCM cache, empty if unavailable. */
+
+
 /**
  * @brief Group implementation similar to SDL_Mixer.
  */
@@ -140,8 +185,14 @@ static int al_enableEFX (void);
 static ALuint sound_al_getSource (void);
 static int al_playVoice( alVoice *v, alSound *s,
       ALfloat px, ALfloat py, ALfloat vx, ALfloat vy, ALint relative );
+static ALfloat al_voiceGain( const alVoice *v );
+static void al_startVoice( alVoice *v, ALuint source );
+static void al_virtualizeVoice( alVoice *v );
+static void al_promoteVoices (void);
 static int sound_al_loadWav( alSound *snd, SDL_RWops *rw );
-static int sound_al_loadOgg( alSound *snd, OggVorbis_File *vf );
+static int sound_al_loadOgg( alSound *snd, OggVorbis_File *vf, const char *cache );
+static void sound_al_cacheFile( char *path, const char *data, size_t size );
+static int sound_al_loadCache( alSound *snd, const char *path );
 /*
  * Pausing.
  */
@@ -317,9 +368,9 @@ int sound_al_init (void)
        *  inverse    2        500      1.000   0.333   0.052   0.026
        *  exponent   2        500      1.000   0.250   0.010   0.003
        */
-      alSourcef( s, AL_REFERENCE_DISTANCE, 500. ); /* Close distance to clamp at (doesn't get louder). */
-      alSourcef( s, AL_MAX_DISTANCE,       25000. ); /* Max distance to clamp at (doesn't get quieter). */
-      alSourcef( s, AL_ROLLOFF_FACTOR,     1. ); /* Determines how it drops off. */
+      alSourcef( s, AL_REFERENCE_DISTANCE, SOUND_REFERENCE_DISTANCE ); /* Close distance to clamp at (doesn't get louder). */
+      alSourcef( s, AL_MAX_DISTANCE,       SOUND_MAX_DISTANCE ); /* Max distance to clamp at (doesn't get quieter). */
+      alSourcef( s, AL_ROLLOFF_FACTOR,     SOUND_ROLLOFF_FACTOR ); /* Determines how it drops off. */
 
       /* Set the filter. */
       if (al_info.efx == AL_TRUE)
@@ -354,6 +405,13 @@ int sound_al_init (void)
    /* we can unlock now */
    soundUnlock();
 
+   /* Set up the decoded sound cache. */
+   nsnprintf( sound_cachePath, PATH_MAX, "%s"SOUND_CACHE_PATH, nfile_cachePath() );
+   if (nfile_dirMakeExist( sound_cachePath )) {
+      WARN(_("Unable to create sound cache directory '%s'."), sound_cachePath);
+      sound_cachePath[0] = '\0';
+   }
+
    /* debug magic */
    DEBUG(_("OpenAL started: %d Hz"), freq);
    DEBUG(_("Renderer: %s"), alGetString(AL_RENDERER));
@@ -626,48 +684,85 @@ static const char* vorbis_getErr( int err )
 /**
  * @brief Loads an ogg file from a tested format if possible.
  *
+ * The samples are decoded a chunk at a time so the length doesn't have to be
+ * known in advance, and stored in the cache afterwards.
+ *
  *    @param snd Sound to load ogg into.
  *    @param vf Vorbisfile containing the song.
+ *    @param cache Path of the cache file to write or NULL.
  */
-static int sound_al_loadOgg( alSound *snd, OggVorbis_File *vf )
+static int sound_al_loadOgg( alSound *snd, OggVorbis_File *vf, const char *cache )
 {
    int ret;
-   long i;
    int section;
    vorbis_info *info;
    ALenum format;
-   ogg_int64_t len;
-   char *buf;
+   ogg_int64_t total;
+   size_t len, mem;
+   alPCMHeader_t *hdr;
+   char *buf, *pcm;
 
    /* Finish opening the file. */
    ret = ov_test_open(vf);
    if (ret) {
       WARN(_("Failed to finish loading Ogg file: %s"), vorbis_getErr(ret) );
+      ov_clear(vf);
       return -1;
    }
 
    /* Get file information. */
    info   = ov_info( vf, -1 );
    format = (info->channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
-   len    = ov_pcm_total( vf, -1 ) * info->channels * 2;
-
-   /* Allocate memory. */
-   buf = malloc( len );
-
-   /* Fill buffer. */
-   i = 0;
-   while (i < len) {
-      /* Fill buffer with data in the 16 bit signed samples format. */
-      i += ov_read( vf, &buf[i], len-i, VORBIS_ENDIAN, 2, 1, &section );
+   total  = ov_pcm_total( vf, -1 );
+
+   /* Allocate memory, with some slack so the last read hits the end of file
+    * without growing. The header goes in front so it can be cached as is. */
+   mem    = (total > 0) ? (size_t)total * info->channels * 2 + 4096 : SOUND_DECODE_CHUNK;
+   buf    = malloc( sizeof(alPCMHeader_t) + mem );
+   pcm    = &buf[ sizeof(alPCMHeader_t) ];
+
+   /* Decode in the 16 bit signed samples format. */
+   len = 0;
+   while (1) {
+      if (len >= mem) {
+         mem += MAX( mem/2, SOUND_DECODE_CHUNK );
+         buf  = realloc( buf, sizeof(alPCMHeader_t) + mem );
+         pcm  = &buf[ sizeof(alPCMHeader_t) ];
+      }
+      ret = ov_read( vf, &pcm[len], MIN( mem-len, SOUND_DECODE_CHUNK ),
+            VORBIS_ENDIAN, 2, 1, &section );
+      if (ret == 0)
+         break;
+      if (ret == OV_HOLE)
+         continue;
+      if (ret < 0) {
+         WARN(_("Failed to decode Ogg file: %s"), vorbis_getErr(ret) );
+         free(buf);
+         ov_clear(vf);
+         return -1;
+      }
+      len += ret;
    }
 
    soundLock();
    /* Create new buffer. */
    alGenBuffers( 1, &snd->u.al.buf );
    /* Put into buffer. */
-   alBufferData( snd->u.al.buf, format, buf, len, info->rate );
+   alBufferData( snd->u.al.buf, format, pcm, len, info->rate );
    soundUnlock();
 
+   /* Store decoded samples. */
+   if (cache != NULL) {
+      hdr = (alPCMHeader_t*) buf;
+      memcpy( hdr->magic, SOUND_CACHE_MAGIC, sizeof(hdr->magic) );
+      hdr->version   = SOUND_CACHE_VERSION;
+      hdr->endian    = VORBIS_ENDIAN;
+      hdr->channels  = info->channels;
+      hdr->freq      = info->rate;
+      if (nfile_writeFile( buf, sizeof(alPCMHeader_t) + len, "%s", cache ))
+         WARN(_("Unable to write sound cache '%s'."), cache);
+   }
+
    /* Clean up. */
    free(buf);
    ov_clear(vf);
@@ -676,25 +771,108 @@ static int sound_al_loadOgg( alSound *snd, OggVorbis_File *vf )
 }
 
 
+/**
+ * @brief Gets the path of the PCM cache file of a sound.
+ *
+ *    @param[out] path Path to write to (PATH_MAX long).
+ *    @param data Contents of the sound file.
+ *    @param size Size of the data.
+ */
+static void sound_al_cacheFile( char *path, const char *data, size_t size )
+{
+   md5_state_t md5;
+   md5_byte_t md5val[16];
+   char digest[33];
+   int i;
+
+   md5_init( &md5 );
+   md5_append( &md5, (const md5_byte_t*)data, size );
+   md5_finish( &md5, md5val );
+   for (i=0; i<16; i++)
+      nsnprintf( &digest[i * 2], 3, "%02x", md5val[i] );
+
+   nsnprintf( path, PATH_MAX, "%s%s.pcm", sound_cachePath, digest );
+}
+
+
+/**
+ * @brief Loads decoded samples from the cache.
+ *
+ *    @param snd Sound to load into.
+ *    @param path Path of the cache file.
+ *    @return 0 on success.
+ */
+static int sound_al_loadCache( alSound *snd, const char *path )
+{
+   char *buf;
+   size_t size;
+   alPCMHeader_t *hdr;
+   ALenum format;
+
+   if (!nfile_fileExists( "%s", path ))
+      return -1;
+   buf = nfile_readFile( &size, "%s", path );
+   if (buf == NULL)
+      return -1;
+
+   /* Make sure it's usable, otherwise it gets overwritten. */
+   hdr = (alPCMHeader_t*) buf;
+   if ((size < sizeof(alPCMHeader_t)) ||
+         (memcmp( hdr->magic, SOUND_CACHE_MAGIC, sizeof(hdr->magic) ) != 0) ||
+         (hdr->version != SOUND_CACHE_VERSION) ||
+         (hdr->endian != VORBIS_ENDIAN) ||
+         ((hdr->channels != 1) && (hdr->channels != 2)) ||
+         ((size - sizeof(alPCMHeader_t)) % (hdr->channels * 2) != 0)) {
+      free(buf);
+      return -1;
+   }
+   format = (hdr->channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+
+   soundLock();
+   alGenBuffers( 1, &snd->u.al.buf );
+   alBufferData( snd->u.al.buf, format, &buf[ sizeof(alPCMHeader_t) ],
+         size - sizeof(alPCMHeader_t), hdr->freq );
+   soundUnlock();
+
+   free(buf);
+   return 0;
+}
+
+
 /**
  * @brief Loads the sound.
  *
+ * Called from the threadpool.
+ *
  *    @param snd Sound to load.
- *    @param filename Name of the file to load into sound.
+ *    @param data Contents of the sound file.
+ *    @param datasize Size of the data.
  */
-int sound_al_load( alSound *snd, const char *filename )
+int sound_al_load( alSound *snd, const char *data, size_t datasize )
 {
    int ret;
    SDL_RWops *rw;
    OggVorbis_File vf;
    ALint freq, bits, channels, size;
+   char cache[PATH_MAX];
 
-   /* get the file data buffer from packfile */
-   rw = ndata_rwops( filename );
+   /* wrap the file data */
+   rw = SDL_RWFromConstMem( data, datasize );
 
    /* Check to see if it's an Ogg. */
-   if (ov_test_callbacks( rw, &vf, NULL, 0, sound_al_ovcall_noclose )==0)
-      ret = sound_al_loadOgg( snd, &vf );
+   if (ov_test_callbacks( rw, &vf, NULL, 0, sound_al_ovcall_noclose )==0) {
+      /* Try the decoded cache first. */
+      if (sound_cachePath[0] != '\0') {
+         sound_al_cacheFile( cache, data, datasize );
+         ret = sound_al_loadCache( snd, cache );
+         if (ret == 0)
+            ov_clear(&vf);
+         else
+            ret = sound_al_loadOgg( snd, &vf, cache );
+      }
+      else
+         ret = sound_al_loadOgg( snd, &vf, NULL );
+   }
 
    /* Otherwise try WAV. */
    else {
@@ -709,10 +887,8 @@ int sound_al_load( alSound *snd, const char *filename )
    SDL_RWclose(rw);
 
    /* Failed to load. */
-   if (ret != 0) {
-      WARN(_("Failed to load sound file '%s'."), filename);
+   if (ret != 0)
       return ret;
-   }
 
    soundLock();
 
@@ -722,7 +898,7 @@ int sound_al_load( alSound *snd, const char *filename )
    alGetBufferi( snd->u.al.buf, AL_CHANNELS, &channels );
    alGetBufferi( snd->u.al.buf, AL_SIZE, &size );
    if ((freq==0) || (bits==0) || (channels==0)) {
-      WARN(_("Something went wrong when loading sound file '%s'."), filename);
+      WARN(_("Something went wrong when loading sound file '%s'."), snd->filename);
       snd->length = 0;
    }
    else
@@ -835,53 +1011,179 @@ static ALuint sound_al_getSource (void)
 
 /**
  * @brief Plays a voice.
+ *
+ * Voices that are inaudible or can't get a source start out virtual.
  */
 static int al_playVoice( alVoice *v, alSound *s,
       ALfloat px, ALfloat py, ALfloat vx, ALfloat vy, ALint relative )
 {
+   ALuint source;
+
    /* Must be below the limit. */
+   v->u.al.source = 0;
+   v->flags      &= ~VOICE_VIRTUAL;
    if (sound_speed > SOUND_SPEED_PLAY_LIMIT)
       return 0;
 
-   /* Set up the source and buffer. */
-   v->u.al.source = sound_al_getSource();
-   if (v->u.al.source == 0)
-      return -1;
-   v->u.al.buffer = s->u.al.buf;
+   /* Set up the voice. */
+   v->u.al.buffer   = s->u.al.buf;
+   v->u.al.relative = relative;
+   v->u.al.pos[0]   = px;
+   v->u.al.pos[1]   = py;
+   v->u.al.pos[2]   = 0.;
+   v->u.al.vel[0]   = vx;
+   v->u.al.vel[1]   = vy;
+   v->u.al.vel[2]   = 0.;
+   v->u.al.dirty    = 0;
+   v->u.al.offset   = 0.;
+   v->u.al.length   = s->length;
+   v->u.al.gain     = al_voiceGain( v );
+
+   /* Not worth a source. */
+   if (v->u.al.gain < SOUND_VIRTUAL_GAIN) {
+      v->flags |= VOICE_VIRTUAL;
+      return 0;
+   }
+
+   /* Try to get a source, otherwise it'll compete for one when updating. */
+   source = sound_al_getSource();
+   if (source == 0) {
+      v->flags |= VOICE_VIRTUAL;
+      return 0;
+   }
 
    soundLock();
+   al_startVoice( v, source );
+   soundUnlock();
+
+   return 0;
+}
+
+
+/**
+ * @brief Estimates the gain of a voice at the listener.
+ *
+ * Mirrors the AL_INVERSE_DISTANCE_CLAMPED model the sources use.
+ *
+ *    @param v Voice to estimate gain of.
+ *    @return The estimated gain in the [0:1] range.
+ */
+static ALfloat al_voiceGain( const alVoice *v )
+{
+   ALfloat d;
+
+   if (v->u.al.relative)
+      return 1.;
+
+   d = hypotf( v->u.al.pos[0] - al_listener[0], v->u.al.pos[1] - al_listener[1] );
+   d = CLAMP( SOUND_REFERENCE_DISTANCE, SOUND_MAX_DISTANCE, d );
+   return SOUND_REFERENCE_DISTANCE / (SOUND_REFERENCE_DISTANCE +
+         SOUND_ROLLOFF_FACTOR * (d - SOUND_REFERENCE_DISTANCE));
+}
+
+
+/**
+ * @brief Starts playing a voice on a source from where it's at.
+ *
+ * @note Sound lock must be held.
+ *
+ *    @param v Voice to start playing.
+ *    @param source Source to play the voice on.
+ */
+static void al_startVoice( alVoice *v, ALuint source )
+{
+   v->u.al.source = source;
+   v->u.al.dirty  = 0;
+   v->flags      &= ~VOICE_VIRTUAL;
 
    /* Attach buffer. */
-   alSourcei( v->u.al.source, AL_BUFFER, v->u.al.buffer );
+   alSourcei( source, AL_BUFFER, v->u.al.buffer );
 
    /* Enable positional sound. */
-   alSourcei( v->u.al.source, AL_SOURCE_RELATIVE, relative );
-
-   /* Update position. */
-   v->u.al.pos[0] = px;
-   v->u.al.pos[1] = py;
-   v->u.al.pos[2] = 0.;
-   v->u.al.vel[0] = vx;
-   v->u.al.vel[1] = vy;
-   v->u.al.vel[2] = 0.;
+   alSourcei( source, AL_SOURCE_RELATIVE, v->u.al.relative );
 
    /* Set up properties. */
-   alSourcef(  v->u.al.source, AL_GAIN, svolume*svolume_speed );
-   alSourcefv( v->u.al.source, AL_POSITION, v->u.al.pos );
-   alSourcefv( v->u.al.source, AL_VELOCITY, v->u.al.vel );
+   alSourcef(  source, AL_GAIN, svolume*svolume_speed );
+   alSourcefv( source, AL_POSITION, v->u.al.pos );
+   alSourcefv( source, AL_VELOCITY, v->u.al.vel );
 
    /* Defaults just in case. */
-   alSourcei( v->u.al.source, AL_LOOPING, AL_FALSE );
+   alSourcei( source, AL_LOOPING, AL_FALSE );
+
+   /* Pick up where it would be. */
+   if (v->u.al.offset > 0.)
+      alSourcef( source, AL_SEC_OFFSET, v->u.al.offset );
 
    /* Start playing. */
-   alSourcePlay( v->u.al.source );
+   alSourcePlay( source );
 
    /* Check for errors. */
    al_checkErr();
+}
 
-   soundUnlock();
 
-   return 0;
+/**
+ * @brief Takes the source away from a voice, keeping track of its position.
+ *
+ * @note Sound lock must be held.
+ *
+ *    @param v Voice to make virtual.
+ */
+static void al_virtualizeVoice( alVoice *v )
+{
+   alGetSourcef( v->u.al.source, AL_SEC_OFFSET, &v->u.al.offset );
+   alSourceStop( v->u.al.source );
+   alSourcei( v->u.al.source, AL_BUFFER, AL_NONE );
+
+   /* Put source back on the list. */
+   source_stack[source_nstack] = v->u.al.source;
+   source_nstack++;
+   v->u.al.source = 0;
+   v->flags      |= VOICE_VIRTUAL;
+}
+
+
+/**
+ * @brief Gives sources to the most audible virtual voices.
+ *
+ * Sources are taken away from playing voices if they are much quieter.
+ *
+ * @note Sound lock must be held.
+ */
+static void al_promoteVoices (void)
+{
+   int i;
+   alVoice *v, *best, *worst;
+
+   for (i=0; i<SOUND_PROMOTE_MAX; i++) {
+      /* Find loudest virtual and quietest playing voices. */
+      best  = NULL;
+      worst = NULL;
+      for (v=voice_active; v!=NULL; v=v->next) {
+         if (v->state != VOICE_PLAYING)
+            continue;
+         if (v->flags & VOICE_VIRTUAL) {
+            if ((v->u.al.gain >= SOUND_VIRTUAL_GAIN) &&
+                  ((best == NULL) || (v->u.al.gain > best->u.al.gain)))
+               best = v;
+         }
+         else if (v->u.al.source != 0) {
+            if ((worst == NULL) || (v->u.al.gain < worst->u.al.gain))
+               worst = v;
+         }
+      }
+      if (best == NULL)
+         return;
+
+      /* Steal a source if there are none left, with some hysteresis. */
+      if (source_nstack <= 0) {
+         if ((worst == NULL) || (2.*worst->u.al.gain > best->u.al.gain))
+            return;
+         al_virtualizeVoice( worst );
+      }
+
+      al_startVoice( best, sound_al_getSource() );
+   }
 }
 
 
@@ -926,54 +1228,93 @@ int sound_al_updatePos( alVoice *v,
    v->u.al.pos[1] = py;
    v->u.al.vel[0] = vx;
    v->u.al.vel[1] = vy;
+   v->u.al.dirty  = 1;
 
    return 0;
 }
 
 
 /**
- * @brief Updates the voice.
+ * @brief Updates all the active voices.
+ *
+ * Everything is done under a single sound lock, and only positions that
+ * changed are sent to OpenAL.
  *
- *    @param v Voice to update.
+ * @note Voice lock must be held.
+ *
+ *    @param dt Real time elapsed since last update.
  */
-void sound_al_updateVoice( alVoice *v )
+void sound_al_updateVoices( double dt )
 {
    ALint state;
-
-   /* Invalid source, mark to delete. */
-   if (v->u.al.source == 0) {
-      v->state = VOICE_DESTROY;
-      return;
-   }
+   alVoice *v;
 
    soundLock();
 
-   /* Get status. */
-   alGetSourcei( v->u.al.source, AL_SOURCE_STATE, &state );
-   if (state == AL_STOPPED) {
+   for (v=voice_active; v!=NULL; v=v->next) {
+      /* Stopped voices just give back their source. */
+      if (v->state != VOICE_PLAYING) {
+         if (v->u.al.source != 0) {
+            alSourceStop( v->u.al.source );
+            alSourcei( v->u.al.source, AL_BUFFER, AL_NONE );
+            source_stack[source_nstack] = v->u.al.source;
+            source_nstack++;
+            v->u.al.source = 0;
+         }
+         continue;
+      }
 
-      /* Remove buffer so it doesn't start up again if resume is called. */
-      alSourcei( v->u.al.source, AL_BUFFER, AL_NONE );
+      v->u.al.gain = al_voiceGain( v );
 
-      /* Check for errors. */
-      al_checkErr();
+      /* Virtual voices just keep track of time. */
+      if (v->flags & VOICE_VIRTUAL) {
+         if (!al_paused)
+            v->u.al.offset += dt * sound_speed;
+         if (v->u.al.offset >= v->u.al.length)
+            v->state = VOICE_STOPPED;
+         continue;
+      }
 
-      soundUnlock();
+      /* Invalid source, mark to delete. */
+      if (v->u.al.source == 0) {
+         v->state = VOICE_DESTROY;
+         continue;
+      }
 
-      /* Put source back on the list. */
-      source_stack[source_nstack] = v->u.al.source;
-      source_nstack++;
-      v->u.al.source = 0;
+      /* Get status. */
+      alGetSourcei( v->u.al.source, AL_SOURCE_STATE, &state );
+      if (state == AL_STOPPED) {
 
-      /* Mark as stopped - erased next iteration. */
-      v->state = VOICE_STOPPED;
-      return;
+         /* Remove buffer so it doesn't start up again if resume is called. */
+         alSourcei( v->u.al.source, AL_BUFFER, AL_NONE );
+
+         /* Put source back on the list. */
+         source_stack[source_nstack] = v->u.al.source;
+         source_nstack++;
+         v->u.al.source = 0;
+
+         /* Mark as stopped - erased next iteration. */
+         v->state = VOICE_STOPPED;
+         continue;
+      }
+
+      /* Give up the source if it became inaudible, with some hysteresis. */
+      if (!al_paused && (v->u.al.gain < 0.5*SOUND_VIRTUAL_GAIN)) {
+         al_virtualizeVoice( v );
+         continue;
+      }
+
+      /* Set up properties. */
+      if (v->u.al.dirty) {
+         alSourcefv( v->u.al.source, AL_POSITION, v->u.al.pos );
+         alSourcefv( v->u.al.source, AL_VELOCITY, v->u.al.vel );
+         v->u.al.dirty = 0;
+      }
    }
 
-   /* Set up properties. */
-   alSourcef(  v->u.al.source, AL_GAIN, svolume*svolume_speed );
-   alSourcefv( v->u.al.source, AL_POSITION, v->u.al.pos );
-   alSourcefv( v->u.al.source, AL_VELOCITY, v->u.al.vel );
+   /* Give the sources to the most audible voices. */
+   if (!al_paused)
+      al_promoteVoices();
 
    /* Check for errors. */
    al_checkErr();
@@ -991,6 +1332,7 @@ void sound_al_stop( alVoice* voice )
 
    if (voice->u.al.source != 0)
       alSourceStop( voice->u.al.source );
+   voice->flags &= ~VOICE_VIRTUAL;
 
    /* Check for errors. */
    al_checkErr();
@@ -1005,6 +1347,7 @@ void sound_al_stop( alVoice* voice )
 void sound_al_pause (void)
 {
    soundLock();
+   al_paused = 1;
    al_pausev( source_ntotal, source_total );
    /* Check for errors. */
    al_checkErr();
@@ -1018,6 +1361,7 @@ void sound_al_pause (void)
 void sound_al_resume (void)
 {
    soundLock();
+   al_paused = 0;
    al_resumev( source_ntotal, source_total );
    /* Check for errors. */
    al_checkErr();
@@ -1087,6 +1431,8 @@ int sound_al_updateListener( double dir, double px, double py,
    pos[1] = py;
    pos[2] = 0.;
    alListenerfv( AL_POSITION, pos );
+   al_listener[0] = px;
+   al_listener[1] = py;
    vel[0] = vx;
    vel[1] = vy;
    vel[2] = 0.;
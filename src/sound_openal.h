@@ -67,7 +67,7 @@ void sound_al_exit (void);
 /*
  * Sound creation.
  */
-int sound_al_load( alSound *snd, const char *filename );
+int sound_al_load( alSound *snd, const char *data, size_t size );
 void sound_al_free( alSound *snd );
 
 
@@ -87,7 +87,7 @@ int sound_al_playPos( alVoice *v, alSound *s,
       double px, double py, double vx, double vy );
 int sound_al_updatePos( alVoice *v,
       double px, double py, double vx, double vy );
-void sound_al_updateVoice( alVoice *v );
+void sound_al_updateVoices( double dt );
 
 /*
  * Sound management.
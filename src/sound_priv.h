@@ -25,19 +25,39 @@
  */
 #define VOICE_LOOPING      (1<<10) /* voice loops */
 #define VOICE_STATIC       (1<<11) /* voice isn't relative */
+#define VOICE_VIRTUAL      (1<<12) /* voice is inaudible and only tracked, not mixed */
 
 
 #define MUSIC_FADEOUT_DELAY   1000 /**< Time it takes to fade out. */
 #define MUSIC_FADEIN_DELAY    2000 /**< Time it takes to fade in. */
 
 
+/**
+ * @typedef sound_state_t
+ * @brief The loading state of a sound.
+ * @sa alSound
+ */
+typedef enum sound_state_ {
+   SOUND_UNLOADED, /**< Sound hasn't been requested yet. */
+   SOUND_LOADING, /**< Sound is being decoded in the background. */
+   SOUND_LOADED, /**< Sound is ready to play. */
+   SOUND_FAILED /**< Sound failed to load. */
+} sound_state_t;
+
+
 /**
  * @struct alSound
  *
  * @brief Contains a sound buffer.
+ *
+ * Sounds are only loaded when first requested, and the load is done in the
+ * threadpool, so the backend load function must not touch shared state
+ * without locking.
  */
 typedef struct alSound_ {
    char *name; /**< Buffer's name. */
+   char *filename; /**< File to load the buffer from. */
+   sound_state_t state; /**< Loading state, protected by the sound load lock. */
    double length; /**< Length of the buffer. */
 
    /*
@@ -97,6 +117,11 @@ typedef struct alVoice_ {
          ALfloat vel[3]; /**< Velocity of the voice. */
          ALuint source; /**< Source current in use. */
          ALuint buffer; /**< Buffer attached to the voice. */
+         ALint relative; /**< Whether the voice is relative to the listener. */
+         ALint dirty; /**< Position changed since it was last sent to OpenAL. */
+         ALfloat gain; /**< Estimated gain at the listener, used as priority. */
+         ALfloat offset; /**< Playback position in seconds while virtual. */
+         ALfloat length; /**< Length of the buffer in seconds. */
       } al; /**< For OpenAL backend. */
 #endif /* USE_OPENAL */
 #if USE_SDLMIX
@@ -410,24 +410,26 @@ double sound_mix_getVolumeLog (void)
 /**
  * @brief Loads a sound into the sound_list.
  *
- *    @param filename Name of the file to load.
- *    @return The SDL_Mixer of the loaded chunk.
+ *    @param s Sound to load into.
+ *    @param data Contents of the sound file.
+ *    @param size Size of the data.
+ *    @return 0 on success.
  *
  * @sa sound_makeList
  */
-int sound_mix_load( alSound *s, const char *filename )
+int sound_mix_load( alSound *s, const char *data, size_t size )
 {
    SDL_RWops *rw;
    int freq, bytes, channels;
    Uint16 format;
 
-   /* get the file data buffer from packfile */
-   rw = ndata_rwops( filename );
+   /* wrap the file data */
+   rw = SDL_RWFromConstMem( data, size );
 
    /* bind to buffer */
    s->u.mix.buf = Mix_LoadWAV_RW( rw, 1 );
    if (s->u.mix.buf == NULL) {
-      DEBUG(_("Unable to load sound '%s': %s"), filename, Mix_GetError());
+      DEBUG(_("Unable to load sound '%s': %s"), s->filename, Mix_GetError());
       return -1;
    }
 
@@ -677,13 +679,13 @@ void sound_mix_setSpeedVolume( double vol )
 
 
 /**
- * @brief Does nothing atm.
+ * @brief Does nothing atm, SDL_mixer marks voices stopped from callbacks.
  *
- *    @param v Unused.
+ *    @param dt Unused.
  */
-void sound_mix_updateVoice( alVoice *v )
+void sound_mix_updateVoices( double dt )
 {
-   (void) v;
+   (void) dt;
 }
 
 
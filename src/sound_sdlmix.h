@@ -23,7 +23,7 @@ void sound_mix_exit (void);
 /*
  * Sound creation.
  */
-int sound_mix_load( alSound *snd, const char *filename );
+int sound_mix_load( alSound *snd, const char *data, size_t size );
 void sound_mix_free( alSound *snd );
 
 
@@ -43,7 +43,7 @@ int sound_mix_playPos( alVoice *v, alSound *s,
       double px, double py, double vx, double vy );
 int sound_mix_updatePos( alVoice *v,
       double px, double py, double vx, double vy );
-void sound_mix_updateVoice( alVoice *v );
+void sound_mix_updateVoices( double dt );
 
 /*
  * Sound management.
@@ -52,6 +52,9 @@
 #include "damagetype.h"
 #include "hook.h"
 #include "dev_uniedit.h"
+#include "camera.h"
+
+#include "SDL.h"
 
 
 #define XML_PLANET_TAG        "asset" /**< Individual planet xml tag. */
@@ -75,6 +78,8 @@
 #define ASTEROID_EXPLODE_INTERVAL 5. /**< Interval of asteroids randomly exploding */
 #define ASTEROID_EXPLODE_CHANCE   0.1 /**< Chance of asteroid exploding each interval */
 
+#define SPAWN_FRAME_BUDGET    0.004 /**< Seconds per frame to spend in spawn scripts before deferring. */
+
 /*
  * planet <-> system name stack
  */
@@ -113,9 +118,19 @@ static int systems_loading = 1; /**< Systems are loading. */
 StarSystem *cur_system = NULL; /**< Current star system. */
 glTexture *jumppoint_gfx = NULL; /**< Jump point graphics. */
 static glTexture *jumpbuoy_gfx = NULL; /**< Jump buoy graphics. */
+static gl_vbo *space_vbo      = NULL; /**< Static geometry of the jumps, buoys and planets of the current system. */
+static int space_vboDirty     = 1; /**< Whether the static geometry has to be rebuilt. */
+static int space_vboJumps     = 0; /**< Number of jumps in the static geometry. */
+static int space_vboPlanets   = 0; /**< Number of planets in the static geometry. */
 static nlua_env landing_env = LUA_NOREF; /**< Landing lua env. */
 static int space_fchg = 0; /**< Faction change counter, to avoid unnecessary calls. */
 static int space_simulating = 0; /**< Are we simulating space? */
+static int space_spawnNext  = 0; /**< Presence to run spawn scripts from next frame. */
+static int space_spawnInit  = 0; /**< Presence to run the 'create' function of next. */
+static int space_spawnCo    = LUA_NOREF; /**< Spawn script thread interrupted by the frame budget. */
+static int space_spawnCoFaction = -1; /**< Faction of the interrupted spawn script. */
+static Uint64 space_spawnT0 = 0; /**< When spawning started this frame. */
+static int space_spawnRan   = 0; /**< Whether a spawn script ran this frame. */
 glTexture **asteroid_gfx = NULL;
 static size_t nasterogfx = 0; /**< Nb of asteroid gfx. */
 
@@ -159,10 +174,22 @@ static void system_parseAsteroids( const xmlNodePtr parent, StarSystem *sys );
 static int getPresenceIndex( StarSystem *sys, int faction );
 static void presenceCleanup( StarSystem *sys );
 static void system_scheduler( double dt, int init );
+static int system_schedulerOver (void);
+static int system_schedulerRun( SystemPresence *p, nlua_env env, int init );
+static int system_schedulerResume( int nargs );
+static void system_schedulerResults( SystemPresence *p, lua_State *L );
+static void system_schedulerDrop (void);
 static void asteroid_explode ( Asteroid *a, AsteroidAnchor *field, int give_reward );
 /* Render. */
-static void space_renderJumpPoint( JumpPoint *jp, int i );
-static void space_renderPlanet( Planet *p );
+static void space_gfxGeometry (void);
+static GLfloat* space_gfxQuad( GLfloat *buf, const glTexture *gfx,
+      double x, double y, int sx, int sy );
+static void space_renderGeometryStart (void);
+static void space_renderGeometryEnd (void);
+static void space_renderQuads( const glColour *c, int first, int count );
+static const glColour* space_jumpColour( JumpPoint *jp, int i );
+static void space_renderJumpPoints (void);
+static void space_renderPlanets (void);
 static void space_renderAsteroid( Asteroid *a );
 static void space_renderDebris( Debris *d, double x, double y );
 /*
@@ -1094,113 +1121,277 @@ JumpPoint* jump_getTarget( StarSystem* target, const StarSystem* sys )
 /**
  * @brief Controls fleet spawning.
  *
+ * Spawn scripts run as coroutines and yield after creating each pilot, so
+ *  both the 'create' pass and whole fleets get spread over frames with a time
+ *  budget. A script interrupted by the budget is resumed first next frame,
+ *  and a faction that doesn't get to run keeps its negative timer.
+ *
  *    @param dt Current delta tick.
  *    @param init Should be 1 to initialize the scheduler.
  */
 static void system_scheduler( double dt, int init )
 {
-   int i, n;
+   int i, j, n;
    nlua_env env;
    SystemPresence *p;
-   Pilot *pilot;
 
-   /* Go through all the factions and reduce the timer. */
-   for (i=0; i < cur_system->npresence; i++) {
-      p = &cur_system->presence[i];
-      env = faction_getScheduler( p->faction );
+   if (init) {
+      /* New system, start over. */
+      system_schedulerDrop();
+      space_spawnInit = 0;
+      space_spawnNext = 0;
+   }
+   else {
+      /* Go through all the factions and reduce the timer. */
+      for (i=0; i < cur_system->npresence; i++) {
+         p = &cur_system->presence[i];
+         if (p->disabled || (faction_getScheduler( p->faction )==LUA_NOREF))
+            continue;
+         p->timer -= dt;
+      }
+   }
 
-      /* Must have a valid scheduler. */
-      if (env==LUA_NOREF)
+   space_spawnT0  = SDL_GetPerformanceCounter();
+   space_spawnRan = 0;
+
+   /* Finish the script that was interrupted last frame. */
+   if ((space_spawnCo != LUA_NOREF) && system_schedulerResume( 0 ))
+      return;
+
+   /* Run the 'create' functions that haven't been run yet. */
+   while (space_spawnInit < cur_system->npresence) {
+      p = &cur_system->presence[ space_spawnInit ];
+      env = faction_getScheduler( p->faction );
+      if ((env==LUA_NOREF) || p->disabled) {
+         space_spawnInit++;
          continue;
+      }
+      if (system_schedulerOver())
+         return;
+      space_spawnInit++;
+      if (system_schedulerRun( p, env, 1 ))
+         return;
+   }
+   if (init)
+      return;
+
+   /* Run the factions that are due, starting where we left off last frame. */
+   n = cur_system->npresence;
+   for (j=0; j<n; j++) {
+      i = (space_spawnNext + j) % n;
+      p = &cur_system->presence[i];
 
-      /* Spawning is disabled for this faction. */
-      if (p->disabled)
+      /* Only continue if timer expired, disabled factions don't tick. */
+      if ((p->timer >= 0.) || p->disabled)
+         continue;
+      env = faction_getScheduler( p->faction );
+      if (env==LUA_NOREF)
          continue;
 
-      /* Run the appropriate function. */
-      if (init) {
-         nlua_getenv( env, "create" ); /* f */
-         if (lua_isnil(naevL,-1)) {
-            WARN(_("Lua Spawn script for faction '%s' missing obligatory entry point 'create'."),
-                  faction_name( p->faction ) );
-            lua_pop(naevL,1);
-            continue;
-         }
-         n = 0;
+      /* Over budget, leave the rest for the next frame. */
+      if (system_schedulerOver()) {
+         space_spawnNext = i;
+         return;
       }
-      else {
-         /* Decrement dt, only continue  */
-         p->timer -= dt;
-         if (p->timer >= 0.)
-            continue;
 
-         nlua_getenv( env, "spawn" ); /* f */
-         if (lua_isnil(naevL,-1)) {
-            WARN(_("Lua Spawn script for faction '%s' missing obligatory entry point 'spawn'."),
-                  faction_name( p->faction ) );
-            lua_pop(naevL,1);
-            continue;
-         }
-         lua_pushnumber( naevL, p->curUsed ); /* f, presence */
-         n = 1;
+      if (system_schedulerRun( p, env, 0 )) {
+         space_spawnNext = (i+1) % n;
+         return;
       }
-      lua_pushnumber( naevL, p->value ); /* f, [arg,], max */
+   }
+   space_spawnNext = 0;
+}
 
-      /* Actually run the function. */
-      if (nlua_pcall(env, n+1, 2)) { /* error has occurred */
-         WARN(_("Lua Spawn script for faction '%s' : %s"),
-               faction_name( p->faction ), lua_tostring(naevL,-1));
+
+/**
+ * @brief Checks to see if spawning went over the budget of the frame.
+ *
+ * Something always gets to run each frame, and simulating is part of loading
+ *  so there is no budget then.
+ *
+ *    @return 1 if the rest of the spawning should wait for the next frame.
+ */
+static int system_schedulerOver (void)
+{
+   Uint64 budget;
+
+   if (space_simulating || !space_spawnRan)
+      return 0;
+   budget = (Uint64)(SPAWN_FRAME_BUDGET * SDL_GetPerformanceFrequency());
+   return (SDL_GetPerformanceCounter() - space_spawnT0 > budget);
+}
+
+
+/**
+ * @brief Starts the spawn script of a faction.
+ *
+ *    @param p Presence of the faction.
+ *    @param env Spawn script environment of the faction.
+ *    @param init 1 to run the 'create' function, 0 to run 'spawn'.
+ *    @return 1 if the script was interrupted by the budget.
+ */
+static int system_schedulerRun( SystemPresence *p, nlua_env env, int init )
+{
+   int n;
+   lua_State *co;
+
+   /* Get the appropriate function. */
+   if (init) {
+      nlua_getenv( env, "create" ); /* f */
+      if (lua_isnil(naevL,-1)) {
+         WARN(_("Lua Spawn script for faction '%s' missing obligatory entry point 'create'."),
+               faction_name( p->faction ) );
          lua_pop(naevL,1);
-         continue;
+         return 0;
       }
-
-      /* Output is handled the same way. */
-      if (!lua_isnumber(naevL,-2)) {
-         WARN(_("Lua spawn script for faction '%s' failed to return timer value."),
+   }
+   else {
+      nlua_getenv( env, "spawn" ); /* f */
+      if (lua_isnil(naevL,-1)) {
+         WARN(_("Lua Spawn script for faction '%s' missing obligatory entry point 'spawn'."),
                faction_name( p->faction ) );
-         lua_pop(naevL,2);
-         continue;
+         lua_pop(naevL,1);
+         return 0;
       }
-      p->timer    += lua_tonumber(naevL,-2);
-      /* Handle table if it exists. */
-      if (lua_istable(naevL,-1)) {
-         lua_pushnil(naevL); /* tk, k */
-         while (lua_next(naevL,-2) != 0) { /* tk, k, v */
-            /* Must be table. */
-            if (!lua_istable(naevL,-1)) {
-               WARN(_("Lua spawn script for faction '%s' returns invalid data (not a table)."),
-                     faction_name( p->faction ) );
-               lua_pop(naevL,2); /* tk, k */
-               continue;
-            }
+   }
 
-            lua_getfield( naevL, -1, "pilot" ); /* tk, k, v, p */
-            if (!lua_ispilot(naevL,-1)) {
-               WARN(_("Lua spawn script for faction '%s' returns invalid data (not a pilot)."),
-                     faction_name( p->faction ) );
-               lua_pop(naevL,2); /* tk, k */
-               continue;
-            }
-            pilot = pilot_get( lua_topilot(naevL,-1) );
-            if (pilot == NULL) {
-               lua_pop(naevL,2); /* tk, k */
-               continue;
-            }
-            lua_pop(naevL,1); /* tk, k, v */
-            lua_getfield( naevL, -1, "presence" ); /* tk, k, v, p */
-            if (!lua_isnumber(naevL,-1)) {
-               WARN(_("Lua spawn script for faction '%s' returns invalid data (not a number)."),
-                     faction_name( p->faction ) );
-               lua_pop(naevL,2); /* tk, k */
-               continue;
-            }
-            pilot->presence = lua_tonumber(naevL,-1);
-            p->curUsed     += pilot->presence;
-            lua_pop(naevL,2); /* tk, k */
+   /* Run it in its own thread so it can be interrupted. */
+   co = lua_newthread( naevL ); /* f, co */
+   space_spawnCo        = luaL_ref( naevL, LUA_REGISTRYINDEX ); /* f */
+   space_spawnCoFaction = p->faction;
+   lua_xmove( naevL, co, 1 ); /* */
+   n = 0;
+   if (!init) {
+      lua_pushnumber( co, p->curUsed ); /* f, presence */
+      n = 1;
+   }
+   lua_pushnumber( co, p->value ); /* f, [arg,], max */
+   return system_schedulerResume( n+1 );
+}
+
+
+/**
+ * @brief Runs the current spawn script until it ends or the budget runs out.
+ *
+ *    @param nargs Number of arguments on the thread's stack when starting it.
+ *    @return 1 if the script was interrupted by the budget.
+ */
+static int system_schedulerResume( int nargs )
+{
+   int i, ret;
+   nlua_env env, prev_env;
+   lua_State *co;
+   SystemPresence *p;
+
+   lua_rawgeti( naevL, LUA_REGISTRYINDEX, space_spawnCo ); /* co */
+   co = lua_tothread( naevL, -1 );
+   lua_pop( naevL, 1 ); /* */
+   env = faction_getScheduler( space_spawnCoFaction );
+
+   /* Scripts yield after each pilot they create. */
+   do {
+      prev_env       = __NLUA_CURENV;
+      __NLUA_CURENV  = env;
+      ret            = lua_resume( co, nargs );
+      __NLUA_CURENV  = prev_env;
+      space_spawnRan = 1;
+      nargs          = 0;
+      if (ret != LUA_YIELD)
+         break;
+      lua_settop( co, 0 );
+   } while (!system_schedulerOver());
+   if (ret == LUA_YIELD)
+      return 1;
+
+   /* Presences may have changed while the script was interrupted. */
+   p = NULL;
+   for (i=0; i<cur_system->npresence; i++) {
+      if (cur_system->presence[i].faction == space_spawnCoFaction) {
+         p = &cur_system->presence[i];
+         break;
+      }
+   }
+
+   if (ret != 0)
+      WARN(_("Lua Spawn script for faction '%s' : %s"),
+            faction_name( space_spawnCoFaction ), lua_tostring(co,-1));
+   else if (p != NULL) {
+      lua_settop( co, 2 ); /* timer, pilots */
+      system_schedulerResults( p, co );
+   }
+   system_schedulerDrop();
+   return 0;
+}
+
+
+/**
+ * @brief Drops the spawn script thread.
+ */
+static void system_schedulerDrop (void)
+{
+   if (space_spawnCo != LUA_NOREF)
+      luaL_unref( naevL, LUA_REGISTRYINDEX, space_spawnCo );
+   space_spawnCo        = LUA_NOREF;
+   space_spawnCoFaction = -1;
+}
+
+
+/**
+ * @brief Registers the timer and the pilots returned by a spawn script.
+ *
+ *    @param p Presence of the faction.
+ *    @param L Thread the script ran in, with the timer and pilots on top.
+ */
+static void system_schedulerResults( SystemPresence *p, lua_State *L )
+{
+   Pilot *pilot;
+
+   /* Output is handled the same way. */
+   if (!lua_isnumber(L,-2)) {
+      WARN(_("Lua spawn script for faction '%s' failed to return timer value."),
+            faction_name( p->faction ) );
+      lua_pop(L,2);
+      return;
+   }
+   p->timer    += lua_tonumber(L,-2);
+   /* Handle table if it exists. */
+   if (lua_istable(L,-1)) {
+      lua_pushnil(L); /* tk, k */
+      while (lua_next(L,-2) != 0) { /* tk, k, v */
+         /* Must be table. */
+         if (!lua_istable(L,-1)) {
+            WARN(_("Lua spawn script for faction '%s' returns invalid data (not a table)."),
+                  faction_name( p->faction ) );
+            lua_pop(L,2); /* tk, k */
+            continue;
+         }
+
+         lua_getfield( L, -1, "pilot" ); /* tk, k, v, p */
+         if (!lua_ispilot(L,-1)) {
+            WARN(_("Lua spawn script for faction '%s' returns invalid data (not a pilot)."),
+                  faction_name( p->faction ) );
+            lua_pop(L,2); /* tk, k */
+            continue;
+         }
+         pilot = pilot_get( lua_topilot(L,-1) );
+         if (pilot == NULL) {
+            lua_pop(L,2); /* tk, k */
+            continue;
          }
+         lua_pop(L,1); /* tk, k, v */
+         lua_getfield( L, -1, "presence" ); /* tk, k, v, p */
+         if (!lua_isnumber(L,-1)) {
+            WARN(_("Lua spawn script for faction '%s' returns invalid data (not a number)."),
+                  faction_name( p->faction ) );
+            lua_pop(L,2); /* tk, k */
+            continue;
+         }
+         pilot->presence = lua_tonumber(L,-1);
+         p->curUsed     += pilot->presence;
+         lua_pop(L,2); /* tk, k */
       }
-      lua_pop(naevL,2);
    }
+   lua_pop(L,2);
 }
 
 
@@ -1468,6 +1659,7 @@ void space_init( const char* sysname )
       if (i>=systems_nstack)
          ERR(_("System %s not found in stack"), sysname);
       cur_system = &systems_stack[i];
+      space_vboDirty = 1;
 
       nt = ntime_pretty(0, 2);
       player_message(_("\apEntering System %s on %s."), sysname, nt);
@@ -1900,6 +2092,101 @@ void space_gfxLoad( StarSystem *sys )
       if (planet->gfx_space == NULL)
          planet->gfx_space = gl_newImage( planet->gfx_spaceName, OPENGL_TEX_MIPMAPS );
    }
+
+   /* Rebuild the static geometry with the new graphics. */
+   if (sys == cur_system)
+      space_gfxGeometry();
+}
+
+
+/**
+ * @brief Writes the two triangles of a sprite quad in game coordinates.
+ *
+ *    @param buf Buffer to write 6 vertices of x, y, s, t to.
+ *    @param gfx Sprite to use, may be NULL for an empty quad.
+ *    @param x X position of the center of the sprite.
+ *    @param y Y position of the center of the sprite.
+ *    @param sx X position of the sprite to use.
+ *    @param sy Y position of the sprite to use.
+ *    @return Buffer position after the quad.
+ */
+static GLfloat* space_gfxQuad( GLfloat *buf, const glTexture *gfx,
+      double x, double y, int sx, int sy )
+{
+   const GLfloat corners[6][2] = {
+      { 0., 0. }, { 1., 0. }, { 0., 1. },
+      { 1., 0. }, { 1., 1. }, { 0., 1. } };
+   double tx, ty;
+   int i;
+
+   if (gfx == NULL) {
+      memset( buf, 0, 6*4*sizeof(GLfloat) );
+      return &buf[6*4];
+   }
+
+   /* Same as gl_blitSprite. */
+   x -= gfx->sw/2.;
+   y -= gfx->sh/2.;
+   tx = gfx->sw*(double)(sx)/gfx->rw;
+   ty = gfx->sh*(gfx->sy-(double)sy-1)/gfx->rh;
+   for (i=0; i<6; i++) {
+      buf[4*i+0] = x + corners[i][0]*gfx->sw;
+      buf[4*i+1] = y + corners[i][1]*gfx->sh;
+      buf[4*i+2] = tx + corners[i][0]*gfx->srw;
+      buf[4*i+3] = ty + corners[i][1]*gfx->srh;
+   }
+   return &buf[6*4];
+}
+
+
+/**
+ * @brief Builds the static geometry of the current system.
+ *
+ * Quads are stored in game coordinates as jump points, then pairs of buoys,
+ * then planets, the camera is applied when rendering.
+ */
+static void space_gfxGeometry (void)
+{
+   int i, n;
+   GLfloat *buf, *pos;
+   JumpPoint *jp;
+   Planet *pnt;
+
+   if (space_vbo != NULL) {
+      gl_vboDestroy( space_vbo );
+      space_vbo = NULL;
+   }
+   space_vboDirty    = 0;
+   space_vboJumps    = 0;
+   space_vboPlanets  = 0;
+   if (cur_system == NULL)
+      return;
+
+   space_vboJumps    = cur_system->njumps;
+   space_vboPlanets  = cur_system->nplanets;
+   n = 3*space_vboJumps + space_vboPlanets;
+   if (n == 0)
+      return;
+
+   buf = malloc( n * 6*4*sizeof(GLfloat) );
+   pos = buf;
+   for (i=0; i<space_vboJumps; i++) {
+      jp  = &cur_system->jumps[i];
+      pos = space_gfxQuad( pos, jumppoint_gfx, jp->pos.x, jp->pos.y, jp->sx, jp->sy );
+   }
+   for (i=0; i<space_vboJumps; i++) {
+      jp  = &cur_system->jumps[i];
+      pos = space_gfxQuad( pos, jumpbuoy_gfx, jp->pos.x + 200 * jp->sina, jp->pos.y + 200 * jp->cosa, 0, 0 ); /* Left */
+      pos = space_gfxQuad( pos, jumpbuoy_gfx, jp->pos.x + -200 * jp->sina, jp->pos.y + -200 * jp->cosa, 0, 0 ); /* Right */
+   }
+   for (i=0; i<space_vboPlanets; i++) {
+      pnt = cur_system->planets[i];
+      pos = space_gfxQuad( pos, (pnt->real == ASSET_REAL) ? pnt->gfx_space : NULL,
+            pnt->pos.x, pnt->pos.y, 0, 0 );
+   }
+
+   space_vbo = gl_vboCreateStatic( n * 6*4*sizeof(GLfloat), buf );
+   free(buf);
 }
 
 
@@ -2233,6 +2520,7 @@ int system_addPlanet( StarSystem *sys, const char *planetname )
    }
 
    /* Reload graphics if necessary. */
+   space_vboDirty = 1;
    if (cur_system != NULL)
       space_gfxLoad( cur_system );
 
@@ -2294,6 +2582,7 @@ int system_rmPlanet( StarSystem *sys, const char *planetname )
             planetname, sys->name );
 
    system_setFaction(sys);
+   space_vboDirty = 1;
 
    economy_addQueuedUpdate();
 
@@ -2314,6 +2603,7 @@ int system_addJumpDiff( StarSystem *sys, xmlNodePtr node )
    if (system_parseJumpPointDiff(node, sys) <= -1)
       return 0;
    systems_reconstructJumps();
+   space_vboDirty = 1;
    economy_addQueuedUpdate();
 
    return 1;
@@ -2334,6 +2624,7 @@ int system_addJump( StarSystem *sys, xmlNodePtr node )
    if (system_parseJumpPoint(node, sys) <= -1)
       return 0;
    systems_reconstructJumps();
+   space_vboDirty = 1;
    economy_refresh();
 
    return 1;
@@ -2373,6 +2664,7 @@ int system_rmJump( StarSystem *sys, const char *jumpname )
 
    /* Remove jump from system. */
    sys->njumps--;
+   space_vboDirty = 1;
 
    /* Refresh presence */
    system_setFaction(sys);
@@ -2475,8 +2767,10 @@ StarSystem *system_new (void)
    sys = &systems_stack[ systems_nstack-1 ];
 
    /* Reset cur_system. */
-   if (cur_system != NULL)
+   if (cur_system != NULL) {
       cur_system = system_getIndex( id );
+      space_vboDirty = 1;
+   }
 
    /* Initialize system and id. */
    system_init( sys );
@@ -3543,14 +3837,15 @@ void planets_render (void)
    if (cur_system==NULL)
       return;
 
-   /* Render the jumps. */
-   for (i=0; i < cur_system->njumps; i++)
-      space_renderJumpPoint( &cur_system->jumps[i], i );
+   /* Jumps and planets may have been added or removed. */
+   if (space_vboDirty)
+      space_gfxGeometry();
 
-   /* Render the planets. */
-   for (i=0; i < cur_system->nplanets; i++)
-      if (cur_system->planets[i]->real == ASSET_REAL)
-         space_renderPlanet( cur_system->planets[i] );
+   /* Render the jumps and planets from the static geometry. */
+   if (space_vbo != NULL) {
+      space_renderJumpPoints();
+      space_renderPlanets();
+   }
 
    /* Get the player in order to compute the offset for debris. */
    pplayer = pilot_get( PLAYER_ID );
@@ -3580,39 +3875,154 @@ void planets_render (void)
 
 
 /**
- * @brief Renders a jump point.
+ * @brief Sets up the state for rendering the static geometry.
+ *
+ * The camera is applied through the projection matrix so the geometry never
+ * has to be touched on the CPU.
  */
-static void space_renderJumpPoint( JumpPoint *jp, int i )
+static void space_renderGeometryStart (void)
 {
-   const glColour *c;
+   gl_Matrix4 projection;
+   double cx, cy, gx, gy, z;
+
+   /* Same transformation as gl_gameToScreenCoords. */
+   cam_getPos( &cx, &cy );
+   z = cam_getZoom();
+   gui_getOffset( &gx, &gy );
+   projection = gl_Matrix4_Translate( gl_view_matrix, gx + SCREEN_W/2., gy + SCREEN_H/2., 0 );
+   projection = gl_Matrix4_Scale( projection, z, z, 1 );
+   projection = gl_Matrix4_Translate( projection, -cx, -cy, 0 );
+
+   glUseProgram( shaders.texture_batch.program );
+   glEnableVertexAttribArray( shaders.texture_batch.vertex );
+   glEnableVertexAttribArray( shaders.texture_batch.vertex_tex );
+   gl_vboActivateAttribOffset( space_vbo, shaders.texture_batch.vertex,
+         0, 2, GL_FLOAT, 4*sizeof(GLfloat) );
+   gl_vboActivateAttribOffset( space_vbo, shaders.texture_batch.vertex_tex,
+         2*sizeof(GLfloat), 2, GL_FLOAT, 4*sizeof(GLfloat) );
+   gl_Matrix4_Uniform( shaders.texture_batch.projection, projection );
+}
 
-   if (!jp_isUsable(jp))
+
+/**
+ * @brief Cleans up the state after rendering the static geometry.
+ */
+static void space_renderGeometryEnd (void)
+{
+   glDisableVertexAttribArray( shaders.texture_batch.vertex );
+   glDisableVertexAttribArray( shaders.texture_batch.vertex_tex );
+   glUseProgram(0);
+
+   /* anything failed? */
+   gl_checkErr();
+}
+
+
+/**
+ * @brief Renders a run of quads of the static geometry.
+ *
+ *    @param c Colour to modulate with.
+ *    @param first First quad to render.
+ *    @param count Number of quads to render.
+ */
+static void space_renderQuads( const glColour *c, int first, int count )
+{
+   if (count <= 0)
       return;
+   gl_uniformColor( shaders.texture_batch.color, c );
+   glDrawArrays( GL_TRIANGLES, 6*first, 6*count );
+}
+
+
+/**
+ * @brief Gets the colour to render a jump point with.
+ *
+ *    @param jp Jump point to get colour of.
+ *    @param i Index of the jump point.
+ *    @return Colour of the jump point or NULL if it shouldn't be rendered.
+ */
+static const glColour* space_jumpColour( JumpPoint *jp, int i )
+{
+   if (!jp_isUsable(jp))
+      return NULL;
 
    if ((player.p != NULL) && (i==player.p->nav_hyperspace) &&
          (pilot_isFlag(player.p, PILOT_HYPERSPACE) || space_canHyperspace(player.p)))
-      c = &cGreen;
+      return &cGreen;
    else if (jp_isFlag(jp, JP_HIDDEN))
-      c = &cRed;
-   else
-      c = NULL;
+      return &cRed;
+   return &cWhite;
+}
+
 
-   gl_blitSprite( jumppoint_gfx, jp->pos.x, jp->pos.y, jp->sx, jp->sy, c );
+/**
+ * @brief Renders the jump points.
+ *
+ * Consecutive jump points with the same colour are drawn at once.
+ */
+static void space_renderJumpPoints (void)
+{
+   int i, n, first;
+   JumpPoint *jp;
+   const glColour *c, *lc;
+
+   space_renderGeometryStart();
+
+   /* Jump points. */
+   n     = space_vboJumps;
+   lc    = NULL;
+   first = 0;
+   glBindTexture( GL_TEXTURE_2D, jumppoint_gfx->texture );
+   for (i=0; i<=n; i++) {
+      c = (i < n) ? space_jumpColour( &cur_system->jumps[i], i ) : NULL;
+      if (c == lc)
+         continue;
+      if (lc != NULL)
+         space_renderQuads( lc, first, i-first );
+      lc    = c;
+      first = i;
+   }
 
    /* Draw buoys next to "highway" jump points. */
-   if (jp->hide == 0.) {
-      gl_blitSprite( jumpbuoy_gfx, jp->pos.x + 200 * jp->sina, jp->pos.y + 200 * jp->cosa, 0, 0, NULL ); /* Left */
-      gl_blitSprite( jumpbuoy_gfx, jp->pos.x + -200 * jp->sina, jp->pos.y + -200 * jp->cosa, 0, 0, NULL ); /* Right */
+   lc    = NULL;
+   first = 0;
+   glBindTexture( GL_TEXTURE_2D, jumpbuoy_gfx->texture );
+   for (i=0; i<=n; i++) {
+      c = NULL;
+      if (i < n) {
+         jp = &cur_system->jumps[i];
+         if (jp_isUsable(jp) && (jp->hide == 0.))
+            c = &cWhite;
+      }
+      if (c == lc)
+         continue;
+      if (lc != NULL)
+         space_renderQuads( lc, n + 2*first, 2*(i-first) );
+      lc    = c;
+      first = i;
    }
+
+   space_renderGeometryEnd();
 }
 
 
 /**
- * @brief Renders a planet.
+ * @brief Renders the planets.
  */
-static void space_renderPlanet( Planet *p )
+static void space_renderPlanets (void)
 {
-   gl_blitSprite( p->gfx_space, p->pos.x, p->pos.y, 0, 0, NULL );
+   int i;
+   Planet *p;
+
+   space_renderGeometryStart();
+   for (i=0; i<space_vboPlanets; i++) {
+      p = cur_system->planets[i];
+      if ((p->real != ASSET_REAL) || (p->gfx_space == NULL))
+         continue;
+      glBindTexture( GL_TEXTURE_2D, p->gfx_space->texture );
+      space_renderQuads( &cWhite, 3*space_vboJumps + i, 1 );
+   }
+   space_renderGeometryEnd();
 }
 
 
@@ -3688,6 +4098,16 @@ void space_exit (void)
    StarSystem *sys;
    AsteroidType *at;
 
+   /* Drop any interrupted spawn script. */
+   system_schedulerDrop();
+
+   /* Free static geometry. */
+   if (space_vbo != NULL) {
+      gl_vboDestroy( space_vbo );
+      space_vbo = NULL;
+   }
+   space_vboDirty = 1;
+
    /* Free jump point graphic. */
    if (jumppoint_gfx != NULL)
       gl_freeTexture(jumppoint_gfx);
@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include "nstring.h"
 
+#include "array.h"
 #include "log.h"
 #include "rng.h"
 #include "pilot.h"
@@ -31,6 +32,7 @@
 #include "gui.h"
 #include "camera.h"
 #include "ai.h"
+#include "pilot_grid.h"
 
 
 #define weapon_isSmart(w)     (w->think != NULL) /**< Checks if the weapon w is smart. */
@@ -96,14 +98,9 @@ static Weapon** wfrontLayer = NULL; /**< in front of pilots, behind player */
 static int nwfrontLayer = 0; /**< number of elements */
 static int mwfrontLayer = 0; /**< alloced memory size */
 
-/* Graphics. */
-static gl_vbo  *weapon_vbo     = NULL; /**< Weapon VBO. */
-static GLfloat *weapon_vboData = NULL; /**< Data of weapon VBO. */
-static int weapon_vboSize      = 0; /**< Size of the VBO. */
-
-
 /* Internal stuff. */
 static unsigned int beam_idgen = 0; /**< Beam identifier generator. */
+static Pilot **weapon_near = NULL; /**< Pilots found by the last distress query (array.h). */
 
 
 /*
@@ -132,6 +129,7 @@ static void weapon_explodeLayer( WeaponLayer layer,
       const Pilot *parent, int mode );
 /* Hitting. */
 static int weapon_checkCanHit( Weapon* w, Pilot *p );
+static int weapon_filterDistress( const Pilot *p, const Pilot *target, void *data );
 static void weapon_hit( Weapon* w, Pilot* p, WeaponLayer layer, Vector2d* pos );
 static void weapon_hitAst( Weapon* w, Asteroid* a, WeaponLayer layer, Vector2d* pos );
 static void weapon_hitBeam( Weapon* w, Pilot* p, WeaponLayer layer,
@@ -150,7 +148,9 @@ static void weapon_setTurn( Weapon *w, double turn );
 
 
 /**
- * @brief Draws the minimap weapons (used in player.c).
+ * @brief Adds the minimap weapons to the radar (used in gui.c).
+ *
+ * They get drawn along with the rest of the radar in gui_radarFlush().
  *
  *    @param res Minimap resolution.
  *    @param w Width of minimap.
@@ -161,17 +161,13 @@ static void weapon_setTurn( Weapon *w, double turn );
 void weapon_minimap( const double res, const double w,
       const double h, const RadarShape shape, double alpha )
 {
-   int i, rc, p;
+   int i, rc;
    double x, y;
    Weapon *wp;
    const glColour *c;
-   GLsizei offset;
+   glColour col;
    Pilot *par;
 
-   /* Get offset. */
-   p = 0;
-   offset = weapon_vboSize;
-
    if (shape==RADAR_CIRCLE)
       rc = (int)(w*w);
    else
@@ -211,18 +207,10 @@ void weapon_minimap( const double res, const double w,
          }
       }
 
-      /* Set the colour. */
-      weapon_vboData[ offset + 4*p + 0 ] = c->r;
-      weapon_vboData[ offset + 4*p + 1 ] = c->g;
-      weapon_vboData[ offset + 4*p + 2 ] = c->b;
-      weapon_vboData[ offset + 4*p + 3 ] = alpha;
-
-      /* Put the pixel. */
-      weapon_vboData[ 2*p + 0 ] = x;
-      weapon_vboData[ 2*p + 1 ] = y;
-
-      /* "Add" pixel. */
-      p++;
+      /* Add the pixel to the radar. */
+      col   = *c;
+      col.a = alpha;
+      gui_radarRect( x-.5, y-.5, 1., 1., &col );
    }
    for (i=0; i<nwfrontLayer; i++) {
       wp = wfrontLayer[i];
@@ -250,32 +238,10 @@ void weapon_minimap( const double res, const double w,
       else
          c = &cNeutral;
 
-      /* Set the colour. */
-      weapon_vboData[ offset + 4*p + 0 ] = c->r;
-      weapon_vboData[ offset + 4*p + 1 ] = c->g;
-      weapon_vboData[ offset + 4*p + 2 ] = c->b;
-      weapon_vboData[ offset + 4*p + 3 ] = alpha;
-
-      /* Put the pixel. */
-      weapon_vboData[ 2*p + 0 ] = x;
-      weapon_vboData[ 2*p + 1 ] = y;
-
-      /* "Add" pixel. */
-      p++;
-   }
-
-   /* Only render with something to draw. */
-   if (p > 0) {
-      /* Upload data changes. */
-      gl_vboSubData( weapon_vbo, 0, sizeof(GLfloat) * 2*p, weapon_vboData );
-      gl_vboSubData( weapon_vbo, offset * sizeof(GLfloat),
-            sizeof(GLfloat) * 4*p, &weapon_vboData[offset] );
-
-      gl_beginSmoothProgram(gl_view_matrix);
-      gl_vboActivateAttribOffset( weapon_vbo, shaders.smooth.vertex, 0, 2, GL_FLOAT, 0 );
-      gl_vboActivateAttribOffset( weapon_vbo, shaders.smooth.vertex_color, offset * sizeof(GLfloat), 4, GL_FLOAT, 0 );
-      glDrawArrays( GL_POINTS, 0, p );
-      gl_endSmoothProgram();
+      /* Add the pixel to the radar. */
+      col   = *c;
+      col.a = alpha;
+      gui_radarRect( x-.5, y-.5, 1., 1., &col );
    }
 }
 
@@ -1016,6 +982,19 @@ static void weapon_update( Weapon* w, const double dt, WeaponLayer layer )
 }
 
 
+/**
+ * @brief Filter for pilots that can react to a distress signal.
+ */
+static int weapon_filterDistress( const Pilot *p, const Pilot *target, void *data )
+{
+   (void) p;
+   (void) data;
+   return (target->ai != NULL) &&
+         !pilot_isFlag(target, PILOT_DEAD) &&
+         !pilot_isFlag(target, PILOT_DELETE);
+}
+
+
 /**
  * @brief Informs the AI if needed that it's been hit.
  *
@@ -1025,8 +1004,7 @@ static void weapon_update( Weapon* w, const double dt, WeaponLayer layer )
  */
 static void weapon_hitAI( Pilot *p, Pilot *shooter, double dmg )
 {
-   int i;
-   double d;
+   int i, n;
 
    /* Must be a valid shooter. */
    if (shooter == NULL)
@@ -1048,25 +1026,17 @@ static void weapon_hitAI( Pilot *p, Pilot *shooter, double dmg )
          /* Inform attacked. */
          ai_attacked( p, shooter->id, dmg );
 
-         /* Trigger a pseudo-distress that incurs no faction loss. */
-         for (i=0; i<pilot_nstack; i++) {
-            /* Skip if unsuitable. */
-            if ((pilot_stack[i]->ai == NULL) || (pilot_stack[i]->id == p->id) ||
-                  (pilot_isFlag(pilot_stack[i], PILOT_DEAD)) ||
-                  (pilot_isFlag(pilot_stack[i], PILOT_DELETE)))
-               continue;
-
-            /*
-             * Pilots within a radius of 1500 (in a zero-interference system)
-             * will immediately notice hostile actions.
-             */
-            d = vect_dist2( &p->solid->pos, &pilot_stack[i]->solid->pos );
-            if (d > (pilot_sensorRange() * 0.04 )) /* 0.2^2 */
-               continue;
-
+         /*
+          * Trigger a pseudo-distress that incurs no faction loss.
+          *
+          * Pilots within a radius of 1500 (in a zero-interference system)
+          * will immediately notice hostile actions.
+          */
+         n = pilot_gridQuery( &weapon_near, p, p->solid->pos.x, p->solid->pos.y,
+               sqrt( pilot_sensorRange() * 0.04 ), 0, weapon_filterDistress, NULL ); /* 0.2^2 */
+         for (i=0; i<n; i++)
             /* Send AI the distress signal. */
-            ai_getDistress( pilot_stack[i], p, shooter );
-         }
+            ai_getDistress( weapon_near[i], p, shooter );
 
          /* Set as hostile. */
          pilot_setHostile(p);
@@ -1610,7 +1580,6 @@ void weapon_add( const Outfit* outfit, const double T, const double dir,
    Weapon *w;
    Weapon **curLayer;
    int *mLayer, *nLayer;
-   GLsizei size;
 
    if (!outfit_isBolt(outfit) &&
          !outfit_isLauncher(outfit)) {
@@ -1655,14 +1624,6 @@ void weapon_add( const Outfit* outfit, const double T, const double dir,
             break;
       }
       curLayer[(*nLayer)++] = w;
-
-      /* Grow the vertex stuff. */
-      weapon_vboSize = mwfrontLayer + mwbacklayer;
-      size = sizeof(GLfloat) * (2+4) * weapon_vboSize;
-      weapon_vboData = realloc( weapon_vboData, size );
-      if (weapon_vbo == NULL)
-         weapon_vbo = gl_vboCreateStream( size, NULL );
-      gl_vboData( weapon_vbo, size, weapon_vboData );
    }
 }
 
@@ -1690,7 +1651,6 @@ unsigned int beam_start( const Outfit* outfit,
    Weapon *w;
    Weapon **curLayer;
    int *mLayer, *nLayer;
-   GLsizei size;
 
    if (!outfit_isBeam(outfit)) {
       ERR(_("Trying to create a Beam Weapon from a non-beam outfit."));
@@ -1738,14 +1698,6 @@ unsigned int beam_start( const Outfit* outfit,
             break;
       }
       curLayer[(*nLayer)++] = w;
-
-      /* Grow the vertex stuff. */
-      weapon_vboSize = mwfrontLayer + mwbacklayer;
-      size = sizeof(GLfloat) * (2+4) * weapon_vboSize;
-      weapon_vboData = realloc( weapon_vboData, size );
-      if (weapon_vbo == NULL)
-         weapon_vbo = gl_vboCreateStream( size, NULL );
-      gl_vboData( weapon_vbo, size, weapon_vboData );
    }
 
    return w->ID;
@@ -1912,13 +1864,10 @@ void weapon_exit (void)
       mwfrontLayer = 0;
    }
 
-   /* Destroy VBO. */
-   if (weapon_vbo != NULL) {
-      free( weapon_vboData );
-      weapon_vboData = NULL;
-      gl_vboDestroy( weapon_vbo );
-      weapon_vbo = NULL;
-   }
+   /* Destroy query results. */
+   if (weapon_near != NULL)
+      array_free( weapon_near );
+   weapon_near = NULL;
 }
 
 